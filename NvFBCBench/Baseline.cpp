@@ -0,0 +1,76 @@
+#include "Baseline.h"
+
+#include <fstream>
+#include <iomanip>
+#include <regex>
+#include <sstream>
+
+using namespace std;
+
+// The baseline is flat enough that each entry is one object without nested braces
+static const regex ENTRY_PATTERN(R"(\{[^{}]*\})");
+static const regex NAME_PATTERN(R"re("name"\s*:\s*"([^"]*)")re");
+static const regex NS_PATTERN(R"re("ns_per_op"\s*:\s*([-+0-9.eE]+))re");
+static const regex BYTES_PATTERN(R"re("bytes_per_op"\s*:\s*([-+0-9.eE]+))re");
+static const regex THRESHOLD_PATTERN(R"re("threshold"\s*:\s*([-+0-9.eE]+))re");
+
+static double FindNumber(const string& entry, const regex& pattern)
+{
+    smatch match;
+    return regex_search(entry, match, pattern) ? stod(match[1].str()) : 0;
+}
+
+bool LoadBaseline(const string& file_name, vector<BenchmarkResult>* results)
+{
+    ifstream file(file_name);
+    if (!file)
+        return false;
+
+    stringstream contents;
+    contents << file.rdbuf();
+    const string json = contents.str();
+
+    results->clear();
+    for (sregex_iterator it(json.begin(), json.end(), ENTRY_PATTERN), end; it != end; ++it) {
+        const string entry = it->str();
+        smatch name;
+        if (!regex_search(entry, name, NAME_PATTERN))
+            continue;
+
+        BenchmarkResult result;
+        result.name = name[1].str();
+        result.ns_per_op = FindNumber(entry, NS_PATTERN);
+        result.bytes_per_op = FindNumber(entry, BYTES_PATTERN);
+        result.threshold = FindNumber(entry, THRESHOLD_PATTERN);
+        results->push_back(result);
+    }
+    return true;
+}
+
+bool SaveBaseline(const string& file_name, const vector<BenchmarkResult>& results)
+{
+    ofstream file(file_name);
+    if (!file)
+        return false;
+
+    file << "{\n  \"benchmarks\": [\n" << setprecision(6);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        file << "    {\"name\": \"" << result.name << "\", \"ns_per_op\": " << result.ns_per_op
+             << ", \"bytes_per_op\": " << result.bytes_per_op;
+        if (result.threshold > 0)
+            file << ", \"threshold\": " << result.threshold;
+        file << '}' << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    file << "  ]\n}\n";
+    return file.good();
+}
+
+const BenchmarkResult* FindResult(const vector<BenchmarkResult>& results, const string& name)
+{
+    for (const BenchmarkResult& result : results) {
+        if (result.name == name)
+            return &result;
+    }
+    return nullptr;
+}
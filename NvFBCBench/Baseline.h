@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// The result of one benchmark, as kept in a baseline file
+struct BenchmarkResult {
+    std::string name;
+    double ns_per_op;
+    double bytes_per_op;    // 0 for benchmarks without a throughput
+    double threshold;       // Allowed slowdown in percent, 0 to use the command line default
+};
+
+// Reads a baseline written by SaveBaseline. Entries may be edited by hand, e.g. to give a noisy
+// benchmark a threshold of its own. Returns false if the file cannot be read.
+bool LoadBaseline(const std::string& file_name, std::vector<BenchmarkResult>* results);
+
+// Writes the results as JSON
+bool SaveBaseline(const std::string& file_name, const std::vector<BenchmarkResult>& results);
+
+// Returns the entry with the given name or null
+const BenchmarkResult* FindResult(const std::vector<BenchmarkResult>& results, const std::string& name);
@@ -0,0 +1,903 @@
+#include "Baseline.h"
+#include "../NvFBCCapture/AsyncCapture.h"
+#include "../NvFBCCapture/CaptureSession.h"
+#include "../NvFBCH264/FrameWriter.h"
+#include "../NvFBCH264/SyntheticEncoder.h"
+
+#include <Bitmap.h>
+#include <DirtyRegions.h>
+#include <H264Bitstream.h>
+#include <Jpeg.h>
+#include <NumaMemory.h>
+#include <Qoi.h>
+#include <Timer.h>
+#include <Y4MWriter.h>
+
+#include <boost/program_options.hpp>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+using namespace std;
+
+const int CLOCK_READS = 100'000;
+const int PIPELINE_FRAMES = 30;
+const int STREAM_FRAMES = 100;
+const int FRAME_RATE = 30;
+// Frame buffers of the recorder, its default --queue
+const int RECORDER_BUFFERS = 8;
+// Sessions run at once by the sessions/* benchmarks, and the threads the coroutines share
+const int SESSIONS = 64;
+const int OFFLOAD_THREADS = 4;
+// Threads of the image encoders which split the work
+const int ENCODE_THREADS = 4;
+
+struct cmdargs {
+    string         baseline;
+    string         save;
+    double         threshold;
+    double         min_time;
+    string         filter;
+    vector<string> resolutions;
+    string         scratch;
+    int            grab_cpu;
+    int            writer_cpu;
+};
+
+struct Resolution {
+    const char* name;
+    DWORD width;
+    DWORD height;
+    DWORD bitrate;  // Lossy bitrate, about what the recorder is run with at this size
+};
+
+static const Resolution RESOLUTIONS[] = {
+    { "1080p", 1920, 1080, 8'000'000 },
+    { "4k",    3840, 2160, 32'000'000 },
+    { "8k",    7680, 4320, 128'000'000 },
+};
+
+// CPU time of all threads, for benchmarks which spend most of their time waiting
+static LONGLONG ProcessCpuNanoseconds()
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    auto ns = [](const FILETIME& t) { return ((LONGLONG)t.dwHighDateTime << 32 | t.dwLowDateTime) * 100; };
+    return ns(kernel) + ns(user);
+}
+
+// Keeps the results of the measured code from being optimized away
+static volatile LONGLONG g_sink;
+
+// An ostream that throws away what is written, so the pipeline is timed without the disk
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize count) override { return count; }
+};
+
+// Times benchmarks and compares them with the baseline
+class Suite {
+public:
+    Suite(const cmdargs& args, const vector<BenchmarkResult>& baseline)
+        : m_args(args)
+        , m_baseline(baseline)
+        , m_regressions(0)
+    {
+        cout << left << setw(44) << "Benchmark" << right << setw(14) << "ns/op" << setw(10) << "MB/s"
+             << setw(14) << "baseline" << setw(10) << "change" << '\n';
+    }
+
+    // Calls op, which does ops_per_call operations and returns the bytes it processed, until
+    // min_time has passed and at least three calls were made. The median call is reported,
+    // timed with clock, which counts nanoseconds. Returns false if the benchmark is filtered out.
+    bool run(const string& name, double ops_per_call, const function<size_t()>& op,
+             LONGLONG (*clock)() = Timer::nanoseconds)
+    {
+        if (!wanted(name))
+            return false;
+
+        op();
+
+        vector<LONGLONG> calls;
+        LONGLONG total = 0;
+        double bytes = 0;
+        while (total < m_args.min_time * 1e9 || calls.size() < 3) {
+            const LONGLONG start = clock();
+            bytes += op();
+            const LONGLONG duration = clock() - start;
+            calls.push_back(duration);
+            total += duration;
+        }
+
+        nth_element(calls.begin(), calls.begin() + calls.size() / 2, calls.end());
+        BenchmarkResult result;
+        result.name = name;
+        result.ns_per_op = calls[calls.size() / 2] / ops_per_call;
+        result.bytes_per_op = bytes / (calls.size() * ops_per_call);
+        result.threshold = 0;
+
+        cout << left << setw(44) << name << right << fixed << setprecision(1) << setw(14) << result.ns_per_op;
+        if (result.bytes_per_op > 0)
+            cout << setw(10) << result.bytes_per_op / result.ns_per_op * 1e3;
+        else
+            cout << setw(10) << "-";
+
+        const BenchmarkResult* base = FindResult(m_baseline, name);
+        if (base && base->ns_per_op > 0) {
+            // Keep thresholds edited into the baseline when it is saved again
+            result.threshold = base->threshold;
+            const double threshold = base->threshold > 0 ? base->threshold : m_args.threshold;
+            const double change = (result.ns_per_op / base->ns_per_op - 1) * 100;
+            cout << setw(14) << base->ns_per_op << setw(9) << showpos << change << noshowpos << '%';
+            if (change > threshold) {
+                cout << "  REGRESSION (over " << threshold << "%)";
+                ++m_regressions;
+            }
+        }
+        cout << endl;
+
+        m_results.push_back(result);
+        return true;
+    }
+
+    // Whether --filter leaves the benchmark in, for setup too costly to make for nothing
+    bool wanted(const string& name) const
+    {
+        return m_args.filter.empty() || name.find(m_args.filter) != string::npos;
+    }
+
+    const vector<BenchmarkResult>& results() const { return m_results; }
+    int regressions() const { return m_regressions; }
+
+private:
+    const cmdargs& m_args;
+    const vector<BenchmarkResult>& m_baseline;
+    vector<BenchmarkResult> m_results;
+    int m_regressions;
+};
+
+static void BenchmarkClocks(Suite& suite)
+{
+    Timer timer;
+
+    auto reads = [](LONGLONG (*read)()) {
+        return [read]() -> size_t {
+            LONGLONG sum = 0;
+            for (int i = 0; i < CLOCK_READS; ++i)
+                sum += read();
+            g_sink = sum;
+            return 0;
+        };
+    };
+    bool ran = suite.run("clock/Timer::nanoseconds", CLOCK_READS, reads([] { return Timer::nanoseconds(); }));
+    ran |= suite.run("clock/Timer::systemNanoseconds", CLOCK_READS, reads([] { return Timer::systemNanoseconds(); }));
+    ran |= suite.run("clock/steady_clock", CLOCK_READS, reads([] {
+        return (LONGLONG)chrono::steady_clock::now().time_since_epoch().count();
+    }));
+
+    // How far the TSC drifted from the OS clock since calibration
+    if (ran) {
+        const LONGLONG drift = Timer::nanoseconds() - Timer::systemNanoseconds();
+        cout << "TSC - OS clock after " << fixed << setprecision(2) << timer.now() / 1000 << " s: " << drift << " ns\n";
+    }
+}
+
+// The encoder settings NvFBCH264 uses, at the bitrate typical for the resolution
+static NvFBC_H264HWEncoder_Config EncoderConfig(const Resolution& resolution, bool lossless)
+{
+    NvFBC_H264HWEncoder_Config config = {0};
+    config.dwVersion = NVFBC_H264HWENC_CONFIG_VER;
+    config.dwFrameRateNum = FRAME_RATE;
+    config.dwFrameRateDen = 1;
+    if (lossless) {
+        config.ePresetConfig = NVFBC_H264_PRESET_LOSSLESS_HP;
+        config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_CONSTQP;
+    } else {
+        config.dwAvgBitRate = resolution.bitrate;
+        config.dwPeakBitRate = resolution.bitrate * 2;
+        config.dwGOPLength = 100;
+        config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_VBR;
+        config.ePresetConfig = NVFBC_H264_PRESET_LOW_LATENCY_HQ;
+    }
+    return config;
+}
+
+// A synthetic encoder set up like the recorder's, grabbing without pacing
+static bool SetUpEncoder(SyntheticEncoder& encoder, NvFBC_H264HWEncoder_Config& config)
+{
+    DWORD max_width, max_height;
+    NVFBC_H264_SETUP_PARAMS setup = {0};
+    setup.pEncodeConfig = &config;
+    return encoder.create(&max_width, &max_height) && encoder.setUp(&setup) == NVFBC_SUCCESS;
+}
+
+static DWORD GrabFrame(SyntheticEncoder& encoder, NvU8* buffer)
+{
+    NvFBCFrameGrabInfo grab_info = {0};
+    NvFBC_H264HWEncoder_FrameInfo frame_info = {0};
+    NVFBC_H264_GRAB_FRAME_PARAMS params = {0};
+    params.pNvFBCFrameGrabInfo = &grab_info;
+    params.pFrameInfo = &frame_info;
+    params.pBitStreamBuffer = buffer;
+    return encoder.grabFrame(&params) == NVFBC_SUCCESS ? frame_info.dwByteSize : 0;
+}
+
+// Synthetic grabs through the frame writer into a null sink: the capture loop without the GPU and disk.
+// With a placement, the frame buffers are allocated as NvFBCH264 --large-pages --lock-buffers does.
+static void BenchmarkPipeline(Suite& suite, const Resolution& resolution, bool lossless,
+                              const MemoryPlacement* placement, int writer_cpu)
+{
+    NvFBC_H264HWEncoder_Config config = EncoderConfig(resolution, lossless);
+    SyntheticEncoder encoder(resolution.width, resolution.height, 0, false);
+    if (!SetUpEncoder(encoder, config))
+        return;
+
+    NullBuffer null_buffer;
+    ostream sink(&null_buffer);
+    FrameWriter writer(sink, nullptr, 4, (size_t)resolution.width * resolution.height, false,
+                       placement ? *placement : DefaultPlacement());
+    if (writer_cpu >= 0)
+        writer.pin(writer_cpu);
+
+    const string name = string("pipeline/") + resolution.name + (lossless ? "/lossless" : "/lossy") +
+                        (placement ? "/placed" : "");
+    suite.run(name, PIPELINE_FRAMES, [&]() -> size_t {
+        size_t bytes = 0;
+        for (int i = 0; i < PIPELINE_FRAMES; ++i) {
+            EncodedFrame* frame = writer.acquire();
+            frame->size = GrabFrame(encoder, frame->data.data());
+            frame->timestamp = i * 1000.0 / FRAME_RATE;
+            frame->index = i;
+            frame->width = resolution.width;
+            frame->height = resolution.height;
+            frame->sei_size = 0;
+            bytes += frame->size;
+            writer.submit(frame);
+        }
+        return bytes;
+    });
+    writer.close();
+}
+
+// The first frame of a clip: cold, the recorder creates and sets up the session, allocates its
+// buffers and starts the writer first; warm, as NvFBCH264 --daemon does, all of that is done
+// and only an IDR frame is forced. Without the GPU, loading NvFBC and creating the session on
+// it are not part of the cold start.
+static void BenchmarkStartup(Suite& suite, const Resolution& resolution)
+{
+    NvFBC_H264HWEncoder_Config config = EncoderConfig(resolution, false);
+    const size_t buffer_size = (size_t)resolution.width * resolution.height;
+    const string prefix = string("startup/") + resolution.name;
+    NullBuffer null_buffer;
+    ostream sink(&null_buffer);
+
+    auto first_frame = [&](SyntheticEncoder& encoder, FrameWriter& writer, bool force_idr) -> size_t {
+        NvFBCFrameGrabInfo grab_info = {0};
+        NvFBC_H264HWEncoder_FrameInfo frame_info = {0};
+        NvFBC_H264HWEncoder_EncodeParams encode_params = {0};
+        encode_params.bForceIDRFrame = TRUE;
+        NVFBC_H264_GRAB_FRAME_PARAMS params = {0};
+        params.pNvFBCFrameGrabInfo = &grab_info;
+        params.pFrameInfo = &frame_info;
+        params.pEncodeParams = force_idr ? &encode_params : nullptr;
+
+        EncodedFrame* frame = writer.acquire();
+        params.pBitStreamBuffer = frame->data.data();
+        frame->size = encoder.grabFrame(&params) == NVFBC_SUCCESS ? frame_info.dwByteSize : 0;
+        frame->timestamp = 0;
+        frame->index = 0;
+        frame->width = resolution.width;
+        frame->height = resolution.height;
+        frame->sei_size = 0;
+        writer.submit(frame);
+        writer.drain();
+        return frame_info.dwByteSize;
+    };
+
+    suite.run(prefix + "/cold", 1, [&]() -> size_t {
+        SyntheticEncoder encoder(resolution.width, resolution.height, 0, false);
+        if (!SetUpEncoder(encoder, config))
+            return 0;
+        FrameWriter writer(sink, nullptr, RECORDER_BUFFERS, buffer_size);
+        return first_frame(encoder, writer, false);
+    });
+
+    SyntheticEncoder encoder(resolution.width, resolution.height, 0, false);
+    if (!SetUpEncoder(encoder, config))
+        return;
+    FrameWriter writer(sink, nullptr, RECORDER_BUFFERS, buffer_size);
+    suite.run(prefix + "/warm", 1, [&]() -> size_t { return first_frame(encoder, writer, true); });
+    writer.close();
+}
+
+// Synthetic grabs through CaptureSession, pulled and released one by one or pushed to a
+// callback which releases them: what the session adds to the grab for in-process consumers
+static void BenchmarkSession(Suite& suite, const Resolution& resolution)
+{
+    CaptureSessionConfig config;
+    config.encodeConfig = EncoderConfig(resolution, false);
+    config.makeEncoder = [&resolution] { return new SyntheticEncoder(resolution.width, resolution.height, 0, false); };
+    const string prefix = string("session/") + resolution.name;
+
+    CaptureSession session;
+    if (session.open(config) != NVFBC_SUCCESS)
+        return;
+    suite.run(prefix + "/pull", PIPELINE_FRAMES, [&]() -> size_t {
+        size_t bytes = 0;
+        for (int i = 0; i < PIPELINE_FRAMES; ++i) {
+            const CaptureFrame* frame;
+            if (session.nextFrame(&frame) != NVFBC_SUCCESS)
+                break;
+            bytes += frame->size;
+            session.release(frame);
+        }
+        return bytes;
+    });
+
+    mutex lock;
+    condition_variable pushed;
+    unsigned frames = 0;
+    size_t bytes = 0;
+    session.start([&](const CaptureFrame* frame, NVFBCRESULT) {
+        if (!frame)
+            return;
+        {
+            lock_guard<mutex> guard(lock);
+            ++frames;
+            bytes += frame->size;
+        }
+        session.release(frame);
+        pushed.notify_one();
+    });
+    suite.run(prefix + "/push", PIPELINE_FRAMES, [&]() -> size_t {
+        unique_lock<mutex> guard(lock);
+        const unsigned target = frames + PIPELINE_FRAMES;
+        const size_t start = bytes;
+        pushed.wait(guard, [&] { return frames >= target; });
+        return bytes - start;
+    });
+    session.stop();
+}
+
+// SESSIONS synthetic 360p sessions at 30 fps whose grabs block for about a millisecond, as
+// NvFBC grabs do while the frame is encoded. With a thread per session, each one pushes its
+// frames from a thread of its own and grabs on another. With coroutines, the grabs are paced
+// by the timers of one event loop and made on OFFLOAD_THREADS threads, and the frames are
+// written through an AsyncSink on those too. Each model is timed by wall clock, which stays
+// at a frame period divided by SESSIONS while it keeps up, and by the CPU time per frame.
+static void BenchmarkSessions(Suite& suite)
+{
+    const Resolution resolution = { "360p", 640, 360, 1'000'000 };
+    CaptureSessionConfig config;
+    config.encodeConfig = EncoderConfig(resolution, false);
+    const int frames_per_call = SESSIONS * FRAME_RATE / 10;
+    const string prefix = "sessions/" + to_string(SESSIONS);
+
+    mutex lock;
+    condition_variable delivered;
+    unsigned frames = 0;
+    size_t bytes = 0;
+    auto count = [&](size_t size) {
+        {
+            lock_guard<mutex> guard(lock);
+            ++frames;
+            bytes += size;
+        }
+        delivered.notify_one();
+    };
+    auto wait_for_frames = [&]() -> size_t {
+        unique_lock<mutex> guard(lock);
+        const unsigned target = frames + frames_per_call;
+        const size_t start = bytes;
+        delivered.wait(guard, [&] { return frames >= target; });
+        return bytes - start;
+    };
+
+    // SESSIONS sessions and their threads are only set up for a model which is run
+    if (suite.wanted(prefix + "/threads") || suite.wanted(prefix + "/threads/cpu")) {
+        config.makeEncoder = [&resolution] {
+            SyntheticEncoder* encoder = new SyntheticEncoder(resolution.width, resolution.height, 0);
+            encoder->setEncodeCost(9);
+            return encoder;
+        };
+        vector<unique_ptr<CaptureSession>> sessions;
+        for (int i = 0; i < SESSIONS; ++i) {
+            sessions.emplace_back(new CaptureSession);
+            CaptureSession& session = *sessions.back();
+            if (session.open(config) != NVFBC_SUCCESS)
+                return;
+            session.start([&session, &count](const CaptureFrame* frame, NVFBCRESULT) {
+                if (!frame)
+                    return;
+                count(frame->size);
+                session.release(frame);
+            });
+        }
+        suite.run(prefix + "/threads", frames_per_call, wait_for_frames);
+        suite.run(prefix + "/threads/cpu", frames_per_call, wait_for_frames, ProcessCpuNanoseconds);
+        for (auto& session : sessions)
+            session->stop();
+    }
+
+#if NVFBC_ASYNC_CAPTURE
+    if (suite.wanted(prefix + "/coroutines") || suite.wanted(prefix + "/coroutines/cpu")) {
+        // The loop paces the grabs, so the encoders do not
+        config.makeEncoder = [&resolution] {
+            SyntheticEncoder* encoder = new SyntheticEncoder(resolution.width, resolution.height, 0, false);
+            encoder->setEncodeCost(9);
+            return encoder;
+        };
+        OffloadPool pool(OFFLOAD_THREADS);
+        EventLoop loop;
+        AsyncSink sink(loop, pool, [&count](const CaptureFrame& frame) {
+            count(frame.size);
+            return true;
+        });
+
+        vector<unique_ptr<AsyncCaptureSession>> sessions;
+        for (int i = 0; i < SESSIONS; ++i) {
+            sessions.emplace_back(new AsyncCaptureSession(loop, pool));
+            if (sessions.back()->open(config) != NVFBC_SUCCESS)
+                return;
+        }
+
+        atomic<bool> stopping(false);
+        atomic<int> running(SESSIONS);
+        auto consume = [&](AsyncCaptureSession& session) -> DetachedTask {
+            while (!stopping.load()) {
+                AsyncFrame frame = co_await session.nextFrame();
+                if (!frame || !co_await sink.write(frame))
+                    break;
+            }
+            if (--running == 0)
+                loop.stop();
+        };
+        loop.post([&] {
+            for (auto& session : sessions)
+                consume(*session);
+        });
+        thread loop_thread([&loop] { loop.run(); });
+
+        suite.run(prefix + "/coroutines", frames_per_call, wait_for_frames);
+        suite.run(prefix + "/coroutines/cpu", frames_per_call, wait_for_frames, ProcessCpuNanoseconds);
+        stopping = true;
+        loop_thread.join();
+    }
+#endif
+}
+
+// Walking the NAL units of a recorded stream, as the recorder and NvFBCLatency do for every frame
+static void BenchmarkBitstream(Suite& suite, const Resolution& resolution, bool lossless)
+{
+    NvFBC_H264HWEncoder_Config config = EncoderConfig(resolution, lossless);
+    SyntheticEncoder encoder(resolution.width, resolution.height, 0, false);
+    if (!SetUpEncoder(encoder, config))
+        return;
+
+    vector<BYTE> frame((size_t)resolution.width * resolution.height);
+    vector<BYTE> stream;
+    vector<size_t> frame_ends;
+    for (int i = 0; i < STREAM_FRAMES; ++i) {
+        const DWORD size = GrabFrame(encoder, frame.data());
+        stream.insert(stream.end(), frame.begin(), frame.begin() + size);
+        frame_ends.push_back(stream.size());
+    }
+
+    const string prefix = string("bitstream/") + resolution.name + (lossless ? "/lossless" : "/lossy");
+    suite.run(prefix + "/nal-units", STREAM_FRAMES, [&]() -> size_t {
+        size_t offset = 0, units = 0;
+        H264NalUnit unit;
+        while (NextNalUnit(stream.data(), stream.size(), &offset, &unit))
+            ++units;
+        g_sink = units;
+        return stream.size();
+    });
+    suite.run(prefix + "/idr-check", STREAM_FRAMES, [&]() -> size_t {
+        size_t start = 0, idrs = 0;
+        for (size_t end : frame_ends) {
+            idrs += IsIdrAccessUnit(stream.data() + start, end - start);
+            start = end;
+        }
+        g_sink = idrs;
+        return stream.size();
+    });
+}
+
+// Memory straight from the OS, so every page faults when first written, like a buffer allocated
+// on the hot path. malloc would hand back the pages of the previous call.
+static BYTE* AllocateFresh(size_t size)
+{
+#ifdef _WIN32
+    return (BYTE*)VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory != MAP_FAILED ? (BYTE*)memory : nullptr;
+#endif
+}
+
+static void FreeFresh(BYTE* memory, size_t size)
+{
+#ifdef _WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+
+// Writing a frame into fresh memory against writing it into a buffer placed, pre-faulted and
+// locked up front, as the frame writer's buffers are with --large-pages --lock-buffers
+static void BenchmarkMemory(Suite& suite, const Resolution& resolution, const MemoryPlacement& placement)
+{
+    const size_t size = (size_t)resolution.width * resolution.height;
+    const string prefix = string("memory/") + resolution.name;
+
+    suite.run(prefix + "/frame-write-fresh", 1, [&]() -> size_t {
+        BYTE* buffer = AllocateFresh(size);
+        if (!buffer)
+            return 0;
+        memset(buffer, 0x5A, size);
+        g_sink = buffer[size - 1];
+        FreeFresh(buffer, size);
+        return size;
+    });
+
+    MemoryPlacement actual;
+    BYTE* placed = (BYTE*)AllocatePlaced(size, placement, &actual);
+    if (!placed)
+        return;
+    const bool ran = suite.run(prefix + "/frame-write-placed", 1, [&]() -> size_t {
+        memset(placed, 0x5A, size);
+        g_sink = placed[size - 1];
+        return size;
+    });
+    if (ran) {
+        cout << "  placed on node " << actual.node << (actual.largePages ? ", large pages" : "")
+             << (actual.locked ? ", locked" : "") << '\n';
+    }
+    FreePlaced(placed, size);
+}
+
+static void BenchmarkSei(Suite& suite)
+{
+    static const BYTE uuid[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    BYTE payload[24] = { 0, 0, 0, 1 };
+    BYTE nal[80];
+
+    suite.run("bitstream/sei-roundtrip", 1, [&]() -> size_t {
+        const size_t size = WriteUserDataSei(uuid, payload, sizeof(payload), nal);
+        size_t offset = 0;
+        H264NalUnit unit;
+        BYTE read[sizeof(payload)];
+        size_t read_size = sizeof(read);
+        if (NextNalUnit(nal, size, &offset, &unit))
+            g_sink = ReadUserDataSei(unit, uuid, read, &read_size);
+        return size;
+    });
+}
+
+// Every Bitmap.cpp conversion, writing to files in the scratch directory
+static void BenchmarkBitmaps(Suite& suite, const Resolution& resolution, const string& scratch)
+{
+    const int width = resolution.width, height = resolution.height;
+    const size_t pixels = (size_t)width * height;
+
+    vector<BYTE> input(pixels * 4);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = (BYTE)(i * 31 + i / 4096);
+
+    const string file_name = scratch + "/nvfbcbench.bmp";
+    const char* name = file_name.c_str();
+    BYTE* data = input.data();
+    RECT rect = { width / 4, height / 4, width * 3 / 4, height * 3 / 4 };
+
+    struct Conversion {
+        const char* name;
+        size_t bytes;
+        function<bool()> save;
+    };
+    const Conversion conversions[] = {
+        { "SaveRGB",       pixels * 3,      [&] { return SaveRGB(name, data, width, height); } },
+        { "SaveBGR",       pixels * 3,      [&] { return SaveBGR(name, data, width, height); } },
+        { "SaveARGB",      pixels * 4,      [&] { return SaveARGB(name, data, width, height); } },
+        { "SaveARGBRect",  pixels,          [&] { return SaveARGBRect(name, data, width, height, rect); } },
+        { "SaveRGBPlanar", pixels * 3,      [&] { return SaveRGBPlanar(name, data, width, height); } },
+        { "SaveYUV",       pixels * 3 / 2,  [&] { return SaveYUV(name, data, width, height); } },
+        { "SaveBitmap",    (size_t)((width + 3) & ~3) * height * 3, [&] { return SaveBitmap(name, data, width, height); } },
+    };
+
+    for (const Conversion& conversion : conversions) {
+        if (!conversion.save()) {
+            cerr << conversion.name << " cannot write to " << file_name << endl;
+            continue;
+        }
+        suite.run(string("bitmap/") + resolution.name + "/" + conversion.name, 1, [&]() -> size_t {
+            conversion.save();
+            return conversion.bytes;
+        });
+    }
+
+    for (const char* suffix : { "", "-red", "-green", "-blue", "-y", "-u", "-v" }) {
+        remove((scratch + "/nvfbcbench" + suffix + ".bmp").c_str());
+    }
+}
+
+// An ARGB frame shaped like a desktop rather than noise, which the image encoders would not
+// compress: a gradient wallpaper, a window with a solid title bar and lines of text-like strokes
+static vector<BYTE> DesktopImage(int width, int height)
+{
+    vector<BYTE> image((size_t)width * height * 4);
+    const int left = width / 8, right = width * 7 / 8, top = height / 8, bottom = height * 7 / 8;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            BYTE* pixel = &image[((size_t)y * width + x) * 4];
+            BYTE blue = (BYTE)(x * 255 / width), green = (BYTE)(y * 255 / height), red = 96;
+            if (x >= left && x < right && y >= top && y < bottom) {
+                if (y < top + 32) {
+                    blue = 160, green = 80, red = 40;
+                } else {
+                    // 8x12 glyph cells on 20 pixel lines, each cell a few strokes picked by its hash
+                    const unsigned cell = (unsigned)(x / 8) * 2654435761u ^ (unsigned)(y / 20) * 40503u;
+                    const bool stroke = y % 20 < 12 && ((cell >> ((x % 8) + (y % 20) / 3 * 8)) & 1) && cell % 7 != 0;
+                    blue = green = red = stroke ? 30 : 240;
+                }
+            }
+            pixel[0] = blue;
+            pixel[1] = green;
+            pixel[2] = red;
+            pixel[3] = 255;
+        }
+    }
+    return image;
+}
+
+// QOI screenshots: encoding in memory on one thread and in bands, decoding, and saving to a
+// file in the scratch directory as the bitmap benchmarks do
+static void BenchmarkQoi(Suite& suite, const Resolution& resolution, const string& scratch)
+{
+    const string prefix = string("qoi/") + resolution.name;
+    const string encode = prefix + "/encode", encode_bands = encode + "/" + to_string(ENCODE_THREADS) + "-threads",
+                 decode = prefix + "/decode", save = prefix + "/SaveARGBQOI";
+    if (!suite.wanted(encode) && !suite.wanted(encode_bands) && !suite.wanted(decode) && !suite.wanted(save))
+        return;
+
+    const int width = resolution.width, height = resolution.height;
+    vector<BYTE> image = DesktopImage(width, height);
+    const size_t bytes = image.size();
+
+    vector<BYTE> encoded;
+    suite.run(encode, 1, [&]() -> size_t {
+        EncodeQOI(image.data(), width, height, QOI_FORMAT_ARGB, encoded);
+        return bytes;
+    });
+    suite.run(encode_bands, 1, [&]() -> size_t {
+        EncodeQOI(image.data(), width, height, QOI_FORMAT_ARGB, encoded, ENCODE_THREADS);
+        return bytes;
+    });
+
+    EncodeQOI(image.data(), width, height, QOI_FORMAT_ARGB, encoded);
+    vector<BYTE> decoded;
+    int decoded_width, decoded_height;
+    suite.run(decode, 1, [&]() -> size_t {
+        DecodeQOI(encoded.data(), encoded.size(), decoded, &decoded_width, &decoded_height);
+        return bytes;
+    });
+
+    const string file_name = scratch + "/nvfbcbench.qoi";
+    if (suite.wanted(save) && !SaveARGBQOI(file_name.c_str(), image.data(), width, height)) {
+        cerr << "SaveARGBQOI cannot write to " << file_name << endl;
+        return;
+    }
+    suite.run(save, 1, [&]() -> size_t {
+        SaveARGBQOI(file_name.c_str(), image.data(), width, height);
+        return bytes;
+    });
+    remove(file_name.c_str());
+}
+
+static void BenchmarkJpeg(Suite& suite, const Resolution& resolution, const string& scratch)
+{
+    const string prefix = string("jpeg/") + resolution.name;
+    const string encode = prefix + "/encode", encode_rows = encode + "/" + to_string(ENCODE_THREADS) + "-threads",
+                 save = prefix + "/SaveARGBJPEG";
+    if (!suite.wanted(encode) && !suite.wanted(encode_rows) && !suite.wanted(save))
+        return;
+
+    const int width = resolution.width, height = resolution.height;
+    vector<BYTE> image = DesktopImage(width, height);
+    const size_t bytes = image.size();
+
+    vector<BYTE> encoded;
+    suite.run(encode, 1, [&]() -> size_t {
+        EncodeJPEG(image.data(), width, height, JPEG_FORMAT_ARGB, 75, encoded);
+        return bytes;
+    });
+    suite.run(encode_rows, 1, [&]() -> size_t {
+        EncodeJPEG(image.data(), width, height, JPEG_FORMAT_ARGB, 75, encoded, ENCODE_THREADS);
+        return bytes;
+    });
+
+    const string file_name = scratch + "/nvfbcbench.jpg";
+    if (suite.wanted(save) && !SaveARGBJPEG(file_name.c_str(), image.data(), width, height)) {
+        cerr << "SaveARGBJPEG cannot write to " << file_name << endl;
+        return;
+    }
+    suite.run(save, 1, [&]() -> size_t {
+        SaveARGBJPEG(file_name.c_str(), image.data(), width, height);
+        return bytes;
+    });
+    remove(file_name.c_str());
+}
+
+// One frame files, like bitmap/<resolution>/SaveYUV which writes the same planes as bitmaps
+static void BenchmarkY4M(Suite& suite, const Resolution& resolution, const string& scratch)
+{
+    const string prefix = string("y4m/") + resolution.name;
+    const string i420 = prefix + "/I420", nv12 = prefix + "/NV12";
+    if (!suite.wanted(i420) && !suite.wanted(nv12))
+        return;
+
+    const int width = resolution.width, height = resolution.height;
+    vector<uint8_t> frame((size_t)width * height * 3 / 2);
+    for (size_t i = 0; i < frame.size(); ++i)
+        frame[i] = (uint8_t)(i * 31 + i / 4096);
+
+    const string file_name = scratch + "/nvfbcbench.y4m";
+    const struct {
+        const string& name;
+        Y4MPixelFormat format;
+    } formats[] = { { i420, Y4M_FORMAT_I420 }, { nv12, Y4M_FORMAT_NV12 } };
+    for (const auto& format : formats) {
+        if (!suite.wanted(format.name))
+            continue;
+        Y4MWriter writer;
+        if (!writer.open(file_name.c_str(), width, height, format.format)) {
+            cerr << "Y4MWriter cannot write to " << file_name << endl;
+            return;
+        }
+        writer.close();
+        suite.run(format.name, 1, [&]() -> size_t {
+            writer.open(file_name.c_str(), width, height, format.format);
+            writer.writeFrame(frame.data());
+            writer.close();
+            return frame.size();
+        });
+    }
+    remove(file_name.c_str());
+}
+
+// Updates with an unchanged desktop, and alternating with one where a window-sized area changed
+static void BenchmarkDirtyRegions(Suite& suite, const Resolution& resolution)
+{
+    const string prefix = string("dirty/") + resolution.name;
+    const string unchanged = prefix + "/unchanged", changed = prefix + "/changed";
+    if (!suite.wanted(unchanged) && !suite.wanted(changed))
+        return;
+
+    const int width = resolution.width, height = resolution.height;
+    const vector<BYTE> image = DesktopImage(width, height);
+    vector<BYTE> other = image;
+    for (int y = height / 4; y < height / 2; ++y) {
+        for (int x = width / 4; x < width / 2; ++x)
+            other[((size_t)y * width + x) * 4] ^= 0xFF;
+    }
+    const size_t bytes = image.size();
+
+    DirtyRegionTracker tracker;
+    tracker.update(image.data(), width, height);
+    suite.run(unchanged, 1, [&]() -> size_t {
+        tracker.update(image.data(), width, height);
+        return bytes;
+    });
+
+    bool flip = false;
+    suite.run(changed, 1, [&]() -> size_t {
+        flip = !flip;
+        tracker.update(flip ? other.data() : image.data(), width, height);
+        return bytes;
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    cmdargs args;
+
+    po::options_description desc("Benchmarks the building blocks of the recorder.\nOptions");
+    desc.add_options()
+		("help,h", "Produce help message")
+		("baseline,b",   po::value<string>(&args.baseline), "Compare with the results in this JSON file and fail on regressions")
+		("save,s",       po::value<string>(&args.save), "Save the results as a JSON baseline")
+		("threshold,t",  po::value<double>(&args.threshold)->default_value(10), "Slowdown in percent counted as a regression, unless the baseline entry has a threshold of its own")
+		("min-time",     po::value<double>(&args.min_time)->default_value(0.5), "Seconds to run each benchmark for")
+		("filter,f",     po::value<string>(&args.filter), "Run only the benchmarks whose name contains this")
+		("resolutions,r", po::value<vector<string>>(&args.resolutions)->multitoken(), "Resolutions to run, out of 1080p, 4k and 8k; all by default")
+		("grab-cpu",     po::value<int>(&args.grab_cpu)->default_value(-1), "Logical CPU to pin the benchmark thread to, its NUMA node is used for placed buffers")
+		("writer-cpu",   po::value<int>(&args.writer_cpu)->default_value(-1), "Logical CPU to pin the frame writer threads to")
+		("scratch",      po::value<string>(&args.scratch)->default_value("."), "Directory for the files written by the bitmap and image benchmarks")
+		;
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    }
+    catch (const po::error& e) {
+        cerr << e.what() << "\n" << desc << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help")) {
+        cout << desc << endl;
+        return EXIT_SUCCESS;
+    }
+
+    vector<BenchmarkResult> baseline;
+    if (!args.baseline.empty() && !LoadBaseline(args.baseline, &baseline)) {
+        cerr << "Cannot read " << args.baseline << endl;
+        return EXIT_FAILURE;
+    }
+
+    cout << "Clock source: " << (Timer::usesTsc() ? "invariant TSC" : "OS clock") << "\n\n";
+    if (args.grab_cpu >= 0 && !PinCurrentThread(args.grab_cpu))
+        cerr << "Cannot pin to CPU " << args.grab_cpu << endl;
+
+    MemoryPlacement placement = DefaultPlacement();
+    placement.node = NumaNodeOfCpu(args.grab_cpu);
+    placement.largePages = true;
+    placement.locked = true;
+
+    Suite suite(args, baseline);
+    BenchmarkClocks(suite);
+    BenchmarkSei(suite);
+    BenchmarkSessions(suite);
+
+    for (const Resolution& resolution : RESOLUTIONS) {
+        if (!args.resolutions.empty() &&
+            find(args.resolutions.begin(), args.resolutions.end(), resolution.name) == args.resolutions.end())
+            continue;
+
+        for (bool lossless : { false, true }) {
+            BenchmarkPipeline(suite, resolution, lossless, nullptr, args.writer_cpu);
+            BenchmarkPipeline(suite, resolution, lossless, &placement, args.writer_cpu);
+            BenchmarkBitstream(suite, resolution, lossless);
+        }
+        BenchmarkMemory(suite, resolution, placement);
+        BenchmarkStartup(suite, resolution);
+        BenchmarkSession(suite, resolution);
+        BenchmarkBitmaps(suite, resolution, args.scratch);
+        BenchmarkQoi(suite, resolution, args.scratch);
+        BenchmarkJpeg(suite, resolution, args.scratch);
+        BenchmarkY4M(suite, resolution, args.scratch);
+        BenchmarkDirtyRegions(suite, resolution);
+    }
+
+    if (!args.save.empty() && !SaveBaseline(args.save, suite.results())) {
+        cerr << "Cannot write " << args.save << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (suite.regressions() > 0) {
+        cout << '\n' << suite.regressions() << " benchmarks regressed" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
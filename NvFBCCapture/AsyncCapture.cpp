@@ -0,0 +1,307 @@
+#include "AsyncCapture.h"
+
+#if NVFBC_ASYNC_CAPTURE
+
+#include <Timer.h>
+#include <Trace.h>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+// Set by a job whose thread was given up on
+static thread_local bool t_leaving = false;
+
+OffloadPool::OffloadPool(size_t threads)
+    : m_state(make_shared<State>())
+{
+    m_state->stopping = false;
+    for (size_t i = 0; i < max<size_t>(threads, 1); ++i)
+        m_threads.push_back(thread(&OffloadPool::run, m_state));
+}
+
+OffloadPool::~OffloadPool()
+{
+    {
+        lock_guard<mutex> lock(m_state->lock);
+        m_state->stopping = true;
+    }
+    m_state->queued.notify_all();
+    for (thread &worker : m_threads)
+        worker.join();
+}
+
+void OffloadPool::submit(function<void()> job)
+{
+    {
+        lock_guard<mutex> lock(m_state->lock);
+        m_state->jobs.push_back(move(job));
+    }
+    m_state->queued.notify_one();
+}
+
+void OffloadPool::replace(thread::id worker)
+{
+    auto stuck = find_if(m_threads.begin(), m_threads.end(), [worker](const thread &t) { return t.get_id() == worker; });
+    if (stuck == m_threads.end())
+        return;
+
+    stuck->detach();
+    *stuck = thread(&OffloadPool::run, m_state);
+}
+
+void OffloadPool::leave()
+{
+    t_leaving = true;
+}
+
+void OffloadPool::run(shared_ptr<State> state)
+{
+    Trace::setThreadName("Offload");
+
+    unique_lock<mutex> lock(state->lock);
+    for (;;) {
+        state->queued.wait(lock, [&state] { return state->stopping || !state->jobs.empty(); });
+        if (state->jobs.empty())
+            break;
+
+        function<void()> job = move(state->jobs.front());
+        state->jobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+
+        // Another thread took its place
+        if (t_leaving)
+            break;
+    }
+}
+
+EventLoop::EventLoop()
+    : m_order(0)
+    , m_stopping(false)
+{
+}
+
+void EventLoop::post(function<void()> job)
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_jobs.push_back(move(job));
+    }
+    m_wake.notify_one();
+}
+
+void EventLoop::postAt(LONGLONG at, function<void()> job)
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        Timed timed = {at, m_order++, move(job)};
+        m_timers.push(move(timed));
+    }
+    m_wake.notify_one();
+}
+
+void EventLoop::run()
+{
+    unique_lock<mutex> lock(m_lock);
+    while (!m_stopping) {
+        // Timers which are due go behind the jobs posted before
+        const LONGLONG now = Timer::nanoseconds();
+        while (!m_timers.empty() && m_timers.top().at <= now) {
+            m_jobs.push_back(move(const_cast<Timed &>(m_timers.top()).job));
+            m_timers.pop();
+        }
+
+        if (m_jobs.empty()) {
+            if (m_timers.empty())
+                m_wake.wait(lock);
+            else
+                m_wake.wait_for(lock, chrono::nanoseconds(m_timers.top().at - now));
+            continue;
+        }
+
+        function<void()> job = move(m_jobs.front());
+        m_jobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+    m_stopping = false;
+}
+
+void EventLoop::stop()
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+}
+
+// A grab on the pool, which the loop may give up on
+struct AsyncCaptureSession::Grab
+{
+    std::mutex lock;
+    // 0 until a thread of the pool took the grab up
+    LONGLONG started;
+    std::thread::id worker;
+    bool finished;
+    bool abandoned;
+};
+
+AsyncCaptureSession::AsyncCaptureSession(EventLoop &loop, OffloadPool &pool)
+    : m_loop(loop)
+    , m_pool(pool)
+    , m_session(new CaptureSession)
+    , m_period(0)
+    , m_due(0)
+    , m_timeoutNs(0)
+    , m_recreated(0)
+{
+}
+
+NVFBCRESULT AsyncCaptureSession::open(const CaptureSessionConfig &config, bool paced)
+{
+    m_config = config;
+    m_config.grabThread = false;
+
+    const NvFBC_H264HWEncoder_Config &encodeConfig = config.encodeConfig;
+    m_period = paced && encodeConfig.dwFrameRateNum != 0
+                   ? 1000000000LL * (encodeConfig.dwFrameRateDen ? encodeConfig.dwFrameRateDen : 1) / encodeConfig.dwFrameRateNum
+                   : 0;
+    m_due = 0;
+    m_timeoutNs = config.grabTimeoutMs * 1000000LL;
+    m_recreated = 0;
+    return m_session->open(m_config);
+}
+
+// Waits for the grab to be due on the loop, then for a free buffer, grabs on the pool and
+// resumes the coroutine on the loop again; a grab which brought nothing is tried again a
+// period later
+void AsyncCaptureSession::grab(AsyncFrame *frame, coroutine_handle<> handle)
+{
+    const LONGLONG now = Timer::nanoseconds();
+    const LONGLONG due = m_due;
+    m_due = m_period != 0 ? max(due, now) + m_period : 0;
+    if (due > now)
+        m_loop.postAt(due, [this, frame, handle] { start(frame, handle); });
+    else
+        start(frame, handle);
+}
+
+// On the loop: a pool thread only takes the grab up once it cannot block on a buffer
+void AsyncCaptureSession::start(AsyncFrame *frame, coroutine_handle<> handle)
+{
+    const bool available = m_session->whenFree([this, frame, handle] {
+        m_loop.post([this, frame, handle] { start(frame, handle); });
+    });
+    if (available)
+        submit(frame, handle);
+}
+
+void AsyncCaptureSession::submit(AsyncFrame *frame, coroutine_handle<> handle)
+{
+    shared_ptr<Grab> pending = make_shared<Grab>();
+    pending->started = 0;
+    pending->finished = false;
+    pending->abandoned = false;
+
+    CaptureSession *session = m_session.get();
+    m_pool.submit([this, session, pending, frame, handle] {
+        {
+            lock_guard<mutex> lock(pending->lock);
+            pending->started = Timer::nanoseconds();
+            pending->worker = this_thread::get_id();
+        }
+        const CaptureFrame *captured = nullptr;
+        const NVFBCRESULT result = session->tryFrame(&captured);
+        {
+            lock_guard<mutex> lock(pending->lock);
+            if (pending->abandoned) {
+                // Nobody awaits the frame any more, the session is leaked and the thread
+                // replaced, or about to be
+                if (captured)
+                    session->release(captured);
+                OffloadPool::leave();
+                return;
+            }
+            pending->finished = true;
+        }
+
+        m_loop.post([this, session, frame, handle, captured, result] {
+            if (result == NVFBC_SUCCESS && !captured) {
+                grab(frame, handle);
+                return;
+            }
+            *frame = AsyncFrame(session, captured, result);
+            handle.resume();
+        });
+    });
+
+    if (m_timeoutNs != 0)
+        m_loop.postAt(Timer::nanoseconds() + m_timeoutNs, [this, pending, frame, handle] { check(pending, frame, handle); });
+}
+
+// On the loop, once the grab may have run for the timeout. Only the grab itself counts, not
+// the wait for a thread of the pool before it.
+void AsyncCaptureSession::check(shared_ptr<Grab> pending, AsyncFrame *frame, coroutine_handle<> handle)
+{
+    thread::id worker;
+    {
+        lock_guard<mutex> lock(pending->lock);
+        if (pending->finished)
+            return;
+        const LONGLONG now = Timer::nanoseconds();
+        if (pending->started == 0 || now - pending->started < m_timeoutNs) {
+            const LONGLONG at = (pending->started != 0 ? pending->started : now) + m_timeoutNs;
+            m_loop.postAt(at, [this, pending, frame, handle] { check(pending, frame, handle); });
+            return;
+        }
+        pending->abandoned = true;
+        worker = pending->worker;
+    }
+
+    // The stuck grab keeps its thread and the session, buffers and all; the pool goes on with
+    // a new thread and the coroutine with a new session, whose first frame is an IDR frame
+    TRACE_SCOPE("Recycle session");
+    m_pool.replace(worker);
+    m_recreated += m_session->recreated() + 1;
+    m_session.release();  // leaked, the stuck grab is still in it
+    m_session.reset(new CaptureSession);
+    const NVFBCRESULT result = m_session->open(m_config);
+    if (result != NVFBC_SUCCESS) {
+        *frame = AsyncFrame(m_session.get(), nullptr, result);
+        handle.resume();
+        return;
+    }
+    grab(frame, handle);
+}
+
+AsyncSink::AsyncSink(EventLoop &loop, OffloadPool &pool, function<bool(const CaptureFrame &)> write)
+    : m_loop(loop)
+    , m_pool(pool)
+    , m_write(move(write))
+{
+}
+
+AsyncSink::AsyncSink(EventLoop &loop, OffloadPool &pool, ostream &output)
+    : m_loop(loop)
+    , m_pool(pool)
+    , m_write([&output](const CaptureFrame &frame) {
+        output.write(reinterpret_cast<const char *>(frame.data), frame.size);
+        return !output.fail();
+    })
+{
+}
+
+void AsyncSink::write(const CaptureFrame &frame, bool *written, coroutine_handle<> handle)
+{
+    m_pool.submit([this, &frame, written, handle] {
+        *written = m_write(frame);
+        m_loop.post([handle] { handle.resume(); });
+    });
+}
+
+#endif
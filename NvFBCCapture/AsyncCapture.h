@@ -0,0 +1,284 @@
+#pragma once
+
+// Coroutine interface of CaptureSession, for services which run many sessions on an event
+// loop instead of a thread or two each. It needs C++20 coroutines; with an older compiler or
+// language standard the header declares nothing and NVFBC_ASYNC_CAPTURE is 0.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define NVFBC_ASYNC_CAPTURE 1
+#endif
+#endif
+#ifndef NVFBC_ASYNC_CAPTURE
+#define NVFBC_ASYNC_CAPTURE 0
+#endif
+
+#if NVFBC_ASYNC_CAPTURE
+
+#include "CaptureSession.h"
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Runs blocking calls on a fixed number of threads. A grab blocks while the frame is encoded,
+// so the pool needs about frames per second * grab time threads to keep up with every session.
+class OffloadPool
+{
+    OffloadPool(const OffloadPool &);
+    OffloadPool &operator=(const OffloadPool &);
+
+public:
+    explicit OffloadPool(size_t threads);
+
+    // Runs the jobs queued so far and joins the threads, but those given up on
+    ~OffloadPool();
+
+    void submit(std::function<void()> job);
+
+    // Gives up on the thread worker, stuck in a job which may never return, and starts another
+    // one in its place. The job calls leave() if it returns, so its thread ends rather than
+    // joining the one which replaced it. Not concurrently with itself or the destructor.
+    void replace(std::thread::id worker);
+
+    // Called from a job: its thread ends once the job returned
+    static void leave();
+
+private:
+    // Outlives the pool for the threads given up on
+    struct State
+    {
+        std::mutex lock;
+        std::condition_variable queued;
+        std::deque<std::function<void()>> jobs;
+        bool stopping;
+    };
+
+    static void run(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> m_state;
+    std::vector<std::thread> m_threads;
+};
+
+// Runs jobs and timers one after the other on the thread which calls run(). Services with an
+// event loop of their own override post() and postAt() to hand the jobs to it instead.
+class EventLoop
+{
+    EventLoop(const EventLoop &);
+    EventLoop &operator=(const EventLoop &);
+
+public:
+    EventLoop();
+    virtual ~EventLoop() {}
+
+    // Both may be called from any thread; at is Timer::nanoseconds() time
+    virtual void post(std::function<void()> job);
+    virtual void postAt(LONGLONG at, std::function<void()> job);
+
+    // Runs jobs until stop()
+    void run();
+    void stop();
+
+private:
+    struct Timed
+    {
+        LONGLONG at;
+        unsigned long long order;
+        std::function<void()> job;
+
+        bool operator>(const Timed &other) const { return at != other.at ? at > other.at : order > other.order; }
+    };
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_jobs;
+    std::priority_queue<Timed, std::vector<Timed>, std::greater<Timed>> m_timers;
+    unsigned long long m_order;
+    bool m_stopping;
+};
+
+// Return type of coroutines which nobody awaits, e.g. one consuming a session. It runs until
+// its first co_await right away and frees itself once it returns.
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return DetachedTask(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// A frame of an AsyncCaptureSession, released when it is destroyed. result is what the grab
+// returned; there is no frame unless it is NVFBC_SUCCESS.
+class AsyncFrame
+{
+    AsyncFrame(const AsyncFrame &);
+    AsyncFrame &operator=(const AsyncFrame &);
+
+public:
+    AsyncFrame()
+        : result(NVFBC_ERROR_GENERIC)
+        , m_session(nullptr)
+        , m_frame(nullptr)
+    {
+    }
+    AsyncFrame(CaptureSession *session, const CaptureFrame *frame, NVFBCRESULT result)
+        : result(result)
+        , m_session(session)
+        , m_frame(frame)
+    {
+    }
+    AsyncFrame(AsyncFrame &&other) noexcept
+        : result(other.result)
+        , m_session(other.m_session)
+        , m_frame(other.m_frame)
+    {
+        other.m_frame = nullptr;
+    }
+    AsyncFrame &operator=(AsyncFrame &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            result = other.result;
+            m_session = other.m_session;
+            m_frame = other.m_frame;
+            other.m_frame = nullptr;
+        }
+        return *this;
+    }
+    ~AsyncFrame() { reset(); }
+
+    explicit operator bool() const { return m_frame != nullptr; }
+    const CaptureFrame *operator->() const { return m_frame; }
+    const CaptureFrame &operator*() const { return *m_frame; }
+
+    void reset()
+    {
+        if (m_frame)
+            m_session->release(m_frame);
+        m_frame = nullptr;
+    }
+
+    NVFBCRESULT result;
+
+private:
+    CaptureSession *m_session;
+    const CaptureFrame *m_frame;
+};
+
+// A CaptureSession whose frames are awaited: co_await session.nextFrame() resumes on the
+// event loop with the next frame, while the grab itself is made on the pool. Grabs are paced
+// to the frame rate with the loop's timers rather than by blocking in the driver, and wait on
+// the loop for the consumer to release a buffer, so a session costs no thread while it waits.
+// A grab which runs for longer than grabTimeoutMs is given up on with its pool thread, which
+// the pool replaces, and the session, which is opened again.
+class AsyncCaptureSession
+{
+    AsyncCaptureSession(const AsyncCaptureSession &);
+    AsyncCaptureSession &operator=(const AsyncCaptureSession &);
+
+public:
+    class NextFrame
+    {
+    public:
+        explicit NextFrame(AsyncCaptureSession &session) : m_session(session) {}
+
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { m_session.grab(&m_frame, handle); }
+        AsyncFrame await_resume() { return std::move(m_frame); }
+
+    private:
+        AsyncCaptureSession &m_session;
+        AsyncFrame m_frame;
+    };
+
+    AsyncCaptureSession(EventLoop &loop, OffloadPool &pool);
+
+    // Opens the session without a GrabThread. Unless paced is false, grabs are started a frame
+    // period apart, which an encoder blocking until the next frame does not need.
+    NVFBCRESULT open(const CaptureSessionConfig &config, bool paced = true);
+
+    // Every frame has to be destroyed and no grab awaited
+    void close() { m_session->close(); }
+
+    // Awaits the next frame with something in it; one at a time
+    NextFrame nextFrame() { return NextFrame(*this); }
+
+    void requestIdr() { m_session->requestIdr(); }
+
+    // Times the session was re-created or opened again after a grab stalled
+    unsigned recreated() const { return m_recreated + m_session->recreated(); }
+
+private:
+    struct Grab;
+
+    void grab(AsyncFrame *frame, std::coroutine_handle<> handle);
+    void start(AsyncFrame *frame, std::coroutine_handle<> handle);
+    void submit(AsyncFrame *frame, std::coroutine_handle<> handle);
+    void check(std::shared_ptr<Grab> pending, AsyncFrame *frame, std::coroutine_handle<> handle);
+
+    EventLoop &m_loop;
+    OffloadPool &m_pool;
+    CaptureSessionConfig m_config;
+    // Leaked and replaced once a grab stalled in it
+    std::unique_ptr<CaptureSession> m_session;
+    LONGLONG m_period;
+    // When the next grab is due, 0 to grab at once
+    LONGLONG m_due;
+    LONGLONG m_timeoutNs;
+    // Of the sessions given up on
+    unsigned m_recreated;
+};
+
+// Writes frames on the pool, so a slow disk or consumer holds up the coroutine writing to it
+// rather than the event loop: co_await sink.write(frame) resumes on the loop once the frame
+// is written, with whether it was.
+class AsyncSink
+{
+    AsyncSink(const AsyncSink &);
+    AsyncSink &operator=(const AsyncSink &);
+
+public:
+    class Write
+    {
+    public:
+        Write(AsyncSink &sink, const CaptureFrame &frame) : m_sink(sink), m_frame(frame), m_written(false) {}
+
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { m_sink.write(m_frame, &m_written, handle); }
+        bool await_resume() const { return m_written; }
+
+    private:
+        AsyncSink &m_sink;
+        const CaptureFrame &m_frame;
+        bool m_written;
+    };
+
+    // write is called on a thread of the pool and returns whether the frame was written
+    AsyncSink(EventLoop &loop, OffloadPool &pool, std::function<bool(const CaptureFrame &)> write);
+
+    // Writes the frames one after the other to output
+    AsyncSink(EventLoop &loop, OffloadPool &pool, std::ostream &output);
+
+    // Only one write of a sink may be awaited at a time
+    Write write(const AsyncFrame &frame) { return Write(*this, *frame); }
+
+private:
+    void write(const CaptureFrame &frame, bool *written, std::coroutine_handle<> handle);
+
+    EventLoop &m_loop;
+    OffloadPool &m_pool;
+    std::function<bool(const CaptureFrame &)> m_write;
+};
+
+#endif
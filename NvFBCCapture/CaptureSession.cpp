@@ -0,0 +1,292 @@
+#include "CaptureSession.h"
+
+#include <H264Bitstream.h>
+#include <Timer.h>
+#include <Trace.h>
+
+#include <string.h>
+
+using namespace std;
+
+CaptureSessionConfig::CaptureSessionConfig()
+    : buffers(4)
+    , grabTimeoutMs(5000)
+    , grabThread(true)
+{
+    memset(&encodeConfig, 0, sizeof(encodeConfig));
+    encodeConfig.dwVersion = NVFBC_H264HWENC_CONFIG_VER;
+    encodeConfig.dwProfile = 100;
+    encodeConfig.dwFrameRateNum = 30;
+    encodeConfig.dwFrameRateDen = 1;
+    encodeConfig.bOutBandSPSPPS = FALSE;
+    encodeConfig.bRecordTimeStamps = TRUE;
+    encodeConfig.stereoFormat = NVFBC_H264_STEREO_NONE;
+    encodeConfig.dwAvgBitRate = 8000000;
+    encodeConfig.dwPeakBitRate = 16000000;
+    encodeConfig.dwGOPLength = 100;
+    encodeConfig.eRateControl = NVFBC_H264_ENC_PARAMS_RC_VBR;
+    encodeConfig.ePresetConfig = NVFBC_H264_PRESET_LOW_LATENCY_HQ;
+    encodeConfig.dwQP = 26;
+}
+
+CaptureSession::CaptureSession()
+    : m_maxWidth(0)
+    , m_maxHeight(0)
+    , m_index(0)
+    , m_recreated(0)
+    , m_bufferSize(0)
+    , m_stopping(false)
+    , m_pushing(false)
+{
+    memset(&m_setupParams, 0, sizeof(m_setupParams));
+}
+
+CaptureSession::~CaptureSession()
+{
+    close();
+}
+
+Encoder *CaptureSession::makeEncoder()
+{
+    if (m_config.makeEncoder)
+        return m_config.makeEncoder();
+    return new NvFBCEncoder(m_nvfbc);
+}
+
+NVFBCRESULT CaptureSession::open(const CaptureSessionConfig &config)
+{
+    close();
+
+    m_config = config;
+    if (!m_config.makeEncoder && !m_nvfbc.load())
+        return NVFBC_ERROR_GENERIC;
+
+    m_setupParams.dwVersion = NVFBC_H264_SETUP_PARAMS_VER;
+    m_setupParams.bWithHWCursor = TRUE;
+    m_setupParams.pEncodeConfig = &m_config.encodeConfig;
+
+    m_encoder.reset(makeEncoder());
+    if (m_config.grabThread) {
+        m_grabThread.reset(new GrabThread);
+        m_grabThread->invoke([] { Trace::setThreadName("Grab"); });
+    }
+
+    m_grabber.reset(new Grabber(m_encoder, m_grabThread.get(), &m_setupParams, &m_maxWidth, &m_maxHeight));
+    m_grabber->makeEncoder = [this] { return makeEncoder(); };
+    m_grabber->prepareThread = [] { Trace::setThreadName("Grab"); };
+    m_grabber->setTimeouts(0, m_config.grabTimeoutMs * 1000000LL);
+
+    NVFBCRESULT result = NVFBC_SUCCESS;
+    m_grabber->call([&] {
+        result = m_encoder->create(&m_maxWidth, &m_maxHeight) ? m_encoder->setUp(&m_setupParams) : NVFBC_ERROR_GENERIC;
+    });
+    if (result != NVFBC_SUCCESS) {
+        close();
+        return result;
+    }
+
+    m_bufferSize = m_maxWidth * m_maxHeight;
+    m_buffers.resize(m_config.buffers > 0 ? m_config.buffers : 1);
+    m_free.reserve(m_buffers.size());
+    for (size_t i = 0; i < m_buffers.size(); ++i) {
+        memset(&m_buffers[i].frame, 0, sizeof(m_buffers[i].frame));
+        m_buffers[i].frame.buffer = static_cast<unsigned>(i);
+        m_buffers[i].data.resize(m_bufferSize);
+        m_free.push_back(&m_buffers[i]);
+    }
+    m_index = 0;
+    return NVFBC_SUCCESS;
+}
+
+void CaptureSession::close()
+{
+    stop();
+
+    // A grab still running is left behind with the thread, and keeps the encoder it runs in
+    m_grabber.reset();
+    const bool stuck = m_grabThread && m_grabThread->busy();
+    m_grabThread.reset();
+    if (stuck)
+        m_encoder.release();
+    else
+        m_encoder.reset();
+    m_whenFree = nullptr;
+    m_free.clear();
+    m_buffers.clear();
+    m_nvfbc.close();
+}
+
+NVFBCRESULT CaptureSession::nextFrame(const CaptureFrame **frame)
+{
+    if (m_pushing.load(memory_order_relaxed) || !m_encoder)
+        return NVFBC_ERROR_GENERIC;
+
+    lock_guard<mutex> lock(m_grabLock);
+    return grab(frame);
+}
+
+NVFBCRESULT CaptureSession::tryFrame(const CaptureFrame **frame)
+{
+    *frame = nullptr;
+    if (m_pushing.load(memory_order_relaxed) || !m_encoder)
+        return NVFBC_ERROR_GENERIC;
+
+    lock_guard<mutex> lock(m_grabLock);
+    return grabOnce(frame);
+}
+
+void CaptureSession::requestIdr()
+{
+    if (m_grabber)
+        m_grabber->requestIdr();
+}
+
+void CaptureSession::release(const CaptureFrame *frame)
+{
+    function<void()> job;
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_free.push_back(&m_buffers[frame->buffer]);
+        job.swap(m_whenFree);
+    }
+    m_freed.notify_one();
+    if (job)
+        job();
+}
+
+bool CaptureSession::whenFree(function<void()> job)
+{
+    lock_guard<mutex> lock(m_lock);
+    if (!m_free.empty() || m_buffers.empty())
+        return true;
+    m_whenFree = move(job);
+    return false;
+}
+
+CaptureSession::Buffer *CaptureSession::acquire()
+{
+    unique_lock<mutex> lock(m_lock);
+    m_freed.wait(lock, [this] { return !m_free.empty() || m_stopping; });
+    if (m_stopping)
+        return nullptr;
+
+    Buffer *buffer = m_free.back();
+    m_free.pop_back();
+    const size_t buffer_size = m_bufferSize;
+    lock.unlock();
+
+    if (buffer->data.size() < buffer_size)
+        buffer->data.resize(buffer_size);
+    return buffer;
+}
+
+// Called with m_grabLock held
+NVFBCRESULT CaptureSession::grab(const CaptureFrame **frame)
+{
+    *frame = nullptr;
+    NVFBCRESULT result = NVFBC_SUCCESS;
+    while (result == NVFBC_SUCCESS && !*frame)
+        result = grabOnce(frame);
+    return result;
+}
+
+// Called with m_grabLock held
+NVFBCRESULT CaptureSession::grabOnce(const CaptureFrame **frame)
+{
+    Buffer *buffer = acquire();
+    if (!buffer)
+        return NVFBC_ERROR_GENERIC;
+
+    NVFBCRESULT result = NVFBC_SUCCESS;
+    const GrabStatus status = m_grabber->grab(buffer->data.data(), &result);
+    if (status == GRAB_STALLED) {
+        // The stuck grab keeps its buffer, which is leaked on purpose
+        new vector<NvU8>(move(buffer->data));
+        buffer->data = vector<NvU8>();
+    }
+    if (status != GRAB_FRAME) {
+        release(&buffer->frame);
+        if (status == GRAB_STALLED || status == GRAB_INVALIDATED)
+            return recover(status);
+        return status == GRAB_FAILED ? result : NVFBC_SUCCESS;
+    }
+
+    CaptureFrame &captured = buffer->frame;
+    captured.data = buffer->data.data();
+    captured.size = m_grabber->frameInfo().dwByteSize;
+    captured.index = m_index++;
+    captured.width = m_grabber->grabInfo().dwWidth;
+    captured.height = m_grabber->grabInfo().dwHeight;
+    captured.idr = IsIdrAccessUnit(captured.data, captured.size);
+    captured.grabbed = Timer::nanoseconds();
+    *frame = &captured;
+    return NVFBC_SUCCESS;
+}
+
+// Called with m_grabLock held
+NVFBCRESULT CaptureSession::recover(GrabStatus status)
+{
+    const NVFBCRESULT result = m_grabber->recover(status);
+    m_recreated.fetch_add(1, memory_order_relaxed);
+    if (result != NVFBC_SUCCESS)
+        return result;
+
+    lock_guard<mutex> lock(m_lock);
+    m_bufferSize = m_maxWidth * m_maxHeight;
+    return NVFBC_SUCCESS;
+}
+
+bool CaptureSession::start(const Callback &callback)
+{
+    if (m_pushThread.joinable() || !m_encoder)
+        return false;
+
+    m_stopping = false;
+    m_pushing.store(true, memory_order_relaxed);
+    m_pushThread = thread(&CaptureSession::push, this, callback);
+    return true;
+}
+
+void CaptureSession::push(Callback callback)
+{
+    Trace::setThreadName("Capture push");
+
+    for (;;) {
+        const CaptureFrame *frame = nullptr;
+        NVFBCRESULT result;
+        {
+            lock_guard<mutex> lock(m_grabLock);
+            result = grab(&frame);
+        }
+
+        bool stopping;
+        {
+            lock_guard<mutex> lock(m_lock);
+            stopping = m_stopping;
+        }
+        if (result != NVFBC_SUCCESS) {
+            if (!stopping)
+                callback(nullptr, result);
+            break;
+        }
+        callback(frame, NVFBC_SUCCESS);
+        if (stopping)
+            break;
+    }
+}
+
+void CaptureSession::stop()
+{
+    if (!m_pushThread.joinable())
+        return;
+
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_freed.notify_all();
+    m_pushThread.join();
+
+    m_stopping = false;
+    m_pushing.store(false, memory_order_relaxed);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "../NvFBCH264/Encoder.h"
+#include "../NvFBCH264/GrabThread.h"
+#include "../NvFBCH264/Grabber.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A grabbed frame, viewed in place in one of the session's buffers. It stays valid until it
+// is handed back to CaptureSession::release().
+struct CaptureFrame
+{
+    const NvU8 *data;
+    size_t size;
+    unsigned index;     // Counts the frames the session returned
+    DWORD width;
+    DWORD height;
+    bool idr;
+    LONGLONG grabbed;   // Timer::nanoseconds() when the grab returned
+    unsigned buffer;    // Which buffer of the session holds it
+};
+
+struct CaptureSessionConfig
+{
+    // The configuration of a capture with default options: High profile, 8 Mbps VBR, 30 fps
+    CaptureSessionConfig();
+
+    NvFBC_H264HWEncoder_Config encodeConfig;
+    // Frames which can be held by the consumer or grabbed into at once
+    size_t buffers;
+    // Time after which a grab which did not return is given up on and the session re-created,
+    // 0 to wait for ever
+    DWORD grabTimeoutMs;
+    // Makes the encoder, again after a stalled grab; NvFBC if not set, otherwise e.g. a
+    // SyntheticEncoder to run without a GPU
+    std::function<Encoder *()> makeEncoder;
+    // Whether the calls into the session are made on a GrabThread of its own. Without one
+    // they are made on the calling thread, e.g. by a pool shared by many sessions, and
+    // grabTimeoutMs is up to the caller, as AsyncCaptureSession applies it.
+    bool grabThread;
+};
+
+// The capture loop of NvFBCH264 without the file around it, for programs which want the
+// frames themselves. The session owns the NvFBC library, the encoder session and the frame
+// buffers, and frames are grabbed straight into the buffers the consumer gets to see.
+//
+// Frames are either pulled with nextFrame() or pushed to a callback from a thread of the
+// session's own after start(); each one is returned with release() once the consumer is done
+// with it, from any thread. Grabs are made on a GrabThread by default, so a grab which never
+// returns is given up on and the session re-created, as is an invalidated session; after a
+// resolution change, frames are only returned from the first IDR frame on. Empty grabs, with
+// nothing changed since the previous one, are skipped.
+class CaptureSession
+{
+    CaptureSession(const CaptureSession &);
+    CaptureSession &operator=(const CaptureSession &);
+
+public:
+    // Called with each frame, or with null and the result once a grab failed and the session
+    // stopped pushing
+    typedef std::function<void(const CaptureFrame *frame, NVFBCRESULT result)> Callback;
+
+    CaptureSession();
+
+    // Stops pushing and frees the session; every frame has to be released before
+    ~CaptureSession();
+
+    // Loads NvFBC unless config makes another encoder, creates and sets up the session
+    NVFBCRESULT open(const CaptureSessionConfig &config);
+
+    void close();
+
+    // Grabs the next frame with something in it, waiting while all buffers are held by the
+    // consumer. Calls from several threads are made one after the other. Fails while pushing.
+    NVFBCRESULT nextFrame(const CaptureFrame **frame);
+
+    // Makes a single grab, for callers which wait for the next frame on their own: *frame is
+    // null if the grab brought nothing, because the desktop did not change, the session had
+    // to be re-created or an IDR frame is awaited
+    NVFBCRESULT tryFrame(const CaptureFrame **frame);
+
+    // Returns the frame's buffer to the session
+    void release(const CaptureFrame *frame);
+
+    // For callers which must not block on a buffer, like grabs on a shared pool: returns true
+    // if the next grab has one, or the session is not open for the grab to fail, otherwise
+    // false and calls job from release() once a buffer is back. One job at a time.
+    bool whenFree(std::function<void()> job);
+
+    // Pushes every frame to callback until stop(), or until a grab failed
+    bool start(const Callback &callback);
+
+    // Waits for the frame being grabbed; not from the callback
+    void stop();
+
+    // Makes the next frame an IDR frame
+    void requestIdr();
+
+    // Largest frame the session can capture
+    DWORD maxWidth() const { return m_maxWidth; }
+    DWORD maxHeight() const { return m_maxHeight; }
+
+    // Times the session was re-created after it was invalidated or a grab stalled
+    unsigned recreated() const { return m_recreated.load(std::memory_order_relaxed); }
+
+private:
+    struct Buffer
+    {
+        CaptureFrame frame;
+        std::vector<NvU8> data;
+    };
+
+    Encoder *makeEncoder();
+    NVFBCRESULT grab(const CaptureFrame **frame);
+    NVFBCRESULT grabOnce(const CaptureFrame **frame);
+    NVFBCRESULT recover(GrabStatus status);
+    Buffer *acquire();
+    void push(Callback callback);
+
+    NvFBCLibrary m_nvfbc;
+    CaptureSessionConfig m_config;
+    NVFBC_H264_SETUP_PARAMS m_setupParams;
+    std::unique_ptr<Encoder> m_encoder;
+    std::unique_ptr<GrabThread> m_grabThread;
+    std::unique_ptr<Grabber> m_grabber;
+    DWORD m_maxWidth;
+    DWORD m_maxHeight;
+    unsigned m_index;
+    std::atomic<unsigned> m_recreated;
+
+    // Grabs are made one at a time, by nextFrame() or the push thread
+    std::mutex m_grabLock;
+
+    // Guards the free buffers, m_whenFree and m_stopping
+    std::mutex m_lock;
+    std::condition_variable m_freed;
+    std::vector<Buffer> m_buffers;
+    std::vector<Buffer *> m_free;
+    std::function<void()> m_whenFree;
+    // Buffers grow to this size when acquired, after the session was re-created larger
+    size_t m_bufferSize;
+    bool m_stopping;
+
+    std::thread m_pushThread;
+    std::atomic<bool> m_pushing;
+};
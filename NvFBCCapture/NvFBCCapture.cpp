@@ -0,0 +1,174 @@
+#include "NvFBCCapture.h"
+#include "CaptureSession.h"
+#include "../NvFBCH264/SyntheticEncoder.h"
+
+#include <limits.h>
+#include <memory>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+// How much of NvFBCCaptureConfig each version has, indexed by version
+static const size_t CONFIG_SIZES[NVFBC_CAPTURE_CONFIG_VER + 1] = {
+    0,
+    offsetof(NvFBCCaptureConfig, syntheticHeight) + sizeof(unsigned int),
+};
+
+struct NvFBCCapture
+{
+    CaptureSession session;
+    // The C view of each buffer's frame, filled in when it is handed out
+    vector<NvFBCCaptureFrame> frames;
+    vector<const CaptureFrame *> captured;
+};
+
+// Copies what the C view needs; the data stays where it was grabbed to
+static const NvFBCCaptureFrame *View(NvFBCCapture *capture, const CaptureFrame *frame)
+{
+    NvFBCCaptureFrame &view = capture->frames[frame->buffer];
+    view.version = NVFBC_CAPTURE_FRAME_VER;
+    view.data = frame->data;
+    view.size = frame->size;
+    view.index = frame->index;
+    view.width = frame->width;
+    view.height = frame->height;
+    view.idr = frame->idr ? 1 : 0;
+    view.grabbedNs = frame->grabbed;
+    capture->captured[frame->buffer] = frame;
+    return &view;
+}
+
+void NvFBCCaptureDefaultConfig(NvFBCCaptureConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->version = NVFBC_CAPTURE_CONFIG_VER;
+    config->profile = 100;
+    config->bitrate = 8000000;
+    config->frameRate = 30;
+    config->gopLength = 100;
+    config->buffers = 4;
+    config->grabTimeoutMs = 5000;
+    config->syntheticWidth = 1920;
+    config->syntheticHeight = 1080;
+}
+
+int NvFBCCaptureOpen(const NvFBCCaptureConfig *callerConfig, NvFBCCapture **capture)
+{
+    try {
+        if (!callerConfig || !capture || callerConfig->version < 1 || callerConfig->version > NVFBC_CAPTURE_CONFIG_VER)
+            return NVFBC_ERROR_GENERIC;
+        *capture = nullptr;
+
+        // Only as much as the caller's version has is read, the rest keeps the defaults
+        NvFBCCaptureConfig defaults;
+        NvFBCCaptureDefaultConfig(&defaults);
+        memcpy(&defaults, callerConfig, CONFIG_SIZES[callerConfig->version]);
+        const NvFBCCaptureConfig *config = &defaults;
+
+        CaptureSessionConfig sessionConfig;
+        NvFBC_H264HWEncoder_Config &encodeConfig = sessionConfig.encodeConfig;
+        encodeConfig.dwProfile = config->profile;
+        encodeConfig.dwFrameRateNum = config->frameRate ? config->frameRate : 30;
+        encodeConfig.bEnableYUV444Encoding = config->yuv444 ? TRUE : FALSE;
+        if (config->lossless) {
+            encodeConfig.ePresetConfig = NVFBC_H264_PRESET_LOSSLESS_HP;
+            encodeConfig.eRateControl = NVFBC_H264_ENC_PARAMS_RC_CONSTQP;
+            encodeConfig.dwAvgBitRate = 0;
+            encodeConfig.dwPeakBitRate = 0;
+        } else {
+            encodeConfig.dwAvgBitRate = config->bitrate;
+            encodeConfig.dwPeakBitRate = config->bitrate > UINT_MAX / 2 ? UINT_MAX : config->bitrate * 2;
+        }
+        if (config->gopLength)
+            encodeConfig.dwGOPLength = config->gopLength;
+        sessionConfig.buffers = config->buffers;
+        sessionConfig.grabTimeoutMs = config->grabTimeoutMs;
+        if (config->synthetic) {
+            const DWORD width = config->syntheticWidth, height = config->syntheticHeight;
+            sessionConfig.makeEncoder = [width, height] { return new SyntheticEncoder(width, height, 0.5); };
+        }
+
+        unique_ptr<NvFBCCapture> created(new NvFBCCapture);
+        const NVFBCRESULT result = created->session.open(sessionConfig);
+        if (result != NVFBC_SUCCESS)
+            return result;
+        created->frames.resize(sessionConfig.buffers > 0 ? sessionConfig.buffers : 1);
+        created->captured.resize(created->frames.size());
+        *capture = created.release();
+        return NVFBC_SUCCESS;
+    } catch (...) {
+        // Nothing may unwind into a C caller: bad_alloc from the buffers, system_error from
+        // the threads and locks
+        return NVFBC_ERROR_GENERIC;
+    }
+}
+
+void NvFBCCaptureClose(NvFBCCapture *capture)
+{
+    try {
+        delete capture;
+    } catch (...) {
+    }
+}
+
+int NvFBCCaptureNextFrame(NvFBCCapture *capture, const NvFBCCaptureFrame **frame)
+{
+    try {
+        if (!capture || !frame)
+            return NVFBC_ERROR_GENERIC;
+
+        const CaptureFrame *captured = nullptr;
+        const NVFBCRESULT result = capture->session.nextFrame(&captured);
+        if (result != NVFBC_SUCCESS)
+            return result;
+        *frame = View(capture, captured);
+        return NVFBC_SUCCESS;
+    } catch (...) {
+        return NVFBC_ERROR_GENERIC;
+    }
+}
+
+void NvFBCCaptureRelease(NvFBCCapture *capture, const NvFBCCaptureFrame *frame)
+{
+    try {
+        if (!capture || !frame)
+            return;
+        const size_t buffer = frame - capture->frames.data();
+        capture->session.release(capture->captured[buffer]);
+    } catch (...) {
+    }
+}
+
+int NvFBCCaptureStart(NvFBCCapture *capture, NvFBCCaptureCallback callback, void *context)
+{
+    try {
+        if (!capture || !callback)
+            return NVFBC_ERROR_GENERIC;
+
+        const bool started = capture->session.start([capture, callback, context](const CaptureFrame *frame, NVFBCRESULT result) {
+            callback(context, frame ? View(capture, frame) : nullptr, result);
+        });
+        return started ? NVFBC_SUCCESS : NVFBC_ERROR_GENERIC;
+    } catch (...) {
+        return NVFBC_ERROR_GENERIC;
+    }
+}
+
+void NvFBCCaptureStop(NvFBCCapture *capture)
+{
+    try {
+        if (capture)
+            capture->session.stop();
+    } catch (...) {
+    }
+}
+
+void NvFBCCaptureRequestIdr(NvFBCCapture *capture)
+{
+    try {
+        if (capture)
+            capture->session.requestIdr();
+    } catch (...) {
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * C interface of CaptureSession, for programs which capture in process rather than run
+ * NvFBCH264 and read its output. Frames are handed out in place in the session's buffers,
+ * without a copy, and stay valid until they are released.
+ *
+ * The structures start with a version and are only ever extended at the end, each extension
+ * raising the version. The library takes any config version up to its own and leaves the
+ * fields a caller's version lacks at their defaults; frames carry the version the library
+ * filled them in for, so a caller reads the fields past its own version only when that
+ * version is high enough. Programs built against an older header keep working with a newer
+ * library.
+ */
+#pragma once
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifdef NVFBCCAPTURE_EXPORTS
+#define NVFBCCAPTURE_API __declspec(dllexport)
+#else
+#define NVFBCCAPTURE_API __declspec(dllimport)
+#endif
+#else
+#define NVFBCCAPTURE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NVFBC_CAPTURE_CONFIG_VER 1
+#define NVFBC_CAPTURE_FRAME_VER 1
+
+typedef struct NvFBCCaptureConfig
+{
+    unsigned int version;           /* NVFBC_CAPTURE_CONFIG_VER */
+    unsigned int profile;           /* 66 Baseline, 77 Main, 100 High */
+    unsigned int bitrate;           /* Average bits per second, unless lossless */
+    unsigned int frameRate;
+    unsigned int gopLength;
+    int lossless;
+    int yuv444;
+    unsigned int buffers;           /* Frames which can be held or grabbed into at once */
+    unsigned int grabTimeoutMs;     /* After which a stuck grab is given up on, 0 for never */
+    int synthetic;                  /* Makes frames up instead of grabbing them, no GPU needed */
+    unsigned int syntheticWidth;
+    unsigned int syntheticHeight;
+} NvFBCCaptureConfig;
+
+typedef struct NvFBCCaptureFrame
+{
+    unsigned int version;           /* NVFBC_CAPTURE_FRAME_VER of the library */
+    const unsigned char *data;      /* H.264 access unit */
+    size_t size;
+    unsigned int index;             /* Counts the frames the session returned */
+    unsigned int width;
+    unsigned int height;
+    int idr;
+    long long grabbedNs;            /* Steady clock time when the grab returned */
+} NvFBCCaptureFrame;
+
+typedef struct NvFBCCapture NvFBCCapture;
+
+/* Called on the session's thread with each frame, or with NULL and the NVFBCRESULT of the grab
+   which failed, after which no more frames are pushed */
+typedef void (*NvFBCCaptureCallback)(void *context, const NvFBCCaptureFrame *frame, int result);
+
+/* Functions returning int return 0 on success, otherwise an NVFBCRESULT, NVFBC_ERROR_GENERIC
+   also when the library ran out of memory. No C++ exception leaves any of the functions. */
+
+/* Fills config with the defaults of NvFBCH264: High profile, 8 Mbps, 30 fps */
+NVFBCCAPTURE_API void NvFBCCaptureDefaultConfig(NvFBCCaptureConfig *config);
+
+/* Creates and sets up a session */
+NVFBCCAPTURE_API int NvFBCCaptureOpen(const NvFBCCaptureConfig *config, NvFBCCapture **capture);
+
+/* Stops pushing and frees the session; every frame has to be released before */
+NVFBCCAPTURE_API void NvFBCCaptureClose(NvFBCCapture *capture);
+
+/* Grabs the next frame with something in it, waiting while all buffers are held. Calls from
+   several threads are made one after the other. Fails while frames are pushed. */
+NVFBCCAPTURE_API int NvFBCCaptureNextFrame(NvFBCCapture *capture, const NvFBCCaptureFrame **frame);
+
+/* Returns the frame's buffer to the session, from any thread */
+NVFBCCAPTURE_API void NvFBCCaptureRelease(NvFBCCapture *capture, const NvFBCCaptureFrame *frame);
+
+/* Pushes every frame to callback until NvFBCCaptureStop() */
+NVFBCCAPTURE_API int NvFBCCaptureStart(NvFBCCapture *capture, NvFBCCaptureCallback callback, void *context);
+
+/* Waits for the frame being grabbed; not from the callback */
+NVFBCCAPTURE_API void NvFBCCaptureStop(NvFBCCapture *capture);
+
+/* Makes the next frame an IDR frame */
+NVFBCCAPTURE_API void NvFBCCaptureRequestIdr(NvFBCCapture *capture);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,195 @@
+#include "AllocationTracker.h"
+
+#include <new>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+atomic<bool> AllocationTracker::s_started(false);
+atomic<unsigned long long> AllocationTracker::s_allocations(0);
+atomic<unsigned long long> AllocationTracker::s_bytes(0);
+
+static thread_local bool t_tracked = false;
+
+bool AllocationTracker::available()
+{
+#ifdef NVFBC_TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocationTracker::trackThread()
+{
+    t_tracked = true;
+}
+
+void AllocationTracker::start()
+{
+    s_started.store(true, memory_order_relaxed);
+}
+
+void AllocationTracker::stop()
+{
+    s_started.store(false, memory_order_relaxed);
+}
+
+void AllocationTracker::record(size_t size)
+{
+    if (t_tracked && s_started.load(memory_order_relaxed)) {
+        s_allocations.fetch_add(1, memory_order_relaxed);
+        s_bytes.fetch_add(size, memory_order_relaxed);
+    }
+}
+
+#ifdef NVFBC_TRACK_ALLOCATIONS
+
+static void* Allocate(size_t size)
+{
+    AllocationTracker::record(size);
+    // malloc(0) may return null, operator new may not
+    void* memory = malloc(size != 0 ? size : 1);
+    if (!memory)
+        throw bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new[](size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    AllocationTracker::record(size);
+    return malloc(size != 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    AllocationTracker::record(size);
+    return malloc(size != 0 ? size : 1);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, const nothrow_t&) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, const nothrow_t&) noexcept
+{
+    free(memory);
+}
+
+#ifdef __cpp_aligned_new
+
+// For types aligned beyond what malloc guarantees; their memory has to be freed the same way
+static void* AllocateAligned(size_t size, align_val_t alignment)
+{
+    AllocationTracker::record(size);
+    size = size != 0 ? size : 1;
+#ifdef _WIN32
+    return _aligned_malloc(size, static_cast<size_t>(alignment));
+#else
+    void* memory = nullptr;
+    return posix_memalign(&memory, static_cast<size_t>(alignment), size) == 0 ? memory : nullptr;
+#endif
+}
+
+static void FreeAligned(void* memory)
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void* operator new(size_t size, align_val_t alignment)
+{
+    void* memory = AllocateAligned(size, alignment);
+    if (!memory)
+        throw bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size, align_val_t alignment)
+{
+    void* memory = AllocateAligned(size, alignment);
+    if (!memory)
+        throw bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    return AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept
+{
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* memory, align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete[](void* memory, align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete(void* memory, size_t, align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete[](void* memory, size_t, align_val_t) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete(void* memory, align_val_t, const nothrow_t&) noexcept
+{
+    FreeAligned(memory);
+}
+
+void operator delete[](void* memory, align_val_t, const nothrow_t&) noexcept
+{
+    FreeAligned(memory);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Counts the heap allocations made through operator new, aligned or not, by the threads which
+// asked for it, to check that the capture loop does not allocate once it is warmed up. Only
+// builds defining NVFBC_TRACK_ALLOCATIONS (NvFBCTest and the Debug configurations of NvFBCH264)
+// replace the global operator new and delete for the whole program; while tracking is stopped
+// they cost one thread-local test over malloc and free. Elsewhere nothing is counted.
+class AllocationTracker
+{
+public:
+    // Whether operator new is replaced, so allocations are counted at all
+    static bool available();
+
+    // Counts the allocations of the calling thread while tracking is started
+    static void trackThread();
+
+    static void start();
+    static void stop();
+    static bool started() { return s_started.load(std::memory_order_relaxed); }
+
+    // Allocations and bytes counted since the program started
+    static unsigned long long allocations() { return s_allocations.load(std::memory_order_relaxed); }
+    static unsigned long long bytes() { return s_bytes.load(std::memory_order_relaxed); }
+
+    // Called by operator new
+    static void record(size_t size);
+
+private:
+    static std::atomic<bool> s_started;
+    static std::atomic<unsigned long long> s_allocations;
+    static std::atomic<unsigned long long> s_bytes;
+};
@@ -0,0 +1,180 @@
+#include "Autotuner.h"
+
+#include <Timer.h>
+#include <Trace.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <thread>
+
+using namespace std;
+
+// Share of the frame rate a candidate has to grab
+static const double MIN_FRAME_RATE_SHARE = 0.95;
+// Share of the time the writer has to be idle, for the disk or consumer to have some slack
+static const double MIN_HEADROOM = 0.2;
+// Grabs made before a trial is measured, while the first IDR frame is encoded and written
+static const unsigned WARMUP_FRAMES = 5;
+
+static const DWORD PROFILES[] = {100, 77, 66};
+
+Autotuner::Autotuner(Grabber &grabber, NVFBC_H264_SETUP_PARAMS &setupParams, FrameWriter &writer,
+                     const NvFBC_H264HWEncoder_Config &config)
+    : m_grabber(grabber)
+    , m_setupParams(setupParams)
+    , m_writer(writer)
+    , m_config(config)
+    , m_trialConfig(config)
+{
+}
+
+vector<AutotuneCandidate> Autotuner::candidates(DWORD maxBitrate)
+{
+    vector<AutotuneCandidate> result;
+    for (bool yuv444 : {true, false}) {
+        AutotuneCandidate candidate = {100, true, yuv444, 0};
+        result.push_back(candidate);
+    }
+    for (DWORD bitrate = maxBitrate; bitrate >= maxBitrate / 8 && bitrate > 0; bitrate /= 2) {
+        for (DWORD profile : PROFILES) {
+            for (bool yuv444 : {true, false}) {
+                // YUV444 encoding is only done with the High profile
+                if (yuv444 && profile != 100)
+                    continue;
+                AutotuneCandidate candidate = {profile, false, yuv444, bitrate};
+                result.push_back(candidate);
+            }
+        }
+    }
+    return result;
+}
+
+NvFBC_H264HWEncoder_Config Autotuner::configure(const AutotuneCandidate &candidate) const
+{
+    NvFBC_H264HWEncoder_Config config = m_config;
+    config.dwProfile = candidate.profile;
+    config.bEnableYUV444Encoding = candidate.yuv444 ? TRUE : FALSE;
+    if (candidate.lossless) {
+        config.ePresetConfig = NVFBC_H264_PRESET_LOSSLESS_HP;
+        config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_CONSTQP;
+        config.dwAvgBitRate = 0;
+        config.dwPeakBitRate = 0;
+    } else {
+        config.ePresetConfig = NVFBC_H264_PRESET_LOW_LATENCY_HQ;
+        config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_VBR;
+        config.dwAvgBitRate = candidate.bitrate;
+        config.dwPeakBitRate = candidate.bitrate * 2;
+        if (config.dwGOPLength == 0)
+            config.dwGOPLength = 100;
+        if (config.dwQP == 0)
+            config.dwQP = 26;
+    }
+    return config;
+}
+
+AutotuneTrial Autotuner::run(const AutotuneCandidate &candidate, LONGLONG durationNs)
+{
+    TRACE_SCOPE("Autotune trial");
+
+    AutotuneTrial trial;
+    memset(&trial, 0, sizeof(trial));
+    trial.candidate = candidate;
+
+    m_trialConfig = configure(candidate);
+    NvFBC_H264HWEncoder_Config *const previous = m_setupParams.pEncodeConfig;
+    m_setupParams.pEncodeConfig = &m_trialConfig;
+    NVFBCRESULT result = m_grabber.setUp();
+    if (result != NVFBC_SUCCESS) {
+        m_setupParams.pEncodeConfig = previous;
+        return trial;
+    }
+    trial.setUp = true;
+
+    m_latencies.clear();
+    LONGLONG start = 0, end = 0;
+    unsigned long long startBytes = 0, startWriteNs = 0;
+    unsigned grabs = 0, frames = 0, warmup = WARMUP_FRAMES;
+
+    while (start == 0 || end - start < durationNs) {
+        if (warmup == 0 && start == 0) {
+            start = Timer::nanoseconds();
+            startBytes = m_writer.bytesWritten();
+            startWriteNs = m_writer.writeNanoseconds();
+        }
+
+        EncodedFrame *frame = m_writer.acquire();
+        const LONGLONG grabStart = Timer::nanoseconds();
+        const GrabStatus status = m_grabber.grab(frame->data.data(), &result);
+        end = Timer::nanoseconds();
+
+        if (status == GRAB_INVALIDATED || status == GRAB_STALLED) {
+            // Measured again from the new session on; a stuck grab keeps its buffer
+            if (status == GRAB_STALLED)
+                m_writer.abandon(frame);
+            else
+                m_writer.discard(frame);
+            result = m_grabber.recover(status);
+            if (result != NVFBC_SUCCESS)
+                break;
+            m_writer.resize(m_grabber.maxFrameSize());
+            m_latencies.clear();
+            start = 0;
+            frames = 0;
+            trial.peakDepth = 0;
+            warmup = WARMUP_FRAMES;
+            continue;
+        }
+        if (status == GRAB_FAILED) {
+            m_writer.discard(frame);
+            break;
+        }
+
+        if (start != 0)
+            m_latencies.push_back(end - grabStart);
+        else
+            --warmup;
+
+        // Only frames with new content count, or an idle desktop would sustain anything
+        if (status != GRAB_FRAME) {
+            m_writer.discard(frame);
+            continue;
+        }
+        if (start != 0) {
+            ++frames;
+            trial.peakDepth = max(trial.peakDepth, m_writer.queueDepth());
+        }
+
+        const NvFBCFrameGrabInfo &grabInfo = m_grabber.grabInfo();
+        frame->size = m_grabber.frameInfo().dwByteSize;
+        frame->timestamp = 0;
+        frame->index = grabs++;
+        frame->width = grabInfo.dwWidth;
+        frame->height = grabInfo.dwHeight;
+        frame->sei_size = 0;
+        m_writer.submit(frame);
+    }
+    m_setupParams.pEncodeConfig = previous;
+
+    // The frames still queued were grabbed within the trial, and writing them is part of it
+    while (m_writer.queueDepth() > 0 && !m_writer.failed())
+        this_thread::sleep_for(chrono::milliseconds(1));
+    const LONGLONG drained = Timer::nanoseconds();
+
+    if (result != NVFBC_SUCCESS || start == 0 || end <= start || m_latencies.empty())
+        return trial;
+
+    const double seconds = (end - start) / 1e9;
+    trial.frameRate = frames / seconds;
+    trial.outputRate = (m_writer.bytesWritten() - startBytes) / ((drained - start) / 1e9);
+    trial.headroom = max(0.0, 1 - (m_writer.writeNanoseconds() - startWriteNs) / 1e9 / ((drained - start) / 1e9));
+
+    const size_t percentile = m_latencies.size() * 99 / 100;
+    nth_element(m_latencies.begin(), m_latencies.begin() + percentile, m_latencies.end());
+    trial.grabLatencyMs = m_latencies[percentile] / 1e6;
+
+    const double frameRate = (double)m_config.dwFrameRateNum / (m_config.dwFrameRateDen ? m_config.dwFrameRateDen : 1);
+    trial.sustained = trial.frameRate >= frameRate * MIN_FRAME_RATE_SHARE && trial.headroom >= MIN_HEADROOM &&
+                      trial.peakDepth * 2 < m_writer.queueSize() && !m_writer.failed();
+    return trial;
+}
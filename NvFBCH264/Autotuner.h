@@ -0,0 +1,64 @@
+#pragma once
+
+#include "FrameWriter.h"
+#include "Grabber.h"
+
+#include <stddef.h>
+#include <vector>
+
+// One encoder configuration the autotuner tries
+struct AutotuneCandidate
+{
+    DWORD profile;      // 66 Baseline, 77 Main, 100 High
+    bool lossless;
+    bool yuv444;
+    DWORD bitrate;      // Average bitrate, 0 for lossless
+};
+
+// What a candidate achieved over its trial
+struct AutotuneTrial
+{
+    AutotuneCandidate candidate;
+    bool setUp;             // Whether the session took the configuration at all
+    double frameRate;       // Frames with new content grabbed per second
+    double grabLatencyMs;   // 99th percentile of the time a grab took
+    double outputRate;      // Bytes written per second
+    double headroom;        // Share of the time the writer was idle
+    size_t peakDepth;       // Most frames queued for the writer at once
+    bool sustained;
+};
+
+// Finds the best encoder configuration the machine sustains at a frame rate. Candidates are
+// tried from the highest quality down, each for a trial of its own in which the session is
+// set up with it and grabs into the writer as the capture would. The first one which grabs
+// at least 95% of the frame rate while the writer stays idle a fifth of the time and its
+// queue never gets half full is taken, so the sweep usually ends long before the last one.
+class Autotuner
+{
+public:
+    // config is the configuration of the capture, which the candidates change the profile,
+    // YUV444, lossless and bitrate of. The trials grab with grabber, whose setup parameters are
+    // setupParams; they point at the candidate's configuration during its trial only, while
+    // the session is left set up with whatever was tried last.
+    Autotuner(Grabber &grabber, NVFBC_H264_SETUP_PARAMS &setupParams, FrameWriter &writer,
+              const NvFBC_H264HWEncoder_Config &config);
+
+    // Lossless with and without YUV444 first, then every profile with and without YUV444 at
+    // maxBitrate, half of it, a quarter and an eighth, from High with YUV444 down to Baseline
+    static std::vector<AutotuneCandidate> candidates(DWORD maxBitrate);
+
+    // The configuration a candidate stands for
+    NvFBC_H264HWEncoder_Config configure(const AutotuneCandidate &candidate) const;
+
+    // Sets the session up with the candidate and grabs for durationNs
+    AutotuneTrial run(const AutotuneCandidate &candidate, LONGLONG durationNs);
+
+private:
+    Grabber &m_grabber;
+    NVFBC_H264_SETUP_PARAMS &m_setupParams;
+    FrameWriter &m_writer;
+    NvFBC_H264HWEncoder_Config m_config;
+    // Of the trial running, which a re-created session is set up with as well
+    NvFBC_H264HWEncoder_Config m_trialConfig;
+    std::vector<LONGLONG> m_latencies;
+};
@@ -0,0 +1,120 @@
+#include "BitrateController.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static const int64_t WINDOW_NS = 500'000'000;
+// Windows of calm before every step up
+static const unsigned CALM_WINDOWS = 10;
+// Windows ignored after a step down
+static const unsigned COOLDOWN_WINDOWS = 2;
+
+static const double DECREASE = 0.7;
+static const double INCREASE = 1.15;
+// Share of the achieved throughput aimed for when stepping down
+static const double HEADROOM = 0.9;
+
+BitrateController::BitrateController(uint32_t maxBitrate, uint32_t minBitrate, uint32_t maxFrameRate, uint32_t minFrameRate)
+    : m_maxBitrate(maxBitrate)
+    , m_minBitrate(min(minBitrate, maxBitrate))
+    , m_maxFrameRate(maxFrameRate)
+    , m_minFrameRate(max(1u, min(minFrameRate, maxFrameRate)))
+    , m_bitrate(maxBitrate)
+    , m_frameRate(maxFrameRate)
+    , m_windowStart(0)
+    , m_windowBytes(0)
+    , m_windowWriteNs(0)
+    , m_peakDepth(0)
+    , m_cooldown(0)
+    , m_calmWindows(0)
+    , m_reason("")
+    , m_throughput(0)
+    , m_busy(0)
+    , m_lastPeakDepth(0)
+{
+}
+
+void BitrateController::setBitrate(uint32_t bitrate)
+{
+    m_maxBitrate = bitrate;
+    m_minBitrate = min(m_minBitrate, bitrate);
+    m_bitrate = bitrate;
+    m_calmWindows = 0;
+}
+
+void BitrateController::revert(uint32_t bitrate, uint32_t frameRate)
+{
+    m_bitrate = bitrate;
+    m_frameRate = frameRate;
+    m_calmWindows = 0;
+}
+
+bool BitrateController::update(int64_t now, size_t queueDepth, size_t queueSize, unsigned long long bytesWritten,
+                               unsigned long long writeNanoseconds)
+{
+    m_peakDepth = max(m_peakDepth, queueDepth);
+
+    if (m_windowStart == 0) {
+        m_windowStart = now;
+        m_windowBytes = bytesWritten;
+        m_windowWriteNs = writeNanoseconds;
+        return false;
+    }
+    if (now - m_windowStart < WINDOW_NS)
+        return false;
+
+    const double seconds = (now - m_windowStart) / 1e9;
+    m_throughput = (bytesWritten - m_windowBytes) / seconds;
+    m_busy = (writeNanoseconds - m_windowWriteNs) / 1e9 / seconds;
+    m_lastPeakDepth = m_peakDepth;
+
+    m_windowStart = now;
+    m_windowBytes = bytesWritten;
+    m_windowWriteNs = writeNanoseconds;
+    m_peakDepth = queueDepth;
+
+    if (m_cooldown > 0) {
+        --m_cooldown;
+        return false;
+    }
+
+    const uint32_t bitrate = m_bitrate;
+    const uint32_t frameRate = m_frameRate;
+
+    // One frame waiting is normal, and all a queue of one can hold
+    if ((m_lastPeakDepth > 1 && m_lastPeakDepth * 2 >= queueSize) || m_busy > 0.9) {
+        m_calmWindows = 0;
+        if (m_bitrate > m_minBitrate) {
+            const double achieved = m_throughput * 8 * HEADROOM;
+            const double target = achieved > 0 ? min(m_bitrate * DECREASE, achieved) : m_bitrate * DECREASE;
+            m_bitrate = max(m_minBitrate, (uint32_t)target);
+            m_reason = "output falling behind";
+        } else if (m_frameRate > m_minFrameRate) {
+            m_frameRate = max(m_minFrameRate, m_frameRate / 2);
+            m_reason = "output falling behind at the minimum bitrate";
+        }
+        if (m_bitrate != bitrate || m_frameRate != frameRate) {
+            m_cooldown = COOLDOWN_WINDOWS;
+            return true;
+        }
+        return false;
+    }
+
+    if (m_lastPeakDepth <= 1 && m_busy < 0.5) {
+        if (++m_calmWindows < CALM_WINDOWS)
+            return false;
+        m_calmWindows = 0;
+
+        if (m_frameRate < m_maxFrameRate)
+            m_frameRate = min(m_maxFrameRate, m_frameRate * 2);
+        else if (m_bitrate < m_maxBitrate)
+            m_bitrate = (uint32_t)min((double)m_maxBitrate, m_bitrate * INCREASE);
+        m_reason = "output keeping up";
+        return m_bitrate != bitrate || m_frameRate != frameRate;
+    }
+
+    // Between the two: no reason to change, nor to count towards a step up
+    m_calmWindows = 0;
+    return false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <stddef.h>
+
+// Adapts the bitrate, and optionally the frame rate, to what the output keeps up with. Every
+// half second it looks at the state of the writer over the last half second:
+//
+// - The output falls behind when the write queue got half full, with more than one frame in
+//   it, or the writer was busy more than 90% of the time. The bitrate then drops to 70%, or to 90% of what the output
+//   achieved if that is less, but not below the minimum; once there, the frame rate halves
+//   down to its minimum, which is at least 1 fps. The next two windows are left out, for the
+//   queue to drain.
+// - The output keeps up when the queue never held more than one frame and the writer was
+//   busy less than half the time. After five seconds of that, the frame rate is restored
+//   first, then the bitrate rises by 15% at a time, every five seconds, up to the maximum.
+//
+// Anything in between keeps the settings, so they do not flap around the limit of the output.
+class BitrateController
+{
+public:
+    BitrateController(uint32_t maxBitrate, uint32_t minBitrate, uint32_t maxFrameRate, uint32_t minFrameRate);
+
+    // Called once per frame with the state of the writer. Returns true if bitrate() or
+    // frameRate() changed.
+    bool update(int64_t now, size_t queueDepth, size_t queueSize, unsigned long long bytesWritten,
+                unsigned long long writeNanoseconds);
+
+    // Makes bitrate the maximum and the current bitrate, e.g. when it is set by hand
+    void setBitrate(uint32_t bitrate);
+
+    // Sets bitrate() and frameRate() back when the encoder did not take the last change, which
+    // is tried again no sooner than it would have been followed by another one
+    void revert(uint32_t bitrate, uint32_t frameRate);
+
+    uint32_t bitrate() const { return m_bitrate; }
+    uint32_t frameRate() const { return m_frameRate; }
+
+    // Why the last change was made, and what the output did in the window before it
+    const char *reason() const { return m_reason; }
+    double throughput() const { return m_throughput; }
+    double busy() const { return m_busy; }
+    size_t peakDepth() const { return m_lastPeakDepth; }
+
+private:
+    uint32_t m_maxBitrate;
+    uint32_t m_minBitrate;
+    uint32_t m_maxFrameRate;
+    uint32_t m_minFrameRate;
+    uint32_t m_bitrate;
+    uint32_t m_frameRate;
+
+    int64_t m_windowStart;
+    unsigned long long m_windowBytes;
+    unsigned long long m_windowWriteNs;
+    size_t m_peakDepth;
+
+    unsigned m_cooldown;
+    unsigned m_calmWindows;
+
+    const char *m_reason;
+    double m_throughput;
+    double m_busy;
+    size_t m_lastPeakDepth;
+};
@@ -0,0 +1,460 @@
+#include "ControlChannel.h"
+
+#include <Timer.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Longest command line, and answer
+static const size_t MAX_LINE = 256;
+
+ControlChannel::ControlChannel()
+#ifdef _WIN32
+    : m_pipe(INVALID_HANDLE_VALUE)
+    , m_stopEvent(NULL)
+    , m_ioEvent(NULL)
+#else
+    : m_listener(-1)
+    , m_client(-1)
+#endif
+    , m_ready(false)
+    , m_pending(false)
+    , m_done(false)
+    , m_stopping(false)
+    , m_command()
+    , m_error(nullptr)
+    , m_applied(0)
+{
+#ifndef _WIN32
+    m_wakePipe[0] = m_wakePipe[1] = -1;
+#endif
+}
+
+ControlChannel::~ControlChannel()
+{
+    stop();
+}
+
+bool ControlChannel::start(const string &name)
+{
+    stop();
+
+    m_name = name;
+    m_stopping = false;
+    if (!open()) {
+        close();
+        return false;
+    }
+    m_thread = thread(&ControlChannel::run, this);
+    return true;
+}
+
+void ControlChannel::stop()
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    if (m_thread.joinable()) {
+#ifdef _WIN32
+        SetEvent(m_stopEvent);
+#else
+        const char wake = 0;
+        (void)::write(m_wakePipe[1], &wake, 1);
+#endif
+        m_thread.join();
+    }
+    close();
+}
+
+bool ControlChannel::poll(ControlCommand *command)
+{
+    // Checked before every grab, so it must not take the lock while nothing was sent
+    if (!m_ready.load(memory_order_acquire))
+        return false;
+
+    lock_guard<mutex> lock(m_lock);
+    if (!m_pending)
+        return false;
+    *command = m_command;
+    m_pending = false;
+    m_ready.store(false, memory_order_relaxed);
+    return true;
+}
+
+bool ControlChannel::wait(ControlCommand *command)
+{
+    unique_lock<mutex> lock(m_lock);
+    m_wake.wait(lock, [this] { return m_pending || m_stopping; });
+    if (!m_pending)
+        return false;
+    *command = m_command;
+    m_pending = false;
+    m_ready.store(false, memory_order_relaxed);
+    return true;
+}
+
+void ControlChannel::complete(const char *error)
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_error = error;
+        m_applied = Timer::nanoseconds();
+        m_done = true;
+    }
+    m_wake.notify_all();
+}
+
+void ControlChannel::run()
+{
+    char line[MAX_LINE];
+    char reply[MAX_LINE];
+
+    while (connect()) {
+        size_t length = 0;
+        bool connected = true;
+        while (connected) {
+            const int received = read(line + length, sizeof(line) - 1 - length);
+            if (received <= 0)
+                break;
+            length += received;
+
+            char *end;
+            while (connected && (end = (char *)memchr(line, '\n', length)) != nullptr) {
+                *end = 0;
+                if (end > line && end[-1] == '\r')
+                    end[-1] = 0;
+                connected = handle(line, reply, sizeof(reply)) && write(reply, strlen(reply));
+
+                const size_t consumed = end + 1 - line;
+                memmove(line, end + 1, length - consumed);
+                length -= consumed;
+            }
+
+            if (connected && length == sizeof(line) - 1) {
+                static const char tooLong[] = "error line too long\n";
+                write(tooLong, sizeof(tooLong) - 1);
+                connected = false;
+            }
+        }
+        disconnect();
+    }
+}
+
+// Parses a command line and has the capture loop apply it. Returns false once the channel is
+// stopped, after the answer for the client was written to reply.
+bool ControlChannel::handle(const char *line, char *reply, size_t size)
+{
+    ControlCommand command;
+    command.value = 0;
+    command.path[0] = 0;
+    command.received = Timer::nanoseconds();
+
+    char name[32];
+    unsigned value;
+    char extra;
+    const int fields = sscanf(line, "%31s %u %c", name, &value, &extra);
+    // Paths are taken as they are, spaces included
+    const int pathFields = sscanf(line, "%31s %255[^\n]", name, command.path);
+    if (fields == 2 && strcmp(name, "set-bitrate") == 0) {
+        command.type = CONTROL_SET_BITRATE;
+        command.value = value;
+    } else if (fields == 2 && strcmp(name, "set-gop") == 0) {
+        command.type = CONTROL_SET_GOP;
+        command.value = value;
+    } else if (fields == 1 && strcmp(name, "force-idr") == 0) {
+        command.type = CONTROL_FORCE_IDR;
+    } else if (fields == 1 && strcmp(name, "pause") == 0) {
+        command.type = CONTROL_PAUSE;
+    } else if (fields == 1 && strcmp(name, "resume") == 0) {
+        command.type = CONTROL_RESUME;
+    } else if (pathFields == 2 && strcmp(name, "start-clip") == 0) {
+        command.type = CONTROL_START_CLIP;
+    } else if (fields == 1 && strcmp(name, "stop-clip") == 0) {
+        command.type = CONTROL_STOP_CLIP;
+    } else if (pathFields == 2 && strcmp(name, "grab-now") == 0) {
+        command.type = CONTROL_GRAB_NOW;
+    } else if (fields == 1 && strcmp(name, "quit") == 0) {
+        command.type = CONTROL_QUIT;
+    } else {
+        snprintf(reply, size, "error unknown command: %.200s\n", line);
+        return true;
+    }
+
+    unique_lock<mutex> lock(m_lock);
+    m_done = false;
+    if (!m_stopping) {
+        m_command = command;
+        m_pending = true;
+        m_done = false;
+        m_ready.store(true, memory_order_release);
+        m_wake.notify_all();
+        m_wake.wait(lock, [this] { return m_done || m_stopping; });
+    }
+
+    if (!m_done) {
+        m_pending = false;
+        m_ready.store(false, memory_order_relaxed);
+        snprintf(reply, size, "error capture ended\n");
+        return false;
+    }
+    if (m_error)
+        snprintf(reply, size, "error %s\n", m_error);
+    else
+        snprintf(reply, size, "ok %lld\n", (long long)((m_applied - command.received) / 1000));
+    return true;
+}
+
+#ifdef _WIN32
+static string PipePath(const string &name)
+{
+    return "\\\\.\\pipe\\" + name;
+}
+
+// Waits for an overlapped operation on the pipe, and cancels it once stop() was called
+static bool Finish(HANDLE pipe, OVERLAPPED *overlapped, HANDLE stopEvent, DWORD *bytes)
+{
+    HANDLE events[2] = {overlapped->hEvent, stopEvent};
+    if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0) {
+        CancelIo(pipe);
+        GetOverlappedResult(pipe, overlapped, bytes, TRUE);
+        return false;
+    }
+    return GetOverlappedResult(pipe, overlapped, bytes, FALSE) != FALSE;
+}
+
+bool ControlChannel::open()
+{
+    m_stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    m_ioEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (!m_stopEvent || !m_ioEvent)
+        return false;
+
+    // One instance, reused for every client in turn. The default security lets other users
+    // connect, but only read.
+    m_pipe = CreateNamedPipeA(PipePath(m_name).c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                              PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1,
+                              MAX_LINE, MAX_LINE, 0, NULL);
+    return m_pipe != INVALID_HANDLE_VALUE;
+}
+
+bool ControlChannel::connect()
+{
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = m_ioEvent;
+    ResetEvent(m_ioEvent);
+
+    if (ConnectNamedPipe(m_pipe, &overlapped))
+        return true;
+    if (GetLastError() == ERROR_PIPE_CONNECTED)
+        return true;
+
+    DWORD bytes;
+    return GetLastError() == ERROR_IO_PENDING && Finish(m_pipe, &overlapped, m_stopEvent, &bytes);
+}
+
+int ControlChannel::read(char *buffer, size_t size)
+{
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = m_ioEvent;
+
+    DWORD bytes = 0;
+    if (!ReadFile(m_pipe, buffer, (DWORD)size, NULL, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+        return -1;
+    return Finish(m_pipe, &overlapped, m_stopEvent, &bytes) ? (int)bytes : -1;
+}
+
+bool ControlChannel::write(const char *data, size_t size)
+{
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = m_ioEvent;
+
+    DWORD bytes = 0;
+    if (!WriteFile(m_pipe, data, (DWORD)size, NULL, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+        return false;
+    return Finish(m_pipe, &overlapped, m_stopEvent, &bytes) && bytes == size;
+}
+
+void ControlChannel::disconnect()
+{
+    DisconnectNamedPipe(m_pipe);
+}
+
+void ControlChannel::close()
+{
+    if (m_pipe != INVALID_HANDLE_VALUE)
+        CloseHandle(m_pipe);
+    if (m_ioEvent)
+        CloseHandle(m_ioEvent);
+    if (m_stopEvent)
+        CloseHandle(m_stopEvent);
+    m_pipe = INVALID_HANDLE_VALUE;
+    m_ioEvent = NULL;
+    m_stopEvent = NULL;
+}
+
+bool ControlChannel::send(const string &name, const string &line, string *reply)
+{
+    const string path = PipePath(name);
+    HANDLE pipe;
+    for (;;) {
+        pipe = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (pipe != INVALID_HANDLE_VALUE)
+            break;
+        // The one instance is serving another client
+        if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeA(path.c_str(), 5000))
+            return false;
+    }
+
+    const string request = line + "\n";
+    DWORD bytes;
+    bool result = WriteFile(pipe, request.data(), (DWORD)request.size(), &bytes, NULL) && bytes == request.size();
+
+    reply->clear();
+    char c;
+    while (result && ReadFile(pipe, &c, 1, &bytes, NULL) && bytes == 1 && c != '\n')
+        *reply += c;
+
+    CloseHandle(pipe);
+    return result && !reply->empty();
+}
+#else
+// An abstract socket name starts with a zero byte; there is no file to clean up
+static bool SocketAddress(const string &name, sockaddr_un *address, socklen_t *length)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (name.empty() || name.size() + 1 > sizeof(address->sun_path))
+        return false;
+    memcpy(address->sun_path + 1, name.data(), name.size());
+    *length = (socklen_t)(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+    return true;
+}
+
+// Waits until fd can be read; false once stop() was called
+static bool WaitReadable(int fd, int wake)
+{
+    pollfd fds[2] = {{fd, POLLIN, 0}, {wake, POLLIN, 0}};
+    while (::poll(fds, 2, -1) < 0) {
+        if (errno != EINTR)
+            return false;
+    }
+    return !(fds[1].revents & POLLIN);
+}
+
+bool ControlChannel::open()
+{
+    if (pipe(m_wakePipe) != 0)
+        return false;
+
+    sockaddr_un address;
+    socklen_t length;
+    if (!SocketAddress(m_name, &address, &length))
+        return false;
+
+    m_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return m_listener >= 0 && bind(m_listener, (sockaddr *)&address, length) == 0 && listen(m_listener, 1) == 0;
+}
+
+bool ControlChannel::connect()
+{
+    for (;;) {
+        if (!WaitReadable(m_listener, m_wakePipe[0]))
+            return false;
+
+        m_client = accept4(m_listener, NULL, NULL, SOCK_CLOEXEC);
+        if (m_client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return false;
+        }
+
+        // Abstract sockets have no permissions; only the same user, or root, may connect
+        ucred credentials;
+        socklen_t size = sizeof(credentials);
+        if (getsockopt(m_client, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 &&
+            (credentials.uid == getuid() || credentials.uid == 0))
+            return true;
+        disconnect();
+    }
+}
+
+int ControlChannel::read(char *buffer, size_t size)
+{
+    if (!WaitReadable(m_client, m_wakePipe[0]))
+        return -1;
+    return (int)recv(m_client, buffer, size, 0);
+}
+
+bool ControlChannel::write(const char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t sent = ::send(m_client, data, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+void ControlChannel::disconnect()
+{
+    if (m_client >= 0)
+        ::close(m_client);
+    m_client = -1;
+}
+
+void ControlChannel::close()
+{
+    disconnect();
+    if (m_listener >= 0)
+        ::close(m_listener);
+    for (int &fd : m_wakePipe) {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+    m_listener = -1;
+}
+
+bool ControlChannel::send(const string &name, const string &line, string *reply)
+{
+    sockaddr_un address;
+    socklen_t length;
+    if (!SocketAddress(name, &address, &length))
+        return false;
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+
+    const string request = line + "\n";
+    bool result = ::connect(fd, (sockaddr *)&address, length) == 0 &&
+                  ::send(fd, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size();
+
+    reply->clear();
+    char c;
+    while (result && recv(fd, &c, 1, 0) == 1 && c != '\n')
+        *reply += c;
+
+    ::close(fd);
+    return result && !reply->empty();
+}
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum ControlCommandType
+{
+    CONTROL_SET_BITRATE,    // set-bitrate <bits per second>
+    CONTROL_SET_GOP,        // set-gop <frames between IDR frames, 0 for only the first>
+    CONTROL_FORCE_IDR,      // force-idr
+    CONTROL_PAUSE,          // pause
+    CONTROL_RESUME,         // resume
+    CONTROL_START_CLIP,     // start-clip <file>
+    CONTROL_STOP_CLIP,      // stop-clip
+    CONTROL_GRAB_NOW,       // grab-now <file>
+    CONTROL_QUIT            // quit
+};
+
+struct ControlCommand
+{
+    ControlCommandType type;
+    unsigned value;
+    char path[256];         // The file of start-clip and grab-now, the rest of the line
+    int64_t received;      // Timer::nanoseconds() when it was read
+};
+
+// Lets another process reconfigure a running capture. Clients connect to the named pipe
+// \\.\pipe\<name> on Windows, or the abstract Unix socket @<name> elsewhere, which only
+// accepts processes of the same user, and send commands as lines of text. One command is
+// handed to the capture loop at a time; once it was applied, the client is answered with
+// "ok <microseconds from receipt to application>" or "error <reason>". The capture loop may
+// answer later than it takes the command, e.g. once the first frame of a clip was grabbed.
+class ControlChannel
+{
+    ControlChannel(const ControlChannel &);
+    ControlChannel &operator=(const ControlChannel &);
+
+public:
+    ControlChannel();
+    ~ControlChannel();
+
+    // Starts listening; false if the pipe or socket cannot be created, e.g. as it is in use
+    bool start(const std::string &name);
+    void stop();
+
+    // Takes the next command without waiting; false if there is none
+    bool poll(ControlCommand *command);
+
+    // Waits for the next command; false once the channel is stopped
+    bool wait(ControlCommand *command);
+
+    // Answers the command taken last, with error a string literal, or null if it was applied.
+    // No other command is taken until then.
+    void complete(const char *error);
+
+    // Sends one command line to the channel of a running capture and returns its answer
+    static bool send(const std::string &name, const std::string &line, std::string *reply);
+
+private:
+    void run();
+    bool handle(const char *line, char *reply, size_t size);
+
+    // The platform part: waiting for a client, reading and writing, all cut short by stop()
+    bool open();
+    bool connect();
+    int read(char *buffer, size_t size);
+    bool write(const char *data, size_t size);
+    void disconnect();
+    void close();
+
+    std::string m_name;
+#ifdef _WIN32
+    HANDLE m_pipe;
+    HANDLE m_stopEvent;
+    HANDLE m_ioEvent;
+#else
+    int m_listener;
+    int m_client;
+    int m_wakePipe[2];
+#endif
+    std::thread m_thread;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_ready;
+    bool m_pending;
+    bool m_done;
+    bool m_stopping;
+    ControlCommand m_command;
+    const char *m_error;
+    int64_t m_applied;
+};
@@ -0,0 +1,28 @@
+#include "CpuHog.h"
+
+#include <Trace.h>
+
+using namespace std;
+
+CpuHog::CpuHog(unsigned threads)
+    : m_stop(false)
+{
+    for (unsigned i = 0; i < threads; ++i)
+        m_threads.emplace_back(&CpuHog::spin, this);
+}
+
+CpuHog::~CpuHog()
+{
+    m_stop.store(true, memory_order_relaxed);
+    for (thread &hog : m_threads)
+        hog.join();
+}
+
+void CpuHog::spin()
+{
+    Trace::setThreadName("CPU hog");
+
+    volatile unsigned long long work = 0;
+    while (!m_stop.load(memory_order_relaxed))
+        work = work + 1;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Threads spinning at normal priority for as long as the object lives: the load of a busy
+// host, to see what it does to the grab loop without one
+class CpuHog
+{
+    CpuHog(const CpuHog &);
+    CpuHog &operator=(const CpuHog &);
+
+public:
+    explicit CpuHog(unsigned threads);
+    ~CpuHog();
+
+private:
+    void spin();
+
+    std::atomic<bool> m_stop;
+    std::vector<std::thread> m_threads;
+};
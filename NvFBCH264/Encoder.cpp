@@ -0,0 +1,20 @@
+#include "Encoder.h"
+
+static NVFBCRESULT Recreate(Encoder &encoder, NVFBC_H264_SETUP_PARAMS *params, DWORD *max_width, DWORD *max_height)
+{
+    return encoder.create(max_width, max_height) ? encoder.setUp(params) : NVFBC_ERROR_GENERIC;
+}
+
+ReconfigureResult ReconfigureEncoder(Encoder &encoder, NVFBC_H264_SETUP_PARAMS *params,
+                                     const NvFBC_H264HWEncoder_Config &previous, DWORD *max_width, DWORD *max_height)
+{
+    if (encoder.reconfigure(*params->pEncodeConfig))
+        return RECONFIGURED_IN_PLACE;
+    if (encoder.setUp(params) == NVFBC_SUCCESS || Recreate(encoder, params, max_width, max_height) == NVFBC_SUCCESS)
+        return RECONFIGURED_SET_UP_AGAIN;
+
+    // Whatever the failed attempts left of the session, the previous configuration gets a new one
+    *params->pEncodeConfig = previous;
+    return Recreate(encoder, params, max_width, max_height) == NVFBC_SUCCESS ? RECONFIGURE_RESTORED
+                                                                             : RECONFIGURE_FAILED;
+}
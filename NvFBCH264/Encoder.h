@@ -0,0 +1,83 @@
+#pragma once
+
+#include <NvFBCLibrary.h>
+#include <NvFBC/nvFBC.h>
+#include <NvFBC/nvFBCH264.h>
+
+#include <functional>
+#include <memory>
+
+// The source of H.264 frames the capture loop pulls from. NvFBCEncoder grabs from the GPU,
+// SyntheticEncoder makes frames up so the loop can run and be measured without one.
+class Encoder
+{
+public:
+    virtual ~Encoder() {}
+
+    // (Re)creates the session, reporting the largest frame it can capture
+    virtual bool create(DWORD *max_width, DWORD *max_height) = 0;
+
+    virtual NVFBCRESULT setUp(NVFBC_H264_SETUP_PARAMS *params) = 0;
+
+    virtual NVFBCRESULT grabFrame(NVFBC_H264_GRAB_FRAME_PARAMS *params) = 0;
+
+    // Applies a changed configuration to the session without setting it up again, if the
+    // encoder can. Returns false if it cannot, and the caller has to set it up again.
+    virtual bool reconfigure(const NvFBC_H264HWEncoder_Config &config)
+    {
+        (void)config;
+        return false;
+    }
+};
+
+class NvFBCEncoder : public Encoder
+{
+public:
+    explicit NvFBCEncoder(NvFBCLibrary &nvfbc)
+        : m_nvfbc(nvfbc)
+        , m_encoder(nullptr, std::bind(&NvFBCToH264HWEncoder::NvFBCH264Release, std::placeholders::_1))
+    {
+    }
+
+    bool create(DWORD *max_width, DWORD *max_height) override
+    {
+        m_encoder.reset(static_cast<NvFBCToH264HWEncoder *>(m_nvfbc.create(NVFBC_TO_H264_HW_ENCODER, max_width, max_height)));
+        return m_encoder != nullptr;
+    }
+
+    // Both fail without a session, after create() failed
+    NVFBCRESULT setUp(NVFBC_H264_SETUP_PARAMS *params) override
+    {
+        return m_encoder ? m_encoder->NvFBCH264SetUp(params) : NVFBC_ERROR_GENERIC;
+    }
+
+    NVFBCRESULT grabFrame(NVFBC_H264_GRAB_FRAME_PARAMS *params) override
+    {
+        return m_encoder ? m_encoder->NvFBCH264GrabFrame(params) : NVFBC_ERROR_GENERIC;
+    }
+
+    // NvFBCH264SetUp is the only way to configure a session, so reconfigure() keeps failing
+
+private:
+    NvFBCLibrary &m_nvfbc;
+    std::unique_ptr<NvFBCToH264HWEncoder, std::function<NVFBCRESULT(NvFBCToH264HWEncoder *)>> m_encoder;
+};
+
+// How ReconfigureEncoder() applied a configuration
+enum ReconfigureResult
+{
+    RECONFIGURED_IN_PLACE,
+    // By setting the session up again or re-creating it, which starts over with an IDR frame
+    RECONFIGURED_SET_UP_AGAIN,
+    // The encoder took none of it; the configuration is back to the previous one, in a
+    // re-created session set up with it
+    RECONFIGURE_RESTORED,
+    // Not even the previous configuration could be set up, the session is unusable
+    RECONFIGURE_FAILED,
+};
+
+// Applies *params->pEncodeConfig to the session: in place if the encoder can, otherwise by
+// setting it up again, or re-creating it if that fails. If the encoder takes none of it,
+// *params->pEncodeConfig is set back to previous and the session re-created with it.
+ReconfigureResult ReconfigureEncoder(Encoder &encoder, NVFBC_H264_SETUP_PARAMS *params,
+                                     const NvFBC_H264HWEncoder_Config &previous, DWORD *max_width, DWORD *max_height);
@@ -0,0 +1,31 @@
+#include "FramePacer.h"
+
+#include <Timer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+FramePacer::FramePacer()
+    : m_period(0)
+    , m_due(0)
+{
+}
+
+void FramePacer::setPeriod(int64_t periodNs)
+{
+    m_period = periodNs;
+    m_due = 0;
+}
+
+void FramePacer::wait()
+{
+    if (m_period == 0)
+        return;
+    const int64_t now = Timer::nanoseconds();
+    if (m_due > now)
+        this_thread::sleep_for(chrono::nanoseconds(m_due - now));
+    m_due = max(m_due, now) + m_period;
+}
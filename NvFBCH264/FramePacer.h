@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+// Spaces grabs a frame period apart. NOWAIT grabs return as soon as the desktop changed, so a
+// lower frame rate in the encoder configuration alone does not grab fewer frames.
+class FramePacer
+{
+public:
+    FramePacer();
+
+    // Grabs at most every periodNs nanoseconds from now on, as fast as frames come for 0
+    void setPeriod(int64_t periodNs);
+
+    // Sleeps until the next grab is due. A grab late by more than a period does not make up
+    // for it with grabs in a row.
+    void wait();
+
+private:
+    int64_t m_period;
+    int64_t m_due;
+};
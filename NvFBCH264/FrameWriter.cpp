@@ -0,0 +1,251 @@
+#include "FrameWriter.h"
+#include "AllocationTracker.h"
+
+#include <Metrics.h>
+#include <Probes.h>
+#include <Timer.h>
+#include <Trace.h>
+
+using namespace std;
+
+FrameWriter::FrameWriter(ostream &output, ostream *timestamps, size_t buffers, size_t buffer_size, bool flush_frames,
+                         const MemoryPlacement &placement)
+    : m_output(output)
+    , m_timestamps(timestamps)
+    , m_flushFrames(flush_frames)
+    , m_placement(placement)
+    , m_frames(buffers > 0 ? buffers : 1)
+    , m_bufferSize(buffer_size)
+    , m_queue(m_frames.size())
+    , m_queueHead(0)
+    , m_queueSize(0)
+    , m_depth(0)
+    , m_bytesWritten(0)
+    , m_writeNanoseconds(0)
+    , m_failed(false)
+    , m_firstWritten(0)
+    , m_closing(false)
+    , m_warmedUp(m_frames.size() == 1)
+    , m_width(0)
+    , m_height(0)
+{
+    Metrics &metrics = Metrics::instance();
+    m_bytesMetric = metrics.counter("nvfbc_bytes_written_total", "Bytes of encoded frames written to the output");
+    m_framesMetric = metrics.counter("nvfbc_frames_written_total", "Frames written to the output");
+    m_depthMetric = metrics.gauge("nvfbc_write_queue_depth", "Frames waiting to be written or being written");
+    m_bitrateMetric = metrics.gauge("nvfbc_output_bitrate_bits_per_second", "Bitrate written to the output over the last second");
+    m_latencyMetric = metrics.summary("nvfbc_write_latency_seconds", "Time taken to write one frame");
+
+    m_free.reserve(m_frames.size());
+    m_frames[0].data = vector<NvU8, PlacedAllocator<NvU8>>(PlacedAllocator<NvU8>(placement, &m_frames[0].placement));
+    m_frames[0].data.resize(buffer_size);
+    m_free.push_back(&m_frames[0]);
+
+    m_thread = thread(&FrameWriter::run, this);
+    if (m_frames.size() > 1)
+        m_warmUp = thread(&FrameWriter::warmUp, this, buffer_size, placement);
+}
+
+FrameWriter::~FrameWriter()
+{
+    close();
+}
+
+EncodedFrame *FrameWriter::acquire()
+{
+    unique_lock<mutex> lock(m_lock);
+    m_freed.wait(lock, [this] { return !m_free.empty(); });
+
+    EncodedFrame *frame = m_free.back();
+    m_free.pop_back();
+    const size_t buffer_size = m_bufferSize;
+    lock.unlock();
+
+    // Nothing in the buffer needs to be kept, clearing it first saves copying it over
+    if (frame->data.size() < buffer_size) {
+        TRACE_SCOPE("Grow buffer");
+        frame->data.clear();
+        frame->data.resize(buffer_size);
+    }
+    return frame;
+}
+
+void FrameWriter::submit(EncodedFrame *frame)
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_queue[(m_queueHead + m_queueSize) % m_queue.size()] = frame;
+        ++m_queueSize;
+        m_depth.store(m_queueSize, memory_order_relaxed);
+    }
+    Metrics::instance().set(m_depthMetric, (double)queueDepth());
+    m_queued.notify_one();
+}
+
+void FrameWriter::discard(EncodedFrame *frame)
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_free.push_back(frame);
+    }
+    m_freed.notify_one();
+}
+
+void FrameWriter::abandon(EncodedFrame *frame)
+{
+    // Leaked on purpose
+    new vector<NvU8, PlacedAllocator<NvU8>>(move(frame->data));
+
+    frame->data = vector<NvU8, PlacedAllocator<NvU8>>(PlacedAllocator<NvU8>(m_placement, &frame->placement));
+    discard(frame);
+}
+
+void FrameWriter::resize(size_t buffer_size)
+{
+    lock_guard<mutex> lock(m_lock);
+    m_bufferSize = buffer_size;
+}
+
+void FrameWriter::drain()
+{
+    {
+        unique_lock<mutex> lock(m_lock);
+        m_freed.wait(lock, [this] { return m_queueSize == 0; });
+    }
+    m_output.flush();
+    if (m_timestamps)
+        m_timestamps->flush();
+}
+
+void FrameWriter::clearFailure()
+{
+    m_output.clear();
+    m_failed.store(false, memory_order_relaxed);
+}
+
+void FrameWriter::warmUp(size_t buffer_size, MemoryPlacement placement)
+{
+    Trace::setThreadName("Buffer warm-up");
+    TRACE_SCOPE("Warm up buffers");
+
+    // Each buffer is handed out as soon as it is ready; nobody else touches it before
+    for (size_t i = 1; i < m_frames.size(); ++i) {
+        vector<NvU8, PlacedAllocator<NvU8>> data{PlacedAllocator<NvU8>(placement, &m_frames[i].placement)};
+        data.resize(buffer_size);
+        {
+            lock_guard<mutex> lock(m_lock);
+            m_frames[i].data = move(data);
+            m_free.push_back(&m_frames[i]);
+            m_warmedUp = i + 1 == m_frames.size();
+        }
+        m_freed.notify_all();
+    }
+}
+
+MemoryPlacement FrameWriter::placement()
+{
+    unique_lock<mutex> lock(m_lock);
+    m_freed.wait(lock, [this] { return m_warmedUp; });
+
+    MemoryPlacement actual = m_frames[0].placement;
+    for (const EncodedFrame &frame : m_frames) {
+        if (frame.placement.node != actual.node)
+            actual.node = -1;
+        actual.largePages = actual.largePages && frame.placement.largePages;
+        actual.locked = actual.locked && frame.placement.locked;
+    }
+    return actual;
+}
+
+void FrameWriter::close()
+{
+    if (m_warmUp.joinable())
+        m_warmUp.join();
+    if (!m_thread.joinable())
+        return;
+
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_closing = true;
+    }
+    m_queued.notify_one();
+    m_thread.join();
+
+    m_output.flush();
+    if (m_timestamps)
+        m_timestamps->flush();
+}
+
+void FrameWriter::run()
+{
+    Trace::setThreadName("Writer");
+    AllocationTracker::trackThread();
+
+    Metrics &metrics = Metrics::instance();
+    LONGLONG window_start = Timer::nanoseconds();
+    unsigned long long window_bytes = 0;
+
+    unique_lock<mutex> lock(m_lock);
+    for (;;) {
+        m_queued.wait(lock, [this] { return m_queueSize != 0 || m_closing; });
+        if (m_queueSize == 0)
+            break;
+
+        // The frame stays queued while being written, so it counts toward the depth
+        EncodedFrame *frame = m_queue[m_queueHead];
+        lock.unlock();
+
+        const LONGLONG start = Timer::nanoseconds();
+        PROBE_WRITE_START(frame->index, frame->size);
+        {
+            TRACE_SCOPE("Write");
+            const char* data = reinterpret_cast<const char*>(frame->data.data());
+            if (frame->sei_size != 0) {
+                m_output.write(data, frame->sei_offset);
+                m_output.write(reinterpret_cast<const char*>(frame->sei), frame->sei_size);
+                m_output.write(data + frame->sei_offset, frame->size - frame->sei_offset);
+            } else {
+                m_output.write(data, frame->size);
+            }
+            if (m_flushFrames)
+                m_output.flush();
+            if (m_timestamps) {
+                if (frame->width != m_width || frame->height != m_height) {
+                    *m_timestamps << "# resolution " << frame->width << 'x' << frame->height << '\n';
+                    m_width = frame->width;
+                    m_height = frame->height;
+                }
+                *m_timestamps << frame->timestamp << '\n';
+            }
+        }
+        PROBE_WRITE_END(frame->index, frame->size);
+        const LONGLONG end = Timer::nanoseconds();
+
+        if (!m_output)
+            m_failed.store(true, memory_order_relaxed);
+        if (m_firstWritten.load(memory_order_relaxed) == 0)
+            m_firstWritten.store(end, memory_order_relaxed);
+
+        metrics.observe(m_latencyMetric, end - start);
+        m_bytesWritten.fetch_add(frame->size + frame->sei_size, memory_order_relaxed);
+        m_writeNanoseconds.fetch_add(end - start, memory_order_relaxed);
+        metrics.add(m_bytesMetric, frame->size + frame->sei_size);
+        metrics.add(m_framesMetric);
+
+        window_bytes += frame->size + frame->sei_size;
+        const double window = (end - window_start) / 1e9;
+        if (window >= 1.0) {
+            metrics.set(m_bitrateMetric, window_bytes * 8 / window);
+            window_start = end;
+            window_bytes = 0;
+        }
+
+        lock.lock();
+        m_queueHead = (m_queueHead + 1) % m_queue.size();
+        --m_queueSize;
+        m_depth.store(m_queueSize, memory_order_relaxed);
+        metrics.set(m_depthMetric, (double)m_queueSize);
+        m_free.push_back(frame);
+        m_freed.notify_all();
+    }
+}
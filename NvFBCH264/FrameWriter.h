@@ -0,0 +1,136 @@
+#pragma once
+
+#include <NvFBC/nvFBC.h>
+#include <NumaMemory.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// An encoded frame on its way to the output
+struct EncodedFrame
+{
+    std::vector<NvU8, PlacedAllocator<NvU8>> data;
+    size_t size;
+    double timestamp;   // milliseconds since the capture started
+    unsigned index;
+    DWORD width;
+    DWORD height;
+    // An SEI NAL unit written in front of data[sei_offset], if sei_size is not 0
+    NvU8 sei[80];
+    size_t sei_size;
+    size_t sei_offset;
+    // How data was actually allocated, the last time it was
+    MemoryPlacement placement;
+};
+
+// Writes frames on a thread of its own, so a slow disk only holds up the grab loop once all
+// buffers are queued. Frames are grabbed straight into the buffers handed out by acquire().
+// The constructor allocates the first buffer only; the others are allocated and pre-faulted by
+// a thread of their own meanwhile, so the first grab does not wait for them. Apart from that
+// and the buffers growing after resize(), nothing allocates once the writer is constructed.
+class FrameWriter
+{
+    FrameWriter(const FrameWriter &);
+    FrameWriter &operator=(const FrameWriter &);
+
+public:
+    // timestamps, if not null, receives the timestamp of every written frame on a line, and a
+    // "# resolution WxH" comment in front of the first frame and every one changing it.
+    // flush_frames flushes the output after every frame, for live consumers.
+    // The buffers are allocated as placement asks.
+    FrameWriter(std::ostream &output, std::ostream *timestamps, size_t buffers, size_t buffer_size, bool flush_frames = false,
+                const MemoryPlacement &placement = DefaultPlacement());
+    ~FrameWriter();
+
+    // Returns a free buffer, waiting while all of them are queued
+    EncodedFrame *acquire();
+
+    // Queues the frame for writing; size, timestamp, index, width, height and sei_size must be set
+    void submit(EncodedFrame *frame);
+
+    // Returns a frame to the free buffers without writing it
+    void discard(EncodedFrame *frame);
+
+    // Returns the frame to the free buffers without its buffer, which is left to whatever may
+    // still be writing into it, e.g. a grab which was given up on. acquire() gives it a new one.
+    void abandon(EncodedFrame *frame);
+
+    // Makes the buffers at least buffer_size bytes large from now on. Each one grows when
+    // acquire() hands it out, so the frames queued meanwhile are written as they are and the
+    // buffers which are large enough already are kept.
+    void resize(size_t buffer_size);
+
+    // Waits until all queued frames are written and flushes the output, which can then be
+    // closed or reopened on another file until the next frame is queued
+    void drain();
+
+    // Writes all queued frames and stops the thread
+    void close();
+
+    // Frames queued or being written
+    size_t queueDepth() const { return m_depth.load(std::memory_order_relaxed); }
+
+    // Frames which can be queued at most
+    size_t queueSize() const { return m_queue.size(); }
+
+    // Bytes written so far, and the time spent writing them
+    unsigned long long bytesWritten() const { return m_bytesWritten.load(std::memory_order_relaxed); }
+    unsigned long long writeNanoseconds() const { return m_writeNanoseconds.load(std::memory_order_relaxed); }
+
+    bool failed() const { return m_failed.load(std::memory_order_relaxed); }
+
+    // Forgets a failed write once drained, e.g. before the output is reopened on another file
+    void clearFailure();
+
+    // Timer::nanoseconds() when the first frame was written, 0 until then
+    LONGLONG firstWritten() const { return m_firstWritten.load(std::memory_order_relaxed); }
+
+    // Restricts the writer thread to one logical CPU
+    bool pin(int cpu) { return PinThread(m_thread, cpu); }
+
+    // How the buffers were actually allocated: the node all of them are on, -1 if they are not
+    // all on the same one, and large pages or locked only if all of them are. Waits until all
+    // buffers are allocated.
+    MemoryPlacement placement();
+
+private:
+    void run();
+    void warmUp(size_t buffer_size, MemoryPlacement placement);
+
+    std::ostream &m_output;
+    std::ostream *m_timestamps;
+    bool m_flushFrames;
+    MemoryPlacement m_placement;
+    std::vector<EncodedFrame> m_frames;
+    size_t m_bufferSize;
+    std::vector<EncodedFrame *> m_free;
+    // Ring of queued frames; there are never more than m_frames.size()
+    std::vector<EncodedFrame *> m_queue;
+    size_t m_queueHead;
+    size_t m_queueSize;
+    std::mutex m_lock;
+    std::condition_variable m_queued;
+    std::condition_variable m_freed;
+    std::atomic<size_t> m_depth;
+    std::atomic<unsigned long long> m_bytesWritten;
+    std::atomic<unsigned long long> m_writeNanoseconds;
+    std::atomic<bool> m_failed;
+    std::atomic<LONGLONG> m_firstWritten;
+    bool m_closing;
+    bool m_warmedUp;
+    // Resolution of the last frame written, for the timestamps comments
+    DWORD m_width;
+    DWORD m_height;
+    std::thread m_thread;
+    std::thread m_warmUp;
+
+    int m_bytesMetric;
+    int m_framesMetric;
+    int m_depthMetric;
+    int m_bitrateMetric;
+    int m_latencyMetric;
+};
@@ -0,0 +1,140 @@
+#include "GrabThread.h"
+
+#include <Timer.h>
+
+#include <chrono>
+
+using namespace std;
+
+GrabThread::GrabThread()
+    : m_state(make_shared<State>())
+    , m_params(nullptr)
+    , m_started(0)
+{
+    m_thread = std::thread(&GrabThread::run, m_state);
+}
+
+GrabThread::~GrabThread()
+{
+    bool stuck;
+    {
+        lock_guard<mutex> lock(m_state->lock);
+        m_state->stopping = true;
+        stuck = m_state->busy;
+    }
+    m_state->wake.notify_one();
+
+    if (stuck)
+        m_thread.detach();
+    else
+        m_thread.join();
+}
+
+void GrabThread::run(shared_ptr<State> state)
+{
+    unique_lock<mutex> lock(state->lock);
+    for (;;) {
+        state->wake.wait(lock, [&state] { return state->stopping || state->busy; });
+        if (state->stopping)
+            break;
+
+        lock.unlock();
+        NVFBCRESULT result = NVFBC_SUCCESS;
+        if (state->job)
+            (*state->job)();
+        else
+            result = state->encoder->grabFrame(&state->params);
+        lock.lock();
+
+        state->result = result;
+        state->job = nullptr;
+        state->encoder = nullptr;
+        state->busy = false;
+        state->done.notify_one();
+    }
+}
+
+void GrabThread::invoke(const function<void()> &job)
+{
+    unique_lock<mutex> lock(m_state->lock);
+    m_state->job = &job;
+    m_state->busy = true;
+    m_state->wake.notify_one();
+    m_state->done.wait(lock, [this] { return !m_state->busy; });
+}
+
+void GrabThread::start(Encoder &encoder, NVFBC_H264_GRAB_FRAME_PARAMS *params)
+{
+    lock_guard<mutex> lock(m_state->lock);
+
+    m_params = params;
+    m_state->params = *params;
+    if (params->pEncodeParams) {
+        m_state->encodeParams = *params->pEncodeParams;
+        m_state->params.pEncodeParams = &m_state->encodeParams;
+    }
+    if (params->pFrameInfo) {
+        m_state->frameInfo = *params->pFrameInfo;
+        m_state->params.pFrameInfo = &m_state->frameInfo;
+    }
+    if (params->pNvFBCFrameGrabInfo) {
+        m_state->grabInfo = *params->pNvFBCFrameGrabInfo;
+        m_state->params.pNvFBCFrameGrabInfo = &m_state->grabInfo;
+    }
+
+    m_state->encoder = &encoder;
+    m_state->busy = true;
+    m_started = Timer::nanoseconds();
+    m_state->wake.notify_one();
+}
+
+bool GrabThread::waitFor(LONGLONG timeoutNs, NVFBCRESULT *result)
+{
+    unique_lock<mutex> lock(m_state->lock);
+    if (!m_state->done.wait_for(lock, chrono::nanoseconds(timeoutNs > 0 ? timeoutNs : 0), [this] { return !m_state->busy; }))
+        return false;
+
+    finish(result);
+    return true;
+}
+
+bool GrabThread::waitRunning(LONGLONG runningNs, NVFBCRESULT *result)
+{
+    return waitFor(m_started + runningNs - Timer::nanoseconds(), result);
+}
+
+void GrabThread::wait(NVFBCRESULT *result)
+{
+    unique_lock<mutex> lock(m_state->lock);
+    m_state->done.wait(lock, [this] { return !m_state->busy; });
+    finish(result);
+}
+
+// Called with the lock held, once the grab returned
+void GrabThread::finish(NVFBCRESULT *result)
+{
+    *result = m_state->result;
+    if (m_params->pFrameInfo)
+        *m_params->pFrameInfo = m_state->frameInfo;
+    if (m_params->pNvFBCFrameGrabInfo)
+        *m_params->pNvFBCFrameGrabInfo = m_state->grabInfo;
+}
+
+bool GrabThread::busy() const
+{
+    lock_guard<mutex> lock(m_state->lock);
+    return m_state->busy;
+}
+
+void GrabThread::abandon()
+{
+    {
+        lock_guard<mutex> lock(m_state->lock);
+        m_state->stopping = true;
+    }
+    m_thread.detach();
+
+    m_state = make_shared<State>();
+    m_params = nullptr;
+    m_thread = std::thread(&GrabThread::run, m_state);
+}
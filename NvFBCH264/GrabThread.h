@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Encoder.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Makes the calls into the capture session on a thread of its own, so the capture loop can
+// give up on a grab which never returns, as NvFBCH264GrabFrame does after some driver resets.
+// A grab works on copies of the grab and frame info, so one which returns after it was given
+// up on only writes into its own state and the frame buffer it was handed.
+class GrabThread
+{
+    GrabThread(const GrabThread &);
+    GrabThread &operator=(const GrabThread &);
+
+public:
+    GrabThread();
+
+    // Joins the thread, or leaves it behind if it is stuck in a grab
+    ~GrabThread();
+
+    // Runs job on the thread and waits for it, e.g. to create the session there
+    void invoke(const std::function<void()> &job);
+
+    // Starts a grab into params. Nothing else may run on the thread until it is waited for.
+    void start(Encoder &encoder, NVFBC_H264_GRAB_FRAME_PARAMS *params);
+
+    // Waits up to timeoutNs for the grab to return. Returns false if it is still running,
+    // otherwise stores its result and copies the grab and frame info back into params.
+    bool waitFor(LONGLONG timeoutNs, NVFBCRESULT *result);
+    void wait(NVFBCRESULT *result);
+
+    // Like waitFor, but until the grab has been running for runningNs since start(), so the
+    // time the caller spent before starting it, e.g. waiting for a free buffer, never counts
+    bool waitRunning(LONGLONG runningNs, NVFBCRESULT *result);
+
+    // Whether a grab is running, which the destructor would leave behind with its encoder
+    bool busy() const;
+
+    // Timer::nanoseconds() when the last grab was started
+    LONGLONG started() const { return m_started; }
+
+    // Gives up on a stuck grab and carries on with a new thread. The stuck one keeps its
+    // encoder and frame buffer, neither of which may be used or freed again.
+    void abandon();
+
+    std::thread &thread() { return m_thread; }
+
+private:
+    struct State
+    {
+        State()
+            : stopping(false)
+            , job(nullptr)
+            , encoder(nullptr)
+            , busy(false)
+            , result(NVFBC_SUCCESS)
+        {
+        }
+
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        bool stopping;
+        const std::function<void()> *job;
+        Encoder *encoder;
+        bool busy;
+        NVFBCRESULT result;
+        NVFBC_H264_GRAB_FRAME_PARAMS params;
+        NvFBC_H264HWEncoder_EncodeParams encodeParams;
+        NvFBC_H264HWEncoder_FrameInfo frameInfo;
+        NvFBCFrameGrabInfo grabInfo;
+    };
+
+    // Takes its own reference to the state, which outlives the object if the thread is stuck
+    static void run(std::shared_ptr<State> state);
+
+    void finish(NVFBCRESULT *result);
+
+    std::shared_ptr<State> m_state;
+    std::thread m_thread;
+    NVFBC_H264_GRAB_FRAME_PARAMS *m_params;
+    LONGLONG m_started;
+};
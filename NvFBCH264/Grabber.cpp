@@ -0,0 +1,138 @@
+#include "Grabber.h"
+
+#include <H264Bitstream.h>
+#include <Probes.h>
+#include <Trace.h>
+
+#include <string.h>
+
+using namespace std;
+
+Grabber::Grabber(unique_ptr<Encoder> &encoder, GrabThread *thread, NVFBC_H264_SETUP_PARAMS *setupParams,
+                 DWORD *maxWidth, DWORD *maxHeight)
+    : m_encoder(encoder)
+    , m_thread(thread)
+    , m_setupParams(setupParams)
+    , m_maxWidth(maxWidth)
+    , m_maxHeight(maxHeight)
+    , m_reportNs(0)
+    , m_timeoutNs(0)
+    , m_forceIdr(false)
+    , m_width(0)
+    , m_height(0)
+{
+    memset(&m_grabInfo, 0, sizeof(m_grabInfo));
+    memset(&m_frameInfo, 0, sizeof(m_frameInfo));
+    memset(&m_encodeParams, 0, sizeof(m_encodeParams));
+    m_encodeParams.dwVersion = NVFBC_H264HWENC_PARAMS_VER;
+    m_encodeParams.bForceIDRFrame = TRUE;
+}
+
+void Grabber::setTimeouts(LONGLONG reportNs, LONGLONG timeoutNs)
+{
+    m_reportNs = reportNs;
+    m_timeoutNs = timeoutNs;
+}
+
+void Grabber::call(const function<void()> &job)
+{
+    if (m_thread)
+        m_thread->invoke(job);
+    else
+        job();
+}
+
+NVFBCRESULT Grabber::recreate()
+{
+    TRACE_SCOPE("Recreate session");
+    NVFBCRESULT result = NVFBC_SUCCESS;
+    call([&] {
+        result = m_encoder->create(m_maxWidth, m_maxHeight) ? m_encoder->setUp(m_setupParams) : NVFBC_ERROR_GENERIC;
+    });
+    PROBE_SESSION_RECREATE(result);
+    return result;
+}
+
+NVFBCRESULT Grabber::setUp()
+{
+    NVFBCRESULT result = NVFBC_SUCCESS;
+    call([&] { result = m_encoder->setUp(m_setupParams); });
+    return result;
+}
+
+NVFBCRESULT Grabber::recover(GrabStatus status)
+{
+    if (status == GRAB_STALLED) {
+        // The stuck grab keeps its thread and session, grabs go on with new ones
+        m_thread->abandon();
+        m_encoder.release();  // leaked, the stuck grab is still in it
+        m_encoder.reset(makeEncoder());
+        if (prepareThread)
+            m_thread->invoke(prepareThread);
+    }
+    m_forceIdr.store(true, memory_order_relaxed);
+    return recreate();
+}
+
+GrabStatus Grabber::grab(NvU8 *buffer, NVFBCRESULT *result)
+{
+    // A request made meanwhile is kept for the next grab unless this one brings a frame
+    const bool idr = m_forceIdr.exchange(false, memory_order_relaxed);
+
+    memset(&m_grabInfo, 0, sizeof(m_grabInfo));
+    memset(&m_frameInfo, 0, sizeof(m_frameInfo));
+    memset(&m_params, 0, sizeof(m_params));
+    m_params.dwVersion = NVFBC_H264_GRAB_FRAME_PARAMS_VER;
+    m_params.dwFlags = NVFBC_TOH264_NOWAIT;
+    m_params.pNvFBCFrameGrabInfo = &m_grabInfo;
+    m_params.pFrameInfo = &m_frameInfo;
+    m_params.pBitStreamBuffer = buffer;
+    m_params.pEncodeParams = idr ? &m_encodeParams : nullptr;
+
+    bool returned = true;
+    {
+        TRACE_SCOPE("Grab");
+        if (!m_thread) {
+            *result = m_encoder->grabFrame(&m_params);
+        } else {
+            m_thread->start(*m_encoder, &m_params);
+            returned = m_reportNs != 0 && m_thread->waitRunning(m_reportNs, result);
+            if (!returned && m_reportNs != 0 && onStall)
+                onStall();
+            if (!returned && m_timeoutNs == 0) {
+                m_thread->wait(result);
+                returned = true;
+            } else if (!returned) {
+                returned = m_thread->waitRunning(m_timeoutNs, result);
+            }
+        }
+    }
+
+    if (!returned) {
+        *result = NVFBC_ERROR_GENERIC;
+        return GRAB_STALLED;
+    }
+
+    GrabStatus status = GRAB_FRAME;
+    if (*result == NVFBC_ERROR_INVALIDATED_SESSION) {
+        status = GRAB_INVALIDATED;
+    } else if (*result != NVFBC_SUCCESS) {
+        status = GRAB_FAILED;
+    } else if (m_frameInfo.dwByteSize == 0) {
+        status = GRAB_EMPTY;
+    } else if (m_grabInfo.dwWidth != m_width || m_grabInfo.dwHeight != m_height) {
+        // Frames of a new resolution have to start with an SPS and an IDR frame, or decoders
+        // go on with the old one
+        if (m_width != 0 && !IsIdrAccessUnit(buffer, m_frameInfo.dwByteSize)) {
+            TRACE_INSTANT("Waiting for IDR");
+            m_forceIdr.store(true, memory_order_relaxed);
+            return GRAB_DROPPED;
+        }
+        m_width = m_grabInfo.dwWidth;
+        m_height = m_grabInfo.dwHeight;
+    }
+
+    if (status != GRAB_FRAME && idr)
+        m_forceIdr.store(true, memory_order_relaxed);
+    return status;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Encoder.h"
+#include "GrabThread.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// What a grab of Grabber brought
+enum GrabStatus
+{
+    GRAB_FRAME,         // A frame to keep, in the buffer
+    GRAB_EMPTY,         // Nothing changed since the previous grab
+    GRAB_DROPPED,       // A frame of a new resolution ahead of its IDR frame, which is forced next
+    GRAB_INVALIDATED,   // The session has to be re-created with recover()
+    GRAB_STALLED,       // The grab is still running after the timeout and keeps the buffer; recover()
+                        // gives up on it
+    GRAB_FAILED,        // result tells why
+};
+
+// The grab step of the capture loop, shared by NvFBCH264 and CaptureSession: one NOWAIT grab
+// into a buffer, made on the grab thread if there is one. A grab which runs for longer than
+// the timeout is given up on, leaving its thread and session to it, and the session re-created
+// with a new encoder on a new thread; an invalidated session is re-created as it is. After a
+// resolution change, frames are dropped until the first IDR frame, which is forced.
+//
+// The encoder, grab thread, setup parameters and largest frame size belong to the caller,
+// which may use them between grabs; the encoder is replaced after a stalled grab.
+class Grabber
+{
+    Grabber(const Grabber &);
+    Grabber &operator=(const Grabber &);
+
+public:
+    // Without a thread, grabs are made on the calling thread and never time out
+    Grabber(std::unique_ptr<Encoder> &encoder, GrabThread *thread, NVFBC_H264_SETUP_PARAMS *setupParams,
+            DWORD *maxWidth, DWORD *maxHeight);
+
+    // Makes the encoder which replaces one a grab stalled in
+    std::function<Encoder *()> makeEncoder;
+    // Called once a grab has been running for the report time, e.g. to log where it is stuck
+    std::function<void()> onStall;
+    // Run on every new grab thread before the session is created on it
+    std::function<void()> prepareThread;
+
+    // Reports a grab once it has been running for reportNs and gives up on it after timeoutNs;
+    // 0 does neither
+    void setTimeouts(LONGLONG reportNs, LONGLONG timeoutNs);
+
+    // Makes the next frame returned an IDR frame; from any thread
+    void requestIdr() { m_forceIdr.store(true, std::memory_order_relaxed); }
+
+    // Grabs into buffer, which has to hold a frame of the largest size
+    GrabStatus grab(NvU8 *buffer, NVFBCRESULT *result);
+
+    // Creates the session again and sets it up, after GRAB_STALLED with a new encoder on a new
+    // thread; the new session starts with an IDR frame
+    NVFBCRESULT recover(GrabStatus status);
+
+    // The largest frame the session makes, which the buffers have to hold
+    size_t maxFrameSize() const { return (size_t)*m_maxWidth * *m_maxHeight; }
+
+    // Of the last grab
+    const NvFBCFrameGrabInfo &grabInfo() const { return m_grabInfo; }
+    const NvFBC_H264HWEncoder_FrameInfo &frameInfo() const { return m_frameInfo; }
+
+    // Creates the session again and sets it up, on the grab thread if there is one
+    NVFBCRESULT recreate();
+
+    // Sets the session up again with the setup parameters, e.g. after they changed
+    NVFBCRESULT setUp();
+
+    // Runs job on the grab thread if there is one, otherwise here
+    void call(const std::function<void()> &job);
+
+private:
+    std::unique_ptr<Encoder> &m_encoder;
+    GrabThread *m_thread;
+    NVFBC_H264_SETUP_PARAMS *m_setupParams;
+    DWORD *m_maxWidth;
+    DWORD *m_maxHeight;
+    LONGLONG m_reportNs;
+    LONGLONG m_timeoutNs;
+    std::atomic<bool> m_forceIdr;
+    // Resolution of the last frame returned
+    DWORD m_width;
+    DWORD m_height;
+
+    NvFBCFrameGrabInfo m_grabInfo;
+    NvFBC_H264HWEncoder_FrameInfo m_frameInfo;
+    NvFBC_H264HWEncoder_EncodeParams m_encodeParams;
+    NVFBC_H264_GRAB_FRAME_PARAMS m_params;
+};
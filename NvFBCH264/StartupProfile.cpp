@@ -0,0 +1,52 @@
+#include "StartupProfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+using namespace std;
+
+StartupProfile::StartupProfile()
+    : m_start(now())
+    , m_count(0)
+{
+}
+
+int64_t StartupProfile::now()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void StartupProfile::record(const char *step, int64_t start)
+{
+    const int64_t end = now();
+
+    lock_guard<mutex> lock(m_lock);
+    if (m_count == MAX_STEPS)
+        return;
+    m_steps[m_count].name = step;
+    m_steps[m_count].start = start;
+    m_steps[m_count].end = end;
+    ++m_count;
+}
+
+void StartupProfile::report(ostream &out, int64_t firstFrame) const
+{
+    lock_guard<mutex> lock(m_lock);
+
+    // In the order they started, which is not the order they ended in
+    Step steps[MAX_STEPS];
+    copy(m_steps, m_steps + m_count, steps);
+    sort(steps, steps + m_count, [](const Step &a, const Step &b) { return a.start < b.start; });
+
+    const ios::fmtflags flags = out.flags();
+    const streamsize precision = out.precision();
+    out << fixed << setprecision(1) << "Startup took " << (firstFrame - m_start) / 1e6
+        << " ms to the first frame written:\n";
+    for (size_t i = 0; i < m_count; ++i) {
+        out << "  " << left << setw(20) << steps[i].name << right << setw(8) << (steps[i].start - m_start) / 1e6
+            << " ms +" << setw(8) << (steps[i].end - steps[i].start) / 1e6 << " ms\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+// Records how long the steps from the start of main to the first written frame took. Steps
+// may run on several threads at once, so each one is kept with when it started and ended,
+// and the report shows which overlapped. Times come from steady_clock rather than Timer,
+// whose calibration is one of the steps.
+class StartupProfile
+{
+    StartupProfile(const StartupProfile &);
+    StartupProfile &operator=(const StartupProfile &);
+
+public:
+    // The profile starts when it is constructed
+    StartupProfile();
+
+    int64_t start() const { return m_start; }
+
+    // steady_clock time in nanoseconds, which steps start and end at
+    static int64_t now();
+
+    // Records a step which started at start and ends now. Steps past the first MAX_STEPS are
+    // dropped.
+    void record(const char *step, int64_t start);
+
+    // Prints every step with its start and duration in milliseconds after the start of the
+    // profile, and the time to firstFrame
+    void report(std::ostream &out, int64_t firstFrame) const;
+
+private:
+    enum { MAX_STEPS = 16 };
+
+    struct Step
+    {
+        const char *name;
+        int64_t start;
+        int64_t end;
+    };
+
+    int64_t m_start;
+    mutable std::mutex m_lock;
+    Step m_steps[MAX_STEPS];
+    size_t m_count;
+};
@@ -0,0 +1,196 @@
+#include "SyntheticEncoder.h"
+
+#include <H264Bitstream.h>
+
+#include <algorithm>
+#include <string.h>
+#include <thread>
+
+using namespace std;
+
+SyntheticEncoder::SyntheticEncoder(DWORD width, DWORD height, double static_ratio, bool paced)
+    : m_width(width)
+    , m_height(height)
+    , m_maxWidth(width)
+    , m_maxHeight(height)
+    , m_staticRatio(static_ratio)
+    , m_paced(paced)
+    , m_config()
+    , m_setUp(false)
+    , m_sinceIdr(0)
+    , m_grabs(0)
+    , m_stallGrab(0)
+    , m_stallMs(0)
+    , m_resizeGrab(0)
+    , m_newWidth(0)
+    , m_newHeight(0)
+    , m_encodeMs(0)
+    , m_random(0x4E564643)
+{
+}
+
+bool SyntheticEncoder::create(DWORD *max_width, DWORD *max_height)
+{
+    *max_width = m_maxWidth = m_width;
+    *max_height = m_maxHeight = m_height;
+    m_setUp = false;
+    return true;
+}
+
+NVFBCRESULT SyntheticEncoder::setUp(NVFBC_H264_SETUP_PARAMS *params)
+{
+    if (!params || !params->pEncodeConfig || params->pEncodeConfig->dwFrameRateNum == 0)
+        return NVFBC_ERROR_GENERIC;
+
+    m_config = *params->pEncodeConfig;
+    if (m_config.dwFrameRateDen == 0)
+        m_config.dwFrameRateDen = 1;
+
+    m_setUp = true;
+    m_sinceIdr = 0;
+    m_nextGrab = chrono::steady_clock::now();
+    return NVFBC_SUCCESS;
+}
+
+bool SyntheticEncoder::reconfigure(const NvFBC_H264HWEncoder_Config &config)
+{
+    if (!m_setUp || config.ePresetConfig != m_config.ePresetConfig || config.eRateControl != m_config.eRateControl ||
+        config.dwFrameRateNum != m_config.dwFrameRateNum || config.dwFrameRateDen != m_config.dwFrameRateDen ||
+        config.dwGOPLength != m_config.dwGOPLength)
+        return false;
+
+    m_config.dwAvgBitRate = config.dwAvgBitRate;
+    m_config.dwPeakBitRate = config.dwPeakBitRate;
+    return true;
+}
+
+BYTE *SyntheticEncoder::writeNal(BYTE *out, int type, size_t size)
+{
+    static const BYTE startCode[] = {0, 0, 0, 1};
+    memcpy(out, startCode, sizeof(startCode));
+    out += sizeof(startCode);
+
+    int refIdc = type == H264_NAL_SLICE || type == H264_NAL_IDR || type == H264_NAL_SPS || type == H264_NAL_PPS ? 3 : 0;
+    *out++ = (BYTE)(refIdc << 5 | type);
+
+    // Nonzero payload, so no start code is emulated and the last byte is never taken for trailing zeros.
+    // The bytes come eight at a time from a xorshift seeded by m_random, which is too slow for
+    // unpaced benchmarks at 8K lossless sizes.
+    uint64_t state = (uint64_t)m_random() << 32 | m_random() | 1;
+    for (size_t i = 1; i < size; i += 8) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        uint64_t bits = state * 0x2545F4914F6CDD1DULL;
+        for (size_t j = i; j < min(i + 8, size); ++j, bits >>= 8)
+            *out++ = (BYTE)(bits & 0xFF ? bits & 0xFF : 1);
+    }
+    return out;
+}
+
+void SyntheticEncoder::stall(unsigned grab, DWORD ms)
+{
+    m_stallGrab = grab;
+    m_stallMs = ms;
+}
+
+void SyntheticEncoder::changeResolution(unsigned grab, DWORD width, DWORD height)
+{
+    m_resizeGrab = grab;
+    m_newWidth = width;
+    m_newHeight = height;
+}
+
+void SyntheticEncoder::setEncodeCost(double ms)
+{
+    m_encodeMs = ms;
+}
+
+NVFBCRESULT SyntheticEncoder::grabFrame(NVFBC_H264_GRAB_FRAME_PARAMS *params)
+{
+    if (!m_setUp)
+        return NVFBC_ERROR_GENERIC;
+
+    if (++m_grabs == m_stallGrab) {
+        if (m_stallMs == INFINITE) {
+            for (;;)
+                this_thread::sleep_for(chrono::hours(1));
+        }
+        this_thread::sleep_for(chrono::milliseconds(m_stallMs));
+        m_nextGrab = chrono::steady_clock::now();
+    }
+
+    if (m_grabs == m_resizeGrab) {
+        m_width = m_newWidth;
+        m_height = m_newHeight;
+        if (m_width > m_maxWidth || m_height > m_maxHeight) {
+            m_setUp = false;
+            return NVFBC_ERROR_INVALIDATED_SESSION;
+        }
+    }
+
+    if (m_paced) {
+        const chrono::nanoseconds period(1'000'000'000LL * m_config.dwFrameRateDen / m_config.dwFrameRateNum);
+        // The desktop does not keep the frames of a pause, the first grab after one returns at once
+        const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if (m_nextGrab < now - period)
+            m_nextGrab = now;
+        this_thread::sleep_until(m_nextGrab);
+        m_nextGrab += period;
+    }
+
+    size_t capacity = (size_t)m_width * m_height;
+    size_t macroblocks = ((m_width + 15) / 16) * ((m_height + 15) / 16);
+    bool lossless = m_config.ePresetConfig == NVFBC_H264_PRESET_LOSSLESS_HP;
+
+    // A GOP length of 0 means only the first frame is an IDR
+    bool idr = m_sinceIdr == 0 || (m_config.dwGOPLength != 0 && m_sinceIdr >= m_config.dwGOPLength) ||
+               (params->pEncodeParams && params->pEncodeParams->bForceIDRFrame);
+    bool unchanged = !idr && uniform_real_distribution<double>(0, 1)(m_random) < m_staticRatio;
+
+    if (m_encodeMs > 0 && !unchanged) {
+        double cost = m_encodeMs * macroblocks / (120 * 68);
+        if (m_config.dwProfile == 100)
+            cost *= 1.15;
+        else if (m_config.dwProfile == 66)
+            cost *= 0.8;
+        if (m_config.bEnableYUV444Encoding)
+            cost *= 1.5;
+        if (lossless)
+            cost *= 2;
+        this_thread::sleep_for(chrono::duration<double, milli>(cost));
+        // A frame which took longer than a period delays the ones after it
+        if (m_paced)
+            m_nextGrab = max(m_nextGrab, chrono::steady_clock::now());
+    }
+
+    size_t slice_size;
+    if (unchanged) {
+        // Slice header and one mb_skip_run covering the picture
+        slice_size = 8 + macroblocks / 2048;
+    } else {
+        double average = lossless ? capacity / 12.0 : m_config.dwAvgBitRate / 8.0 * m_config.dwFrameRateDen / m_config.dwFrameRateNum;
+        double scale = idr ? 4.0 : uniform_real_distribution<double>(0.25, 1.75)(m_random);
+        slice_size = max<size_t>(64, (size_t)(average * scale));
+    }
+    slice_size = min(slice_size, capacity - 64);
+
+    BYTE *out = params->pBitStreamBuffer;
+    if (idr) {
+        out = writeNal(out, H264_NAL_SPS, 12);
+        out = writeNal(out, H264_NAL_PPS, 5);
+        m_sinceIdr = 0;
+    }
+    out = writeNal(out, idr ? H264_NAL_IDR : H264_NAL_SLICE, slice_size);
+    ++m_sinceIdr;
+
+    if (params->pFrameInfo) {
+        params->pFrameInfo->dwByteSize = (DWORD)(out - params->pBitStreamBuffer);
+    }
+    if (params->pNvFBCFrameGrabInfo) {
+        params->pNvFBCFrameGrabInfo->dwWidth = m_width;
+        params->pNvFBCFrameGrabInfo->dwHeight = m_height;
+        params->pNvFBCFrameGrabInfo->dwBufferWidth = m_width;
+    }
+    return NVFBC_SUCCESS;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Encoder.h"
+
+#include <chrono>
+#include <random>
+
+// Makes up a stream shaped like the one NvFBC produces: in-band SPS/PPS in front of every IDR,
+// frame sizes following the configured bitrate (or typical lossless sizes), and all-skip
+// P frames of a few bytes for the share of frames in which the desktop did not change. Like
+// NVENC's, every P frame is a reference frame.
+// Grabs are paced to the configured frame rate, like blocking grabs on a busy desktop,
+// unless paced is false, which lets benchmarks grab as fast as frames can be made up.
+// stall() makes a grab block, like NvFBC grabs after some driver resets,
+// changeResolution() changes the desktop resolution in the middle of the capture, and
+// setEncodeCost() makes the encoder too slow for some configurations, to try --autotune.
+class SyntheticEncoder : public Encoder
+{
+public:
+    SyntheticEncoder(DWORD width, DWORD height, double static_ratio, bool paced = true);
+
+    bool create(DWORD *max_width, DWORD *max_height) override;
+    NVFBCRESULT setUp(NVFBC_H264_SETUP_PARAMS *params) override;
+    NVFBCRESULT grabFrame(NVFBC_H264_GRAB_FRAME_PARAMS *params) override;
+
+    // Changes the bitrate in place, like encoders with dynamic bitrate support; anything else,
+    // the GOP length included, needs the session to be set up again
+    bool reconfigure(const NvFBC_H264HWEncoder_Config &config) override;
+
+    // Makes the grab-th grab of this encoder block for ms milliseconds, INFINITE for ever
+    void stall(unsigned grab, DWORD ms);
+
+    // Changes the resolution to width x height from the grab-th grab of this encoder on. If the
+    // frames no longer fit the buffers of the session, that grab invalidates it; otherwise the
+    // session goes on with P frames until an IDR frame is due or forced.
+    void changeResolution(unsigned grab, DWORD width, DWORD height);
+
+    // Makes every changed frame take ms milliseconds to encode at 1920x1080 with the Main
+    // profile, scaled by the macroblocks and by the extra work of the High profile (x1.15),
+    // YUV444 (x1.5) and lossless encoding (x2), or the lesser of the Baseline profile (x0.8).
+    // A grab then returns a frame period after the previous one or once the frame is encoded,
+    // whichever is later, so configurations too slow for the frame rate grab fewer frames.
+    void setEncodeCost(double ms);
+
+private:
+    BYTE *writeNal(BYTE *out, int type, size_t size);
+
+    DWORD m_width;
+    DWORD m_height;
+    DWORD m_maxWidth;
+    DWORD m_maxHeight;
+    double m_staticRatio;
+    bool m_paced;
+    NvFBC_H264HWEncoder_Config m_config;
+    bool m_setUp;
+    unsigned m_sinceIdr;
+    unsigned m_grabs;
+    unsigned m_stallGrab;
+    DWORD m_stallMs;
+    unsigned m_resizeGrab;
+    DWORD m_newWidth;
+    DWORD m_newHeight;
+    double m_encodeMs;
+    std::chrono::steady_clock::time_point m_nextGrab;
+    std::mt19937 m_random;
+};
@@ -0,0 +1,54 @@
+#include "ThrottledBuffer.h"
+
+#include <Timer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+ThrottledBuffer::ThrottledBuffer(streambuf *target, double bytesPerSecond, double from, double to)
+    : m_target(target)
+    , m_rate(bytesPerSecond)
+    , m_start(0)
+    , m_from((int64_t)(from * 1e9))
+    , m_to(to > 0 ? (int64_t)(to * 1e9) : 0)
+    , m_due(0)
+{
+}
+
+void ThrottledBuffer::throttle(streamsize size)
+{
+    if (m_rate <= 0)
+        return;
+    const int64_t now = Timer::nanoseconds();
+    if (m_start == 0)
+        m_start = now;
+    const int64_t elapsed = now - m_start;
+    if (elapsed < m_from || (m_to != 0 && elapsed >= m_to))
+        return;
+
+    m_due = max(m_due, now) + (int64_t)(size / m_rate * 1e9);
+    if (m_due > now)
+        this_thread::sleep_for(chrono::nanoseconds(m_due - now));
+}
+
+streamsize ThrottledBuffer::xsputn(const char *data, streamsize size)
+{
+    throttle(size);
+    return m_target->sputn(data, size);
+}
+
+ThrottledBuffer::int_type ThrottledBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+    throttle(1);
+    return m_target->sputc(traits_type::to_char_type(c));
+}
+
+int ThrottledBuffer::sync()
+{
+    return m_target->pubsync();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <streambuf>
+
+// Passes what is written on to another stream buffer, no faster than a given rate between two
+// points in time, to see what a slow disk or consumer does to the capture
+class ThrottledBuffer : public std::streambuf
+{
+public:
+    // The times are seconds after the first write; to may be 0 to throttle for ever
+    ThrottledBuffer(std::streambuf *target, double bytesPerSecond, double from, double to);
+
+protected:
+    std::streamsize xsputn(const char *data, std::streamsize size) override;
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+private:
+    void throttle(std::streamsize size);
+
+    std::streambuf *m_target;
+    double m_rate;
+    int64_t m_start;
+    int64_t m_from;
+    int64_t m_to;
+    // When the bytes passed on so far would have been written at the rate
+    int64_t m_due;
+};
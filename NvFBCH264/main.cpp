@@ -1,16 +1,58 @@
+#include <CaptureTimestamp.h>
 #include <NvFBCLibrary.h>
 #include <NvFBC/nvFBC.h>
 #include <NvFBC/nvFBCH264.h>
+#include <H264Bitstream.h>
+#include <Metrics.h>
+#include <Preallocate.h>
+#include <Probes.h>
+#include <RealtimeGuard.h>
+#include <ThreadStack.h>
+#include <Timer.h>
+#include <Trace.h>
 
+#include "AllocationTracker.h"
+#include "Autotuner.h"
+#include "BitrateController.h"
+#include "ControlChannel.h"
+#include "CpuHog.h"
+#include "Encoder.h"
+#include "FramePacer.h"
+#include "FrameWriter.h"
+#include "GrabThread.h"
+#include "Grabber.h"
+#include "StartupProfile.h"
+#include "SyntheticEncoder.h"
+#include "ThrottledBuffer.h"
+
+#include <atomic>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <stdarg.h>
+#include <stdio.h>
 #include <string>
 #include <vector>
 
 #include <boost/program_options.hpp>
 
 const NvU32 FPS = 30;
+// Grabs before --check-allocations starts counting, while metrics and trace buffers are set up
+const NvU32 ALLOCATION_WARMUP_FRAMES = 100;
+// Time a grab may run before the grab thread's stack and the metrics are logged
+const LONGLONG STALL_REPORT_NS = 1'000'000'000;
+// Most disk space reserved for the output ahead of the capture
+const unsigned long long MAX_PREALLOCATION = 4ULL << 30;
+// How long --autotune tries each configuration
+const LONGLONG AUTOTUNE_TRIAL_NS = 2'000'000'000;
+// Longest a daemon tries to grab the frame for grab-now
+const LONGLONG GRAB_NOW_TIMEOUT_NS = 1'000'000'000;
 
 using namespace std;
 
@@ -61,10 +103,95 @@ struct cmdargs
     string   filename;
     bool     is_lossless;
     bool     bYUV444;
+    bool     skip_duplicates;
+    string   timestamps;
+    bool     synthetic;
+    double   static_ratio;
+    string   trace;
+    NvU32    queue_size;
+    string   metrics;
+    NvU32    metrics_interval;
+    bool     latency_sei;
+    bool     check_allocations;
+    int      grab_cpu;
+    int      writer_cpu;
+    int      numa_node;
+    bool     large_pages;
+    bool     lock_buffers;
+    string   realtime;
+    int      realtime_priority;
+    double   realtime_budget;
+    NvU32    cpu_hog;
+    NvU32    grab_timeout;
+    NvU32    synthetic_stall;
+    NvU32    synthetic_stall_ms;
+    string   synthetic_resize;
+    string   control;
+    string   send;
+    bool     adaptive_bitrate;
+    NvU32    min_bitrate;
+    NvU32    min_fps;
+    string   throttle_output;
+    string   config;
+    string   autotune;
+    NvU32    autotune_seconds;
+    double   synthetic_encode_ms;
+    bool     daemon;
+    bool     startup_profile;
 };
 
+static atomic<bool> trace_requested { false };
+
+// Ctrl+Break dumps the trace recorded so far without stopping the capture
+static BOOL WINAPI ConsoleHandler(DWORD event)
+{
+    if (event != CTRL_BREAK_EVENT)
+        return FALSE;
+    trace_requested = true;
+    return TRUE;
+}
+
+// User and kernel time used by the process so far, in seconds
+static double ProcessCpuSeconds()
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0;
+    auto seconds = [](const FILETIME& t) { return (double(t.dwHighDateTime) * 4294967296.0 + t.dwLowDateTime) * 1e-7; };
+    return seconds(kernel) + seconds(user);
+}
+
+// Logs a line of the capture loop through a buffer on the stack, so logging every frame does
+// not allocate whatever the C++ library does for cerr
+static void LogLine(const char* format, ...)
+{
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    fputs(line, stderr);
+}
+
+// Offset of the start code of the first slice, where SEI has to be inserted
+static size_t FirstSliceOffset(const NvU8* data, size_t size)
+{
+    size_t offset = 0;
+    H264NalUnit unit;
+    while (NextNalUnit(data, size, &offset, &unit)) {
+        if (unit.type == H264_NAL_SLICE || unit.type == H264_NAL_IDR) {
+            const size_t start = unit.data - data - 3;
+            return start > 0 && data[start - 1] == 0 ? start - 1 : start;
+        }
+    }
+    return size;
+}
+
 int main(int argc, char *argv[])
 {
+	StartupProfile startup;
+	LONGLONG step = StartupProfile::now();
+
 	cmdargs args;
 	namespace po = boost::program_options;
 	po::options_description desc("Usage");
@@ -75,11 +202,56 @@ int main(int argc, char *argv[])
 		("output,o",   po::value<string>(&args.filename)->default_value("stream.h264"), "The filename for the output stream")
 		("lossless,l", po::bool_switch(&args.is_lossless), "If set, the frames are encoded lossless")
 		("yuv444",     po::bool_switch(&args.bYUV444),     "If set, YUV444 encoding is enabled, hence no color resampling performed")
+		("skip-duplicates,d", po::bool_switch(&args.skip_duplicates), "If set, grabs without new content are not logged and the timestamps of the frames written are saved")
+		("timestamps,t", po::value<string>(&args.timestamps), "The filename for the frame timestamps (mkvmerge v2 format), <output>.timestamps.txt with --skip-duplicates")
+		("synthetic",    po::bool_switch(&args.synthetic), "If set, frames are made up instead of grabbed, no GPU needed")
+		("static-ratio", po::value<double>(&args.static_ratio)->default_value(0.9), "The share of unchanged frames made up by --synthetic")
+		("trace",        po::value<string>(&args.trace), "The filename for a Chrome trace of the capture, written at exit and on Ctrl+Break")
+		("queue,q",      po::value<NvU32>(&args.queue_size)->default_value(8), "Number of frames which may wait to be written")
+		("metrics,m",    po::value<string>(&args.metrics), "The filename for metrics in the Prometheus text format, rewritten periodically")
+		("metrics-interval", po::value<NvU32>(&args.metrics_interval)->default_value(5000), "Milliseconds between rewrites of the metrics file")
+		("grab-cpu",     po::value<int>(&args.grab_cpu)->default_value(-1), "Logical CPU to pin the grab thread to")
+		("writer-cpu",   po::value<int>(&args.writer_cpu)->default_value(-1), "Logical CPU to pin the writer thread to")
+		("numa-node",    po::value<int>(&args.numa_node)->default_value(-1), "NUMA node to allocate the frame buffers on, by default the node of --grab-cpu")
+		("large-pages",  po::bool_switch(&args.large_pages), "If set, the frame buffers use large pages (Windows: needs the Lock pages in memory privilege)")
+		("lock-buffers", po::bool_switch(&args.lock_buffers), "If set, the frame buffers are locked in physical memory")
+		("realtime",     po::value<string>(&args.realtime), "Runs the grab thread at real-time priority, fifo or rr (SCHED_FIFO/SCHED_RR; MMCSS on Windows)")
+		("realtime-priority", po::value<int>(&args.realtime_priority)->default_value(10), "The SCHED_FIFO/SCHED_RR priority, 1-98")
+		("realtime-budget", po::value<double>(&args.realtime_budget)->default_value(0.9), "Share of a CPU the real-time grab thread may use before it is demoted to normal priority")
+		("cpu-hog",      po::value<NvU32>(&args.cpu_hog)->default_value(0), "Number of threads spinning at normal priority during the capture, to load the host")
+		("grab-timeout", po::value<NvU32>(&args.grab_timeout)->default_value(5000), "Milliseconds a grab may run before the session is given up and re-created (0 waits for ever)")
+		("synthetic-stall", po::value<NvU32>(&args.synthetic_stall)->default_value(0), "Makes this grab of --synthetic block, to try --grab-timeout")
+		("synthetic-stall-ms", po::value<NvU32>(&args.synthetic_stall_ms)->default_value(0), "How long the --synthetic-stall grab blocks, 0 for ever")
+		("synthetic-resize", po::value<string>(&args.synthetic_resize), "Changes the resolution of --synthetic at a grab, given as grab:WIDTHxHEIGHT")
+		("control",      po::value<string>(&args.control), "Accepts commands under this name: a pipe \\\\.\\pipe\\<name> on Windows, an abstract Unix socket elsewhere")
+		("send",         po::value<string>(&args.send), "Sends a command to the capture listening at --control and exits: set-bitrate <bps>, set-gop <frames>, force-idr, pause, resume, start-clip <file>, stop-clip, grab-now <file> or quit")
+		("daemon",       po::bool_switch(&args.daemon), "If set, the session is set up and kept paused until --control clients ask for clips, with start-clip <file> and stop-clip, or single frames, with grab-now <file>; runs until quit")
+		("adaptive-bitrate", po::bool_switch(&args.adaptive_bitrate), "If set, the bitrate is lowered while the output falls behind and raised again once it keeps up")
+		("min-bitrate",  po::value<NvU32>(&args.min_bitrate)->default_value(0), "Lowest bitrate of --adaptive-bitrate, by default an eighth of --bitrate")
+		("min-fps",      po::value<NvU32>(&args.min_fps)->default_value(FPS), "Lowest frame rate of --adaptive-bitrate, once at the lowest bitrate")
+		("throttle-output", po::value<string>(&args.throttle_output), "Writes no faster than this many bytes per second, to try --adaptive-bitrate; RATE or RATE@FROM-TO seconds")
+		("config",       po::value<string>(&args.config), "Reads options from this file, one name=value per line, e.g. as written by --autotune; the command line takes precedence")
+		("autotune",     po::value<string>(&args.autotune), "Tries encoder configurations from the best down until one sustains the frame rate, writes it to this file for --config and exits")
+		("autotune-seconds", po::value<NvU32>(&args.autotune_seconds)->default_value(60), "Longest time --autotune may take, at two seconds per configuration")
+		("synthetic-encode-ms", po::value<double>(&args.synthetic_encode_ms)->default_value(0), "Milliseconds --synthetic takes to encode a changed 1080p frame with the Main profile, to try --autotune")
+		("startup-profile", po::bool_switch(&args.startup_profile), "If set, prints how long each step from the start to the first frame written took")
+		("check-allocations", po::bool_switch(&args.check_allocations), "If set, fails if the capture loop allocates heap memory after the first 100 frames (Debug builds only)")
+		("latency-sei",  po::bool_switch(&args.latency_sei), "If set, every frame carries its grab time and number as SEI user data, see NvFBCLatency")
 		;
 
 	po::variables_map vm;
 	try {
 		po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+		// Options already given on the command line are kept
+		if (vm.count("config")) {
+			const string config_file = vm["config"].as<string>();
+			ifstream config(config_file);
+			if (!config) {
+				cerr << "Cannot read " << config_file << endl;
+				return EXIT_FAILURE;
+			}
+			po::store(po::parse_config_file(config, desc), vm);
+		}
 		po::notify(vm);
 	} catch (boost::program_options::error const& e) {
 		cerr << e.what() << endl;
@@ -87,38 +259,198 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
     
-    DWORD max_width, max_height;
+	if (!args.send.empty()) {
+		if (args.control.empty()) {
+			cerr << "--send needs --control" << endl;
+			return EXIT_FAILURE;
+		}
+		string reply;
+		if (!ControlChannel::send(args.control, args.send, &reply)) {
+			cerr << "Cannot reach a capture at " << args.control << endl;
+			return EXIT_FAILURE;
+		}
+		cout << reply << endl;
+		return reply.compare(0, 3, "ok ") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	startup.record("Options", step);
 
-    NvFBCLibrary nvfbc;
+	// Nothing below depends on each other until the first grab, which needs all of them: the
+	// clock calibrates while the library loads and the session is made, and the output is
+	// opened meanwhile
+	auto calibration = async(launch::async, [&startup] {
+		const LONGLONG start = StartupProfile::now();
+		Timer::nanoseconds();
+		startup.record("Clock calibration", start);
+	});
 
-    NvFBCFrameGrabInfo grab_info = {0};
-    NvFBC_H264HWEncoder_FrameInfo frame_info = {0};
-    NVFBC_H264_GRAB_FRAME_PARAMS fbch264GrabFrameParams = {0};
-    NVFBCRESULT res;
-    
-	if (!nvfbc.load()) {
-		cerr << "Cannot load NvFBC library" << endl;
+	auto dump_trace = [&args] {
+		if (!args.trace.empty() && !Trace::dump(args.trace.c_str()))
+			cerr << "Cannot write the trace to " << args.trace << endl;
+	};
+	if (!args.trace.empty()) {
+		Trace::enable(true);
+		Trace::setThreadName("Capture");
+		SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+	}
+
+    // Pin before the session is created, so whatever it allocates lands on the grab thread's node
+    if (args.grab_cpu >= 0 && !PinCurrentThread(args.grab_cpu))
+        cerr << "Cannot pin the grab thread to CPU " << args.grab_cpu << endl;
+
+    MemoryPlacement placement = DefaultPlacement();
+    placement.node = args.numa_node >= 0 ? args.numa_node : NumaNodeOfCpu(args.grab_cpu);
+    placement.largePages = args.large_pages;
+    placement.locked = args.lock_buffers;
+
+	RegisterProbes();
+
+	if (!args.realtime.empty() && args.realtime != "fifo" && args.realtime != "rr") {
+		cerr << "--realtime is fifo or rr" << endl;
+		return EXIT_FAILURE;
+	}
+	if (args.realtime_priority < 1 || args.realtime_priority > 98) {
+		cerr << "--realtime-priority is 1-98, the watchdog runs one above it" << endl;
+		return EXIT_FAILURE;
+	}
+	if (args.adaptive_bitrate && args.is_lossless) {
+		cerr << "--adaptive-bitrate needs a bitrate, not --lossless" << endl;
+		return EXIT_FAILURE;
+	}
+	if (args.min_fps < 1) {
+		cerr << "--min-fps is at least 1" << endl;
+		return EXIT_FAILURE;
+	}
+	double throttle_rate = 0, throttle_from = 0, throttle_to = 0;
+	if (!args.throttle_output.empty()) {
+		const int fields = sscanf(args.throttle_output.c_str(), "%lf@%lf-%lf", &throttle_rate, &throttle_from, &throttle_to);
+		if ((fields != 1 && fields != 3) || throttle_rate <= 0) {
+			cerr << "--throttle-output is RATE or RATE@FROM-TO" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	unsigned resize_grab = 0, resize_width = 0, resize_height = 0;
+	if (!args.synthetic_resize.empty() &&
+		(sscanf(args.synthetic_resize.c_str(), "%u:%ux%u", &resize_grab, &resize_width, &resize_height) != 3 ||
+		 resize_width == 0 || resize_height == 0)) {
+		cerr << "--synthetic-resize is grab:WIDTHxHEIGHT" << endl;
+		return EXIT_FAILURE;
+	}
+	if (args.check_allocations && !AllocationTracker::available()) {
+		cerr << "--check-allocations needs a build with NVFBC_TRACK_ALLOCATIONS, e.g. the Debug configuration" << endl;
 		return EXIT_FAILURE;
 	}
+	if (args.check_allocations && !args.daemon && args.frame_cnt <= ALLOCATION_WARMUP_FRAMES) {
+		cerr << "--check-allocations only counts after the first " << ALLOCATION_WARMUP_FRAMES << " frames, so it needs more" << endl;
+		return EXIT_FAILURE;
+	}
+	if (args.daemon && (args.control.empty() || args.skip_duplicates || !args.timestamps.empty() || !args.autotune.empty())) {
+		cerr << "--daemon needs --control, and records clips without --skip-duplicates, --timestamps or --autotune" << endl;
+		return EXIT_FAILURE;
+	}
+	if (!args.autotune.empty() && args.filename == "-") {
+		cerr << "--autotune tries the configurations on a file it deletes afterwards, not on stdout" << endl;
+		return EXIT_FAILURE;
+	}
+	if (args.skip_duplicates && args.timestamps.empty())
+		args.timestamps = args.filename + ".timestamps.txt";
 
-    // Create the encoder instance
-	unique_ptr<NvFBCToH264HWEncoder, decltype(bind(&NvFBCToH264HWEncoder::NvFBCH264Release, placeholders::_1))> encoder {
-		static_cast<NvFBCToH264HWEncoder*>(nvfbc.create(NVFBC_TO_H264_HW_ENCODER, &max_width, &max_height)),
-		bind(&NvFBCToH264HWEncoder::NvFBCH264Release, placeholders::_1) };
+	Metrics& metrics = Metrics::instance();
+	const int grabbed_metric = metrics.counter("nvfbc_frames_grabbed_total", "Frames grabbed from the encoder");
+	const int empty_metric = metrics.counter("nvfbc_zero_sized_frames_total", "Grabs which returned no data");
+	const int invalidated_metric = metrics.counter("nvfbc_session_invalidations_total", "Times the capture session had to be re-created");
+	const int target_bitrate_metric = metrics.gauge("nvfbc_target_bitrate_bits_per_second", "The average bitrate the encoder is set up for");
+	const int grab_latency_metric = metrics.summary("nvfbc_grab_latency_seconds", "Time taken by one grab");
+	const int missed_deadline_metric = metrics.counter("nvfbc_missed_deadlines_total", "Grabs which ended more than half a frame period late");
+	const int demotion_metric = metrics.counter("nvfbc_realtime_demotions_total", "Times the grab thread lost its real-time priority for using too much CPU");
+	const int stall_metric = metrics.counter("nvfbc_grab_stalls_total", "Times no grab succeeded for a second");
+	const int recycled_metric = metrics.counter("nvfbc_sessions_recycled_total", "Times a stalled session was given up and re-created");
+	const int resolution_metric = metrics.counter("nvfbc_resolution_changes_total", "Times the captured resolution changed");
+	const int control_metric = metrics.counter("nvfbc_control_commands_total", "Commands received on the control channel");
+	const int bitrate_change_metric = metrics.counter("nvfbc_bitrate_changes_total", "Times --adaptive-bitrate changed the bitrate or frame rate");
+	const int startup_metric = metrics.gauge("nvfbc_startup_seconds", "Time from the start to the first frame written");
+	const int control_latency_metric = metrics.summary("nvfbc_control_apply_latency_seconds", "Time from receiving a control command to having it applied");
 
-    if (!encoder) {
-        cerr << "Cannot create the H.264 encoder\n";
-        return EXIT_FAILURE;
+    // "-" streams to stdout, e.g. into NvFBCLatency. A daemon opens a file for each clip. The
+    // output is preallocated for the bitrate asked for, so the writer does not extend it.
+    const bool to_stdout = args.filename == "-" && !args.daemon;
+    const bool preallocate = !to_stdout && !args.daemon && !args.is_lossless;
+    PreallocatedFile preallocated;
+    ofstream output_file;
+    ofstream timestamps_file;
+    auto open_output = async(launch::async, [&]() -> string {
+        const LONGLONG start = StartupProfile::now();
+        if (to_stdout) {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        } else if (!args.daemon) {
+            const unsigned long long size = (unsigned long long)args.bitrate / 8 * args.frame_cnt / FPS;
+            if (preallocate && preallocated.create(args.filename.c_str(), min(size, MAX_PREALLOCATION)))
+                output_file.open(args.filename, ios::in | ios::out | ios::binary);
+            else
+                output_file.open(args.filename, ios::binary);
+        }
+        if (!to_stdout && !args.daemon && !output_file)
+            return "Cannot open " + args.filename + " for writing\n";
+
+        // --autotune leaves no output behind
+        if (!args.timestamps.empty() && args.autotune.empty()) {
+            timestamps_file.open(args.timestamps);
+            if (!timestamps_file)
+                return "Cannot open " + args.timestamps + " for writing\n";
+            timestamps_file << "# timestamp format v2\n" << fixed << setprecision(3);
+        }
+        startup.record("Open output", start);
+        return string();
+    });
+
+    DWORD max_width, max_height;
+
+    NvFBCLibrary nvfbc;
+
+    NVFBCRESULT res;
+
+    if (!args.synthetic) {
+        step = StartupProfile::now();
+        if (!nvfbc.load()) {
+            cerr << "Cannot load NvFBC library" << endl;
+            return EXIT_FAILURE;
+        }
+        startup.record("Load NvFBC", step);
     }
+    auto make_encoder = [&]() -> Encoder* {
+        if (args.synthetic)
+            return new SyntheticEncoder(1920, 1080, args.static_ratio);
+        return new NvFBCEncoder(nvfbc);
+    };
+
+    unique_ptr<Encoder> encoder(make_encoder());
+    if (args.synthetic && args.synthetic_stall != 0)
+        static_cast<SyntheticEncoder*>(encoder.get())->stall(args.synthetic_stall, args.synthetic_stall_ms ? args.synthetic_stall_ms : INFINITE);
+    if (args.synthetic && resize_grab != 0)
+        static_cast<SyntheticEncoder*>(encoder.get())->changeResolution(resize_grab, resize_width, resize_height);
+    if (args.synthetic && args.synthetic_encode_ms > 0)
+        static_cast<SyntheticEncoder*>(encoder.get())->setEncodeCost(args.synthetic_encode_ms);
 
-    ofstream output_file { args.filename, ios::binary };
+    // All calls into the session are made on the grab thread, which the capture loop can give up on
+    GrabThread grab_thread;
+    auto prepare_grab_thread = [&] {
+        Trace::setThreadName("Grab");
+        AllocationTracker::trackThread();
+        if (args.grab_cpu >= 0)
+            PinCurrentThread(args.grab_cpu);
+    };
+    grab_thread.invoke(prepare_grab_thread);
 
-    if (!output_file) {
-        cerr << "Cannot open " << args.filename << " for writing\n";
+    // Create the encoder instance
+    bool created = false;
+    step = StartupProfile::now();
+    grab_thread.invoke([&] { created = encoder->create(&max_width, &max_height); });
+    if (!created) {
+        cerr << "Cannot create the H.264 encoder\n";
         return EXIT_FAILURE;
     }
-
-    vector<NvU8> output_buffer(max_width * max_height);
+    startup.record("Create session", step);
 
     NvFBC_H264HWEncoder_Config encode_config = {0};
     encode_config.dwVersion = NVFBC_H264HWENC_CONFIG_VER;
@@ -149,48 +481,600 @@ int main(int argc, char *argv[])
     fbch264SetupParams.bWithHWCursor = TRUE;
     fbch264SetupParams.pEncodeConfig = &encode_config;
 
-    res = encoder->NvFBCH264SetUp(&fbch264SetupParams);
+    // The session is set up while the writer allocates its buffers
+    auto set_up = async(launch::async, [&] {
+        const LONGLONG start = StartupProfile::now();
+        grab_thread.invoke([&] { res = encoder->setUp(&fbch264SetupParams); });
+        startup.record("Set up encoder", start);
+    });
+
+    const string output_error = open_output.get();
+    if (!output_error.empty()) {
+        cerr << output_error;
+        return EXIT_FAILURE;
+    }
+
+    ostream& output = to_stdout ? cout : output_file;
+    ThrottledBuffer throttled_buffer(output.rdbuf(), throttle_rate, throttle_from, throttle_to);
+    ostream throttled_output(&throttled_buffer);
+
+    step = StartupProfile::now();
+    FrameWriter writer(throttle_rate > 0 ? throttled_output : output, timestamps_file.is_open() ? &timestamps_file : nullptr,
+                       args.queue_size, max_width * max_height, to_stdout, placement);
+    startup.record("Frame buffers", step);
+
+    set_up.get();
     if (res != NVFBC_SUCCESS) {
         cerr << "Cannot setup H264 encoder\n";
         return EXIT_FAILURE;
     }
 
-    for (unsigned i = 0; i < args.frame_cnt; ++i) {
-        memset(&grab_info, 0, sizeof(grab_info));
-        memset(&frame_info, 0, sizeof(frame_info));
-        memset(&fbch264GrabFrameParams, 0, sizeof(fbch264GrabFrameParams));
-        fbch264GrabFrameParams.dwVersion = NVFBC_H264_GRAB_FRAME_PARAMS_VER;
-        fbch264GrabFrameParams.dwFlags   = NVFBC_TOH264_NOWAIT;
-        fbch264GrabFrameParams.pNvFBCFrameGrabInfo = &grab_info;
-        fbch264GrabFrameParams.pFrameInfo = &frame_info;
-        fbch264GrabFrameParams.pBitStreamBuffer = output_buffer.data();
-
-        res = encoder->NvFBCH264GrabFrame(&fbch264GrabFrameParams); // blocks until a new frame available
-        if (res == NVFBC_SUCCESS) {
-            if (frame_info.dwByteSize == 0) {
-                cerr << "Got zero-sized frame\n";
+    metrics.set(target_bitrate_metric, args.is_lossless ? 0 : args.bitrate);
+    if (!args.metrics.empty() && !metrics.startExport(args.metrics.c_str(), args.metrics_interval)) {
+        cerr << "Cannot write the metrics to " << args.metrics << endl;
+        return EXIT_FAILURE;
+    }
+    if (args.writer_cpu >= 0 && !writer.pin(args.writer_cpu))
+        cerr << "Cannot pin the writer thread to CPU " << args.writer_cpu << endl;
+
+    // Started before the grab thread is raised: on Linux new threads inherit its policy
+    const CpuHog cpu_hog(args.cpu_hog);
+
+    ControlChannel control;
+    if (!args.control.empty() && !control.start(args.control)) {
+        cerr << "Cannot open the control channel " << args.control << endl;
+        return EXIT_FAILURE;
+    }
+
+    RealtimeGuard realtime;
+    auto raise_grab_thread = [&] {
+        bool raised = true;
+        if (!args.realtime.empty())
+            grab_thread.invoke([&] {
+                raised = realtime.start(args.realtime == "rr" ? REALTIME_RR : REALTIME_FIFO, args.realtime_priority,
+                                        args.realtime_budget, 500);
+            });
+        if (!raised)
+            cerr << "Cannot run the grab thread at real-time priority\n";
+    };
+    raise_grab_thread();
+    bool demotion_reported = false;
+
+    // Grabs on the grab thread. Once a grab has been running for STALL_REPORT_NS, the grab
+    // thread's stack, the metrics and the trace are logged; it is given up on once it ran for
+    // --grab-timeout. Only the grab itself counts, not the time spent waiting for a free buffer
+    // before it, which a slow output stretches.
+    const LONGLONG timeout_ns = args.grab_timeout * 1'000'000LL;
+    const LONGLONG report_ns = args.grab_timeout != 0 ? min(STALL_REPORT_NS, timeout_ns) : STALL_REPORT_NS;
+    Grabber grabber(encoder, &grab_thread, &fbch264SetupParams, &max_width, &max_height);
+    grabber.makeEncoder = make_encoder;
+    grabber.prepareThread = prepare_grab_thread;
+    grabber.setTimeouts(report_ns, timeout_ns);
+    grabber.onStall = [&] {
+        // The report is not the steady state --check-allocations is about
+        const bool tracking = AllocationTracker::started();
+        AllocationTracker::stop();
+        TRACE_INSTANT("Grab stalled");
+        metrics.add(stall_metric);
+        cerr << "The grab has been running for " << (Timer::nanoseconds() - grab_thread.started()) / 1'000'000
+             << " ms, grab thread stack:\n";
+        if (!PrintThreadStack(grab_thread.thread(), cerr))
+            cerr << "  (not available)\n";
+        cerr << metrics.format();
+        dump_trace();
+        if (tracking)
+            AllocationTracker::start();
+    };
+
+    // Tried with the grabber as set up for the capture, into the writer and the output file it
+    // would write to, so the result holds for captures run the same way; the file is deleted
+    // afterwards
+    if (!args.autotune.empty()) {
+        Autotuner autotuner(grabber, fbch264SetupParams, writer, encode_config);
+        const LONGLONG deadline = Timer::nanoseconds() + args.autotune_seconds * 1'000'000'000LL;
+        AutotuneTrial chosen = {};
+        for (const AutotuneCandidate& candidate : Autotuner::candidates(args.bitrate)) {
+            if (deadline - Timer::nanoseconds() < AUTOTUNE_TRIAL_NS) {
+                cerr << "Out of time after " << args.autotune_seconds << " s\n";
+                break;
+            }
+            const AutotuneTrial trial = autotuner.run(candidate, AUTOTUNE_TRIAL_NS);
+            cerr << (candidate.lossless ? "Lossless " : "") << static_cast<profiles>(candidate.profile)
+                 << (candidate.yuv444 ? " YUV444" : "");
+            if (!candidate.lossless)
+                cerr << " at " << candidate.bitrate << " bps";
+            if (!trial.setUp) {
+                cerr << ": not supported\n";
+                continue;
+            }
+            cerr << fixed << setprecision(1) << ": " << trial.frameRate << " fps, grab p99 " << trial.grabLatencyMs
+                 << " ms, output " << static_cast<unsigned>(trial.outputRate / 1000) << " kB/s, writer idle "
+                 << static_cast<unsigned>(trial.headroom * 100) << "%, queue peak " << trial.peakDepth << " of "
+                 << writer.queueSize() << (trial.sustained ? ", sustained\n" : "\n");
+            if (trial.sustained) {
+                chosen = trial;
+                break;
+            }
+        }
+        writer.close();
+        output_file.close();
+        preallocated.close();
+        remove(args.filename.c_str());
+        dump_trace();
+
+        if (!chosen.sustained) {
+            cerr << "No configuration tried sustains " << FPS << " fps\n";
+            return EXIT_FAILURE;
+        }
+
+        ofstream config(args.autotune);
+        config << "# Written by --autotune: the best configuration sustaining " << FPS << " fps here\n"
+               << fixed << setprecision(1) << "# " << chosen.frameRate << " fps, grab p99 " << chosen.grabLatencyMs
+               << " ms, output " << static_cast<unsigned>(chosen.outputRate / 1000) << " kB/s, writer idle "
+               << static_cast<unsigned>(chosen.headroom * 100) << "%\n"
+               << "profile=" << static_cast<profiles>(chosen.candidate.profile) << '\n'
+               << "lossless=" << (chosen.candidate.lossless ? "true" : "false") << '\n'
+               << "yuv444=" << (chosen.candidate.yuv444 ? "true" : "false") << '\n';
+        if (!chosen.candidate.lossless)
+            config << "bitrate=" << chosen.candidate.bitrate << '\n';
+        config.close();
+        if (!config) {
+            cerr << "Cannot write " << args.autotune << endl;
+            return EXIT_FAILURE;
+        }
+        cerr << "Wrote the configuration to " << args.autotune << ", use it with --config " << args.autotune << endl;
+        return EXIT_SUCCESS;
+    }
+
+    // Every grab counts toward frame_cnt, so the capture lasts as long with or without skipping
+    unsigned long long bytes_written = 0;
+    unsigned frames_written = 0, zero_sized = 0, missed_deadlines = 0, recycled = 0;
+    // The resolution of the frames written, and frames dropped at a change until an IDR frame came
+    DWORD width = 0, height = 0;
+    unsigned resolution_changes = 0, reconfiguration_drops = 0;
+
+    // Applies encode_config to the session, see ReconfigureEncoder(). If the encoder takes none
+    // of it, encode_config is back to the previous configuration; if it cannot even be set up
+    // with that, encoder_lost ends the capture, or a daemon's clip.
+    bool encoder_lost = false;
+    auto reconfigure_encoder = [&](const NvFBC_H264HWEncoder_Config& previous) {
+        ReconfigureResult result = RECONFIGURE_FAILED;
+        grab_thread.invoke([&] {
+            result = ReconfigureEncoder(*encoder, &fbch264SetupParams, previous, &max_width, &max_height);
+        });
+        if (result == RECONFIGURE_FAILED) {
+            cerr << "Cannot set the H.264 encoder up again, not even as it was\n";
+            encoder_lost = true;
+            return false;
+        }
+        writer.resize(max_width * max_height);
+        if (result == RECONFIGURE_RESTORED) {
+            cerr << "The encoder takes none of the new configuration, set it up again with "
+                 << encode_config.dwAvgBitRate << " bps at " << encode_config.dwFrameRateNum << " fps, GOP length "
+                 << encode_config.dwGOPLength << endl;
+            return false;
+        }
+
+        metrics.set(target_bitrate_metric, args.is_lossless ? 0 : encode_config.dwAvgBitRate);
+        cerr << "Encoder " << (result == RECONFIGURED_IN_PLACE ? "reconfigured" : "set up again") << " with "
+             << encode_config.dwAvgBitRate << " bps at " << encode_config.dwFrameRateNum << " fps, GOP length "
+             << encode_config.dwGOPLength << endl;
+        return true;
+    };
+
+    BitrateController bitrate_controller(args.bitrate, args.min_bitrate ? args.min_bitrate : args.bitrate / 8, FPS,
+                                         args.min_fps);
+    unsigned bitrate_changes = 0;
+
+    // Creates the session again and sets it up with encode_config, after the grab which left it
+    // unusable, see Grabber::recover()
+    auto recreate_session = [&](GrabStatus status) {
+        res = grabber.recover(status);
+        encoder_lost = res != NVFBC_SUCCESS;
+        if (!encoder_lost)
+            writer.resize(max_width * max_height);
+        return !encoder_lost;
+    };
+
+    // A daemon records into one clip at a time, from start-clip or grab-now on, and answers the
+    // command once the first frame of the clip is queued, or written for grab-now
+    const char* output_name = args.filename.c_str();
+    ControlCommand clip = {};
+    bool clip_open = false, clip_starting = false;
+    unsigned clips = 0, clip_frames = 0;
+    bool paused = args.daemon, quit = false;
+    // Returns whether all frames of the clip were written
+    auto finish_clip = [&] {
+        writer.drain();
+        output_file.close();
+        const bool written = !writer.failed();
+        if (written)
+            cerr << "Wrote " << clip_frames << " frames to " << clip.path << endl;
+        else
+            cerr << "Cannot write to " << clip.path << endl;
+        writer.clearFailure();
+        clip_open = false;
+        paused = true;
+        return written;
+    };
+
+    // A daemon fails the clip it is recording rather than exiting, and waits for the next
+    // request: the request is answered with the error unless it was already, the clip is
+    // closed and deleted if it has no frames
+    auto fail_clip = [&](const char* error) {
+        if (clip_starting || clip_open)
+            cerr << "Giving up on " << clip.path << ": " << error << endl;
+        if (clip_starting) {
+            clip_starting = false;
+            control.complete(error);
+        }
+        if (clip_open) {
+            finish_clip();
+            if (clip_frames == 0)
+                remove(clip.path);
+        }
+        paused = true;
+    };
+
+    // Applies a control command, returning why it could not be
+    auto apply_command = [&](const ControlCommand& command) -> const char* {
+        const NvFBC_H264HWEncoder_Config previous = encode_config;
+        switch (command.type) {
+        case CONTROL_START_CLIP:
+        case CONTROL_GRAB_NOW:
+            if (!args.daemon)
+                return "clips are recorded by a --daemon";
+            if (clip_open)
+                return "a clip is being recorded";
+            if (encoder_lost && !recreate_session(GRAB_FAILED))
+                return "cannot create the capture session";
+            output_file.clear();
+            output_file.open(command.path, ios::binary);
+            if (!output_file)
+                return "cannot open the file";
+            clip = command;
+            output_name = clip.path;
+            clip_open = clip_starting = true;
+            clip_frames = 0;
+            ++clips;
+            grabber.requestIdr();
+            paused = false;
+            return nullptr;
+        case CONTROL_STOP_CLIP:
+            if (!clip_open)
+                return "no clip is being recorded";
+            finish_clip();
+            return nullptr;
+        case CONTROL_QUIT:
+            quit = true;
+            return nullptr;
+        case CONTROL_FORCE_IDR:
+            grabber.requestIdr();
+            return nullptr;
+        case CONTROL_PAUSE:
+            cerr << "Paused\n";
+            paused = true;
+            return nullptr;
+        case CONTROL_RESUME:
+            cerr << "Resumed\n";
+            paused = false;
+            return nullptr;
+        case CONTROL_SET_BITRATE:
+            if (args.is_lossless)
+                return "lossless encoding has no bitrate";
+            if (command.value == 0 || command.value > 0x7FFFFFFF)
+                return "the bitrate is out of range";
+            encode_config.dwAvgBitRate = command.value;
+            encode_config.dwPeakBitRate = command.value * 2;
+            if (!reconfigure_encoder(previous))
+                return "the encoder cannot be set up like that";
+            bitrate_controller.setBitrate(command.value);
+            return nullptr;
+        case CONTROL_SET_GOP:
+            encode_config.dwGOPLength = command.value;
+            break;
+        }
+
+        return reconfigure_encoder(previous) ? nullptr : "the encoder cannot be set up like that";
+    };
+
+    LONGLONG frame_period = 1000000000LL / FPS;
+    // Below FPS, grabs are spaced a frame period apart
+    FramePacer pacer;
+    LONGLONG previous_grab_end = 0;
+    // Reported once the writer wrote the first frame, at the latest once the capture ended, with
+    // how the frame buffers were placed: that waits for the ones still being allocated
+    bool startup_reported = false;
+    auto report_startup = [&] {
+        const LONGLONG first_frame = StartupProfile::now() - (Timer::nanoseconds() - writer.firstWritten());
+        metrics.set(startup_metric, (first_frame - startup.start()) / 1e9);
+        if (args.startup_profile)
+            startup.report(cerr, first_frame);
+        startup_reported = true;
+
+        const MemoryPlacement actual = writer.placement();
+        if (placement.node >= 0 && actual.node != placement.node)
+            cerr << "Cannot allocate the frame buffers on NUMA node " << placement.node << endl;
+        if (placement.largePages && !actual.largePages)
+            cerr << "Cannot use large pages for the frame buffers\n";
+        if (placement.locked && !actual.locked)
+            cerr << "Cannot lock the frame buffers in memory\n";
+    };
+
+    const Timer capture_timer;
+    const double start_cpu = ProcessCpuSeconds();
+    AllocationTracker::trackThread();
+
+    if (args.daemon)
+        cerr << "Waiting for clip requests on " << args.control << endl;
+
+    for (unsigned i = 0; args.daemon || i < args.frame_cnt; ++i) {
+        if (args.check_allocations && i == ALLOCATION_WARMUP_FRAMES)
+            AllocationTracker::start();
+
+        if (trace_requested.exchange(false))
+            dump_trace();
+
+        if (!startup_reported && writer.firstWritten() != 0)
+            report_startup();
+
+        // Control commands are applied between grabs; while paused, the loop only waits for them
+        ControlCommand command;
+        while ((args.daemon || !encoder_lost) && (control.poll(&command) || (paused && !quit && control.wait(&command)))) {
+            const bool tracking = AllocationTracker::started();
+            AllocationTracker::stop();
+            TRACE_SCOPE("Control command");
+            metrics.add(control_metric);
+            const char* error = apply_command(command);
+            if (!error && !clip_starting)
+                metrics.observe(control_latency_metric, Timer::nanoseconds() - command.received);
+            if (error || !clip_starting)
+                control.complete(error);
+            if (tracking)
+                AllocationTracker::start();
+
+            // Neither the command nor a pause counts against the deadlines
+            previous_grab_end = 0;
+        }
+        if (quit)
+            break;
+
+        if (args.adaptive_bitrate && !encoder_lost &&
+            bitrate_controller.update(Timer::nanoseconds(), writer.queueDepth(), writer.queueSize(), writer.bytesWritten(),
+                                      writer.writeNanoseconds())) {
+            const bool tracking = AllocationTracker::started();
+            AllocationTracker::stop();
+            TRACE_SCOPE("Bitrate change");
+            cerr << "Output at " << (unsigned)(bitrate_controller.throughput() / 1000) << " kB/s, writer busy "
+                 << (unsigned)(bitrate_controller.busy() * 100) << "%, queue peak " << bitrate_controller.peakDepth()
+                 << " of " << writer.queueSize() << ": " << bitrate_controller.reason() << ", " << encode_config.dwAvgBitRate
+                 << " bps at " << encode_config.dwFrameRateNum << " fps -> " << bitrate_controller.bitrate() << " bps at "
+                 << bitrate_controller.frameRate() << " fps" << endl;
+
+            const NvFBC_H264HWEncoder_Config previous = encode_config;
+            encode_config.dwAvgBitRate = bitrate_controller.bitrate();
+            encode_config.dwPeakBitRate = bitrate_controller.bitrate() * 2;
+            encode_config.dwFrameRateNum = bitrate_controller.frameRate();
+            if (reconfigure_encoder(previous)) {
+                ++bitrate_changes;
+                metrics.add(bitrate_change_metric);
+                frame_period = 1000000000LL / encode_config.dwFrameRateNum;
+                pacer.setPeriod(encode_config.dwFrameRateNum < FPS ? frame_period : 0);
+            } else {
+                bitrate_controller.revert(encode_config.dwAvgBitRate, encode_config.dwFrameRateNum);
+            }
+            if (tracking)
+                AllocationTracker::start();
+            previous_grab_end = 0;
+        }
+        if (encoder_lost) {
+            if (!args.daemon) {
+                dump_trace();
                 return EXIT_FAILURE;
             }
+            fail_clip("the capture session is lost");
+            continue;
+        }
+        if (clip_starting && clip.type == CONTROL_GRAB_NOW && Timer::nanoseconds() - clip.received > GRAB_NOW_TIMEOUT_NS) {
+            fail_clip("no frame within a second");
+            continue;
+        }
+
+        EncodedFrame* frame = writer.acquire();
+        pacer.wait();
+
+        const LONGLONG grab_wall_clock = WallClockNanoseconds();
+        if (i == 0)
+            step = StartupProfile::now();
+        const LONGLONG grab_start = Timer::nanoseconds();
+        PROBE_GRAB_START(i);
+        const GrabStatus status = grabber.grab(frame->data.data(), &res);
+        PROBE_GRAB_END(i, res);
+        const LONGLONG grab_end = Timer::nanoseconds();
+        if (i == 0)
+            startup.record("First grab", step);
+        metrics.observe(grab_latency_metric, grab_end - grab_start);
+
+        // A grab should end once a frame period after the previous one
+        if (previous_grab_end != 0 && grab_end - previous_grab_end > frame_period * 3 / 2) {
+            ++missed_deadlines;
+            metrics.add(missed_deadline_metric);
+            TRACE_INSTANT("Missed deadline");
+        }
+        previous_grab_end = grab_end;
+
+        if (realtime.demoted() && !demotion_reported) {
+            cerr << "The grab thread used more than " << args.realtime_budget * 100
+                 << "% of a CPU and is back at normal priority\n";
+            metrics.add(demotion_metric);
+            demotion_reported = true;
+        }
 
-            output_file.write(reinterpret_cast<const char*>(output_buffer.data()), frame_info.dwByteSize);
-
-            cerr << "Wrote frame " << i << " to " << args.filename << endl;
-        } else {
-            if (res == NVFBC_ERROR_INVALIDATED_SESSION) {
-				// Invalidated session: need to re-create the encoder...
-                encoder.reset(static_cast<NvFBCToH264HWEncoder *>(nvfbc.create(NVFBC_TO_H264_HW_ENCODER, &max_width, &max_height)));
-                res = encoder->NvFBCH264SetUp(&fbch264SetupParams);
-				// ...and then try again
-				if (res == NVFBC_SUCCESS) {
-					output_buffer.resize(max_width * max_height);
-					res = encoder->NvFBCH264GrabFrame(&fbch264GrabFrameParams);
-				}
+        if (status == GRAB_INVALIDATED || status == GRAB_STALLED) {
+            // Recovery may grow the buffers; it is not the steady state the check is about
+            AllocationTracker::stop();
+            TRACE_SCOPE(status == GRAB_STALLED ? "Recycle session" : "Invalidated session");
+            if (status == GRAB_STALLED) {
+                // The stuck grab keeps its thread, session and buffer; the capture goes on with
+                // new ones
+                cerr << "Giving up on the stalled grab, re-creating the session\n";
+                metrics.add(recycled_metric);
+                ++recycled;
+                realtime.stop();
+                writer.abandon(frame);
+            } else {
+                metrics.add(invalidated_metric);
+                writer.discard(frame);
             }
-            if (res != NVFBC_SUCCESS) {
-                cerr << "Cannot grab the frame\n";
+
+            if (!recreate_session(status)) {
+                cerr << "Cannot re-create the H.264 encoder\n";
+                if (!args.daemon) {
+                    dump_trace();
+                    return EXIT_FAILURE;
+                }
+                fail_clip("cannot re-create the capture session");
+            }
+            if (status == GRAB_STALLED)
+                raise_grab_thread();
+
+            previous_grab_end = 0;
+            if (args.check_allocations && i >= ALLOCATION_WARMUP_FRAMES)
+                AllocationTracker::start();
+            continue;
+        }
+        if (status == GRAB_FAILED) {
+            cerr << "Cannot grab the frame\n";
+            writer.discard(frame);
+            if (!args.daemon) {
+                dump_trace();
                 return EXIT_FAILURE;
             }
+            // The session is created again for the next clip
+            encoder_lost = true;
+            fail_clip("cannot grab the frame");
+            continue;
         }
+
+        const NvFBCFrameGrabInfo& grab_info = grabber.grabInfo();
+        const NvFBC_H264HWEncoder_FrameInfo& frame_info = grabber.frameInfo();
+        metrics.add(grabbed_metric);
+        PROBE_FRAME_SIZE(i, frame_info.dwByteSize);
+
+        const double timestamp = capture_timer.elapsedNs() / 1e6;
+
+        // Nothing was captured since the last grab
+        if (status == GRAB_EMPTY) {
+            if (!args.skip_duplicates)
+                LogLine("Got zero-sized frame\n");
+            ++zero_sized;
+            metrics.add(empty_metric);
+            TRACE_INSTANT("Empty frame");
+            writer.discard(frame);
+            continue;
+        }
+
+        // Frames of a new resolution ahead of its IDR frame
+        if (status == GRAB_DROPPED) {
+            ++reconfiguration_drops;
+            writer.discard(frame);
+            continue;
+        }
+        if (grab_info.dwWidth != width || grab_info.dwHeight != height) {
+            if (width != 0) {
+                cerr << "Resolution changed from " << width << "x" << height << " to " << grab_info.dwWidth << "x"
+                     << grab_info.dwHeight << " at frame " << i << endl;
+                ++resolution_changes;
+                metrics.add(resolution_metric);
+                TRACE_INSTANT("Resolution change");
+            }
+            width = grab_info.dwWidth;
+            height = grab_info.dwHeight;
+        }
+
+        TRACE_COUNTER("Frame bytes", frame_info.dwByteSize);
+        frame->size = frame_info.dwByteSize;
+        frame->timestamp = timestamp;
+        frame->index = i;
+        frame->width = width;
+        frame->height = height;
+        frame->sei_size = 0;
+        if (args.latency_sei) {
+            CaptureTimestamp stamp;
+            stamp.frame = i;
+            stamp.grabStart = grab_wall_clock;
+            stamp.grabEnd = grab_wall_clock + (grab_end - grab_start);
+            frame->sei_offset = FirstSliceOffset(frame->data.data(), frame->size);
+            stamp.trailingBytes = static_cast<unsigned>(frame->size - frame->sei_offset);
+
+            NvU8 payload[CAPTURE_TIMESTAMP_SIZE];
+            PackCaptureTimestamp(stamp, payload);
+            frame->sei_size = WriteUserDataSei(CAPTURE_TIMESTAMP_UUID, payload, sizeof(payload), frame->sei);
+        }
+        bytes_written += frame_info.dwByteSize + frame->sei_size;
+        writer.submit(frame);
+        ++frames_written;
+        ++clip_frames;
+
+        if (clip_starting) {
+            clip_starting = false;
+            const bool written = clip.type == CONTROL_GRAB_NOW ? finish_clip() : !writer.failed();
+            metrics.observe(control_latency_metric, Timer::nanoseconds() - clip.received);
+            control.complete(written ? nullptr : "cannot write the file");
+        }
+
+        if (writer.failed()) {
+            if (!args.daemon) {
+                cerr << "Cannot write to " << output_name << endl;
+                dump_trace();
+                return EXIT_FAILURE;
+            }
+            fail_clip("cannot write the file");
+            continue;
+        }
+
+        LogLine("Wrote frame %u to %s\n", i, output_name);
     }
-    return EXIT_SUCCESS;
+    if (clip_open)
+        finish_clip();
+    writer.close();
+    if (!startup_reported && writer.firstWritten() != 0)
+        report_startup();
+    output_file.close();
+    preallocated.close();
+    AllocationTracker::stop();
+    grab_thread.invoke([&] { realtime.stop(); });
+
+    const double wall_seconds = capture_timer.elapsedNs() / 1e9;
+    const double cpu_seconds = ProcessCpuSeconds() - start_cpu;
+    const double per_hour = wall_seconds > 0 ? 3600 / wall_seconds : 0;
+
+    if (args.daemon)
+        cerr << "Recorded " << clips << " clips\n";
+    cerr << "Wrote " << frames_written << " of " << (args.daemon ? frames_written : args.frame_cnt) << " frames (skipped " << zero_sized
+         << " empty), " << bytes_written << " bytes in "
+         << fixed << setprecision(1) << wall_seconds << " s\n";
+    cerr << "Per hour: " << bytes_written * per_hour / (1 << 20) << " MiB written, "
+         << cpu_seconds * per_hour << " s of CPU time\n";
+    if (bitrate_changes != 0)
+        cerr << "Changed the bitrate " << bitrate_changes << " times, ending at " << encode_config.dwAvgBitRate
+             << " bps and " << encode_config.dwFrameRateNum << " fps\n";
+    if (resolution_changes != 0)
+        cerr << resolution_changes << " resolution changes, " << reconfiguration_drops
+             << " frames dropped until an IDR frame started the new resolution\n";
+    if (recycled != 0)
+        cerr << "Re-created the session " << recycled << " times after a grab stalled\n";
+    cerr << missed_deadlines << " grabs missed their deadline by more than half a frame period\n";
+
+    bool allocated = false;
+    if (args.check_allocations) {
+        allocated = AllocationTracker::allocations() != 0;
+        cerr << AllocationTracker::allocations() << " heap allocations (" << AllocationTracker::bytes()
+             << " bytes) in the capture loop after the first " << ALLOCATION_WARMUP_FRAMES << " frames\n";
+    }
+
+    dump_trace();
+    metrics.stopExport();
+    UnregisterProbes();
+    return allocated ? EXIT_FAILURE : EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "LatencyAnalyzer.h"
+
+#include <H264Bitstream.h>
+
+using namespace std;
+
+// Position of the last 00 00 01 start code, or 0 if there is none past the start
+static size_t LastStartCode(const vector<uint8_t>& data)
+{
+    for (size_t pos = data.size(); pos >= 3; --pos) {
+        if (data[pos - 1] == 1 && data[pos - 2] == 0 && data[pos - 3] == 0)
+            return pos - 3;
+    }
+    return 0;
+}
+
+LatencyAnalyzer::LatencyAnalyzer(bool live)
+    : m_live(live)
+    , m_frames(0)
+    , m_missing(0)
+    , m_havePrevious(false)
+    , m_previous()
+    , m_consumed(0)
+    , m_arrival(0)
+{
+}
+
+void LatencyAnalyzer::add(const uint8_t* data, size_t size, int64_t arrival)
+{
+    // Every frame completed by these bytes arrived now
+    m_arrival = arrival;
+    m_buffer.insert(m_buffer.end(), data, data + size);
+    parse(LastStartCode(m_buffer));
+
+    const unsigned long long received = m_consumed + m_buffer.size();
+    while (!m_pending.empty() && m_pending.front().completeOffset <= received) {
+        complete(m_pending.front(), arrival);
+        m_pending.pop_front();
+    }
+}
+
+vector<unsigned int> LatencyAnalyzer::finish()
+{
+    parse(m_buffer.size());
+
+    vector<unsigned int> truncated;
+    for (const PendingFrame& frame : m_pending) {
+        if (frame.completeOffset <= m_consumed)
+            complete(frame, m_arrival);
+        else
+            truncated.push_back(frame.stamp.frame);
+    }
+    m_pending.clear();
+    return truncated;
+}
+
+// Parses the NAL units in m_buffer[0..end), which are complete
+void LatencyAnalyzer::parse(size_t end)
+{
+    size_t offset = 0;
+    H264NalUnit unit;
+    while (NextNalUnit(m_buffer.data(), end, &offset, &unit)) {
+        uint8_t payload[CAPTURE_TIMESTAMP_SIZE];
+        size_t size = sizeof(payload);
+        CaptureTimestamp stamp;
+        if (!ReadUserDataSei(unit, CAPTURE_TIMESTAMP_UUID, payload, &size) ||
+            !UnpackCaptureTimestamp(payload, size, &stamp))
+            continue;
+
+        m_grabMs.push_back((stamp.grabEnd - stamp.grabStart) / 1e6);
+        if (m_havePrevious) {
+            m_intervalMs.push_back((stamp.grabStart - m_previous.grabStart) / 1e6);
+            if (stamp.frame > m_previous.frame)
+                m_missing += stamp.frame - m_previous.frame - 1;
+        }
+        m_previous = stamp;
+        m_havePrevious = true;
+
+        const unsigned long long sei_end = m_consumed + (unit.data - m_buffer.data()) + unit.size;
+        PendingFrame frame = { stamp, sei_end + stamp.trailingBytes };
+        m_pending.push_back(frame);
+    }
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + end);
+    m_consumed += end;
+}
+
+void LatencyAnalyzer::complete(const PendingFrame& frame, int64_t arrival)
+{
+    ++m_frames;
+    if (m_live) {
+        m_deliveryMs.push_back((arrival - frame.stamp.grabStart) / 1e6);
+        m_afterGrabMs.push_back((arrival - frame.stamp.grabEnd) / 1e6);
+    }
+    if (onFrame)
+        onFrame(frame.stamp, m_live ? arrival : 0);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <CaptureTimestamp.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Follows a stream written by NvFBCH264 --latency-sei as it arrives and collects, in
+// milliseconds, how long the grabs took, the intervals between them and, for a live stream,
+// how long each frame took from its grab until it was completely delivered
+class LatencyAnalyzer {
+public:
+    explicit LatencyAnalyzer(bool live);
+
+    // Adds the next bytes of the stream, which arrived at the wall-clock time arrival
+    void add(const uint8_t* data, size_t size, int64_t arrival);
+
+    // Parses the last frame, which has no start code after it. Returns the numbers of the
+    // frames the stream ended in the middle of.
+    std::vector<unsigned int> finish();
+
+    // Called for every complete frame with the time it arrived, or 0 unless live
+    std::function<void(const CaptureTimestamp&, int64_t)> onFrame;
+
+    unsigned long long frames() const { return m_frames; }
+    // Frame numbers skipped between the timestamps found: empty, unchanged or lost frames
+    unsigned long long missing() const { return m_missing; }
+
+    const std::vector<double>& grabMs() const { return m_grabMs; }
+    const std::vector<double>& intervalMs() const { return m_intervalMs; }
+    const std::vector<double>& deliveryMs() const { return m_deliveryMs; }
+    const std::vector<double>& afterGrabMs() const { return m_afterGrabMs; }
+
+protected:
+    // A frame whose SEI was seen, waiting for the rest of its access unit
+    struct PendingFrame {
+        CaptureTimestamp stamp;
+        unsigned long long completeOffset;
+    };
+
+    void parse(size_t end);
+    void complete(const PendingFrame& frame, int64_t arrival);
+
+    bool m_live;
+    std::vector<double> m_grabMs;
+    std::vector<double> m_intervalMs;
+    std::vector<double> m_deliveryMs;
+    std::vector<double> m_afterGrabMs;
+    std::deque<PendingFrame> m_pending;
+    unsigned long long m_frames;
+    unsigned long long m_missing;
+    bool m_havePrevious;
+    CaptureTimestamp m_previous;
+
+    // Bytes not yet parsed; m_buffer[0] is at offset m_consumed of the stream
+    std::vector<uint8_t> m_buffer;
+    unsigned long long m_consumed;
+    int64_t m_arrival;
+};
@@ -0,0 +1,150 @@
+#include "LatencyAnalyzer.h"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace po = boost::program_options;
+
+using namespace std;
+
+const size_t CHUNK_SIZE = 64 * 1024;
+
+struct cmdargs {
+    string input;
+    bool   live;
+    string csv;
+};
+
+static int OpenInput(const string& name)
+{
+#ifdef _WIN32
+    if (name == "-") {
+        _setmode(_fileno(stdin), _O_BINARY);
+        return _fileno(stdin);
+    }
+    return _open(name.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    return name == "-" ? STDIN_FILENO : open(name.c_str(), O_RDONLY);
+#endif
+}
+
+// Returns as soon as some bytes are available, unlike fread
+static long ReadChunk(int fd, uint8_t* buffer, size_t size)
+{
+#ifdef _WIN32
+    return _read(fd, buffer, static_cast<unsigned>(size));
+#else
+    return static_cast<long>(read(fd, buffer, size));
+#endif
+}
+
+static void Report(const string& name, vector<double> values)
+{
+    cout << left << setw(34) << name << right;
+    if (values.empty()) {
+        cout << setw(10) << "-" << '\n';
+        return;
+    }
+
+    sort(values.begin(), values.end());
+    auto quantile = [&values](double q) {
+        return values[min(values.size() - 1, static_cast<size_t>(q * values.size()))];
+    };
+    cout << fixed << setprecision(3)
+         << setw(10) << quantile(0.5) << setw(10) << quantile(0.9) << setw(10) << quantile(0.99)
+         << setw(10) << quantile(0.999) << setw(10) << values.back() << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+    cmdargs args;
+
+    po::options_description desc("Reads a stream written by NvFBCH264 --latency-sei and reports how long frames took.\nOptions");
+    desc.add_options()
+		("help,h", "Produce help message")
+		("input,i",  po::value<string>(&args.input)->default_value("-"), "H.264 file or - for stdin")
+		("live,l",   po::bool_switch(&args.live), "The input is written while it is read, e.g. piped from NvFBCH264 -o -, so delivery latency can be measured")
+		("csv,c",    po::value<string>(&args.csv), "Write the timestamps of every frame to the given CSV file")
+		;
+
+    po::positional_options_description positional;
+    positional.add("input", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+    }
+    catch (const po::error& e) {
+        cerr << e.what() << "\n" << desc << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help")) {
+        cout << desc << endl;
+        return EXIT_SUCCESS;
+    }
+
+    const int fd = OpenInput(args.input);
+    if (fd < 0) {
+        cerr << "Cannot open " << args.input << endl;
+        return EXIT_FAILURE;
+    }
+
+    ofstream csv_file;
+    if (!args.csv.empty()) {
+        csv_file.open(args.csv);
+        if (!csv_file) {
+            cerr << "Cannot open " << args.csv << endl;
+            return EXIT_FAILURE;
+        }
+        csv_file << "frame,grab_start_ns,grab_end_ns,arrival_ns\n";
+    }
+
+    LatencyAnalyzer analyzer(args.live);
+    if (csv_file.is_open()) {
+        analyzer.onFrame = [&csv_file](const CaptureTimestamp& stamp, int64_t arrival) {
+            csv_file << stamp.frame << ',' << stamp.grabStart << ',' << stamp.grabEnd << ',' << arrival << '\n';
+        };
+    }
+
+    vector<uint8_t> chunk(CHUNK_SIZE);
+    for (;;) {
+        const long bytes = ReadChunk(fd, chunk.data(), chunk.size());
+        if (bytes < 0) {
+            cerr << "Cannot read " << args.input << endl;
+            return EXIT_FAILURE;
+        }
+        if (bytes == 0)
+            break;
+        analyzer.add(chunk.data(), static_cast<size_t>(bytes), WallClockNanoseconds());
+    }
+
+    for (unsigned int frame : analyzer.finish())
+        cerr << "Frame " << frame << " is truncated" << endl;
+
+    cout << analyzer.frames() << " frames with timestamps, " << analyzer.missing() << " frames not in the stream (empty, unchanged or lost)\n\n";
+    cout << left << setw(34) << "Milliseconds" << right << setw(10) << "p50" << setw(10) << "p90" << setw(10) << "p99"
+         << setw(10) << "p99.9" << setw(10) << "max" << '\n';
+    Report("Grab", analyzer.grabMs());
+    Report("Interval between grabs", analyzer.intervalMs());
+    if (args.live) {
+        Report("Grab start to delivery", analyzer.deliveryMs());
+        Report("Grab end to delivery", analyzer.afterGrabMs());
+    }
+
+    return analyzer.frames() > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
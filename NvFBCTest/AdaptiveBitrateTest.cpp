@@ -0,0 +1,156 @@
+#include "Test.h"
+#include "../NvFBCH264/BitrateController.h"
+#include "../NvFBCH264/FramePacer.h"
+#include "../NvFBCH264/FrameWriter.h"
+#include "../NvFBCH264/SyntheticEncoder.h"
+#include "../NvFBCH264/ThrottledBuffer.h"
+
+#include <Timer.h>
+
+#include <ostream>
+#include <streambuf>
+#include <string.h>
+
+using namespace std;
+
+const int64_t MS = 1000000;
+
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize count) override { return count; }
+};
+
+// The adaptive bitrate part of the NvFBCH264 loop, on an encoder which returns a frame at every
+// grab as NOWAIT grabs of a busy desktop do, into an output which is slow for the first second.
+// At the minimum bitrate the controller halves the frame rate, which the grabs have to follow
+// once the output caught up, until the controller restores it five seconds later.
+TEST(ReducedFrameRatePacesTheGrabs)
+{
+    NvFBC_H264HWEncoder_Config config = {0};
+    config.dwVersion = NVFBC_H264HWENC_CONFIG_VER;
+    config.dwFrameRateNum = 30;
+    config.dwFrameRateDen = 1;
+    config.dwAvgBitRate = 4000000;
+    config.dwPeakBitRate = 8000000;
+    config.dwGOPLength = 30;
+    config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_VBR;
+    config.ePresetConfig = NVFBC_H264_PRESET_LOW_LATENCY_HQ;
+    NVFBC_H264_SETUP_PARAMS setup = {0};
+    setup.pEncodeConfig = &config;
+
+    SyntheticEncoder encoder(640, 360, 0, false);
+    DWORD max_width = 0, max_height = 0;
+    CHECK(encoder.create(&max_width, &max_height) && encoder.setUp(&setup) == NVFBC_SUCCESS);
+
+    // A tenth of what the encoder makes at 30 fps
+    NullBuffer null_buffer;
+    ThrottledBuffer throttled_buffer(&null_buffer, config.dwAvgBitRate / 8 / 10, 0, 1);
+    ostream sink(&throttled_buffer);
+    FrameWriter writer(sink, nullptr, 4, (size_t)max_width * max_height);
+
+    BitrateController controller(config.dwAvgBitRate, config.dwAvgBitRate, 30, 15);
+    FramePacer pacer;
+
+    NvFBCFrameGrabInfo grab_info;
+    NvFBC_H264HWEncoder_FrameInfo frame_info;
+    NVFBC_H264_GRAB_FRAME_PARAMS params;
+    const int64_t start = Timer::nanoseconds();
+    const int64_t measure_from = start + 2000 * MS, measure_to = start + 3000 * MS;
+    unsigned measured = 0;
+    for (unsigned i = 0;; ++i) {
+        const int64_t now = Timer::nanoseconds();
+        if (now >= measure_to)
+            break;
+        if (controller.update(now, writer.queueDepth(), writer.queueSize(), writer.bytesWritten(),
+                              writer.writeNanoseconds())) {
+            config.dwFrameRateNum = controller.frameRate();
+            CHECK(encoder.setUp(&setup) == NVFBC_SUCCESS);
+            pacer.setPeriod(config.dwFrameRateNum < 30 ? 1000000000LL / config.dwFrameRateNum : 0);
+        }
+
+        EncodedFrame* frame = writer.acquire();
+        pacer.wait();
+        memset(&grab_info, 0, sizeof(grab_info));
+        memset(&frame_info, 0, sizeof(frame_info));
+        memset(&params, 0, sizeof(params));
+        params.dwVersion = NVFBC_H264_GRAB_FRAME_PARAMS_VER;
+        params.pNvFBCFrameGrabInfo = &grab_info;
+        params.pFrameInfo = &frame_info;
+        params.pBitStreamBuffer = frame->data.data();
+        CHECK(encoder.grabFrame(&params) == NVFBC_SUCCESS);
+        if (Timer::nanoseconds() >= measure_from)
+            ++measured;
+
+        frame->size = frame_info.dwByteSize;
+        frame->timestamp = (Timer::nanoseconds() - start) / 1e6;
+        frame->index = i;
+        frame->width = grab_info.dwWidth;
+        frame->height = grab_info.dwHeight;
+        frame->sei_size = 0;
+        writer.submit(frame);
+    }
+    writer.close();
+
+    CHECK(controller.frameRate() == 15);
+    CHECK(measured >= 13 && measured <= 16);
+}
+
+// A change the encoder did not take is not the controller's state either
+TEST(BitrateControllerRevertsARejectedChange)
+{
+    BitrateController controller(4000000, 1000000, 30, 15);
+    int64_t now = 1;
+    controller.update(now, 0, 8, 0, 0);
+    now += 500 * MS;
+    CHECK(controller.update(now, 8, 8, 0, 0));
+    CHECK(controller.bitrate() < 4000000);
+
+    controller.revert(4000000, 30);
+    CHECK(controller.bitrate() == 4000000);
+    CHECK(controller.frameRate() == 30);
+
+    // Tried again after the cooldown
+    for (unsigned window = 0; window < 2; ++window) {
+        now += 500 * MS;
+        CHECK(!controller.update(now, 8, 8, 0, 0));
+    }
+    now += 500 * MS;
+    CHECK(controller.update(now, 8, 8, 0, 0));
+    CHECK(controller.bitrate() < 4000000);
+}
+
+// The frame rate never halves down to 0, the loop divides by it
+TEST(BitrateControllerKeepsAFrameRate)
+{
+    BitrateController controller(4000000, 4000000, 30, 0);
+    int64_t now = 1;
+    controller.update(now, 0, 8, 0, 0);
+    for (unsigned window = 0; window < 40; ++window) {
+        now += 500 * MS;
+        controller.update(now, 8, 8, 0, 0);
+    }
+    CHECK(controller.frameRate() == 1);
+}
+
+// A queue of one holds a frame all the time, which is no sign of the output falling behind
+TEST(BitrateControllerStepsUpWithAQueueOfOne)
+{
+    BitrateController controller(4000000, 1000000, 30, 15);
+    controller.revert(2000000, 30);
+    int64_t now = 1;
+    controller.update(now, 1, 1, 0, 0);
+    for (unsigned window = 0; window < 9; ++window) {
+        now += 500 * MS;
+        CHECK(!controller.update(now, 1, 1, 0, 0));
+    }
+    now += 500 * MS;
+    CHECK(controller.update(now, 1, 1, 0, 0));
+    CHECK(controller.bitrate() > 2000000);
+
+    // The writer being busy still counts
+    const uint32_t bitrate = controller.bitrate();
+    now += 500 * MS;
+    CHECK(controller.update(now, 1, 1, 0, 500 * MS));
+    CHECK(controller.bitrate() < bitrate);
+}
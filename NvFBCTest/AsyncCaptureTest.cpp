@@ -0,0 +1,72 @@
+#include "Test.h"
+#include "../NvFBCCapture/AsyncCapture.h"
+
+#if NVFBC_ASYNC_CAPTURE
+
+#include "../NvFBCH264/SyntheticEncoder.h"
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace std;
+
+// A grab stuck for longer than the timeout costs the pool its thread and the coroutine its
+// session, and both go on with new ones. Once the stuck grab returns, its thread ends rather
+// than joining the pool next to the one which replaced it.
+TEST(AsyncCaptureSessionAbandonsAStalledGrab)
+{
+    mutex lock;
+    set<thread::id> workers;
+    OffloadPool pool(1);
+    EventLoop loop;
+    AsyncCaptureSession session(loop, pool);
+    CaptureSessionConfig config;
+    config.buffers = 2;
+    config.grabTimeoutMs = 100;
+    unsigned made = 0;
+    config.makeEncoder = [&made]() -> Encoder* {
+        SyntheticEncoder* encoder = new SyntheticEncoder(640, 360, 0, false);
+        if (made++ == 0)
+            encoder->stall(3, 400);
+        return encoder;
+    };
+    CHECK(session.open(config, false) == NVFBC_SUCCESS);
+
+    unsigned frames = 0, idr = 0;
+    auto consume = [&]() -> DetachedTask {
+        for (unsigned i = 0; i < 10; ++i) {
+            AsyncFrame frame = co_await session.nextFrame();
+            if (!frame)
+                break;
+            ++frames;
+            if (i == 2 && frame->idr)
+                ++idr;
+        }
+        loop.stop();
+    };
+    loop.post([&] { consume(); });
+    loop.run();
+
+    CHECK(frames == 10);
+    CHECK(idr == 1);
+    CHECK(session.recreated() == 1);
+    CHECK(made == 2);
+
+    // Past the end of the stall, jobs which overlap all run on the one thread of the pool
+    this_thread::sleep_for(chrono::milliseconds(500));
+    for (unsigned i = 0; i < 4; ++i) {
+        pool.submit([&] {
+            this_thread::sleep_for(chrono::milliseconds(20));
+            lock_guard<mutex> guard(lock);
+            workers.insert(this_thread::get_id());
+        });
+    }
+    this_thread::sleep_for(chrono::milliseconds(200));
+    lock_guard<mutex> guard(lock);
+    CHECK(workers.size() == 1);
+    session.close();
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "Test.h"
+#include "../NvFBCH264/AllocationTracker.h"
+
+#include <Bitmap.h>
+#include <ScratchPool.h>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const int BITMAP_WIDTH = 642;
+const int BITMAP_HEIGHT = 362;
+const int BITMAP_SAVES = 20;
+
+// Once every conversion ran, repeating them takes every pixel buffer from the pool: no
+// operator new and no new memory from the OS
+TEST(BitmapSavesDoNotAllocateOnceWarm)
+{
+    vector<BYTE> input((size_t)BITMAP_WIDTH * BITMAP_HEIGHT * 4);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = (BYTE)(i * 7);
+
+    const string file_name = TestScratch() + "/nvfbctest.bmp";
+    const char* name = file_name.c_str();
+    BYTE* data = input.data();
+    RECT rect = { 10, 20, 300, 200 };
+
+    auto save_all = [&] {
+        bool saved = SaveRGB(name, data, BITMAP_WIDTH, BITMAP_HEIGHT);
+        saved &= SaveBGR(name, data, BITMAP_WIDTH, BITMAP_HEIGHT);
+        saved &= SaveARGB(name, data, BITMAP_WIDTH, BITMAP_HEIGHT);
+        saved &= SaveARGBRect(name, data, BITMAP_WIDTH, BITMAP_HEIGHT, rect);
+        saved &= SaveRGBPlanar(name, data, BITMAP_WIDTH, BITMAP_HEIGHT);
+        saved &= SaveYUV(name, data, BITMAP_WIDTH, BITMAP_HEIGHT);
+        return saved;
+    };
+    CHECK(save_all());
+
+    const ScratchPoolStats warm = ScratchPool::instance().stats();
+    AllocationTracker::trackThread();
+    const unsigned long long allocations = AllocationTracker::allocations();
+    AllocationTracker::start();
+    bool saved = true;
+    for (int i = 0; i < BITMAP_SAVES; ++i)
+        saved &= save_all();
+    AllocationTracker::stop();
+    const ScratchPoolStats stats = ScratchPool::instance().stats();
+
+    CHECK(saved);
+    CHECK(AllocationTracker::allocations() == allocations);
+    CHECK(stats.systemAllocations == warm.systemAllocations);
+    CHECK(stats.acquires == warm.acquires + BITMAP_SAVES * 7);
+
+    for (const char* suffix : { "", "-red", "-green", "-blue", "-y", "-u", "-v" })
+        remove((TestScratch() + "/nvfbctest" + suffix + ".bmp").c_str());
+}
+
+// The planes are saved next to the file name given, with or without an extension
+TEST(BitmapPlanesAreSavedWithSuffixes)
+{
+    vector<BYTE> input(16 * 16 * 3 / 2, 128);
+    const string base = TestScratch() + "/nvfbcplanes";
+    CHECK(SaveYUV((base + ".bmp").c_str(), input.data(), 16, 16));
+    CHECK(SaveYUV(base.c_str(), input.data(), 16, 16));
+
+    for (const char* name : { "-y.bmp", "-u.bmp", "-v.bmp", "-y", "-u", "-v" }) {
+        const string file_name = base + name;
+        FILE* file = fopen(file_name.c_str(), "rb");
+        CHECK(file != NULL);
+        if (file)
+            fclose(file);
+        remove(file_name.c_str());
+    }
+}
@@ -0,0 +1,119 @@
+#include "Test.h"
+#include "../NvFBCH264/AllocationTracker.h"
+#include "../NvFBCH264/FrameWriter.h"
+#include "../NvFBCH264/Grabber.h"
+#include "../NvFBCH264/SyntheticEncoder.h"
+
+#include <memory>
+#include <new>
+#include <ostream>
+#include <stdint.h>
+#include <streambuf>
+
+using namespace std;
+
+const unsigned WARMUP_FRAMES = 100;
+const unsigned CHECKED_FRAMES = 10000;
+// The defaults of NvFBCH264: a stuck grab is reported after a second and given up on after five
+const LONGLONG STALL_REPORT_NS = 1000000000LL;
+const LONGLONG GRAB_TIMEOUT_NS = 5000000000LL;
+
+// An ostream that throws away what is written, so the loop is checked without the disk
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize count) override { return count; }
+};
+
+// The grab and write path of NvFBCH264 as its loop runs it: a Grabber grabbing on the grab
+// thread into the writer's buffers, with the same timeouts, empty frames discarded and the
+// others written by the writer thread. Once warmed up, neither thread may allocate in 10,000
+// frames.
+TEST(CaptureLoopDoesNotAllocateOverTenThousandFrames)
+{
+    CHECK(AllocationTracker::available());
+
+    NvFBC_H264HWEncoder_Config config = {0};
+    config.dwVersion = NVFBC_H264HWENC_CONFIG_VER;
+    config.dwFrameRateNum = 30;
+    config.dwFrameRateDen = 1;
+    config.dwAvgBitRate = 8000000;
+    config.dwPeakBitRate = 16000000;
+    config.dwGOPLength = 100;
+    config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_VBR;
+    config.ePresetConfig = NVFBC_H264_PRESET_LOW_LATENCY_HQ;
+    NVFBC_H264_SETUP_PARAMS setup = {0};
+    setup.dwVersion = NVFBC_H264_SETUP_PARAMS_VER;
+    setup.bWithHWCursor = TRUE;
+    setup.pEncodeConfig = &config;
+
+    unique_ptr<Encoder> encoder(new SyntheticEncoder(1280, 720, 0.3, false));
+    GrabThread grab_thread;
+    DWORD max_width = 0, max_height = 0;
+    NVFBCRESULT result = NVFBC_ERROR_GENERIC;
+    grab_thread.invoke([&] {
+        AllocationTracker::trackThread();
+        result = encoder->create(&max_width, &max_height) ? encoder->setUp(&setup) : NVFBC_ERROR_GENERIC;
+    });
+    CHECK(result == NVFBC_SUCCESS);
+    if (result != NVFBC_SUCCESS)
+        return;
+
+    Grabber grabber(encoder, &grab_thread, &setup, &max_width, &max_height);
+    grabber.setTimeouts(STALL_REPORT_NS, GRAB_TIMEOUT_NS);
+
+    NullBuffer null_buffer;
+    ostream sink(&null_buffer);
+    FrameWriter writer(sink, nullptr, 4, grabber.maxFrameSize());
+    AllocationTracker::trackThread();
+
+    unsigned written = 0;
+    bool grabbed = true;
+    const unsigned long long allocations = AllocationTracker::allocations();
+    for (unsigned i = 0; i < WARMUP_FRAMES + CHECKED_FRAMES; ++i) {
+        if (i == WARMUP_FRAMES)
+            AllocationTracker::start();
+
+        EncodedFrame* frame = writer.acquire();
+        const GrabStatus status = grabber.grab(frame->data.data(), &result);
+        grabbed &= status == GRAB_FRAME || status == GRAB_EMPTY;
+        if (status != GRAB_FRAME) {
+            writer.discard(frame);
+            continue;
+        }
+
+        const NvFBCFrameGrabInfo& grab_info = grabber.grabInfo();
+        frame->size = grabber.frameInfo().dwByteSize;
+        frame->timestamp = i * 1000.0 / 30;
+        frame->index = i;
+        frame->width = grab_info.dwWidth;
+        frame->height = grab_info.dwHeight;
+        frame->sei_size = 0;
+        writer.submit(frame);
+        ++written;
+    }
+    writer.drain();
+    AllocationTracker::stop();
+    writer.close();
+
+    CHECK(grabbed);
+    CHECK(written > CHECKED_FRAMES / 2);
+    CHECK(!writer.failed());
+    CHECK(AllocationTracker::allocations() == allocations);
+}
+
+// Types aligned beyond what malloc guarantees go through the aligned operator new, which has
+// to count as well
+TEST(AllocationTrackerCountsAlignedAllocations)
+{
+    CHECK(AllocationTracker::available());
+
+    AllocationTracker::trackThread();
+    const unsigned long long allocations = AllocationTracker::allocations();
+    AllocationTracker::start();
+    void* memory = operator new(64, align_val_t(64));
+    AllocationTracker::stop();
+    CHECK(reinterpret_cast<uintptr_t>(memory) % 64 == 0);
+    operator delete(memory, align_val_t(64));
+    CHECK(AllocationTracker::allocations() == allocations + 1);
+}
@@ -0,0 +1,181 @@
+#include "Test.h"
+#include "../NvFBCCapture/CaptureSession.h"
+#include "../NvFBCH264/SyntheticEncoder.h"
+
+#include <Timer.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+const DWORD GRAB_TIMEOUT_MS = 100;
+
+// A session on synthetic encoders, the first of which is changed by prepare
+template <typename Prepare>
+static NVFBCRESULT Open(CaptureSession& session, unsigned* made, Prepare prepare)
+{
+    CaptureSessionConfig config;
+    config.buffers = 2;
+    config.grabTimeoutMs = GRAB_TIMEOUT_MS;
+    config.makeEncoder = [made, prepare]() -> Encoder* {
+        SyntheticEncoder* encoder = new SyntheticEncoder(640, 360, 0, false);
+        if ((*made)++ == 0)
+            prepare(*encoder);
+        return encoder;
+    };
+    return session.open(config);
+}
+
+// An invalidated session is created again, larger, and the frames go on at the new size from
+// its first frame, an IDR frame
+TEST(CaptureSessionRecreatesAnInvalidatedSession)
+{
+    CaptureSession session;
+    unsigned made = 0;
+    CHECK(Open(session, &made, [](SyntheticEncoder& encoder) { encoder.changeResolution(3, 1280, 720); }) == NVFBC_SUCCESS);
+
+    const CaptureFrame* frame = nullptr;
+    for (unsigned i = 0; i < 2; ++i) {
+        CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS && frame->width == 640);
+        session.release(frame);
+    }
+    // The encoder, and with it the desktop, outlives its session
+    CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS);
+    CHECK(session.recreated() == 1);
+    CHECK(made == 1);
+    CHECK(session.maxWidth() == 1280 && session.maxHeight() == 720);
+    CHECK(frame->width == 1280 && frame->height == 720 && frame->idr);
+    CHECK(frame->size <= (size_t)session.maxWidth() * session.maxHeight());
+    session.release(frame);
+}
+
+// A grab which blocks is given up on after the timeout; the session goes on with a new encoder
+// on a new thread, starting with an IDR frame
+TEST(CaptureSessionAbandonsAStalledGrab)
+{
+    CaptureSession session;
+    unsigned made = 0;
+    CHECK(Open(session, &made, [](SyntheticEncoder& encoder) { encoder.stall(3, 600); }) == NVFBC_SUCCESS);
+
+    const CaptureFrame* frame = nullptr;
+    for (unsigned i = 0; i < 2; ++i) {
+        CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS);
+        session.release(frame);
+    }
+    const LONGLONG start = Timer::nanoseconds();
+    CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS);
+    const LONGLONG waited = (Timer::nanoseconds() - start) / 1000000;
+    CHECK(waited >= GRAB_TIMEOUT_MS && waited < 500);
+    CHECK(session.recreated() == 1);
+    CHECK(made == 2);
+    CHECK(frame->idr && frame->index == 2);
+    session.release(frame);
+
+    // With a buffer less, the leaked one is replaced when next acquired
+    for (unsigned i = 0; i < 4; ++i) {
+        CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS && frame->size != 0);
+        session.release(frame);
+    }
+    // Until the stuck grab returned into its leaked buffer and encoder
+    this_thread::sleep_for(chrono::milliseconds(600));
+}
+
+// A smaller resolution fits the session, which goes on with P frames; those are dropped and
+// an IDR frame is forced, which is the first frame at the new size
+TEST(CaptureSessionStartsANewResolutionWithAnIdrFrame)
+{
+    CaptureSession session;
+    unsigned made = 0;
+    CHECK(Open(session, &made, [](SyntheticEncoder& encoder) { encoder.changeResolution(3, 320, 180); }) == NVFBC_SUCCESS);
+
+    const CaptureFrame* frame = nullptr;
+    for (unsigned i = 0; i < 2; ++i) {
+        CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS && frame->width == 640);
+        session.release(frame);
+    }
+    CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS);
+    CHECK(frame->width == 320 && frame->height == 180 && frame->idr);
+    CHECK(frame->index == 2);
+    CHECK(session.recreated() == 0);
+    session.release(frame);
+
+    CHECK(session.nextFrame(&frame) == NVFBC_SUCCESS);
+    CHECK(frame->width == 320 && !frame->idr);
+    session.release(frame);
+}
+
+// Frames handed to another thread are released there, while nextFrame() waits for a buffer
+TEST(CaptureSessionTakesReleasesFromAnotherThread)
+{
+    CaptureSession session;
+    unsigned made = 0;
+    CHECK(Open(session, &made, [](SyntheticEncoder&) {}) == NVFBC_SUCCESS);
+
+    mutex lock;
+    condition_variable queued;
+    deque<const CaptureFrame*> frames;
+    bool done = false;
+    thread consumer([&] {
+        unique_lock<mutex> guard(lock);
+        for (;;) {
+            queued.wait(guard, [&] { return !frames.empty() || done; });
+            if (frames.empty())
+                return;
+            const CaptureFrame* frame = frames.front();
+            frames.pop_front();
+            guard.unlock();
+            this_thread::sleep_for(chrono::milliseconds(2));
+            session.release(frame);
+            guard.lock();
+        }
+    });
+
+    bool grabbed = true, ordered = true;
+    for (unsigned i = 0; i < 50; ++i) {
+        const CaptureFrame* frame = nullptr;
+        grabbed &= session.nextFrame(&frame) == NVFBC_SUCCESS;
+        if (!frame)
+            break;
+        ordered &= frame->index == i;
+        lock_guard<mutex> guard(lock);
+        frames.push_back(frame);
+        queued.notify_one();
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        done = true;
+    }
+    queued.notify_one();
+    consumer.join();
+
+    CHECK(grabbed);
+    CHECK(ordered);
+    CHECK(session.recreated() == 0);
+}
+
+// Grabs on a shared pool wait for a buffer without blocking: whenFree() holds the job back
+// until the consumer releases a frame
+TEST(CaptureSessionCallsBackOnceABufferIsFree)
+{
+    CaptureSession session;
+    unsigned made = 0;
+    CHECK(Open(session, &made, [](SyntheticEncoder&) {}) == NVFBC_SUCCESS);
+
+    unsigned called = 0;
+    const CaptureFrame* held[2] = {};
+    for (unsigned i = 0; i < 2; ++i) {
+        CHECK(session.whenFree([&called] { ++called; }));
+        CHECK(session.nextFrame(&held[i]) == NVFBC_SUCCESS);
+    }
+    CHECK(!session.whenFree([&called] { ++called; }));
+    CHECK(called == 0);
+
+    session.release(held[0]);
+    CHECK(called == 1);
+    session.release(held[1]);
+    CHECK(called == 1);
+}
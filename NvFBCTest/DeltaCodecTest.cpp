@@ -0,0 +1,111 @@
+#include "Test.h"
+
+#include <DeltaCodec.h>
+
+#include <cstdint>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+const int DELTA_TILE_SIZE = 64;
+
+// Deterministic noise, so a failure can be reproduced
+static unsigned int Noise(unsigned int* state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state;
+}
+
+// Left half noise, right half few colors: the noisy tiles are stored raw and the right-edge tiles
+// try a palette. With colors, every pixel of a narrow edge tile differs from its neighbors.
+static void FillFrame(vector<uint8_t>& frame, int width, int height, unsigned int seed, unsigned int colors)
+{
+    frame.resize((size_t)width * height * 4);
+    unsigned int* pixels = (unsigned int*)frame.data();
+    unsigned int state = seed;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const unsigned int noise = Noise(&state);
+            pixels[y * width + x] = x < width / 2 ? noise : 0xFF000000u | ((unsigned int)(x + y) % colors) * 0x010203u;
+        }
+    }
+}
+
+// Encodes the frames one after the other and checks that each one decodes to what went in,
+// reading the frames back to back from one buffer as an archive would
+static bool RoundTrip(int width, int height, int threads, const vector<vector<uint8_t>>& frames)
+{
+    DeltaEncoder encoder(DELTA_TILE_SIZE, threads);
+    vector<uint8_t> archive;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        vector<uint8_t> encoded;
+        if (!encoder.encode(frames[i].data(), width, height, encoded, i == 0))
+            return false;
+        archive.insert(archive.end(), encoded.begin(), encoded.end());
+    }
+
+    DeltaDecoder decoder;
+    size_t offset = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        size_t size = 0;
+        if (!decoder.decode(archive.data() + offset, archive.size() - offset, &size))
+            return false;
+        if (decoder.width() != width || decoder.height() != height ||
+            memcmp(decoder.frame(), frames[i].data(), frames[i].size()) != 0)
+            return false;
+        offset += size;
+    }
+    return offset == archive.size();
+}
+
+// Widths of 1 to 4 past a whole tile leave a narrow tile at the right edge, the one whose
+// palette costs more than its pixels
+TEST(DeltaCodecRoundTripsNarrowEdgeTiles)
+{
+    for (int width : { 1, 2, 3, 4, 65, 66, 67, 68, 129, 132, 200 }) {
+        for (int height : { 1, 37, 64, 130 }) {
+            for (int threads : { 1, 3 }) {
+                for (unsigned int colors : { 2u, 64u, 256u }) {
+                    vector<vector<uint8_t>> frames(3);
+                    FillFrame(frames[0], width, height, 1, colors);
+                    FillFrame(frames[1], width, height, 2, colors);
+                    frames[2] = frames[1];
+                    // A few changed pixels, so most tiles are skipped
+                    frames[2][0] ^= 0xFF;
+                    frames[2][frames[2].size() - 1] ^= 0xFF;
+
+                    const bool round_trip = RoundTrip(width, height, threads, frames);
+                    CHECK(round_trip);
+                    if (!round_trip)
+                        return;
+                }
+            }
+        }
+    }
+}
+
+TEST(DeltaCodecRoundTripsSolidAndResizedFrames)
+{
+    DeltaEncoder encoder(DELTA_TILE_SIZE, 2);
+    DeltaDecoder decoder;
+    vector<uint8_t> encoded;
+
+    vector<uint8_t> solid((size_t)100 * 70 * 4, 0x7F);
+    CHECK(encoder.encode(solid.data(), 100, 70, encoded));
+    CHECK(decoder.decode(encoded.data(), encoded.size()));
+    CHECK(memcmp(decoder.frame(), solid.data(), solid.size()) == 0);
+
+    // A new size is a key frame on its own
+    vector<uint8_t> resized;
+    FillFrame(resized, 67, 33, 3, 16);
+    CHECK(encoder.encode(resized.data(), 67, 33, encoded));
+    CHECK(decoder.decode(encoded.data(), encoded.size()));
+    CHECK(decoder.width() == 67 && decoder.height() == 33);
+    CHECK(memcmp(decoder.frame(), resized.data(), resized.size()) == 0);
+
+    // A delta frame needs the frame before it
+    CHECK(encoder.encode(resized.data(), 67, 33, encoded));
+    DeltaDecoder fresh;
+    CHECK(!fresh.decode(encoded.data(), encoded.size()));
+}
@@ -0,0 +1,124 @@
+#include "Test.h"
+
+#include <DirtyRegions.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// 7 x 4 tiles of 16 pixels, the last column 4 pixels wide and the last row 2 pixels high
+const int DIRTY_WIDTH = 100;
+const int DIRTY_HEIGHT = 50;
+const int DIRTY_TILE = 16;
+
+static vector<BYTE> DirtyFrame(int pitch = DIRTY_WIDTH * 4)
+{
+    vector<BYTE> frame((size_t)pitch * DIRTY_HEIGHT);
+    for (size_t i = 0; i < frame.size(); ++i)
+        frame[i] = (BYTE)(i * 7 + i / 1000);
+    return frame;
+}
+
+static void Touch(vector<BYTE>& frame, int x, int y, int pitch = DIRTY_WIDTH * 4)
+{
+    ++frame[(size_t)y * pitch + x * 4 + 1];
+}
+
+static bool SameRects(vector<RECT> rects, vector<RECT> expected)
+{
+    auto before = [](const RECT& a, const RECT& b) {
+        return a.top != b.top ? a.top < b.top : a.left < b.left;
+    };
+    sort(rects.begin(), rects.end(), before);
+    sort(expected.begin(), expected.end(), before);
+    if (rects.size() != expected.size())
+        return false;
+    for (size_t i = 0; i < rects.size(); ++i) {
+        if (rects[i].left != expected[i].left || rects[i].top != expected[i].top ||
+            rects[i].right != expected[i].right || rects[i].bottom != expected[i].bottom)
+            return false;
+    }
+    return true;
+}
+
+// The first frame is dirty as a whole, an unchanged one not at all
+TEST(DirtyRegionsStartWithTheWholeFrame)
+{
+    DirtyRegionTracker tracker(DIRTY_TILE);
+    const vector<BYTE> frame = DirtyFrame();
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT), { { 0, 0, DIRTY_WIDTH, DIRTY_HEIGHT } }));
+    CHECK(tracker.tileCount() == 28);
+    CHECK(tracker.dirtyTileCount() == 28);
+
+    CHECK(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT).empty());
+    CHECK(tracker.dirtyTileCount() == 0);
+}
+
+// A changed pixel dirties its tile, clipped to the frame at the edges
+TEST(DirtyRegionsFindChangedTiles)
+{
+    DirtyRegionTracker tracker(DIRTY_TILE);
+    vector<BYTE> frame = DirtyFrame();
+    tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT);
+
+    Touch(frame, 37, 20);
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT), { { 32, 16, 48, 32 } }));
+    CHECK(tracker.dirtyTileCount() == 1);
+
+    Touch(frame, 99, 49);
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT), { { 96, 48, 100, 50 } }));
+}
+
+// Runs of dirty tiles merge across a row, and down into the next row when they span the same
+// columns; other shapes stay separate rectangles
+TEST(DirtyRegionsMergeTiles)
+{
+    DirtyRegionTracker tracker(DIRTY_TILE);
+    vector<BYTE> frame = DirtyFrame();
+    tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT);
+
+    // A block of 2 x 2 tiles and a tile on its own
+    Touch(frame, 20, 5), Touch(frame, 40, 5), Touch(frame, 20, 25), Touch(frame, 40, 25), Touch(frame, 85, 20);
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT),
+                    { { 16, 0, 48, 32 }, { 80, 16, 96, 32 } }));
+    CHECK(tracker.dirtyTileCount() == 5);
+
+    // An L, three tiles wide on top and one below
+    Touch(frame, 20, 5), Touch(frame, 40, 5), Touch(frame, 50, 5), Touch(frame, 20, 25);
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT),
+                    { { 16, 0, 64, 16 }, { 16, 16, 32, 32 } }));
+}
+
+// Bytes past the end of a row are not part of the frame
+TEST(DirtyRegionsHonorThePitch)
+{
+    const int pitch = DIRTY_WIDTH * 4 + 32;
+    DirtyRegionTracker tracker(DIRTY_TILE);
+    vector<BYTE> frame = DirtyFrame(pitch);
+    tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT, pitch);
+
+    for (int y = 0; y < DIRTY_HEIGHT; ++y)
+        ++frame[(size_t)y * pitch + DIRTY_WIDTH * 4 + 5];
+    CHECK(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT, pitch).empty());
+
+    Touch(frame, 3, 40, pitch);
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT, pitch), { { 0, 32, 16, 48 } }));
+}
+
+// A new size or a reset makes the next frame dirty as a whole again
+TEST(DirtyRegionsRestartOnNewSizes)
+{
+    DirtyRegionTracker tracker(DIRTY_TILE);
+    const vector<BYTE> frame = DirtyFrame();
+    tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT);
+
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH / 2, DIRTY_HEIGHT, DIRTY_WIDTH * 4),
+                    { { 0, 0, DIRTY_WIDTH / 2, DIRTY_HEIGHT } }));
+    CHECK(tracker.tileCount() == 16);
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT), { { 0, 0, DIRTY_WIDTH, DIRTY_HEIGHT } }));
+    CHECK(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT).empty());
+
+    tracker.reset();
+    CHECK(SameRects(tracker.update(frame.data(), DIRTY_WIDTH, DIRTY_HEIGHT), { { 0, 0, DIRTY_WIDTH, DIRTY_HEIGHT } }));
+}
@@ -0,0 +1,58 @@
+#include "Test.h"
+#include "../NvFBCH264/FrameWriter.h"
+
+#include <ostream>
+#include <streambuf>
+
+using namespace std;
+
+// An output which takes nothing while full is set, like a full disk
+class FullBuffer : public streambuf {
+public:
+    FullBuffer() : full(false), written(0) {}
+    bool full;
+    size_t written;
+
+protected:
+    int overflow(int c) override { return full ? traits_type::eof() : c; }
+    streamsize xsputn(const char*, streamsize count) override
+    {
+        if (full)
+            return 0;
+        written += count;
+        return count;
+    }
+};
+
+static void Write(FrameWriter& writer, unsigned index)
+{
+    EncodedFrame* frame = writer.acquire();
+    frame->size = 100;
+    frame->timestamp = index;
+    frame->index = index;
+    frame->width = 64;
+    frame->height = 64;
+    frame->sei_size = 0;
+    writer.submit(frame);
+}
+
+// A daemon goes on with the next clip after one it could not write
+TEST(FrameWriterWritesAgainOnceAFailureIsCleared)
+{
+    FullBuffer buffer;
+    ostream output(&buffer);
+    FrameWriter writer(output, nullptr, 2, 100);
+
+    buffer.full = true;
+    Write(writer, 0);
+    writer.drain();
+    CHECK(writer.failed());
+
+    writer.clearFailure();
+    buffer.full = false;
+    Write(writer, 1);
+    writer.drain();
+    CHECK(!writer.failed());
+    CHECK(buffer.written == 100);
+    writer.close();
+}
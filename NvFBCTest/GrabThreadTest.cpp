@@ -0,0 +1,137 @@
+#include "Test.h"
+#include "../NvFBCH264/FrameWriter.h"
+#include "../NvFBCH264/GrabThread.h"
+#include "../NvFBCH264/SyntheticEncoder.h"
+
+#include <Timer.h>
+
+#include <chrono>
+#include <ostream>
+#include <streambuf>
+#include <string.h>
+#include <thread>
+
+using namespace std;
+
+const LONGLONG MS = 1000000;
+const LONGLONG GRAB_TIMEOUT_NS = 100 * MS;
+
+// An output which takes 250 ms for every frame, so the writer's buffers are all queued and
+// acquire() blocks for longer than the grab timeout
+class SlowBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char*, streamsize count) override
+    {
+        this_thread::sleep_for(chrono::milliseconds(250));
+        return count;
+    }
+};
+
+static bool SetUp(SyntheticEncoder& encoder, DWORD* max_width, DWORD* max_height)
+{
+    static NvFBC_H264HWEncoder_Config config = {0};
+    config.dwVersion = NVFBC_H264HWENC_CONFIG_VER;
+    config.dwFrameRateNum = 30;
+    config.dwFrameRateDen = 1;
+    config.dwAvgBitRate = 2000000;
+    config.dwPeakBitRate = 4000000;
+    config.dwGOPLength = 30;
+    config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_VBR;
+    config.ePresetConfig = NVFBC_H264_PRESET_LOW_LATENCY_HQ;
+    NVFBC_H264_SETUP_PARAMS setup = {0};
+    setup.pEncodeConfig = &config;
+    return encoder.create(max_width, max_height) && encoder.setUp(&setup) == NVFBC_SUCCESS;
+}
+
+struct Grab {
+    NvFBCFrameGrabInfo grabInfo;
+    NvFBC_H264HWEncoder_FrameInfo frameInfo;
+    NVFBC_H264_GRAB_FRAME_PARAMS params;
+
+    explicit Grab(NvU8* buffer)
+    {
+        memset(this, 0, sizeof(*this));
+        params.dwVersion = NVFBC_H264_GRAB_FRAME_PARAMS_VER;
+        params.pNvFBCFrameGrabInfo = &grabInfo;
+        params.pFrameInfo = &frameInfo;
+        params.pBitStreamBuffer = buffer;
+    }
+};
+
+// A slow output holds up acquire() well past the grab timeout, but the grabs themselves are
+// quick, so none of them may be taken for a stalled one
+TEST(GrabTimeoutIgnoresTheWaitForABuffer)
+{
+    SyntheticEncoder encoder(640, 360, 0, false);
+    DWORD max_width = 0, max_height = 0;
+    CHECK(SetUp(encoder, &max_width, &max_height));
+
+    SlowBuffer slow_buffer;
+    ostream sink(&slow_buffer);
+    FrameWriter writer(sink, nullptr, 2, (size_t)max_width * max_height);
+    GrabThread grab_thread;
+
+    LONGLONG longest_acquire = 0;
+    unsigned stalls = 0;
+    for (unsigned i = 0; i < 6; ++i) {
+        const LONGLONG acquire_start = Timer::nanoseconds();
+        EncodedFrame* frame = writer.acquire();
+        longest_acquire = max(longest_acquire, Timer::nanoseconds() - acquire_start);
+
+        Grab grab(frame->data.data());
+        NVFBCRESULT result = NVFBC_ERROR_GENERIC;
+        grab_thread.start(encoder, &grab.params);
+        if (!grab_thread.waitRunning(GRAB_TIMEOUT_NS, &result)) {
+            ++stalls;
+            grab_thread.wait(&result);
+        }
+        CHECK(result == NVFBC_SUCCESS);
+
+        frame->size = grab.frameInfo.dwByteSize;
+        frame->timestamp = i * 1000.0 / 30;
+        frame->index = i;
+        frame->width = grab.grabInfo.dwWidth;
+        frame->height = grab.grabInfo.dwHeight;
+        frame->sei_size = 0;
+        writer.submit(frame);
+    }
+    writer.close();
+
+    CHECK(longest_acquire > GRAB_TIMEOUT_NS);
+    CHECK(stalls == 0);
+}
+
+// A grab which blocks is given up on once it ran for the timeout, however long ago the last
+// one returned
+TEST(GrabTimeoutCountsFromTheGrabsStart)
+{
+    SyntheticEncoder encoder(640, 360, 0, false);
+    DWORD max_width = 0, max_height = 0;
+    CHECK(SetUp(encoder, &max_width, &max_height));
+    encoder.stall(2, 600);
+
+    vector<NvU8> buffer((size_t)max_width * max_height);
+    GrabThread grab_thread;
+    NVFBCRESULT result = NVFBC_ERROR_GENERIC;
+
+    Grab first(buffer.data());
+    grab_thread.start(encoder, &first.params);
+    CHECK(grab_thread.waitRunning(GRAB_TIMEOUT_NS, &result));
+    CHECK(result == NVFBC_SUCCESS);
+
+    // Longer than the timeout between two grabs, as a slow output would make it
+    this_thread::sleep_for(chrono::milliseconds(200));
+
+    Grab second(buffer.data());
+    grab_thread.start(encoder, &second.params);
+    const LONGLONG started = grab_thread.started();
+    CHECK(!grab_thread.waitRunning(GRAB_TIMEOUT_NS, &result));
+    const LONGLONG waited = Timer::nanoseconds() - started;
+    CHECK(waited >= GRAB_TIMEOUT_NS);
+    CHECK(waited < 500 * MS);
+
+    // The stalled grab returns in the end; the encoder outlives it
+    grab_thread.wait(&result);
+    CHECK(result == NVFBC_SUCCESS);
+}
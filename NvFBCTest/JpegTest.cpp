@@ -0,0 +1,381 @@
+#include "Test.h"
+
+#include <Jpeg.h>
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Odd sizes, so the last MCU row and column are partial
+const int JPEG_WIDTH = 133;
+const int JPEG_HEIGHT = 71;
+
+const double PI = 3.14159265358979323846;
+
+// Natural order index of each coefficient in zigzag order
+static const int ZIGZAG[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// Just enough of a baseline decoder for what EncodeJPEG writes: 8-bit, Huffman coded, Y sampled
+// 2x2 against Cb and Cr, restart markers. Returns false on anything else.
+class JpegDecoder {
+public:
+    bool decode(const vector<BYTE>& jpeg, vector<BYTE>* argb, int* width, int* height)
+    {
+        m_data = &jpeg;
+        m_restartInterval = 0;
+        m_restarts = 0;
+        if (jpeg.size() < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8)
+            return false;
+        size_t p = 2;
+        for (;;) {
+            if (p + 4 > jpeg.size() || jpeg[p] != 0xFF)
+                return false;
+            const BYTE marker = jpeg[p + 1];
+            const size_t length = jpeg[p + 2] << 8 | jpeg[p + 3];
+            const BYTE* segment = &jpeg[p + 4];
+            if (p + 2 + length > jpeg.size())
+                return false;
+            p += 2 + length;
+
+            if (marker == 0xDB) {
+                for (size_t i = 0; i + 65 <= length - 2; i += 65) {
+                    for (int k = 0; k < 64; ++k)
+                        m_quant[segment[i] & 3][k] = segment[i + 1 + k];
+                }
+            } else if (marker == 0xC0) {
+                m_height = segment[1] << 8 | segment[2];
+                m_width = segment[3] << 8 | segment[4];
+                if (segment[0] != 8 || segment[5] != 3 || segment[7] != 0x22 || segment[10] != 0x11 || segment[13] != 0x11)
+                    return false;
+                for (int c = 0; c < 3; ++c)
+                    m_quantOf[c] = segment[8 + c * 3];
+            } else if (marker == 0xC4) {
+                for (size_t i = 0; i < length - 2;) {
+                    Huffman& table = m_huffman[segment[i] >> 4][segment[i] & 1];
+                    const BYTE* counts = &segment[i + 1];
+                    const BYTE* values = &segment[i + 17];
+                    table.values.clear();
+                    int code = 0, value = 0;
+                    for (int bits = 1; bits <= 16; ++bits) {
+                        table.first[bits] = code;
+                        table.index[bits] = value;
+                        table.count[bits] = counts[bits - 1];
+                        for (int n = 0; n < counts[bits - 1]; ++n, ++code, ++value)
+                            table.values.push_back(values[value]);
+                        code <<= 1;
+                    }
+                    i += 17 + value;
+                }
+            } else if (marker == 0xDD) {
+                m_restartInterval = segment[0] << 8 | segment[1];
+            } else if (marker == 0xDA) {
+                for (int c = 0; c < 3; ++c)
+                    m_tablesOf[c] = segment[2 + c * 2];
+                break;
+            } else if (marker == 0xD9 || (marker >= 0xC1 && marker <= 0xCF)) {
+                return false;
+            }
+        }
+
+        m_position = p;
+        m_bits = 0;
+        m_bitCount = 0;
+        const int mcuColumns = (m_width + 15) / 16, mcuRows = (m_height + 15) / 16;
+        const int planeWidth = mcuColumns * 16, planeHeight = mcuRows * 16;
+        vector<float> y((size_t)planeWidth * planeHeight), cb(y.size() / 4), cr(y.size() / 4);
+        int predictors[3] = { 0, 0, 0 };
+        float block[64];
+        for (int mcu = 0; mcu < mcuColumns * mcuRows; ++mcu) {
+            if (m_restartInterval != 0 && mcu != 0 && mcu % m_restartInterval == 0) {
+                // Byte aligned, the next restart marker in turn
+                m_bitCount = 0;
+                if (m_position + 2 > jpeg.size() || jpeg[m_position] != 0xFF ||
+                    jpeg[m_position + 1] != 0xD0 + (m_restarts & 7))
+                    return false;
+                m_position += 2;
+                ++m_restarts;
+                predictors[0] = predictors[1] = predictors[2] = 0;
+            }
+            const int mcuX = mcu % mcuColumns, mcuY = mcu / mcuColumns;
+            for (int b = 0; b < 4; ++b) {
+                if (!decodeBlock(0, &predictors[0], block))
+                    return false;
+                store(block, &y[(size_t)(mcuY * 16 + b / 2 * 8) * planeWidth + mcuX * 16 + b % 2 * 8], planeWidth);
+            }
+            for (int c = 1; c < 3; ++c) {
+                if (!decodeBlock(c, &predictors[c], block))
+                    return false;
+                vector<float>& plane = c == 1 ? cb : cr;
+                store(block, &plane[(size_t)mcuY * 8 * (planeWidth / 2) + mcuX * 8], planeWidth / 2);
+            }
+        }
+        if (m_position + 2 > jpeg.size() || jpeg[m_position] != 0xFF || jpeg[m_position + 1] != 0xD9)
+            return false;
+
+        argb->resize((size_t)m_width * m_height * 4);
+        for (int row = 0; row < m_height; ++row) {
+            for (int column = 0; column < m_width; ++column) {
+                const float luma = y[(size_t)row * planeWidth + column];
+                const float blue = cb[(size_t)(row / 2) * (planeWidth / 2) + column / 2] - 128;
+                const float red = cr[(size_t)(row / 2) * (planeWidth / 2) + column / 2] - 128;
+                BYTE* pixel = &(*argb)[((size_t)row * m_width + column) * 4];
+                pixel[0] = Clamp(luma + 1.772f * blue);
+                pixel[1] = Clamp(luma - 0.344136f * blue - 0.714136f * red);
+                pixel[2] = Clamp(luma + 1.402f * red);
+                pixel[3] = 255;
+            }
+        }
+        *width = m_width;
+        *height = m_height;
+        return true;
+    }
+
+    // Restart markers in the last stream decoded
+    int restarts() const { return m_restarts; }
+    int restartInterval() const { return m_restartInterval; }
+
+private:
+    struct Huffman {
+        int first[17];
+        int index[17];
+        int count[17];
+        vector<BYTE> values;
+    };
+
+    static BYTE Clamp(float value) { return (BYTE)(value < 0 ? 0 : value > 255 ? 255 : value + 0.5f); }
+
+    int bit()
+    {
+        if (m_bitCount == 0) {
+            if (m_position >= m_data->size())
+                return -1;
+            m_bits = (*m_data)[m_position++];
+            // Stuffed zero after 0xFF; a marker here would be an error
+            if (m_bits == 0xFF && (m_position >= m_data->size() || (*m_data)[m_position++] != 0))
+                return -1;
+            m_bitCount = 8;
+        }
+        return m_bits >> --m_bitCount & 1;
+    }
+
+    int receive(int length)
+    {
+        int value = 0;
+        for (int i = 0; i < length; ++i) {
+            const int b = bit();
+            if (b < 0)
+                return INT_MIN;
+            value = value << 1 | b;
+        }
+        return length != 0 && value < 1 << (length - 1) ? value - (1 << length) + 1 : value;
+    }
+
+    int symbol(const Huffman& table)
+    {
+        int code = 0;
+        for (int bits = 1; bits <= 16; ++bits) {
+            const int b = bit();
+            if (b < 0)
+                return -1;
+            code = code << 1 | b;
+            if (code - table.first[bits] < table.count[bits])
+                return table.values[table.index[bits] + code - table.first[bits]];
+        }
+        return -1;
+    }
+
+    bool decodeBlock(int component, int* predictor, float* block)
+    {
+        int coefficients[64] = { 0 };
+        const int dcLength = symbol(m_huffman[0][m_tablesOf[component] >> 4]);
+        const int dc = dcLength >= 0 ? receive(dcLength) : INT_MIN;
+        if (dc == INT_MIN)
+            return false;
+        *predictor += dc;
+        coefficients[0] = *predictor;
+        for (int k = 1; k < 64; ++k) {
+            const int rs = symbol(m_huffman[1][m_tablesOf[component] & 15]);
+            if (rs < 0)
+                return false;
+            if ((rs & 15) == 0) {
+                if (rs != 0xF0)
+                    break;
+                k += 15;
+                continue;
+            }
+            k += rs >> 4;
+            const int value = receive(rs & 15);
+            if (k > 63 || value == INT_MIN)
+                return false;
+            coefficients[k] = value;
+        }
+
+        // Dequantized in zigzag order, transformed back in natural order
+        float natural[64];
+        for (int k = 0; k < 64; ++k)
+            natural[ZIGZAG[k]] = (float)(coefficients[k] * m_quant[m_quantOf[component]][k]);
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x) {
+                double sum = 0;
+                for (int v = 0; v < 8; ++v) {
+                    for (int u = 0; u < 8; ++u) {
+                        sum += (u ? 1 : 1 / sqrt(2.0)) * (v ? 1 : 1 / sqrt(2.0)) * natural[v * 8 + u] *
+                               cos((2 * x + 1) * u * PI / 16) * cos((2 * y + 1) * v * PI / 16);
+                    }
+                }
+                block[y * 8 + x] = (float)(sum / 4 + 128);
+            }
+        }
+        return true;
+    }
+
+    static void store(const float* block, float* plane, int pitch)
+    {
+        for (int y = 0; y < 8; ++y) {
+            for (int x = 0; x < 8; ++x)
+                plane[(size_t)y * pitch + x] = block[y * 8 + x];
+        }
+    }
+
+    const vector<BYTE>* m_data;
+    size_t m_position;
+    int m_bits;
+    int m_bitCount;
+    int m_width;
+    int m_height;
+    int m_restartInterval;
+    int m_restarts;
+    int m_quant[4][64];
+    int m_quantOf[3];
+    int m_tablesOf[3];
+    Huffman m_huffman[2][2];
+};
+
+// ARGB of soft gradients and a few flat areas, which JPEG keeps close to the original
+static vector<BYTE> JpegPattern()
+{
+    vector<BYTE> argb((size_t)JPEG_WIDTH * JPEG_HEIGHT * 4);
+    for (int y = 0; y < JPEG_HEIGHT; ++y) {
+        for (int x = 0; x < JPEG_WIDTH; ++x) {
+            BYTE* pixel = &argb[((size_t)y * JPEG_WIDTH + x) * 4];
+            const bool flat = x > 80 && y > 30;
+            pixel[0] = flat ? 200 : (BYTE)(x * 255 / JPEG_WIDTH);
+            pixel[1] = flat ? 120 : (BYTE)(y * 255 / JPEG_HEIGHT);
+            pixel[2] = flat ? 40 : (BYTE)(128 + 60 * sin(x / 15.0 + y / 20.0));
+            pixel[3] = 0;
+        }
+    }
+    return argb;
+}
+
+static double MeanError(const vector<BYTE>& argb, const vector<BYTE>& decoded)
+{
+    double error = 0;
+    for (size_t i = 0; i < argb.size(); i += 4) {
+        for (int c = 0; c < 3; ++c)
+            error += abs(argb[i + c] - decoded[i + c]);
+    }
+    return error / (argb.size() / 4 * 3);
+}
+
+// Decoded, an image is close to what was encoded, closer the higher the quality
+TEST(JpegDecodesCloseToTheOriginal)
+{
+    const vector<BYTE> argb = JpegPattern();
+    JpegDecoder decoder;
+    double errors[2];
+    const int qualities[2] = { 30, 90 };
+    for (int i = 0; i < 2; ++i) {
+        vector<BYTE> jpeg, decoded;
+        int width = 0, height = 0;
+        CHECK(EncodeJPEG(argb.data(), JPEG_WIDTH, JPEG_HEIGHT, JPEG_FORMAT_ARGB, qualities[i], jpeg));
+        CHECK(decoder.decode(jpeg, &decoded, &width, &height));
+        CHECK(width == JPEG_WIDTH && height == JPEG_HEIGHT);
+        errors[i] = decoded.size() == argb.size() ? MeanError(argb, decoded) : 255;
+    }
+    CHECK(errors[1] < 3);
+    CHECK(errors[0] > errors[1]);
+}
+
+// Every source layout makes the same image
+TEST(JpegEncodesEveryLayoutAlike)
+{
+    const vector<BYTE> argb = JpegPattern();
+    const size_t pixels = (size_t)JPEG_WIDTH * JPEG_HEIGHT;
+    vector<BYTE> rgb(pixels * 3), bgr(pixels * 3);
+    for (size_t i = 0; i < pixels; ++i) {
+        rgb[i * 3] = argb[i * 4 + 2], rgb[i * 3 + 1] = argb[i * 4 + 1], rgb[i * 3 + 2] = argb[i * 4];
+        bgr[i * 3] = argb[i * 4], bgr[i * 3 + 1] = argb[i * 4 + 1], bgr[i * 3 + 2] = argb[i * 4 + 2];
+    }
+
+    JpegDecoder decoder;
+    vector<BYTE> jpeg, reference;
+    int width = 0, height = 0;
+    CHECK(EncodeJPEG(argb.data(), JPEG_WIDTH, JPEG_HEIGHT, JPEG_FORMAT_ARGB, 75, jpeg));
+    CHECK(decoder.decode(jpeg, &reference, &width, &height));
+    const struct {
+        const BYTE* data;
+        JpegPixelFormat format;
+    } layouts[] = { { rgb.data(), JPEG_FORMAT_RGB }, { bgr.data(), JPEG_FORMAT_BGR } };
+    for (const auto& layout : layouts) {
+        vector<BYTE> decoded;
+        CHECK(EncodeJPEG(layout.data, JPEG_WIDTH, JPEG_HEIGHT, layout.format, 75, jpeg));
+        CHECK(decoder.decode(jpeg, &decoded, &width, &height));
+        // The ARGB conversion is vectorized and may round differently
+        CHECK(decoded.size() == reference.size() && MeanError(reference, decoded) < 0.5);
+    }
+}
+
+TEST(JpegFilesHoldTheImage)
+{
+    vector<BYTE> argb = JpegPattern();
+    const string file_name = TestScratch() + "/nvfbctest.jpg";
+    CHECK(SaveARGBJPEG(file_name.c_str(), argb.data(), JPEG_WIDTH, JPEG_HEIGHT, 90));
+
+    vector<BYTE> jpeg, decoded;
+    FILE* file = fopen(file_name.c_str(), "rb");
+    CHECK(file != NULL);
+    if (file) {
+        BYTE buffer[4096];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            jpeg.insert(jpeg.end(), buffer, buffer + read);
+        fclose(file);
+    }
+    JpegDecoder decoder;
+    int width = 0, height = 0;
+    CHECK(decoder.decode(jpeg, &decoded, &width, &height));
+    CHECK(decoded.size() == argb.size() && MeanError(argb, decoded) < 3);
+    remove(file_name.c_str());
+}
+
+// Every MCU row is a restart interval, so the rows can be coded on any number of threads and
+// still make the same bytes
+TEST(JpegThreadsMakeTheSameImage)
+{
+    const vector<BYTE> argb = JpegPattern();
+    vector<BYTE> single, decoded;
+    CHECK(EncodeJPEG(argb.data(), JPEG_WIDTH, JPEG_HEIGHT, JPEG_FORMAT_ARGB, 75, single));
+
+    JpegDecoder decoder;
+    int width = 0, height = 0;
+    CHECK(decoder.decode(single, &decoded, &width, &height));
+    CHECK(decoder.restartInterval() == (JPEG_WIDTH + 15) / 16);
+    CHECK(decoder.restarts() == (JPEG_HEIGHT + 15) / 16 - 1);
+
+    for (int threads : { 2, 3, 16 }) {
+        vector<BYTE> jpeg;
+        CHECK(EncodeJPEG(argb.data(), JPEG_WIDTH, JPEG_HEIGHT, JPEG_FORMAT_ARGB, 75, jpeg, threads));
+        CHECK(jpeg == single);
+    }
+}
@@ -0,0 +1,123 @@
+#include "Test.h"
+#include "../NvFBCLatency/LatencyAnalyzer.h"
+
+#include <H264Bitstream.h>
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+const int64_t MS = 1000000;
+const int64_t EPOCH = 1700000000LL * 1000 * MS;
+const size_t SLICE_SIZE = 300;
+
+static bool Near(double value, double expected)
+{
+    return value > expected - 1e-6 && value < expected + 1e-6;
+}
+
+// An access unit the way NvFBCH264 --latency-sei writes it: the SEI with the timestamp in
+// front of the slice, whose size it carries
+static vector<uint8_t> SyntheticFrame(unsigned int number, int64_t grabStart, int64_t grabEnd)
+{
+    vector<uint8_t> slice(SLICE_SIZE, 0xAA);
+    slice[0] = 0;
+    slice[1] = 0;
+    slice[2] = 0;
+    slice[3] = 1;
+    slice[4] = 0x41;
+
+    CaptureTimestamp stamp = { number, grabStart, grabEnd, (unsigned int)slice.size() };
+    uint8_t payload[CAPTURE_TIMESTAMP_SIZE];
+    PackCaptureTimestamp(stamp, payload);
+
+    vector<uint8_t> frame(32 + sizeof(payload) * 3 / 2);
+    frame.resize(WriteUserDataSei(CAPTURE_TIMESTAMP_UUID, payload, sizeof(payload), frame.data()));
+    frame.insert(frame.end(), slice.begin(), slice.end());
+    return frame;
+}
+
+// Frames 0 to 9 grabbed every 33 ms, frame i taking i + 1 ms, with frames 4 and 7 missing
+// as unchanged frames are; each one arrives 5 ms after its grab ended
+TEST(LatencyAnalyzerMeasuresSyntheticFrames)
+{
+    LatencyAnalyzer analyzer(true);
+    vector<unsigned int> numbers;
+    analyzer.onFrame = [&numbers](const CaptureTimestamp& stamp, int64_t) { numbers.push_back(stamp.frame); };
+
+    for (unsigned int i = 0; i < 10; ++i) {
+        if (i == 4 || i == 7)
+            continue;
+        const int64_t start = EPOCH + i * 33 * MS;
+        const int64_t end = start + (i + 1) * MS;
+        const vector<uint8_t> frame = SyntheticFrame(i, start, end);
+        analyzer.add(frame.data(), frame.size(), end + 5 * MS);
+    }
+    CHECK(analyzer.finish().empty());
+
+    CHECK(analyzer.frames() == 8);
+    CHECK(analyzer.missing() == 2);
+    CHECK(numbers == vector<unsigned int>({ 0, 1, 2, 3, 5, 6, 8, 9 }));
+
+    CHECK(analyzer.grabMs().size() == 8);
+    CHECK(analyzer.intervalMs().size() == 7);
+    CHECK(analyzer.deliveryMs().size() == 8);
+    CHECK(analyzer.afterGrabMs().size() == 8);
+    if (analyzer.grabMs().size() != 8 || analyzer.intervalMs().size() != 7 || analyzer.deliveryMs().size() != 8)
+        return;
+
+    CHECK(Near(analyzer.grabMs()[0], 1));
+    CHECK(Near(analyzer.grabMs()[4], 6));
+    CHECK(Near(analyzer.intervalMs()[0], 33));
+    CHECK(Near(analyzer.intervalMs()[3], 66));
+    CHECK(Near(analyzer.deliveryMs()[0], 6));
+    CHECK(Near(analyzer.deliveryMs()[7], 15));
+    for (double after : analyzer.afterGrabMs())
+        CHECK(Near(after, 5));
+}
+
+// A frame is delivered when its last byte arrives, not its SEI
+TEST(LatencyAnalyzerWaitsForTheWholeFrame)
+{
+    LatencyAnalyzer analyzer(true);
+    const vector<uint8_t> first = SyntheticFrame(0, EPOCH, EPOCH + MS);
+    const vector<uint8_t> second = SyntheticFrame(1, EPOCH + 33 * MS, EPOCH + 34 * MS);
+
+    // The SEI and half the slice, then the rest together with all of the next frame
+    const size_t split = first.size() - SLICE_SIZE / 2;
+    analyzer.add(first.data(), split, EPOCH + 2 * MS);
+    CHECK(analyzer.frames() == 0);
+
+    vector<uint8_t> rest(first.begin() + split, first.end());
+    rest.insert(rest.end(), second.begin(), second.end());
+    analyzer.add(rest.data(), rest.size(), EPOCH + 40 * MS);
+    CHECK(analyzer.finish().empty());
+
+    CHECK(analyzer.frames() == 2);
+    CHECK(analyzer.deliveryMs().size() == 2);
+    if (analyzer.deliveryMs().size() == 2) {
+        CHECK(Near(analyzer.deliveryMs()[0], 40));
+        CHECK(Near(analyzer.deliveryMs()[1], 7));
+    }
+}
+
+// A file is not live: no delivery times, and a frame cut short is reported
+TEST(LatencyAnalyzerReportsTruncatedFrames)
+{
+    LatencyAnalyzer analyzer(false);
+    vector<int64_t> arrivals;
+    analyzer.onFrame = [&arrivals](const CaptureTimestamp&, int64_t arrival) { arrivals.push_back(arrival); };
+
+    vector<uint8_t> stream = SyntheticFrame(0, EPOCH, EPOCH + MS);
+    const vector<uint8_t> last = SyntheticFrame(1, EPOCH + 33 * MS, EPOCH + 35 * MS);
+    stream.insert(stream.end(), last.begin(), last.end() - 10);
+    analyzer.add(stream.data(), stream.size(), EPOCH + 50 * MS);
+
+    const vector<unsigned int> truncated = analyzer.finish();
+    CHECK(truncated == vector<unsigned int>({ 1 }));
+    CHECK(analyzer.frames() == 1);
+    CHECK(arrivals == vector<int64_t>({ 0 }));
+    CHECK(analyzer.deliveryMs().empty());
+    CHECK(analyzer.grabMs().size() == 2);
+}
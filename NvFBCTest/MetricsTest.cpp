@@ -0,0 +1,45 @@
+#include "Test.h"
+
+#include <Metrics.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+// Holds the exposition lock the way format() does while it renders the values
+class BlockedMetrics : public Metrics
+{
+public:
+    std::mutex& expositionLock() { return m_lock; }
+};
+
+// A thread recording its first value registers a shard; that must not wait for an exporter
+// which is rendering the values
+TEST(MetricsFirstRecordDoesNotWaitForFormat)
+{
+    BlockedMetrics metrics;
+    const int counter = metrics.counter("nvfbctest_records_total", "Records of the test");
+    CHECK(counter >= 0);
+
+    atomic<bool> recorded(false);
+    thread recorder;
+    {
+        lock_guard<mutex> lock(metrics.expositionLock());
+        recorder = thread([&] {
+            metrics.add(counter, 3);
+            recorded = true;
+        });
+        const auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+        while (!recorded && chrono::steady_clock::now() < deadline)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        CHECK(recorded);
+    }
+    recorder.join();
+
+    const string text = metrics.format();
+    CHECK(text.find("nvfbctest_records_total 3\n") != string::npos);
+}
@@ -0,0 +1,37 @@
+#include "Test.h"
+
+#include <NumaMemory.h>
+
+#include <string.h>
+
+using namespace std;
+
+const size_t PLACED_SIZE = 4 << 20;
+
+// The node reported is where the pages were found, which is the preferred one on a host with
+// memory to spare there
+TEST(PlacedMemoryReportsTheNodeOfItsPages)
+{
+    const int node = NumaNodeOfCpu(0);
+    MemoryPlacement placement = DefaultPlacement();
+    placement.node = node;
+
+    MemoryPlacement actual = DefaultPlacement();
+    actual.node = -2;
+    void* memory = AllocatePlaced(PLACED_SIZE, placement, &actual);
+    CHECK(memory != NULL);
+    if (!memory)
+        return;
+
+    memset(memory, 0x5A, PLACED_SIZE);
+    CHECK(actual.node >= -1);
+    if (node >= 0)
+        CHECK(actual.node == node);
+    FreePlaced(memory, PLACED_SIZE);
+}
+
+TEST(NoCpuHasNoNode)
+{
+    CHECK(NumaNodeOfCpu(-1) == -1);
+    CHECK(NumaNodeOfCpu(1 << 20) == -1);
+}
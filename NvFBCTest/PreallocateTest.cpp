@@ -0,0 +1,68 @@
+#include "Test.h"
+
+#include <Preallocate.h>
+
+#include <fstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+const unsigned long long RESERVED = 64 << 20;
+
+// Bytes of disk space the file takes, and its size
+static bool FileSpace(const string& path, unsigned long long* allocated, unsigned long long* size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    FILE_STANDARD_INFO info;
+    const bool read = GetFileInformationByHandleEx(file, FileStandardInfo, &info, sizeof(info)) != 0;
+    CloseHandle(file);
+    *allocated = (unsigned long long)info.AllocationSize.QuadPart;
+    *size = (unsigned long long)info.EndOfFile.QuadPart;
+    return read;
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+        return false;
+    *allocated = (unsigned long long)status.st_blocks * 512;
+    *size = (unsigned long long)status.st_size;
+    return true;
+#endif
+}
+
+// The space stays reserved while the output is written and closed, and what was not written
+// is given back by close()
+TEST(PreallocatedFileKeepsItsReservationUntilClosed)
+{
+    const string path = TestScratch() + "/nvfbcpreallocated.h264";
+    PreallocatedFile preallocated;
+    CHECK(preallocated.create(path.c_str(), RESERVED));
+
+    const vector<char> frame(1 << 20, 0x42);
+    {
+        ofstream output(path, ios::in | ios::out | ios::binary);
+        CHECK(output.good());
+        output.write(frame.data(), frame.size());
+    }
+
+    unsigned long long allocated = 0, size = 0;
+    CHECK(FileSpace(path, &allocated, &size));
+    CHECK(size == frame.size());
+    // Not every file system reserves space
+    const bool reserved = allocated >= RESERVED;
+
+    preallocated.close();
+    CHECK(FileSpace(path, &allocated, &size));
+    CHECK(size == frame.size());
+    if (reserved)
+        CHECK(allocated < RESERVED / 2);
+    remove(path.c_str());
+}
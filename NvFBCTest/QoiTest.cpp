@@ -0,0 +1,124 @@
+#include "Test.h"
+
+#include <Qoi.h>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Odd sizes, so no row or band lines up with anything
+const int QOI_WIDTH = 131;
+const int QOI_HEIGHT = 67;
+
+// ARGB with what the encoder has to handle: runs, small and large steps, repeated colors and noise
+static vector<BYTE> QoiPattern()
+{
+    vector<BYTE> argb((size_t)QOI_WIDTH * QOI_HEIGHT * 4);
+    unsigned noise = 12345;
+    for (int y = 0; y < QOI_HEIGHT; ++y) {
+        for (int x = 0; x < QOI_WIDTH; ++x) {
+            BYTE* pixel = &argb[((size_t)y * QOI_WIDTH + x) * 4];
+            noise = noise * 1103515245 + 12345;
+            if (y < 10) {
+                pixel[0] = 160, pixel[1] = 80, pixel[2] = 40;
+            } else if (x < 40) {
+                pixel[0] = (BYTE)x, pixel[1] = (BYTE)(y * 3), pixel[2] = (BYTE)(x + y);
+            } else if (x < 90) {
+                pixel[0] = pixel[1] = pixel[2] = (x / 4 + y / 3) % 2 ? 240 : 20;
+            } else {
+                pixel[0] = (BYTE)(noise >> 8), pixel[1] = (BYTE)(noise >> 16), pixel[2] = (BYTE)(noise >> 24);
+            }
+            pixel[3] = (BYTE)(x * 7);
+        }
+    }
+    return argb;
+}
+
+// The decoded ARGB of a pattern: QOI images are stored without alpha, which decodes as opaque
+static bool SamePixels(const vector<BYTE>& argb, const vector<BYTE>& decoded)
+{
+    if (decoded.size() != argb.size())
+        return false;
+    for (size_t i = 0; i < argb.size(); i += 4) {
+        if (decoded[i] != argb[i] || decoded[i + 1] != argb[i + 1] || decoded[i + 2] != argb[i + 2] ||
+            decoded[i + 3] != 255)
+            return false;
+    }
+    return true;
+}
+
+// Every source layout decodes to the same pixels
+TEST(QoiRoundTripsEveryLayout)
+{
+    const vector<BYTE> argb = QoiPattern();
+    const size_t pixels = (size_t)QOI_WIDTH * QOI_HEIGHT;
+    vector<BYTE> rgb(pixels * 3), bgr(pixels * 3);
+    for (size_t i = 0; i < pixels; ++i) {
+        rgb[i * 3] = argb[i * 4 + 2], rgb[i * 3 + 1] = argb[i * 4 + 1], rgb[i * 3 + 2] = argb[i * 4];
+        bgr[i * 3] = argb[i * 4], bgr[i * 3 + 1] = argb[i * 4 + 1], bgr[i * 3 + 2] = argb[i * 4 + 2];
+    }
+
+    const struct {
+        const BYTE* data;
+        QoiPixelFormat format;
+    } layouts[] = { { rgb.data(), QOI_FORMAT_RGB }, { bgr.data(), QOI_FORMAT_BGR }, { argb.data(), QOI_FORMAT_ARGB } };
+    for (const auto& layout : layouts) {
+        vector<BYTE> encoded, decoded;
+        int width = 0, height = 0;
+        CHECK(EncodeQOI(layout.data, QOI_WIDTH, QOI_HEIGHT, layout.format, encoded));
+        CHECK(DecodeQOI(encoded.data(), encoded.size(), decoded, &width, &height));
+        CHECK(width == QOI_WIDTH && height == QOI_HEIGHT);
+        CHECK(SamePixels(argb, decoded));
+    }
+}
+
+// A stream encoded in bands is one standard QOI image: the header of the whole image, the
+// end marker once, and the same pixels
+TEST(QoiBandsMakeOneStream)
+{
+    const vector<BYTE> argb = QoiPattern();
+    for (int threads : { 2, 3, 8 }) {
+        vector<BYTE> encoded, decoded;
+        int width = 0, height = 0;
+        CHECK(EncodeQOI(argb.data(), QOI_WIDTH, QOI_HEIGHT, QOI_FORMAT_ARGB, encoded, threads));
+        CHECK(encoded.size() > 22 && string(encoded.begin(), encoded.begin() + 4) == "qoif");
+        CHECK(encoded[4] == 0 && encoded[5] == 0 && encoded[6] == 0 && encoded[7] == QOI_WIDTH);
+        CHECK(encoded[8] == 0 && encoded[9] == 0 && encoded[10] == 0 && encoded[11] == QOI_HEIGHT);
+        CHECK(encoded[12] == 3);
+        const BYTE end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+        CHECK(vector<BYTE>(encoded.end() - 8, encoded.end()) == vector<BYTE>(end, end + 8));
+        CHECK(DecodeQOI(encoded.data(), encoded.size(), decoded, &width, &height));
+        CHECK(SamePixels(argb, decoded));
+    }
+}
+
+TEST(QoiFilesLoadBack)
+{
+    vector<BYTE> argb = QoiPattern();
+    const string file_name = TestScratch() + "/nvfbctest.qoi";
+    CHECK(SaveARGBQOI(file_name.c_str(), argb.data(), QOI_WIDTH, QOI_HEIGHT, 4));
+
+    vector<BYTE> loaded;
+    int width = 0, height = 0;
+    CHECK(LoadQOI(file_name.c_str(), loaded, &width, &height));
+    CHECK(width == QOI_WIDTH && height == QOI_HEIGHT);
+    CHECK(SamePixels(argb, loaded));
+    remove(file_name.c_str());
+}
+
+// Streams cut short or not QOI at all are refused rather than decoded into garbage
+TEST(QoiRejectsBrokenStreams)
+{
+    const vector<BYTE> argb = QoiPattern();
+    vector<BYTE> encoded, decoded;
+    int width = 0, height = 0;
+    CHECK(EncodeQOI(argb.data(), QOI_WIDTH, QOI_HEIGHT, QOI_FORMAT_ARGB, encoded));
+
+    CHECK(!DecodeQOI(encoded.data(), encoded.size() / 2, decoded, &width, &height));
+    vector<BYTE> wrong_magic = encoded;
+    wrong_magic[0] = 'x';
+    CHECK(!DecodeQOI(wrong_magic.data(), wrong_magic.size(), decoded, &width, &height));
+    CHECK(!DecodeQOI(encoded.data(), 10, decoded, &width, &height));
+}
@@ -0,0 +1,174 @@
+#include "Test.h"
+#include "../NvFBCH264/SyntheticEncoder.h"
+
+#include <Timer.h>
+
+#include <chrono>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// About what creating or setting up an NvFBC session takes
+const DWORD SESSION_MS = 30;
+
+// A synthetic encoder whose sessions take SESSION_MS to create and to set up, which rejects
+// GOP lengths above maxGop and fails the next createFailures creations
+class FakeEncoder : public SyntheticEncoder {
+public:
+    FakeEncoder()
+        : SyntheticEncoder(640, 360, 0, false)
+        , maxGop(1000)
+        , createFailures(0)
+        , creates(0)
+        , setUps(0)
+    {
+    }
+
+    bool create(DWORD* max_width, DWORD* max_height) override
+    {
+        this_thread::sleep_for(chrono::milliseconds(SESSION_MS));
+        ++creates;
+        // The old session is gone either way
+        const bool created = SyntheticEncoder::create(max_width, max_height);
+        if (createFailures != 0) {
+            --createFailures;
+            return false;
+        }
+        return created;
+    }
+
+    NVFBCRESULT setUp(NVFBC_H264_SETUP_PARAMS* params) override
+    {
+        this_thread::sleep_for(chrono::milliseconds(SESSION_MS));
+        ++setUps;
+        if (params->pEncodeConfig->dwGOPLength > maxGop)
+            return NVFBC_ERROR_GENERIC;
+        return SyntheticEncoder::setUp(params);
+    }
+
+    DWORD maxGop;
+    unsigned createFailures;
+    unsigned creates;
+    unsigned setUps;
+};
+
+struct Session {
+    FakeEncoder encoder;
+    NvFBC_H264HWEncoder_Config config;
+    NVFBC_H264_SETUP_PARAMS setup;
+    DWORD maxWidth;
+    DWORD maxHeight;
+    bool ready;
+
+    Session()
+        : maxWidth(0)
+        , maxHeight(0)
+    {
+        memset(&config, 0, sizeof(config));
+        config.dwVersion = NVFBC_H264HWENC_CONFIG_VER;
+        config.dwFrameRateNum = 30;
+        config.dwFrameRateDen = 1;
+        config.dwAvgBitRate = 4000000;
+        config.dwPeakBitRate = 8000000;
+        config.dwGOPLength = 30;
+        config.eRateControl = NVFBC_H264_ENC_PARAMS_RC_VBR;
+        config.ePresetConfig = NVFBC_H264_PRESET_LOW_LATENCY_HQ;
+        memset(&setup, 0, sizeof(setup));
+        setup.pEncodeConfig = &config;
+        ready = encoder.create(&maxWidth, &maxHeight) && encoder.setUp(&setup) == NVFBC_SUCCESS;
+        encoder.creates = encoder.setUps = 0;
+    }
+
+    // Applies config, returning how and the milliseconds it took
+    ReconfigureResult apply(const NvFBC_H264HWEncoder_Config& previous, double *ms)
+    {
+        const LONGLONG start = Timer::nanoseconds();
+        const ReconfigureResult result = ReconfigureEncoder(encoder, &setup, previous, &maxWidth, &maxHeight);
+        *ms = (Timer::nanoseconds() - start) / 1e6;
+        return result;
+    }
+
+    bool grabs()
+    {
+        vector<NvU8> buffer((size_t)maxWidth * maxHeight);
+        NvFBCFrameGrabInfo grab_info = {0};
+        NvFBC_H264HWEncoder_FrameInfo frame_info = {0};
+        NVFBC_H264_GRAB_FRAME_PARAMS params = {0};
+        params.dwVersion = NVFBC_H264_GRAB_FRAME_PARAMS_VER;
+        params.pNvFBCFrameGrabInfo = &grab_info;
+        params.pFrameInfo = &frame_info;
+        params.pBitStreamBuffer = buffer.data();
+        return encoder.grabFrame(&params) == NVFBC_SUCCESS && frame_info.dwByteSize != 0;
+    }
+};
+
+// A bitrate change is applied in place, without the time a session takes to set up
+TEST(ReconfigureAppliesABitrateInPlace)
+{
+    Session session;
+    CHECK(session.ready);
+    const NvFBC_H264HWEncoder_Config previous = session.config;
+    session.config.dwAvgBitRate = 2000000;
+    session.config.dwPeakBitRate = 4000000;
+
+    double ms = 0;
+    CHECK(session.apply(previous, &ms) == RECONFIGURED_IN_PLACE);
+    CHECK(ms < SESSION_MS);
+    CHECK(session.encoder.setUps == 0);
+    CHECK(session.grabs());
+}
+
+// A GOP length change needs the session set up again, once
+TEST(ReconfigureSetsTheSessionUpAgain)
+{
+    Session session;
+    CHECK(session.ready);
+    const NvFBC_H264HWEncoder_Config previous = session.config;
+    session.config.dwGOPLength = 60;
+
+    double ms = 0;
+    CHECK(session.apply(previous, &ms) == RECONFIGURED_SET_UP_AGAIN);
+    CHECK(ms >= SESSION_MS && ms < 3 * SESSION_MS);
+    CHECK(session.encoder.setUps == 1);
+    CHECK(session.encoder.creates == 0);
+    CHECK(session.config.dwGOPLength == 60);
+    CHECK(session.grabs());
+}
+
+// A configuration the encoder rejects, after a creation which failed too, leaves a new session
+// set up as before rather than the half-built one
+TEST(ReconfigureRestoresThePreviousConfiguration)
+{
+    Session session;
+    CHECK(session.ready);
+    session.encoder.maxGop = 100;
+    session.encoder.createFailures = 1;
+    const NvFBC_H264HWEncoder_Config previous = session.config;
+    session.config.dwGOPLength = 300;
+
+    double ms = 0;
+    CHECK(session.apply(previous, &ms) == RECONFIGURE_RESTORED);
+    CHECK(session.config.dwGOPLength == previous.dwGOPLength);
+    CHECK(session.encoder.creates == 2);
+    CHECK(session.encoder.setUps == 2);
+    CHECK(ms < 6 * SESSION_MS);
+    CHECK(session.grabs());
+}
+
+// No session at all is reported, for the capture to end
+TEST(ReconfigureReportsALostSession)
+{
+    Session session;
+    CHECK(session.ready);
+    session.encoder.maxGop = 100;
+    session.encoder.createFailures = 2;
+    const NvFBC_H264HWEncoder_Config previous = session.config;
+    session.config.dwGOPLength = 300;
+
+    double ms = 0;
+    CHECK(session.apply(previous, &ms) == RECONFIGURE_FAILED);
+    CHECK(session.config.dwGOPLength == previous.dwGOPLength);
+    CHECK(!session.grabs());
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+// A test is a function defined with TEST(name) { ... } in any file of the project, which
+// registers itself before main() runs. CHECK() records a failure and carries on, so one run
+// reports every check which failed.
+typedef void (*TestFunction)();
+
+struct TestRegistration {
+    TestRegistration(const char* name, TestFunction function);
+};
+
+// Records a failed check of the test running
+void TestFailed(const char* file, int line, const char* expression);
+
+// Directory for the files tests write, --scratch
+const std::string& TestScratch();
+
+#define TEST(name)                                                       \
+    static void name();                                                  \
+    static const TestRegistration name##_registration(#name, name);      \
+    static void name()
+
+#define CHECK(expression)                                                \
+    do {                                                                 \
+        if (!(expression))                                               \
+            TestFailed(__FILE__, __LINE__, #expression);                 \
+    } while (0)
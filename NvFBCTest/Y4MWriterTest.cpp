@@ -0,0 +1,129 @@
+#include "Test.h"
+
+#include <Y4MWriter.h>
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const int Y4M_WIDTH = 38;
+const int Y4M_HEIGHT = 22;
+
+static string ReadFile(const string& file_name)
+{
+    string contents;
+    FILE* file = fopen(file_name.c_str(), "rb");
+    if (!file)
+        return contents;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, read);
+    fclose(file);
+    return contents;
+}
+
+// A plane with padding at the end of every row, which must not reach the file
+static vector<uint8_t> PaddedPlane(int width, int height, int pitch, uint8_t seed)
+{
+    vector<uint8_t> plane((size_t)pitch * height, 0xEE);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x)
+            plane[(size_t)y * pitch + x] = (uint8_t)(seed + x * 3 + y * 7);
+    }
+    return plane;
+}
+
+static string Unpadded(const vector<uint8_t>& plane, int width, int height, int pitch)
+{
+    string rows;
+    for (int y = 0; y < height; ++y)
+        rows.append((const char*)&plane[(size_t)y * pitch], width);
+    return rows;
+}
+
+// The stream header, then every frame as FRAME and the Y, U and V planes without their padding
+TEST(Y4MWriterWritesI420Frames)
+{
+    const int chroma_width = Y4M_WIDTH / 2, chroma_height = Y4M_HEIGHT / 2;
+    const vector<uint8_t> y = PaddedPlane(Y4M_WIDTH, Y4M_HEIGHT, 64, 16);
+    const vector<uint8_t> u = PaddedPlane(chroma_width, chroma_height, 32, 100);
+    const vector<uint8_t> v = PaddedPlane(chroma_width, chroma_height, 24, 200);
+    const Y4MPlane planes[3] = { { y.data(), 64 }, { u.data(), 32 }, { v.data(), 24 } };
+
+    const string file_name = TestScratch() + "/nvfbctest.y4m";
+    Y4MWriter writer;
+    CHECK(writer.open(file_name.c_str(), Y4M_WIDTH, Y4M_HEIGHT, Y4M_FORMAT_I420, 60, 1));
+    CHECK(writer.writeFrame(planes));
+    CHECK(writer.writeFrame(planes));
+    CHECK(writer.frameCount() == 2);
+    writer.close();
+
+    const string frame = "FRAME\n" + Unpadded(y, Y4M_WIDTH, Y4M_HEIGHT, 64) +
+                         Unpadded(u, chroma_width, chroma_height, 32) + Unpadded(v, chroma_width, chroma_height, 24);
+    CHECK(ReadFile(file_name) == "YUV4MPEG2 W38 H22 F60:1 Ip A1:1 C420jpeg\n" + frame + frame);
+    remove(file_name.c_str());
+}
+
+// NV12 chroma is split into the U and V planes of I420
+TEST(Y4MWriterDeinterleavesNV12)
+{
+    const size_t luma = (size_t)Y4M_WIDTH * Y4M_HEIGHT;
+    vector<uint8_t> nv12(luma * 3 / 2);
+    string y, u, v;
+    for (size_t i = 0; i < luma; ++i) {
+        nv12[i] = (uint8_t)i;
+        y += (char)nv12[i];
+    }
+    for (size_t i = 0; i < luma / 4; ++i) {
+        nv12[luma + i * 2] = (uint8_t)(i * 5);
+        nv12[luma + i * 2 + 1] = (uint8_t)(255 - i);
+        u += (char)nv12[luma + i * 2];
+        v += (char)nv12[luma + i * 2 + 1];
+    }
+
+    const string file_name = TestScratch() + "/nvfbctest.y4m";
+    Y4MWriter writer;
+    CHECK(writer.open(file_name.c_str(), Y4M_WIDTH, Y4M_HEIGHT, Y4M_FORMAT_NV12));
+    CHECK(writer.writeFrame(nv12.data()));
+    writer.close();
+
+    CHECK(ReadFile(file_name) == "YUV4MPEG2 W38 H22 F30:1 Ip A1:1 C420jpeg\nFRAME\n" + y + u + v);
+    remove(file_name.c_str());
+}
+
+TEST(Y4MWriterWritesYUV444Frames)
+{
+    const size_t plane = (size_t)Y4M_WIDTH * Y4M_HEIGHT;
+    vector<uint8_t> yuv(plane * 3);
+    for (size_t i = 0; i < yuv.size(); ++i)
+        yuv[i] = (uint8_t)(i * 13);
+
+    const string file_name = TestScratch() + "/nvfbctest.y4m";
+    Y4MWriter writer;
+    CHECK(writer.open(file_name.c_str(), Y4M_WIDTH, Y4M_HEIGHT, Y4M_FORMAT_YUV444));
+    CHECK(writer.writeFrame(yuv.data()));
+    writer.close();
+
+    CHECK(ReadFile(file_name) ==
+          "YUV4MPEG2 W38 H22 F30:1 Ip A1:1 C444\nFRAME\n" + string((const char*)yuv.data(), yuv.size()));
+    remove(file_name.c_str());
+}
+
+// 4:2:0 needs even sizes, and nothing is written to a writer which is not open
+TEST(Y4MWriterRejectsOddSizes)
+{
+    const string file_name = TestScratch() + "/nvfbctest.y4m";
+    Y4MWriter writer;
+    CHECK(!writer.open(file_name.c_str(), Y4M_WIDTH + 1, Y4M_HEIGHT, Y4M_FORMAT_I420));
+    CHECK(!writer.open(file_name.c_str(), Y4M_WIDTH, Y4M_HEIGHT + 1, Y4M_FORMAT_NV12));
+
+    vector<uint8_t> frame((size_t)Y4M_WIDTH * Y4M_HEIGHT * 3);
+    CHECK(!writer.writeFrame(frame.data()));
+
+    CHECK(writer.open(file_name.c_str(), Y4M_WIDTH + 1, Y4M_HEIGHT + 1, Y4M_FORMAT_YUV444));
+    writer.close();
+    remove(file_name.c_str());
+}
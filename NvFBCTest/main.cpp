@@ -0,0 +1,86 @@
+#include "Test.h"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+using namespace std;
+
+struct TestCase {
+    const char* name;
+    TestFunction function;
+};
+
+// Function-local, so registrations from other files find it constructed
+static vector<TestCase>& Tests()
+{
+    static vector<TestCase> tests;
+    return tests;
+}
+
+static unsigned g_failures;
+static string g_scratch;
+
+TestRegistration::TestRegistration(const char* name, TestFunction function)
+{
+    TestCase test = { name, function };
+    Tests().push_back(test);
+}
+
+void TestFailed(const char* file, int line, const char* expression)
+{
+    cout << "  " << file << "(" << line << "): CHECK(" << expression << ") failed" << endl;
+    ++g_failures;
+}
+
+const string& TestScratch()
+{
+    return g_scratch;
+}
+
+int main(int argc, char *argv[])
+{
+    string filter;
+
+    po::options_description desc("Tests the building blocks of the recorder without a GPU.\nOptions");
+    desc.add_options()
+		("help,h", "Produce help message")
+		("filter,f",     po::value<string>(&filter), "Run only the tests whose name contains this")
+		("scratch",      po::value<string>(&g_scratch)->default_value("."), "Directory for the files written by the tests")
+		;
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    }
+    catch (const po::error& e) {
+        cerr << e.what() << "\n" << desc << endl;
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help")) {
+        cout << desc << endl;
+        return EXIT_SUCCESS;
+    }
+
+    unsigned run = 0, failed = 0;
+    for (const TestCase& test : Tests()) {
+        if (!filter.empty() && string(test.name).find(filter) == string::npos)
+            continue;
+
+        cout << test.name << endl;
+        const unsigned failures = g_failures;
+        test.function();
+        ++run;
+        if (g_failures != failures)
+            ++failed;
+    }
+
+    cout << '\n' << run - failed << " of " << run << " tests passed" << endl;
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -52,9 +52,11 @@
 #pragma warning(disable : 4995 4996)
 
 #include "Bitmap.h"
+#include "ScratchPool.h"
+#include "Trace.h"
 
 #include <stdio.h>
-#include <string>
+#include <string.h>
 
 // Macros to help with bitmap padding
 #define BITMAP_SIZE(width, height) ((((width) + 3) & ~3) * (height))
@@ -85,8 +87,41 @@ struct ARGBPixel
     unsigned char alpha;
 };
 
+// Longest file name, with the suffix of a plane, the conversions save to
+#define BITMAP_NAME_SIZE 1024
+
+// Inserts "-suffix" in front of the extension of fileName, or appends it if there is none.
+// The name is built on the stack, so that saving the planes does not allocate. Returns false
+// if it does not fit.
+static bool SuffixedName(char (&output)[BITMAP_NAME_SIZE], const char *fileName, const char *suffix)
+{
+    const char *extension = strrchr(fileName, '.');
+    size_t stem = extension ? (size_t)(extension - fileName) : strlen(fileName);
+    if (!extension)
+        extension = "";
+
+    int written = snprintf(output, sizeof(output), "%.*s-%s%s", (int)stem, fileName, suffix, extension);
+    return written > 0 && (size_t)written < sizeof(output);
+}
+
+// Zeroes the pixels between the end of each row and the padded row width.
+// The scratch buffers are reused, so unlike fresh allocations they hold stale data.
+static void ClearPadding(BitmapPixel *output, int width, int height)
+{
+    int paddedWidth = (width + 3) & ~3;
+    if (paddedWidth == width)
+        return;
+
+    for (int row = 0; row < height; ++row)
+        memset(output + BITMAP_INDEX(width, row, width), 0, (paddedWidth - width) * sizeof(BitmapPixel));
+}
+
+// fopen allocates the FILE and its buffer from the C runtime heap on every call; only the
+// pixel buffers of the conversions are pooled
 bool SaveBitmap(const char *fileName, BYTE *data, int width, int height)
 {
+    TRACE_SCOPE("SaveBitmap");
+
     BITMAPFILEHEADER fileHeader;
     BITMAPINFOHEADER infoHeader;
     FILE *outputFile;
@@ -129,13 +164,18 @@ bool SaveBitmap(const char *fileName, BYTE *data, int width, int height)
 
 bool SaveRGB(const char *fileName, BYTE *data, int width, int height)
 {
+    TRACE_SCOPE("SaveRGB");
+
     bool result = false;
 
     RGBPixel *input = (RGBPixel *)data;
-    BitmapPixel *output = new BitmapPixel[BITMAP_SIZE(width, height)];
+    ScratchBuffer scratch(BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    BitmapPixel *output = (BitmapPixel *)scratch.data();
+    if (!output)
+        return false;
 
-    // Pad bytes need to be set to zero, it's easier to just set the entire chunk of memory
-    memset(output, 0, BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    // Pad bytes need to be set to zero
+    ClearPadding(output, width, height);
 
     for(int row = 0; row < height; ++row)
     {
@@ -153,22 +193,25 @@ bool SaveRGB(const char *fileName, BYTE *data, int width, int height)
 
     result = SaveBitmap(fileName, (BYTE *)output, width, height);
 
-    delete [] output;
-
     return result;
 }
 
 bool SaveBGR(const char *fileName, BYTE *data, int width, int height)
 {
+    TRACE_SCOPE("SaveBGR");
+
     bool result = false;
 
     if (!data)
         return false;
     RGBPixel *input = (RGBPixel *)data;
-    BitmapPixel *output = new BitmapPixel[BITMAP_SIZE(width, height)];
+    ScratchBuffer scratch(BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    BitmapPixel *output = (BitmapPixel *)scratch.data();
+    if (!output)
+        return false;
 
-    // Pad bytes need to be set to zero, it's easier to just set the entire chunk of memory
-    memset(output, 0, BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    // Pad bytes need to be set to zero
+    ClearPadding(output, width, height);
 
     for(int row = 0; row < height; ++row)
     {
@@ -186,19 +229,23 @@ bool SaveBGR(const char *fileName, BYTE *data, int width, int height)
 
     result = SaveBitmap(fileName, (BYTE *)output, width, height);
 
-    delete [] output;
-
     return result;
 }
 
 bool SaveRGBPlanar(const char *fileName, BYTE *data, int width, int height)
 {
+    TRACE_SCOPE("SaveRGBPlanar");
+
     if (!data)
         return false;
 
     const char *nameExt[] = {"red", "green", "blue"};
-    BitmapPixel *output = new BitmapPixel[BITMAP_SIZE(width, height)];
-    memset(output, 0, BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    ScratchBuffer scratch(BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    BitmapPixel *output = (BitmapPixel *)scratch.data();
+    if (!output)
+        return false;
+
+    ClearPadding(output, width, height);
 
     for(int color = 0; color < 3; ++color)
     {
@@ -233,33 +280,30 @@ bool SaveRGBPlanar(const char *fileName, BYTE *data, int width, int height)
             }
         }
 
-        std::string outputFile = fileName;
-        size_t find = outputFile.find_last_of(".");
-
-        outputFile.insert(find, "-");
-        outputFile.insert(find+1, nameExt[color]);
-
-        if(!SaveBitmap(outputFile.c_str(), (BYTE *)output, width, height))
-        {
-            delete [] output;
+        char outputFile[BITMAP_NAME_SIZE];
+        if(!SuffixedName(outputFile, fileName, nameExt[color]) ||
+           !SaveBitmap(outputFile, (BYTE *)output, width, height))
             return false;
-        }
     }
 
-    delete [] output;
-
     return true;
 }
 
 bool SaveARGB(const char *fileName, BYTE *data, int width, int height)
 {
+    TRACE_SCOPE("SaveARGB");
+
     bool result = false;
     if (!data)
         return result;
 
     ARGBPixel *input = (ARGBPixel *)data;
-    BitmapPixel *output = new BitmapPixel[BITMAP_SIZE(width, height)];
-    memset(output, 0, BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    ScratchBuffer scratch(BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    BitmapPixel *output = (BitmapPixel *)scratch.data();
+    if (!output)
+        return false;
+
+    ClearPadding(output, width, height);
 
     for(int row = 0; row < height; ++row)
     {
@@ -276,26 +320,70 @@ bool SaveARGB(const char *fileName, BYTE *data, int width, int height)
 
     result = SaveBitmap(fileName, (BYTE *)output, width, height);
 
-    delete [] output;
-
     return result;
 }
 
+bool SaveARGBRect(const char *fileName, BYTE *data, int width, int height, const RECT &rect)
+{
+    TRACE_SCOPE("SaveARGBRect");
+
+    if (!data)
+        return false;
+
+    int left = rect.left > 0 ? rect.left : 0;
+    int top = rect.top > 0 ? rect.top : 0;
+    int right = rect.right < width ? rect.right : width;
+    int bottom = rect.bottom < height ? rect.bottom : height;
+    if (left >= right || top >= bottom)
+        return false;
+
+    int rectWidth = right - left;
+    int rectHeight = bottom - top;
+
+    ARGBPixel *input = (ARGBPixel *)data;
+    ScratchBuffer scratch(BITMAP_SIZE(rectWidth, rectHeight) * sizeof(BitmapPixel));
+    BitmapPixel *output = (BitmapPixel *)scratch.data();
+    if (!output)
+        return false;
+
+    ClearPadding(output, rectWidth, rectHeight);
+
+    for(int row = 0; row < rectHeight; ++row)
+    {
+        for(int col = 0; col < rectWidth; ++col)
+        {
+            int outputIdx = BITMAP_INDEX(col, row, rectWidth);
+            int inputIdx = ((bottom - row - 1) * width) + left + col;
+
+            output[outputIdx].red = input[inputIdx].red;
+            output[outputIdx].green = input[inputIdx].green;
+            output[outputIdx].blue = input[inputIdx].blue;
+        }
+    }
+
+    return SaveBitmap(fileName, (BYTE *)output, rectWidth, rectHeight);
+}
+
 bool SaveYUV(const char *fileName, BYTE *data, int width, int height)
 {
+    TRACE_SCOPE("SaveYUV");
+
     if (!data)
         return false;
 
     int hWidth = width >> 1;
     int hHeight = height >> 1;
-    size_t find = -1;
-    std::string outputFile;
+    char outputFile[BITMAP_NAME_SIZE];
 
-    BitmapPixel *luma = new BitmapPixel[BITMAP_SIZE(width, height)];
-    BitmapPixel *chrom = new BitmapPixel[BITMAP_SIZE(width, height)];
+    ScratchBuffer lumaScratch(BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
+    ScratchBuffer chromScratch(BITMAP_SIZE(hWidth, hHeight) * sizeof(BitmapPixel));
+    BitmapPixel *luma = (BitmapPixel *)lumaScratch.data();
+    BitmapPixel *chrom = (BitmapPixel *)chromScratch.data();
+    if (!luma || !chrom)
+        return false;
 
-    memset(luma, 0, BITMAP_SIZE(width, height) * sizeof(BitmapPixel));
-    memset(chrom, 0, BITMAP_SIZE(hWidth, hHeight) * sizeof(BitmapPixel));
+    ClearPadding(luma, width, height);
+    ClearPadding(chrom, hWidth, hHeight);
 
     for(int row = 0; row < height; ++row)
     {
@@ -312,18 +400,9 @@ bool SaveYUV(const char *fileName, BYTE *data, int width, int height)
 
     data += width * height;
 
-    outputFile = fileName;
-    find = outputFile.find_last_of(".");
-
-    outputFile.insert(find, "-");
-    outputFile.insert(find+1, "y");
-
-    if(!SaveBitmap(outputFile.c_str(), (BYTE *)luma, width, height))
-    {
-        delete [] luma;
-        delete [] chrom;
+    if(!SuffixedName(outputFile, fileName, "y") ||
+       !SaveBitmap(outputFile, (BYTE *)luma, width, height))
         return false;
-    }
 
     for(int row = 0; row < hHeight; ++row)
     {
@@ -340,18 +419,9 @@ bool SaveYUV(const char *fileName, BYTE *data, int width, int height)
 
     data += hWidth * hHeight;
 
-    outputFile = fileName;
-    find = outputFile.find_last_of(".");
-
-    outputFile.insert(find, "-");
-    outputFile.insert(find+1, "u");
-
-    if(!SaveBitmap(outputFile.c_str(), (BYTE *)chrom, hWidth, hHeight))
-    {
-        delete [] luma;
-        delete [] chrom;
+    if(!SuffixedName(outputFile, fileName, "u") ||
+       !SaveBitmap(outputFile, (BYTE *)chrom, hWidth, hHeight))
         return false;
-    }
 
     for(int row = 0; row < hHeight; ++row)
     {
@@ -368,20 +438,9 @@ bool SaveYUV(const char *fileName, BYTE *data, int width, int height)
 
     data += hWidth * hHeight;
 
-    outputFile = fileName;
-    find = outputFile.find_last_of(".");
-
-    outputFile.insert(find, "-");
-    outputFile.insert(find+1, "v");
-
-    if(!SaveBitmap(outputFile.c_str(), (BYTE *)chrom, hWidth, hHeight))
-    {
-        delete [] luma;
-        delete [] chrom;
+    if(!SuffixedName(outputFile, fileName, "v") ||
+       !SaveBitmap(outputFile, (BYTE *)chrom, hWidth, hHeight))
         return false;
-    }
 
-    delete [] luma;
-    delete [] chrom;
     return true;
 }
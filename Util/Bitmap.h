@@ -22,6 +22,9 @@ bool SaveBGR(const char *fileName, BYTE *data, int width, int height);
 // Saves the ARGB buffer as a bitmap
 bool SaveARGB(const char *fileName, BYTE *data, int width, int height);
 
+// Saves the part of the ARGB buffer covered by rect as a bitmap
+bool SaveARGBRect(const char *fileName, BYTE *data, int width, int height, const RECT &rect);
+
 // Saves the RGBPlanar buffer as three bitmaps, one bitmap for each channel
 bool SaveRGBPlanar(const char *fileName, BYTE *data, int width, int height);
 
@@ -0,0 +1,48 @@
+#include "CaptureTimestamp.h"
+
+#include <chrono>
+
+const uint8_t CAPTURE_TIMESTAMP_UUID[16] =
+{
+    0xd8, 0xef, 0x54, 0x9a, 0xdc, 0xd4, 0x40, 0x47, 0x88, 0xb4, 0x97, 0xf9, 0x8b, 0x95, 0x83, 0xcf
+};
+
+static uint8_t *PutBigEndian(uint8_t *out, unsigned long long value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i)
+        *out++ = (uint8_t)(value >> (i * 8));
+    return out;
+}
+
+static unsigned long long GetBigEndian(const uint8_t *in, int bytes)
+{
+    unsigned long long value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value = value << 8 | in[i];
+    return value;
+}
+
+void PackCaptureTimestamp(const CaptureTimestamp &timestamp, uint8_t *payload)
+{
+    payload = PutBigEndian(payload, timestamp.frame, 4);
+    payload = PutBigEndian(payload, (unsigned long long)timestamp.grabStart, 8);
+    payload = PutBigEndian(payload, (unsigned long long)timestamp.grabEnd, 8);
+    PutBigEndian(payload, timestamp.trailingBytes, 4);
+}
+
+bool UnpackCaptureTimestamp(const uint8_t *payload, size_t size, CaptureTimestamp *timestamp)
+{
+    if (size != CAPTURE_TIMESTAMP_SIZE)
+        return false;
+
+    timestamp->frame = (unsigned int)GetBigEndian(payload, 4);
+    timestamp->grabStart = (int64_t)GetBigEndian(payload + 4, 8);
+    timestamp->grabEnd = (int64_t)GetBigEndian(payload + 12, 8);
+    timestamp->trailingBytes = (unsigned int)GetBigEndian(payload + 20, 4);
+    return true;
+}
+
+int64_t WallClockNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
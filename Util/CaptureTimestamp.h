@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <stddef.h>
+
+// When a frame was captured, as carried in the stream by NvFBCH264 --latency-sei:
+// an SEI user_data_unregistered message in front of the first slice of every frame
+struct CaptureTimestamp
+{
+    unsigned int frame;
+    // Wall-clock time around the grab, in nanoseconds since the Unix epoch
+    int64_t grabStart;
+    int64_t grabEnd;
+    // Bytes of the access unit which follow the SEI NAL unit, so a reader knows when the
+    // whole frame has arrived
+    unsigned int trailingBytes;
+};
+
+enum
+{
+    CAPTURE_TIMESTAMP_SIZE = 24
+};
+
+extern const uint8_t CAPTURE_TIMESTAMP_UUID[16];
+
+// Serializes the timestamp as the big-endian SEI payload
+void PackCaptureTimestamp(const CaptureTimestamp &timestamp, uint8_t *payload);
+
+// Returns false if the payload has the wrong size
+bool UnpackCaptureTimestamp(const uint8_t *payload, size_t size, CaptureTimestamp *timestamp);
+
+// Wall-clock time in nanoseconds since the Unix epoch
+int64_t WallClockNanoseconds();
@@ -0,0 +1,551 @@
+#include "DeltaCodec.h"
+
+#include <string.h>
+#include <thread>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define DELTA_MAGIC         0x4344564e // "NVDC"
+#define DELTA_VERSION       1
+#define DELTA_FLAG_KEYFRAME 0x01
+#define DELTA_HEADER_SIZE   24
+#define DELTA_BAND_SIZE     16
+
+// Tile types, the first byte of every tile
+#define TILE_SKIP    0  // Same as in the previous frame
+#define TILE_SOLID   1  // One color: 4 bytes
+#define TILE_PALETTE 2  // Color count - 1, the colors, then (run - 1, index) pairs
+#define TILE_RAW     3  // Pixels, each byte minus the same byte of the pixel on the left
+#define TILE_DELTA   4  // Pixels XOR the previous frame
+
+// Band payload compression
+#define METHOD_STORED 0
+#define METHOD_ZSTD   1
+
+#define PALETTE_MAX_COLORS 256
+#define PALETTE_HASH_SIZE  1024
+
+static void Put16(uint8_t *out, unsigned int value)
+{
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void Put32(uint8_t *out, unsigned int value)
+{
+    Put16(out, value);
+    Put16(out + 2, value >> 16);
+}
+
+static unsigned int Get16(const uint8_t *in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+static unsigned int Get32(const uint8_t *in)
+{
+    return Get16(in) | (Get16(in + 2) << 16);
+}
+
+// Maps the colors of one tile to palette indices. Slots are tagged with the tile
+// generation, so starting a new tile does not need to clear the table.
+struct PaletteBuilder
+{
+    unsigned int keys[PALETTE_HASH_SIZE];
+    unsigned int generations[PALETTE_HASH_SIZE];
+    uint8_t indices[PALETTE_HASH_SIZE];
+    unsigned int colors[PALETTE_MAX_COLORS];
+    int count;
+    unsigned int generation;
+
+    PaletteBuilder()
+        : count(0)
+        , generation(0)
+    {
+        memset(generations, 0, sizeof(generations));
+    }
+
+    void reset()
+    {
+        count = 0;
+        if (++generation == 0)
+        {
+            memset(generations, 0, sizeof(generations));
+            generation = 1;
+        }
+    }
+
+    // Returns the index of the color, or -1 if the palette is full
+    int lookup(unsigned int color)
+    {
+        unsigned int slot = (color * 2654435761u) >> 22;
+        while (generations[slot] == generation)
+        {
+            if (keys[slot] == color)
+                return indices[slot];
+            slot = (slot + 1) & (PALETTE_HASH_SIZE - 1);
+        }
+
+        if (count == PALETTE_MAX_COLORS)
+            return -1;
+
+        generations[slot] = generation;
+        keys[slot] = color;
+        indices[slot] = (uint8_t)count;
+        colors[count] = color;
+        return count++;
+    }
+};
+
+struct DeltaEncoder::Band
+{
+    int firstTileRow;
+    int lastTileRow;
+    std::vector<uint8_t> raw;
+    size_t rawSize;
+    std::vector<uint8_t> packed;
+    size_t packedSize;
+    uint8_t method;
+    PaletteBuilder palette;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *context;
+
+    Band() : context(ZSTD_createCCtx()) {}
+    ~Band() { ZSTD_freeCCtx(context); }
+#endif
+};
+
+DeltaEncoder::DeltaEncoder(int tileSize, int threads, int level)
+    : m_tileSize(tileSize > 0 && tileSize <= 256 ? tileSize : 64)
+    , m_threads(threads > 0 ? threads : 1)
+    , m_level(level)
+    , m_width(0)
+    , m_height(0)
+{
+}
+
+DeltaEncoder::~DeltaEncoder()
+{
+    for (size_t i = 0; i < m_bands.size(); ++i)
+        delete m_bands[i];
+}
+
+void DeltaEncoder::encodeBand(Band &band, const uint8_t *data, bool keyFrame)
+{
+    size_t pitch = (size_t)m_width * 4;
+    uint8_t *out = band.raw.data();
+
+    for (int ty = band.firstTileRow; ty < band.lastTileRow; ++ty)
+    {
+        int y0 = ty * m_tileSize;
+        int y1 = y0 + m_tileSize < m_height ? y0 + m_tileSize : m_height;
+
+        for (int x0 = 0; x0 < m_width; x0 += m_tileSize)
+        {
+            int x1 = x0 + m_tileSize < m_width ? x0 + m_tileSize : m_width;
+            size_t rowBytes = (size_t)(x1 - x0) * 4;
+
+            if (!keyFrame)
+            {
+                bool unchanged = true;
+                for (int y = y0; y < y1 && unchanged; ++y)
+                    unchanged = memcmp(data + y * pitch + x0 * 4, &m_previous[y * pitch + x0 * 4], rowBytes) == 0;
+
+                if (unchanged)
+                {
+                    *out++ = TILE_SKIP;
+                    continue;
+                }
+            }
+
+            // Try a palette first, it also detects single-colored tiles. The runs are counted
+            // on the way, so the size of the palette tile is known before it is written.
+            PaletteBuilder &palette = band.palette;
+            palette.reset();
+            bool fits = true;
+            size_t runs = 0;
+            int run = 0;
+            unsigned int last = 0;
+            for (int y = y0; y < y1 && fits; ++y)
+            {
+                const unsigned int *row = (const unsigned int *)(data + y * pitch) + x0;
+                for (int x = 0; x < x1 - x0 && fits; ++x)
+                {
+                    fits = palette.lookup(row[x]) >= 0;
+                    if (run > 0 && row[x] == last && run < 256)
+                    {
+                        ++run;
+                        continue;
+                    }
+                    ++runs;
+                    run = 1;
+                    last = row[x];
+                }
+            }
+
+            if (fits && palette.count == 1)
+            {
+                *out++ = TILE_SOLID;
+                Put32(out, palette.colors[0]);
+                out += 4;
+                continue;
+            }
+
+            // Only when smaller than the pixels themselves, which also keeps narrow tiles at the
+            // right edge within the room reserved for them
+            if (fits && 2 + 4 * (size_t)palette.count + 2 * runs <= 1 + rowBytes * (y1 - y0))
+            {
+                *out++ = TILE_PALETTE;
+                *out++ = (uint8_t)(palette.count - 1);
+                for (int i = 0; i < palette.count; ++i, out += 4)
+                    Put32(out, palette.colors[i]);
+
+                run = 0;
+                int current = -1;
+                for (int y = y0; y < y1; ++y)
+                {
+                    const unsigned int *row = (const unsigned int *)(data + y * pitch) + x0;
+                    for (int x = 0; x < x1 - x0; ++x)
+                    {
+                        int index = palette.lookup(row[x]);
+                        if (index == current && run < 256)
+                        {
+                            ++run;
+                            continue;
+                        }
+                        if (run > 0)
+                        {
+                            *out++ = (uint8_t)(run - 1);
+                            *out++ = (uint8_t)current;
+                        }
+                        current = index;
+                        run = 1;
+                    }
+                }
+                *out++ = (uint8_t)(run - 1);
+                *out++ = (uint8_t)current;
+                continue;
+            }
+
+            if (keyFrame)
+            {
+                *out++ = TILE_RAW;
+                for (int y = y0; y < y1; ++y)
+                {
+                    const uint8_t *row = data + y * pitch + x0 * 4;
+                    memcpy(out, row, 4);
+                    for (size_t i = 4; i < rowBytes; ++i)
+                        out[i] = (uint8_t)(row[i] - row[i - 4]);
+                    out += rowBytes;
+                }
+            }
+            else
+            {
+                *out++ = TILE_DELTA;
+                for (int y = y0; y < y1; ++y)
+                {
+                    const uint8_t *row = data + y * pitch + x0 * 4;
+                    const uint8_t *previous = &m_previous[y * pitch + x0 * 4];
+                    for (size_t i = 0; i < rowBytes; ++i)
+                        out[i] = row[i] ^ previous[i];
+                    out += rowBytes;
+                }
+            }
+        }
+    }
+
+    band.rawSize = out - band.raw.data();
+    band.method = METHOD_STORED;
+
+#ifdef HAVE_ZSTD
+    size_t packedSize = ZSTD_compressCCtx(band.context, band.packed.data(), band.packed.size(),
+                                          band.raw.data(), band.rawSize, m_level);
+    if (!ZSTD_isError(packedSize) && packedSize < band.rawSize)
+    {
+        band.method = METHOD_ZSTD;
+        band.packedSize = packedSize;
+    }
+#endif
+
+    // The rows of this band become the reference for the next frame
+    int firstRow = band.firstTileRow * m_tileSize;
+    int lastRow = band.lastTileRow * m_tileSize < m_height ? band.lastTileRow * m_tileSize : m_height;
+    memcpy(&m_previous[firstRow * pitch], data + firstRow * pitch, (lastRow - firstRow) * pitch);
+}
+
+bool DeltaEncoder::encode(const uint8_t *data, int width, int height, std::vector<uint8_t> &output, bool keyFrame)
+{
+    if (!data || width <= 0 || height <= 0)
+        return false;
+
+    int tileRows = (height + m_tileSize - 1) / m_tileSize;
+    int tileCols = (width + m_tileSize - 1) / m_tileSize;
+
+    if (width != m_width || height != m_height)
+    {
+        m_width = width;
+        m_height = height;
+        m_previous.resize((size_t)width * height * 4);
+        keyFrame = true;
+
+        for (size_t i = 0; i < m_bands.size(); ++i)
+            delete m_bands[i];
+
+        int bands = m_threads < tileRows ? m_threads : tileRows;
+        m_bands.resize(bands);
+        for (int i = 0; i < bands; ++i)
+        {
+            Band *band = new Band;
+            band->firstTileRow = tileRows * i / bands;
+            band->lastTileRow = tileRows * (i + 1) / bands;
+
+            // Worst case: every tile stored raw
+            size_t rows = (size_t)(band->lastTileRow - band->firstTileRow) * m_tileSize;
+            band->raw.resize(rows * width * 4 + rows / m_tileSize * tileCols);
+#ifdef HAVE_ZSTD
+            band->packed.resize(ZSTD_compressBound(band->raw.size()));
+#endif
+            m_bands[i] = band;
+        }
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i + 1 < m_bands.size(); ++i)
+        workers.emplace_back(&DeltaEncoder::encodeBand, this, std::ref(*m_bands[i]), data, keyFrame);
+    encodeBand(*m_bands.back(), data, keyFrame);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    size_t size = DELTA_HEADER_SIZE + m_bands.size() * DELTA_BAND_SIZE;
+    for (size_t i = 0; i < m_bands.size(); ++i)
+        size += m_bands[i]->method == METHOD_STORED ? m_bands[i]->rawSize : m_bands[i]->packedSize;
+
+    output.resize(size);
+    uint8_t *out = output.data();
+
+    Put32(out, DELTA_MAGIC);
+    out[4] = DELTA_VERSION;
+    out[5] = keyFrame ? DELTA_FLAG_KEYFRAME : 0;
+    Put16(out + 6, m_tileSize);
+    Put32(out + 8, width);
+    Put32(out + 12, height);
+    Put16(out + 16, (unsigned int)m_bands.size());
+    Put16(out + 18, 0);
+    Put32(out + 20, (unsigned int)size);
+    out += DELTA_HEADER_SIZE;
+
+    for (size_t i = 0; i < m_bands.size(); ++i, out += DELTA_BAND_SIZE)
+    {
+        const Band &band = *m_bands[i];
+        memset(out, 0, DELTA_BAND_SIZE);
+        Put16(out, band.firstTileRow);
+        Put16(out + 2, band.lastTileRow);
+        out[4] = band.method;
+        Put32(out + 8, (unsigned int)band.rawSize);
+        Put32(out + 12, (unsigned int)(band.method == METHOD_STORED ? band.rawSize : band.packedSize));
+    }
+
+    for (size_t i = 0; i < m_bands.size(); ++i)
+    {
+        const Band &band = *m_bands[i];
+        if (band.method == METHOD_STORED)
+        {
+            memcpy(out, band.raw.data(), band.rawSize);
+            out += band.rawSize;
+        }
+        else
+        {
+            memcpy(out, band.packed.data(), band.packedSize);
+            out += band.packedSize;
+        }
+    }
+
+    return true;
+}
+
+DeltaDecoder::DeltaDecoder()
+    : m_width(0)
+    , m_height(0)
+    , m_tileSize(0)
+{
+}
+
+bool DeltaDecoder::decode(const uint8_t *data, size_t size, size_t *frameSize)
+{
+    if (!data || size < DELTA_HEADER_SIZE || Get32(data) != DELTA_MAGIC || data[4] != DELTA_VERSION)
+        return false;
+
+    bool keyFrame = (data[5] & DELTA_FLAG_KEYFRAME) != 0;
+    int tileSize = Get16(data + 6);
+    int width = Get32(data + 8);
+    int height = Get32(data + 12);
+    size_t bands = Get16(data + 16);
+    size_t total = Get32(data + 20);
+
+    if (total > size || tileSize == 0 || width <= 0 || height <= 0 || DELTA_HEADER_SIZE + bands * DELTA_BAND_SIZE > total)
+        return false;
+
+    if (!keyFrame && (width != m_width || height != m_height || tileSize != m_tileSize))
+        return false;
+
+    m_width = width;
+    m_height = height;
+    m_tileSize = tileSize;
+    m_frame.resize((size_t)width * height * 4);
+
+    const uint8_t *table = data + DELTA_HEADER_SIZE;
+    const uint8_t *payload = table + bands * DELTA_BAND_SIZE;
+    const uint8_t *end = data + total;
+
+    for (size_t i = 0; i < bands; ++i, table += DELTA_BAND_SIZE)
+    {
+        int firstTileRow = Get16(table);
+        int lastTileRow = Get16(table + 2);
+        uint8_t method = table[4];
+        size_t rawSize = Get32(table + 8);
+        size_t storedSize = Get32(table + 12);
+
+        if (payload + storedSize > end)
+            return false;
+
+        if (method == METHOD_STORED)
+        {
+            if (!decodeBand(payload, storedSize, firstTileRow, lastTileRow))
+                return false;
+        }
+#ifdef HAVE_ZSTD
+        else if (method == METHOD_ZSTD)
+        {
+            m_scratch.resize(rawSize);
+            size_t unpacked = ZSTD_decompress(m_scratch.data(), rawSize, payload, storedSize);
+            if (ZSTD_isError(unpacked) || unpacked != rawSize)
+                return false;
+            if (!decodeBand(m_scratch.data(), rawSize, firstTileRow, lastTileRow))
+                return false;
+        }
+#endif
+        else
+        {
+            (void)rawSize;
+            return false;
+        }
+
+        payload += storedSize;
+    }
+
+    if (frameSize)
+        *frameSize = total;
+
+    return true;
+}
+
+bool DeltaDecoder::decodeBand(const uint8_t *in, size_t size, int firstTileRow, int lastTileRow)
+{
+    const uint8_t *end = in + size;
+    size_t pitch = (size_t)m_width * 4;
+
+    if (lastTileRow * m_tileSize >= m_height + m_tileSize)
+        return false;
+
+    for (int ty = firstTileRow; ty < lastTileRow; ++ty)
+    {
+        int y0 = ty * m_tileSize;
+        int y1 = y0 + m_tileSize < m_height ? y0 + m_tileSize : m_height;
+
+        for (int x0 = 0; x0 < m_width; x0 += m_tileSize)
+        {
+            int x1 = x0 + m_tileSize < m_width ? x0 + m_tileSize : m_width;
+            size_t rowBytes = (size_t)(x1 - x0) * 4;
+
+            if (in >= end)
+                return false;
+
+            uint8_t type = *in++;
+            switch (type)
+            {
+            case TILE_SKIP:
+                break;
+
+            case TILE_SOLID:
+            {
+                if (end - in < 4)
+                    return false;
+                unsigned int color = Get32(in);
+                in += 4;
+                for (int y = y0; y < y1; ++y)
+                {
+                    unsigned int *row = (unsigned int *)&m_frame[y * pitch] + x0;
+                    for (int x = 0; x < x1 - x0; ++x)
+                        row[x] = color;
+                }
+                break;
+            }
+
+            case TILE_PALETTE:
+            {
+                if (end - in < 1)
+                    return false;
+                int count = *in++ + 1;
+                if (end - in < count * 4)
+                    return false;
+                unsigned int colors[PALETTE_MAX_COLORS];
+                for (int i = 0; i < count; ++i, in += 4)
+                    colors[i] = Get32(in);
+
+                int run = 0;
+                unsigned int color = 0;
+                for (int y = y0; y < y1; ++y)
+                {
+                    unsigned int *row = (unsigned int *)&m_frame[y * pitch] + x0;
+                    for (int x = 0; x < x1 - x0; ++x)
+                    {
+                        if (run == 0)
+                        {
+                            if (end - in < 2 || in[1] >= count)
+                                return false;
+                            run = in[0] + 1;
+                            color = colors[in[1]];
+                            in += 2;
+                        }
+                        row[x] = color;
+                        --run;
+                    }
+                }
+                break;
+            }
+
+            case TILE_RAW:
+                if ((size_t)(end - in) < rowBytes * (y1 - y0))
+                    return false;
+                for (int y = y0; y < y1; ++y)
+                {
+                    uint8_t *row = &m_frame[y * pitch + x0 * 4];
+                    memcpy(row, in, 4);
+                    for (size_t i = 4; i < rowBytes; ++i)
+                        row[i] = (uint8_t)(in[i] + row[i - 4]);
+                    in += rowBytes;
+                }
+                break;
+
+            case TILE_DELTA:
+                if ((size_t)(end - in) < rowBytes * (y1 - y0))
+                    return false;
+                for (int y = y0; y < y1; ++y)
+                {
+                    uint8_t *row = &m_frame[y * pitch + x0 * 4];
+                    for (size_t i = 0; i < rowBytes; ++i)
+                        row[i] ^= in[i];
+                    in += rowBytes;
+                }
+                break;
+
+            default:
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <stddef.h>
+#include <vector>
+
+// Lossless codec for sequences of raw ARGB frames, meant for archiving desktop captures.
+//
+// Frames are cut into square tiles. A tile identical to the previous frame costs one byte,
+// a single-colored tile five; tiles with few colors are stored as a palette with run-length
+// coded indices, everything else as the XOR against the previous frame (or, in key frames,
+// as left-predicted pixels). Tile rows are grouped in bands which are coded on separate
+// threads and, when built with HAVE_ZSTD, compressed with zstd.
+class DeltaEncoder
+{
+    DeltaEncoder(const DeltaEncoder &);
+    DeltaEncoder &operator=(const DeltaEncoder &);
+
+public:
+    DeltaEncoder(int tileSize = 64, int threads = 1, int level = 1);
+    ~DeltaEncoder();
+
+    // Encodes the top-down ARGB frame, replacing the contents of output. A frame is coded
+    // against the previous one unless keyFrame is set or its dimensions changed.
+    bool encode(const uint8_t *data, int width, int height, std::vector<uint8_t> &output, bool keyFrame = false);
+
+protected:
+    struct Band;
+
+    void encodeBand(Band &band, const uint8_t *data, bool keyFrame);
+
+    int m_tileSize;
+    int m_threads;
+    int m_level;
+    int m_width;
+    int m_height;
+    std::vector<uint8_t> m_previous;
+    std::vector<Band *> m_bands;
+};
+
+// Reconstructs the frames produced by DeltaEncoder, in order
+class DeltaDecoder
+{
+public:
+    DeltaDecoder();
+
+    // Decodes one frame, returns false on malformed input or a delta frame without its reference.
+    // size receives the number of bytes the frame occupied, so frames can be read back to back.
+    bool decode(const uint8_t *data, size_t size, size_t *frameSize = NULL);
+
+    // The current top-down ARGB frame
+    const uint8_t *frame() const { return m_frame.data(); }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+protected:
+    bool decodeBand(const uint8_t *payload, size_t size, int firstTileRow, int lastTileRow);
+
+    int m_width;
+    int m_height;
+    int m_tileSize;
+    std::vector<uint8_t> m_frame;
+    std::vector<uint8_t> m_scratch;
+};
@@ -0,0 +1,232 @@
+#include "DirtyRegions.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DIRTY_USE_SSE42
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE42
+#else
+#include <cpuid.h>
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+typedef unsigned int (*Crc32cFunction)(unsigned int crc, const BYTE *data, size_t size);
+
+static unsigned int crc32cTable[256];
+
+static unsigned int Crc32cSoftware(unsigned int crc, const BYTE *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        crc = crc32cTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef DIRTY_USE_SSE42
+static bool HasSSE42()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+TARGET_SSE42 static unsigned int Crc32cHardware(unsigned int crc, const BYTE *data, size_t size)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    unsigned long long crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        unsigned long long value;
+        memcpy(&value, data, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+    crc = (unsigned int)crc64;
+#endif
+    for (; size >= 4; size -= 4, data += 4)
+    {
+        unsigned int value;
+        memcpy(&value, data, sizeof(value));
+        crc = _mm_crc32_u32(crc, value);
+    }
+    for (; size > 0; --size)
+        crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+#endif
+
+static Crc32cFunction SelectCrc32c()
+{
+    // Castagnoli polynomial, reflected
+    for (unsigned int i = 0; i < 256; ++i)
+    {
+        unsigned int crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+        crc32cTable[i] = crc;
+    }
+
+#ifdef DIRTY_USE_SSE42
+    if (HasSSE42())
+        return Crc32cHardware;
+#endif
+    return Crc32cSoftware;
+}
+
+DirtyRegionTracker::DirtyRegionTracker(int tileSize)
+    : m_tileSize(tileSize > 0 ? tileSize : 64)
+    , m_width(0)
+    , m_height(0)
+    , m_tilesX(0)
+    , m_tilesY(0)
+    , m_dirtyTileCount(0)
+{
+}
+
+void DirtyRegionTracker::reset()
+{
+    m_width = 0;
+    m_height = 0;
+}
+
+const std::vector<RECT> &DirtyRegionTracker::update(const BYTE *data, int width, int height, int pitch)
+{
+    m_rects.clear();
+
+    if (!data || width <= 0 || height <= 0)
+        return m_rects;
+
+    if (pitch == 0)
+        pitch = width * 4;
+
+    bool wholeFrame = width != m_width || height != m_height;
+    if (wholeFrame)
+    {
+        m_width = width;
+        m_height = height;
+        m_tilesX = (width + m_tileSize - 1) / m_tileSize;
+        m_tilesY = (height + m_tileSize - 1) / m_tileSize;
+        m_hashes.assign((size_t)m_tilesX * m_tilesY, 0);
+        m_rowHashes.resize(m_tilesX);
+        m_dirty.resize(m_hashes.size());
+    }
+
+    hashFrame(data, pitch);
+
+    if (wholeFrame)
+    {
+        memset(m_dirty.data(), 1, m_dirty.size());
+        m_dirtyTileCount = m_dirty.size();
+    }
+
+    coalesce();
+
+    return m_rects;
+}
+
+void DirtyRegionTracker::hashFrame(const BYTE *data, int pitch)
+{
+    static const Crc32cFunction crc32c = SelectCrc32c();
+
+    m_dirtyTileCount = 0;
+
+    for (int ty = 0; ty < m_tilesY; ++ty)
+    {
+        int y0 = ty * m_tileSize;
+        int y1 = y0 + m_tileSize < m_height ? y0 + m_tileSize : m_height;
+
+        // Walk the rows in memory order, feeding each row segment to its tile's CRC
+        for (int tx = 0; tx < m_tilesX; ++tx)
+            m_rowHashes[tx] = 0xFFFFFFFF;
+
+        for (int y = y0; y < y1; ++y)
+        {
+            const BYTE *row = data + (size_t)y * pitch;
+            for (int tx = 0; tx < m_tilesX; ++tx)
+            {
+                int x0 = tx * m_tileSize;
+                int x1 = x0 + m_tileSize < m_width ? x0 + m_tileSize : m_width;
+                m_rowHashes[tx] = crc32c(m_rowHashes[tx], row + x0 * 4, (x1 - x0) * 4);
+            }
+        }
+
+        for (int tx = 0; tx < m_tilesX; ++tx)
+        {
+            size_t idx = (size_t)ty * m_tilesX + tx;
+            unsigned int hash = ~m_rowHashes[tx];
+
+            m_dirty[idx] = hash != m_hashes[idx];
+            m_dirtyTileCount += m_dirty[idx];
+            m_hashes[idx] = hash;
+        }
+    }
+}
+
+void DirtyRegionTracker::coalesce()
+{
+    // Rectangles which reached the previous tile row and may still grow downwards
+    size_t open = 0;
+
+    for (int ty = 0; ty < m_tilesY; ++ty)
+    {
+        LONG top = ty * m_tileSize;
+        LONG bottom = top + m_tileSize < m_height ? top + m_tileSize : m_height;
+        size_t rowStart = m_rects.size();
+
+        const BYTE *dirty = &m_dirty[(size_t)ty * m_tilesX];
+        for (int tx = 0; tx < m_tilesX; )
+        {
+            if (!dirty[tx])
+            {
+                ++tx;
+                continue;
+            }
+
+            // Merge a horizontal run of dirty tiles
+            int first = tx;
+            while (tx < m_tilesX && dirty[tx])
+                ++tx;
+
+            LONG left = first * m_tileSize;
+            LONG right = tx * m_tileSize < m_width ? tx * m_tileSize : m_width;
+
+            // Extend a rectangle from the row above if it spans exactly the same columns
+            bool extended = false;
+            for (size_t i = open; i < rowStart; ++i)
+            {
+                RECT &rect = m_rects[i];
+                if (rect.bottom == top && rect.left == left && rect.right == right)
+                {
+                    rect.bottom = bottom;
+                    extended = true;
+                    break;
+                }
+            }
+
+            if (!extended)
+            {
+                RECT rect = {left, top, right, bottom};
+                m_rects.push_back(rect);
+            }
+        }
+
+        // Rectangles ending above this row can no longer grow; keep the open ones at the back
+        size_t keep = open;
+        for (size_t i = open; i < m_rects.size(); ++i)
+        {
+            if (m_rects[i].bottom != bottom)
+                std::swap(m_rects[i], m_rects[keep++]);
+        }
+        open = keep;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+// Finds the areas which changed between consecutive ARGB frames without diffing them.
+// Every frame is cut into square tiles which are hashed with CRC32C (SSE4.2 when the CPU
+// has it); tiles whose hash differs from the previous frame are merged into rectangles.
+class DirtyRegionTracker
+{
+public:
+    explicit DirtyRegionTracker(int tileSize = 64);
+
+    // Hashes the frame and returns the rectangles which changed since the previous call.
+    // The first frame, and every frame whose size differs from the previous one, is dirty
+    // as a whole. pitch is the distance between rows in bytes, 0 means width * 4.
+    const std::vector<RECT> &update(const BYTE *data, int width, int height, int pitch = 0);
+
+    // Forgets the previous frame, so the next one is reported dirty as a whole
+    void reset();
+
+    // Number of tiles found dirty by the last update
+    size_t dirtyTileCount() const { return m_dirtyTileCount; }
+
+    // Number of tiles in the last frame
+    size_t tileCount() const { return m_hashes.size(); }
+
+    int tileSize() const { return m_tileSize; }
+
+protected:
+    void hashFrame(const BYTE *data, int pitch);
+    void coalesce();
+
+    int m_tileSize;
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+    size_t m_dirtyTileCount;
+    std::vector<unsigned int> m_hashes;
+    std::vector<unsigned int> m_rowHashes;
+    std::vector<BYTE> m_dirty;
+    std::vector<RECT> m_rects;
+};
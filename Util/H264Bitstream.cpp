@@ -0,0 +1,175 @@
+#include "H264Bitstream.h"
+
+#include <string.h>
+
+// Returns the position of the next 00 00 01 start code at or after offset, or size if none
+static size_t FindStartCode(const uint8_t *data, size_t size, size_t offset)
+{
+    while (offset + 3 <= size)
+    {
+        const uint8_t *one = (const uint8_t *)memchr(data + offset + 2, 1, size - offset - 2);
+        if (!one)
+            break;
+
+        size_t pos = one - data - 2;
+        if (data[pos] == 0 && data[pos + 1] == 0)
+            return pos;
+        offset = pos + 1;
+    }
+    return size;
+}
+
+bool NextNalUnit(const uint8_t *data, size_t size, size_t *offset, H264NalUnit *unit)
+{
+    size_t start = FindStartCode(data, size, *offset);
+    if (start >= size)
+    {
+        *offset = size;
+        return false;
+    }
+
+    start += 3;
+    size_t end = FindStartCode(data, size, start);
+    *offset = end;
+
+    // The zero byte of a four-byte start code is not part of this unit
+    while (end > start && data[end - 1] == 0)
+        --end;
+
+    if (end == start)
+        return NextNalUnit(data, size, offset, unit);
+
+    unit->data = data + start;
+    unit->size = end - start;
+    unit->type = data[start] & 0x1F;
+    unit->refIdc = (data[start] >> 5) & 3;
+    return true;
+}
+
+bool IsIdrAccessUnit(const uint8_t *data, size_t size)
+{
+    size_t offset = 0;
+    H264NalUnit unit;
+    while (NextNalUnit(data, size, &offset, &unit))
+    {
+        if (unit.type == H264_NAL_IDR)
+            return true;
+    }
+    return false;
+}
+
+// Appends an RBSP byte, inserting emulation prevention bytes so no start code can appear
+static uint8_t *PutEscaped(uint8_t *out, uint8_t value, int *zeros)
+{
+    if (*zeros >= 2 && value <= 3)
+    {
+        *out++ = 3;
+        *zeros = 0;
+    }
+    *out++ = value;
+    *zeros = value == 0 ? *zeros + 1 : 0;
+    return out;
+}
+
+size_t WriteUserDataSei(const uint8_t uuid[16], const uint8_t *payload, size_t size, uint8_t *output)
+{
+    uint8_t *out = output;
+    *out++ = 0;
+    *out++ = 0;
+    *out++ = 0;
+    *out++ = 1;
+    *out++ = H264_NAL_SEI;
+
+    // user_data_unregistered
+    int zeros = 0;
+    out = PutEscaped(out, 5, &zeros);
+
+    size_t remaining = 16 + size;
+    for (; remaining >= 255; remaining -= 255)
+        out = PutEscaped(out, 255, &zeros);
+    out = PutEscaped(out, (uint8_t)remaining, &zeros);
+
+    for (int i = 0; i < 16; ++i)
+        out = PutEscaped(out, uuid[i], &zeros);
+    for (size_t i = 0; i < size; ++i)
+        out = PutEscaped(out, payload[i], &zeros);
+
+    // rbsp_trailing_bits
+    *out++ = 0x80;
+    return out - output;
+}
+
+bool ReadUserDataSei(const H264NalUnit &unit, const uint8_t uuid[16], uint8_t *payload, size_t *size)
+{
+    if (unit.type != H264_NAL_SEI)
+        return false;
+
+    // Reads the next RBSP byte, skipping emulation prevention bytes
+    const uint8_t *data = unit.data;
+    size_t end = unit.size;
+    size_t pos = 1;
+    int zeros = 0;
+    auto next = [&](uint8_t *value) -> bool
+    {
+        if (pos < end && zeros >= 2 && data[pos] == 3)
+        {
+            ++pos;
+            zeros = 0;
+        }
+        if (pos >= end)
+            return false;
+        *value = data[pos++];
+        zeros = *value == 0 ? zeros + 1 : 0;
+        return true;
+    };
+
+    for (;;)
+    {
+        uint8_t value;
+        size_t type = 0, length = 0;
+        do
+        {
+            if (!next(&value))
+                return false;
+            type += value;
+        } while (value == 255);
+
+        // Only the trailing bits are left
+        if (type == 0x80 && pos >= end)
+            return false;
+
+        do
+        {
+            if (!next(&value))
+                return false;
+            length += value;
+        } while (value == 255);
+
+        bool match = type == 5 && length >= 16;
+        uint8_t id[16];
+        size_t i = 0;
+        for (; match && i < 16; ++i)
+        {
+            if (!next(&id[i]))
+                return false;
+        }
+        if (match && memcmp(id, uuid, 16) == 0)
+        {
+            if (length - 16 > *size)
+                return false;
+            for (size_t j = 0; j < length - 16; ++j)
+            {
+                if (!next(&payload[j]))
+                    return false;
+            }
+            *size = length - 16;
+            return true;
+        }
+
+        for (; i < length; ++i)
+        {
+            if (!next(&value))
+                return false;
+        }
+    }
+}
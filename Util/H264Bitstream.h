@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <stddef.h>
+
+// NAL unit types used by the capture tools
+enum H264NalType
+{
+    H264_NAL_SLICE = 1,
+    H264_NAL_IDR = 5,
+    H264_NAL_SEI = 6,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_AUD = 9
+};
+
+// One NAL unit of an Annex B byte stream. data points past the start code at the NAL header;
+// size excludes trailing zero bytes, which belong to the next start code.
+struct H264NalUnit
+{
+    const uint8_t *data;
+    size_t size;
+    int type;
+    int refIdc;
+};
+
+// Finds the NAL unit starting at or after *offset and advances *offset past it.
+// Returns false when there are no more NAL units.
+bool NextNalUnit(const uint8_t *data, size_t size, size_t *offset, H264NalUnit *unit);
+
+// Returns true if the access unit contains a slice of an IDR picture
+bool IsIdrAccessUnit(const uint8_t *data, size_t size);
+
+// Writes an SEI NAL unit, start code included, carrying one user_data_unregistered message
+// with the given UUID and payload. output needs room for 32 + size * 3 / 2 bytes.
+// Returns the number of bytes written.
+size_t WriteUserDataSei(const uint8_t uuid[16], const uint8_t *payload, size_t size, uint8_t *output);
+
+// Looks for a user_data_unregistered message with the given UUID in an SEI NAL unit and copies
+// its payload, without the UUID, to payload. *size holds the capacity on input and receives
+// the payload size. Returns false if there is no such message or it does not fit.
+bool ReadUserDataSei(const H264NalUnit &unit, const uint8_t uuid[16], uint8_t *payload, size_t *size);
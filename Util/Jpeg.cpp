@@ -0,0 +1,752 @@
+#pragma warning(disable : 4996)
+
+#include "Jpeg.h"
+
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE_MODE "wb"
+#else
+#define PIPE_WRITE_MODE "w"
+#endif
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define JPEG_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Worst case of one MCU (six blocks) after byte stuffing, plus a restart marker
+#define JPEG_MAX_MCU_SIZE (6 * 2 * 210 + 2)
+
+static const int zigzag[64] =
+{
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Quantization tables from Annex K of the JPEG standard, in natural order
+static const BYTE lumaQuant[64] =
+{
+    16,  11,  10,  16,  24,  40,  51,  61,
+    12,  12,  14,  19,  26,  58,  60,  55,
+    14,  13,  16,  24,  40,  57,  69,  56,
+    14,  17,  22,  29,  51,  87,  80,  62,
+    18,  22,  37,  56,  68, 109, 103,  77,
+    24,  35,  55,  64,  81, 104, 113,  92,
+    49,  64,  78,  87, 103, 121, 120, 101,
+    72,  92,  95,  98, 112, 100, 103,  99
+};
+
+static const BYTE chromaQuant[64] =
+{
+    17,  18,  24,  47,  99,  99,  99,  99,
+    18,  21,  26,  66,  99,  99,  99,  99,
+    24,  26,  56,  99,  99,  99,  99,  99,
+    47,  66,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99,
+    99,  99,  99,  99,  99,  99,  99,  99
+};
+
+// Huffman tables from Annex K of the JPEG standard: code counts per length, then symbols
+static const BYTE dcLumaBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const BYTE dcChromaBits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const BYTE dcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const BYTE acLumaBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const BYTE acLumaValues[162] =
+{
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const BYTE acChromaBits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const BYTE acChromaValues[162] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// Huffman code and its length for every symbol
+struct HuffmanTable
+{
+    unsigned short code[256];
+    unsigned char length[256];
+};
+
+// Everything derived from the quality setting and the standard tables
+struct JpegTables
+{
+    BYTE quant[2][64];          // zigzag order, as written to the DQT segment
+    float reciprocal[2][64];    // natural order, 1 / quantizer
+    HuffmanTable dc[2];
+    HuffmanTable ac[2];
+};
+
+// Describes the location of the color channels within a source pixel
+struct JpegLayout
+{
+    int bytesPerPixel;
+    int red;
+    int green;
+    int blue;
+};
+
+static float dctMatrix[8][8];
+static BYTE bitLength[2048];
+
+static void BuildHuffmanTable(const BYTE *bits, const BYTE *values, HuffmanTable &table)
+{
+    memset(&table, 0, sizeof(table));
+
+    unsigned short code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; ++length)
+    {
+        for (int i = 0; i < bits[length - 1]; ++i, ++k)
+        {
+            table.code[values[k]] = code++;
+            table.length[values[k]] = (unsigned char)length;
+        }
+        code <<= 1;
+    }
+}
+
+static void BuildQuantTable(const BYTE *base, int quality, BYTE *zigzagOut, float *reciprocal)
+{
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+    for (int i = 0; i < 64; ++i)
+    {
+        int q = (base[i] * scale + 50) / 100;
+        if (q < 1)
+            q = 1;
+        if (q > 255)
+            q = 255;
+        reciprocal[i] = 1.0f / q;
+    }
+
+    for (int i = 0; i < 64; ++i)
+        zigzagOut[i] = (BYTE)(1.0f / reciprocal[zigzag[i]] + 0.5f);
+}
+
+static void InitStaticTables()
+{
+    // The orthonormal DCT-II basis; C * B * C^T is exactly the JPEG forward DCT
+    for (int k = 0; k < 8; ++k)
+    {
+        float scale = k == 0 ? sqrtf(1.0f / 8.0f) : sqrtf(2.0f / 8.0f);
+        for (int n = 0; n < 8; ++n)
+            dctMatrix[k][n] = scale * cosf((2 * n + 1) * k * 3.14159265358979f / 16.0f);
+    }
+
+    for (int v = 1; v < 2048; ++v)
+    {
+        int bits = 0;
+        for (int a = v; a; a >>= 1)
+            ++bits;
+        bitLength[v] = (BYTE)bits;
+    }
+}
+
+static JpegLayout GetLayout(JpegPixelFormat format)
+{
+    switch (format)
+    {
+    case JPEG_FORMAT_BGR:
+        return JpegLayout{3, 2, 1, 0};
+    case JPEG_FORMAT_ARGB:
+        return JpegLayout{4, 2, 1, 0};
+    case JPEG_FORMAT_RGB:
+    default:
+        return JpegLayout{3, 0, 1, 2};
+    }
+}
+
+// Collects entropy-coded bits with 0xFF byte stuffing
+class BitWriter
+{
+public:
+    BitWriter(std::vector<BYTE> &output)
+        : m_output(output)
+        , m_size(0)
+        , m_buffer(0)
+        , m_bits(0)
+    {}
+
+    // Makes sure a whole MCU fits without further checks
+    void reserve()
+    {
+        if (m_output.size() - m_size < JPEG_MAX_MCU_SIZE)
+            m_output.resize(m_output.size() * 2 + JPEG_MAX_MCU_SIZE);
+    }
+
+    void put(unsigned int code, int length)
+    {
+        m_buffer = (m_buffer << length) | code;
+        m_bits += length;
+
+        while (m_bits >= 8)
+        {
+            BYTE b = (BYTE)(m_buffer >> (m_bits - 8));
+            m_output[m_size++] = b;
+            if (b == 0xFF)
+                m_output[m_size++] = 0;
+            m_bits -= 8;
+        }
+        m_buffer &= (1u << m_bits) - 1;
+    }
+
+    // Pads the last byte with ones, as required before a marker
+    void flush()
+    {
+        if (m_bits > 0)
+            put((1u << (8 - m_bits)) - 1, 8 - m_bits);
+    }
+
+    void marker(BYTE code)
+    {
+        m_output[m_size++] = 0xFF;
+        m_output[m_size++] = code;
+    }
+
+    size_t size() const { return m_size; }
+
+protected:
+    std::vector<BYTE> &m_output;
+    size_t m_size;
+    unsigned int m_buffer;
+    int m_bits;
+};
+
+// Transforms an 8x8 block (rows of 8 samples) in place
+static void ForwardDCT(float *block)
+{
+#ifdef JPEG_USE_SSE2
+    __m128 lo[8], hi[8];
+    for (int n = 0; n < 8; ++n)
+    {
+        lo[n] = _mm_loadu_ps(block + n * 8);
+        hi[n] = _mm_loadu_ps(block + n * 8 + 4);
+    }
+
+    // Each pass multiplies by the DCT matrix from the left and transposes,
+    // so two passes produce C * B * C^T in natural order
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        __m128 tlo[8], thi[8];
+        for (int k = 0; k < 8; ++k)
+        {
+            __m128 accLo = _mm_setzero_ps();
+            __m128 accHi = _mm_setzero_ps();
+            for (int n = 0; n < 8; ++n)
+            {
+                __m128 c = _mm_set1_ps(dctMatrix[k][n]);
+                accLo = _mm_add_ps(accLo, _mm_mul_ps(c, lo[n]));
+                accHi = _mm_add_ps(accHi, _mm_mul_ps(c, hi[n]));
+            }
+            tlo[k] = accLo;
+            thi[k] = accHi;
+        }
+
+        // [A B; C D]^T = [A^T C^T; B^T D^T]
+        _MM_TRANSPOSE4_PS(tlo[0], tlo[1], tlo[2], tlo[3]);
+        _MM_TRANSPOSE4_PS(thi[0], thi[1], thi[2], thi[3]);
+        _MM_TRANSPOSE4_PS(tlo[4], tlo[5], tlo[6], tlo[7]);
+        _MM_TRANSPOSE4_PS(thi[4], thi[5], thi[6], thi[7]);
+        for (int n = 0; n < 4; ++n)
+        {
+            lo[n] = tlo[n];
+            hi[n] = tlo[n + 4];
+            lo[n + 4] = thi[n];
+            hi[n + 4] = thi[n + 4];
+        }
+    }
+
+    for (int n = 0; n < 8; ++n)
+    {
+        _mm_storeu_ps(block + n * 8, lo[n]);
+        _mm_storeu_ps(block + n * 8 + 4, hi[n]);
+    }
+#else
+    float temp[64];
+    for (int k = 0; k < 8; ++k)
+    {
+        for (int x = 0; x < 8; ++x)
+        {
+            float sum = 0.0f;
+            for (int n = 0; n < 8; ++n)
+                sum += dctMatrix[k][n] * block[n * 8 + x];
+            temp[k * 8 + x] = sum;
+        }
+    }
+    for (int k = 0; k < 8; ++k)
+    {
+        for (int l = 0; l < 8; ++l)
+        {
+            float sum = 0.0f;
+            for (int n = 0; n < 8; ++n)
+                sum += temp[k * 8 + n] * dctMatrix[l][n];
+            block[k * 8 + l] = sum;
+        }
+    }
+#endif
+}
+
+// Quantizes the transformed block and reorders it to zigzag order
+static void Quantize(const float *block, const float *reciprocal, short *out)
+{
+    short natural[64];
+#ifdef JPEG_USE_SSE2
+    for (int i = 0; i < 64; i += 8)
+    {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(block + i), _mm_loadu_ps(reciprocal + i)));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(block + i + 4), _mm_loadu_ps(reciprocal + i + 4)));
+        _mm_storeu_si128((__m128i *)(natural + i), _mm_packs_epi32(a, b));
+    }
+#else
+    for (int i = 0; i < 64; ++i)
+    {
+        float v = block[i] * reciprocal[i];
+        natural[i] = (short)(v < 0.0f ? v - 0.5f : v + 0.5f);
+    }
+#endif
+    for (int i = 0; i < 64; ++i)
+        out[i] = natural[zigzag[i]];
+}
+
+static inline void PutValue(BitWriter &writer, int value, int length)
+{
+    // Negative values are sent as the one's complement of their magnitude
+    if (value < 0)
+        value -= 1;
+    writer.put(value & ((1 << length) - 1), length);
+}
+
+static void EncodeBlock(BitWriter &writer, const short *coef, int &prevDC, const HuffmanTable &dc, const HuffmanTable &ac)
+{
+    int diff = coef[0] - prevDC;
+    prevDC = coef[0];
+
+    int category = bitLength[diff < 0 ? -diff : diff];
+    writer.put(dc.code[category], dc.length[category]);
+    if (category)
+        PutValue(writer, diff, category);
+
+    int last = 63;
+    while (last > 0 && coef[last] == 0)
+        --last;
+
+    int run = 0;
+    for (int k = 1; k <= last; ++k)
+    {
+        int value = coef[k];
+        if (value == 0)
+        {
+            ++run;
+            continue;
+        }
+
+        while (run > 15)
+        {
+            writer.put(ac.code[0xF0], ac.length[0xF0]);
+            run -= 16;
+        }
+
+        int size = bitLength[value < 0 ? -value : value];
+        int symbol = (run << 4) | size;
+        writer.put(ac.code[symbol], ac.length[symbol]);
+        PutValue(writer, value, size);
+        run = 0;
+    }
+
+    if (last < 63)
+        writer.put(ac.code[0x00], ac.length[0x00]);
+}
+
+// Converts 16 source rows starting at y0 to level-shifted Y and to 2x2 averaged Cb and Cr.
+// Rows and columns beyond the image repeat the last ones.
+static void ConvertMcuRow(const BYTE *data, int width, int height, const JpegLayout &layout, int y0,
+                          int paddedWidth, float *luma, float *cb, float *cr, float *cbFull, float *crFull)
+{
+    for (int row = 0; row < 16; ++row)
+    {
+        int y = y0 + row < height ? y0 + row : height - 1;
+        const BYTE *src = data + (size_t)y * width * layout.bytesPerPixel;
+        float *yRow = luma + row * paddedWidth;
+        float *cbRow = cbFull + row * paddedWidth;
+        float *crRow = crFull + row * paddedWidth;
+
+        int x = 0;
+#ifdef JPEG_USE_SSE2
+        if (layout.bytesPerPixel == 4)
+        {
+            const __m128i mask = _mm_set1_epi32(0xFF);
+            const __m128 yr = _mm_set1_ps(0.299f), yg = _mm_set1_ps(0.587f), yb = _mm_set1_ps(0.114f);
+            const __m128 cbr = _mm_set1_ps(-0.168736f), cbg = _mm_set1_ps(-0.331264f), half = _mm_set1_ps(0.5f);
+            const __m128 crg = _mm_set1_ps(-0.418688f), crb = _mm_set1_ps(-0.081312f), shift = _mm_set1_ps(128.0f);
+
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i px = _mm_loadu_si128((const __m128i *)(src + x * 4));
+                __m128 b = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+                __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+                __m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+
+                __m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(yr, r), _mm_mul_ps(yg, g)), _mm_mul_ps(yb, b));
+                __m128 vcb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cbr, r), _mm_mul_ps(cbg, g)), _mm_mul_ps(half, b));
+                __m128 vcr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(half, r), _mm_mul_ps(crg, g)), _mm_mul_ps(crb, b));
+
+                _mm_storeu_ps(yRow + x, _mm_sub_ps(vy, shift));
+                _mm_storeu_ps(cbRow + x, vcb);
+                _mm_storeu_ps(crRow + x, vcr);
+            }
+        }
+#endif
+        for (; x < paddedWidth; ++x)
+        {
+            const BYTE *px = src + (x < width ? x : width - 1) * layout.bytesPerPixel;
+            float r = px[layout.red];
+            float g = px[layout.green];
+            float b = px[layout.blue];
+
+            yRow[x] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+            cbRow[x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+            crRow[x] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+        }
+    }
+
+    int halfWidth = paddedWidth / 2;
+    for (int row = 0; row < 8; ++row)
+    {
+        const float *cb0 = cbFull + row * 2 * paddedWidth, *cb1 = cb0 + paddedWidth;
+        const float *cr0 = crFull + row * 2 * paddedWidth, *cr1 = cr0 + paddedWidth;
+        float *cbOut = cb + row * halfWidth;
+        float *crOut = cr + row * halfWidth;
+
+#ifdef JPEG_USE_SSE2
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for (int x = 0; x < halfWidth; x += 4)
+        {
+            __m128 a = _mm_add_ps(_mm_loadu_ps(cb0 + x * 2), _mm_loadu_ps(cb1 + x * 2));
+            __m128 b = _mm_add_ps(_mm_loadu_ps(cb0 + x * 2 + 4), _mm_loadu_ps(cb1 + x * 2 + 4));
+            __m128 sum = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_ps(cbOut + x, _mm_mul_ps(sum, quarter));
+
+            a = _mm_add_ps(_mm_loadu_ps(cr0 + x * 2), _mm_loadu_ps(cr1 + x * 2));
+            b = _mm_add_ps(_mm_loadu_ps(cr0 + x * 2 + 4), _mm_loadu_ps(cr1 + x * 2 + 4));
+            sum = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_ps(crOut + x, _mm_mul_ps(sum, quarter));
+        }
+#else
+        for (int x = 0; x < halfWidth; ++x)
+        {
+            cbOut[x] = 0.25f * (cb0[x * 2] + cb0[x * 2 + 1] + cb1[x * 2] + cb1[x * 2 + 1]);
+            crOut[x] = 0.25f * (cr0[x * 2] + cr0[x * 2 + 1] + cr1[x * 2] + cr1[x * 2 + 1]);
+        }
+#endif
+    }
+}
+
+static void LoadBlock(const float *plane, int stride, int x0, float *block)
+{
+    for (int row = 0; row < 8; ++row)
+        memcpy(block + row * 8, plane + row * stride + x0, 8 * sizeof(float));
+}
+
+// Entropy-codes MCU rows [firstRow, lastRow) into output, one restart interval per row
+static void EncodeMcuRows(const BYTE *data, int width, int height, const JpegLayout &layout, const JpegTables &tables,
+                          int firstRow, int lastRow, int mcuRows, std::vector<BYTE> &output)
+{
+    int mcuCols = (width + 15) / 16;
+    int paddedWidth = mcuCols * 16;
+
+    std::vector<float> scratch(paddedWidth * 16 * 3 + paddedWidth * 8);
+    float *luma = scratch.data();
+    float *cbFull = luma + paddedWidth * 16;
+    float *crFull = cbFull + paddedWidth * 16;
+    float *cb = crFull + paddedWidth * 16;
+    float *cr = cb + paddedWidth * 4;
+
+    output.resize((size_t)(lastRow - firstRow) * mcuCols * 64 + JPEG_MAX_MCU_SIZE);
+    BitWriter writer(output);
+
+    float block[64];
+    short coef[64];
+
+    for (int mcuRow = firstRow; mcuRow < lastRow; ++mcuRow)
+    {
+        ConvertMcuRow(data, width, height, layout, mcuRow * 16, paddedWidth, luma, cb, cr, cbFull, crFull);
+
+        int prevDC[3] = {0, 0, 0};
+        for (int mcu = 0; mcu < mcuCols; ++mcu)
+        {
+            writer.reserve();
+
+            for (int i = 0; i < 4; ++i)
+            {
+                LoadBlock(luma + (i >> 1) * 8 * paddedWidth, paddedWidth, mcu * 16 + (i & 1) * 8, block);
+                ForwardDCT(block);
+                Quantize(block, tables.reciprocal[0], coef);
+                EncodeBlock(writer, coef, prevDC[0], tables.dc[0], tables.ac[0]);
+            }
+
+            LoadBlock(cb, paddedWidth / 2, mcu * 8, block);
+            ForwardDCT(block);
+            Quantize(block, tables.reciprocal[1], coef);
+            EncodeBlock(writer, coef, prevDC[1], tables.dc[1], tables.ac[1]);
+
+            LoadBlock(cr, paddedWidth / 2, mcu * 8, block);
+            ForwardDCT(block);
+            Quantize(block, tables.reciprocal[1], coef);
+            EncodeBlock(writer, coef, prevDC[2], tables.dc[1], tables.ac[1]);
+        }
+
+        writer.flush();
+        if (mcuRow != mcuRows - 1)
+            writer.marker((BYTE)(0xD0 + (mcuRow & 7)));
+    }
+
+    output.resize(writer.size());
+}
+
+static void PutMarker(std::vector<BYTE> &out, BYTE code, int length)
+{
+    BYTE header[] = {0xFF, code, (BYTE)(length >> 8), (BYTE)length};
+    out.insert(out.end(), header, header + (length ? 4 : 2));
+}
+
+static void PutHuffmanTable(std::vector<BYTE> &out, BYTE tableClass, const BYTE *bits, const BYTE *values)
+{
+    int count = 0;
+    for (int i = 0; i < 16; ++i)
+        count += bits[i];
+
+    PutMarker(out, 0xC4, 2 + 1 + 16 + count);
+    out.push_back(tableClass);
+    out.insert(out.end(), bits, bits + 16);
+    out.insert(out.end(), values, values + count);
+}
+
+static void WriteHeaders(std::vector<BYTE> &out, int width, int height, const JpegTables &tables, int restartInterval)
+{
+    static const BYTE jfif[] = {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0};
+
+    PutMarker(out, 0xD8, 0);
+
+    PutMarker(out, 0xE0, 2 + sizeof(jfif));
+    out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+    for (int i = 0; i < 2; ++i)
+    {
+        PutMarker(out, 0xDB, 2 + 1 + 64);
+        out.push_back((BYTE)i);
+        out.insert(out.end(), tables.quant[i], tables.quant[i] + 64);
+    }
+
+    // Y is sampled 2x2, Cb and Cr 1x1
+    BYTE frame[] = {8, (BYTE)(height >> 8), (BYTE)height, (BYTE)(width >> 8), (BYTE)width, 3,
+                    1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1};
+    PutMarker(out, 0xC0, 2 + sizeof(frame));
+    out.insert(out.end(), frame, frame + sizeof(frame));
+
+    PutHuffmanTable(out, 0x00, dcLumaBits, dcValues);
+    PutHuffmanTable(out, 0x10, acLumaBits, acLumaValues);
+    PutHuffmanTable(out, 0x01, dcChromaBits, dcValues);
+    PutHuffmanTable(out, 0x11, acChromaBits, acChromaValues);
+
+    PutMarker(out, 0xDD, 4);
+    out.push_back((BYTE)(restartInterval >> 8));
+    out.push_back((BYTE)restartInterval);
+
+    static const BYTE scan[] = {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0};
+    PutMarker(out, 0xDA, 2 + sizeof(scan));
+    out.insert(out.end(), scan, scan + sizeof(scan));
+}
+
+bool EncodeJPEG(const BYTE *data, int width, int height, JpegPixelFormat format, int quality,
+                std::vector<BYTE> &output, int threads)
+{
+    if (!data || width <= 0 || height <= 0 || width > 65535 || height > 65535)
+        return false;
+
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    static bool initialized = (InitStaticTables(), true);
+    (void)initialized;
+
+    JpegTables tables;
+    BuildQuantTable(lumaQuant, quality, tables.quant[0], tables.reciprocal[0]);
+    BuildQuantTable(chromaQuant, quality, tables.quant[1], tables.reciprocal[1]);
+    BuildHuffmanTable(dcLumaBits, dcValues, tables.dc[0]);
+    BuildHuffmanTable(dcChromaBits, dcValues, tables.dc[1]);
+    BuildHuffmanTable(acLumaBits, acLumaValues, tables.ac[0]);
+    BuildHuffmanTable(acChromaBits, acChromaValues, tables.ac[1]);
+
+    JpegLayout layout = GetLayout(format);
+    int mcuCols = (width + 15) / 16;
+    int mcuRows = (height + 15) / 16;
+
+    if (threads < 1)
+        threads = 1;
+    if (threads > mcuRows)
+        threads = mcuRows;
+
+    output.clear();
+    WriteHeaders(output, width, height, tables, mcuCols);
+
+    // Restart intervals make the MCU row ranges independent, so they are coded in parallel
+    // and concatenated in order
+    std::vector<std::vector<BYTE> > segments(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        int firstRow = mcuRows * t / threads;
+        int lastRow = mcuRows * (t + 1) / threads;
+
+        if (t == threads - 1)
+            EncodeMcuRows(data, width, height, layout, tables, firstRow, lastRow, mcuRows, segments[t]);
+        else
+            workers.emplace_back(EncodeMcuRows, data, width, height, std::cref(layout), std::cref(tables),
+                                 firstRow, lastRow, mcuRows, std::ref(segments[t]));
+    }
+
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    for (int t = 0; t < threads; ++t)
+        output.insert(output.end(), segments[t].begin(), segments[t].end());
+
+    PutMarker(output, 0xD9, 0);
+
+    return true;
+}
+
+static bool SaveJPEG(const char *fileName, BYTE *data, int width, int height, JpegPixelFormat format, int quality, int threads)
+{
+    std::vector<BYTE> encoded;
+    if (!EncodeJPEG(data, width, height, format, quality, encoded, threads))
+        return false;
+
+    FILE *outputFile = fopen(fileName, "wb");
+    if (!outputFile)
+        return false;
+
+    bool result = fwrite(encoded.data(), 1, encoded.size(), outputFile) == encoded.size();
+    fclose(outputFile);
+
+    return result;
+}
+
+bool SaveRGBJPEG(const char *fileName, BYTE *data, int width, int height, int quality, int threads)
+{
+    return SaveJPEG(fileName, data, width, height, JPEG_FORMAT_RGB, quality, threads);
+}
+
+bool SaveBGRJPEG(const char *fileName, BYTE *data, int width, int height, int quality, int threads)
+{
+    return SaveJPEG(fileName, data, width, height, JPEG_FORMAT_BGR, quality, threads);
+}
+
+bool SaveARGBJPEG(const char *fileName, BYTE *data, int width, int height, int quality, int threads)
+{
+    return SaveJPEG(fileName, data, width, height, JPEG_FORMAT_ARGB, quality, threads);
+}
+
+MjpegPipeWriter::MjpegPipeWriter()
+    : m_pipe(NULL)
+    , m_isStdout(false)
+    , m_quality(75)
+    , m_threads(1)
+{
+}
+
+MjpegPipeWriter::~MjpegPipeWriter()
+{
+    close();
+}
+
+bool MjpegPipeWriter::open(const char *command, int quality, int threads)
+{
+    close();
+
+    m_quality = quality;
+    m_threads = threads;
+
+    if (strcmp(command, "-") == 0)
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        m_pipe = stdout;
+        m_isStdout = true;
+    }
+    else
+    {
+        m_pipe = popen(command, PIPE_WRITE_MODE);
+        m_isStdout = false;
+    }
+
+    return m_pipe != NULL;
+}
+
+bool MjpegPipeWriter::writeFrame(const BYTE *data, int width, int height, JpegPixelFormat format)
+{
+    if (!m_pipe)
+        return false;
+
+    if (!EncodeJPEG(data, width, height, format, m_quality, m_frame, m_threads))
+        return false;
+
+    if (fwrite(m_frame.data(), 1, m_frame.size(), m_pipe) != m_frame.size())
+        return false;
+
+    return fflush(m_pipe) == 0;
+}
+
+void MjpegPipeWriter::close()
+{
+    if (!m_pipe)
+        return;
+
+    if (m_isStdout)
+        fflush(m_pipe);
+    else
+        pclose(m_pipe);
+
+    m_pipe = NULL;
+}
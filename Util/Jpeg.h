@@ -0,0 +1,57 @@
+#pragma once
+
+#include <windows.h>
+
+#include <stdio.h>
+#include <vector>
+
+// Pixel layouts understood by the JPEG encoder, the same ones accepted by the Save* functions
+enum JpegPixelFormat
+{
+    JPEG_FORMAT_RGB,    // 3 bytes per pixel: red, green, blue
+    JPEG_FORMAT_BGR,    // 3 bytes per pixel: blue, green, red
+    JPEG_FORMAT_ARGB    // 4 bytes per pixel: blue, green, red, alpha (alpha is dropped)
+};
+
+// Encodes the top-down buffer as a baseline 4:2:0 JPEG, replacing the contents of output.
+// Every MCU row is a restart interval; with threads > 1 the rows are split between threads.
+// quality follows the usual 1..100 scale of the IJG tables.
+bool EncodeJPEG(const BYTE *data, int width, int height, JpegPixelFormat format, int quality,
+                std::vector<BYTE> &output, int threads = 1);
+
+// Saves the RGB buffer as a JPEG image
+bool SaveRGBJPEG(const char *fileName, BYTE *data, int width, int height, int quality = 75, int threads = 1);
+
+// Saves the BGR buffer as a JPEG image
+bool SaveBGRJPEG(const char *fileName, BYTE *data, int width, int height, int quality = 75, int threads = 1);
+
+// Saves the ARGB buffer as a JPEG image
+bool SaveARGBJPEG(const char *fileName, BYTE *data, int width, int height, int quality = 75, int threads = 1);
+
+// Streams frames as back-to-back JPEG images (MJPEG) into a pipe, e.g. "ffplay -f mjpeg -"
+class MjpegPipeWriter
+{
+    MjpegPipeWriter(const MjpegPipeWriter &);
+    MjpegPipeWriter &operator=(const MjpegPipeWriter &);
+
+public:
+    MjpegPipeWriter();
+    ~MjpegPipeWriter();
+
+    // Starts the command with the stream connected to its standard input.
+    // "-" streams to the standard output of this process instead.
+    bool open(const char *command, int quality = 75, int threads = 1);
+
+    // Encodes the frame and writes it to the pipe
+    bool writeFrame(const BYTE *data, int width, int height, JpegPixelFormat format);
+
+    // Closes the pipe, waiting for the command to exit
+    void close();
+
+protected:
+    FILE *m_pipe;
+    bool m_isStdout;
+    int m_quality;
+    int m_threads;
+    std::vector<BYTE> m_frame;
+};
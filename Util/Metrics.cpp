@@ -0,0 +1,333 @@
+#pragma warning(disable : 4996)
+
+#include "Metrics.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+struct Metrics::Shard
+{
+    std::atomic<unsigned long long> counters[MAX_METRICS];
+    std::atomic<unsigned long long> buckets[MAX_SUMMARIES][SUMMARY_BUCKETS];
+    std::atomic<unsigned long long> sums[MAX_SUMMARIES];
+    std::atomic<unsigned long long> counts[MAX_SUMMARIES];
+};
+
+thread_local Metrics::Shard *Metrics::s_threadShard = NULL;
+
+// Only the owning thread writes to a shard, so a relaxed load and store is enough to add
+static inline void ShardAdd(std::atomic<unsigned long long> &value, unsigned long long amount)
+{
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static int HighestBit(unsigned long long value)
+{
+#ifdef _MSC_VER
+#ifdef _M_X64
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#else
+    unsigned long index;
+    if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+        return (int)index + 32;
+    _BitScanReverse(&index, (unsigned long)value);
+    return (int)index;
+#endif
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// Buckets are 1/8 of a power of two wide, which keeps the quantiles within 12.5%
+static int BucketIndex(int64_t nanoseconds)
+{
+    unsigned long long us = nanoseconds > 0 ? (unsigned long long)nanoseconds / 1000 : 0;
+    if (us < 8)
+        return (int)us;
+
+    int bit = HighestBit(us);
+    int index = 8 * (bit - 2) + (int)((us >> (bit - 3)) & 7);
+    return index < Metrics::SUMMARY_BUCKETS ? index : Metrics::SUMMARY_BUCKETS - 1;
+}
+
+// Upper bound of a bucket in seconds
+static double BucketLimit(int index)
+{
+    if (index < 8)
+        return (index + 1) * 1e-6;
+
+    int bit = index / 8 + 2;
+    double us = (double)(8 + index % 8 + 1) * (double)(1ULL << (bit - 3));
+    return us * 1e-6;
+}
+
+Metrics &Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Metrics()
+    : m_counters(0)
+    , m_summaries(0)
+    , m_lastBuckets(MAX_SUMMARIES * SUMMARY_BUCKETS)
+    , m_exportStop(false)
+{
+    // Ids index m_metrics from other threads, so it must never reallocate
+    m_metrics.reserve(MAX_METRICS);
+    for (int i = 0; i < MAX_METRICS; ++i)
+        m_gauges[i].store(0, std::memory_order_relaxed);
+}
+
+Metrics::~Metrics()
+{
+    stopExport();
+}
+
+int Metrics::registerMetric(const char *name, const char *help, Type type)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (size_t i = 0; i < m_metrics.size(); ++i)
+    {
+        if (strcmp(m_metrics[i].name, name) == 0)
+            return m_metrics[i].type == type ? (int)i : -1;
+    }
+
+    if (m_metrics.size() >= MAX_METRICS)
+        return -1;
+
+    Metric metric = {name, help, type, 0};
+    if (type == COUNTER)
+        metric.slot = m_counters++;
+    else if (type == SUMMARY)
+    {
+        if (m_summaries >= MAX_SUMMARIES)
+            return -1;
+        metric.slot = m_summaries++;
+    }
+    else
+        metric.slot = (int)m_metrics.size();
+
+    m_metrics.push_back(metric);
+    return (int)m_metrics.size() - 1;
+}
+
+int Metrics::counter(const char *name, const char *help)
+{
+    return registerMetric(name, help, COUNTER);
+}
+
+int Metrics::gauge(const char *name, const char *help)
+{
+    return registerMetric(name, help, GAUGE);
+}
+
+int Metrics::summary(const char *name, const char *help)
+{
+    return registerMetric(name, help, SUMMARY);
+}
+
+Metrics::Shard *Metrics::threadShard()
+{
+    if (!s_threadShard)
+    {
+        Shard *shard = new Shard();
+        std::lock_guard<std::mutex> lock(m_shardLock);
+        m_shards.push_back(shard);
+        s_threadShard = shard;
+    }
+    return s_threadShard;
+}
+
+void Metrics::add(int counter, unsigned long long value)
+{
+    if (counter < 0)
+        return;
+    ShardAdd(threadShard()->counters[m_metrics[counter].slot], value);
+}
+
+void Metrics::set(int gauge, double value)
+{
+    if (gauge < 0)
+        return;
+    m_gauges[m_metrics[gauge].slot].store(value, std::memory_order_relaxed);
+}
+
+void Metrics::observe(int summary, int64_t nanoseconds)
+{
+    if (summary < 0)
+        return;
+
+    int slot = m_metrics[summary].slot;
+    Shard *shard = threadShard();
+    ShardAdd(shard->buckets[slot][BucketIndex(nanoseconds)], 1);
+    ShardAdd(shard->sums[slot], nanoseconds > 0 ? nanoseconds : 0);
+    ShardAdd(shard->counts[slot], 1);
+}
+
+std::string Metrics::format()
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    // Shards registered after the copy have recorded nothing yet
+    std::vector<Shard *> shards;
+    {
+        std::lock_guard<std::mutex> shardLock(m_shardLock);
+        shards = m_shards;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    std::string text;
+    char line[256];
+
+    for (size_t i = 0; i < m_metrics.size(); ++i)
+    {
+        const Metric &metric = m_metrics[i];
+        static const char *types[] = {"counter", "gauge", "summary"};
+        text += "# HELP ";
+        text += metric.name;
+        text += ' ';
+        text += metric.help;
+        text += "\n# TYPE ";
+        text += metric.name;
+        text += ' ';
+        text += types[metric.type];
+        text += '\n';
+
+        if (metric.type == COUNTER)
+        {
+            unsigned long long total = 0;
+            for (size_t s = 0; s < shards.size(); ++s)
+                total += shards[s]->counters[metric.slot].load(std::memory_order_relaxed);
+            sprintf(line, "%s %llu\n", metric.name, total);
+            text += line;
+        }
+        else if (metric.type == GAUGE)
+        {
+            sprintf(line, "%s %.17g\n", metric.name, m_gauges[metric.slot].load(std::memory_order_relaxed));
+            text += line;
+        }
+        else
+        {
+            // Quantiles of the samples recorded since the last call
+            unsigned long long window[SUMMARY_BUCKETS];
+            unsigned long long windowCount = 0, sum = 0, count = 0;
+            unsigned long long *last = &m_lastBuckets[metric.slot * SUMMARY_BUCKETS];
+            for (int b = 0; b < SUMMARY_BUCKETS; ++b)
+            {
+                unsigned long long total = 0;
+                for (size_t s = 0; s < shards.size(); ++s)
+                    total += shards[s]->buckets[metric.slot][b].load(std::memory_order_relaxed);
+                window[b] = total - last[b];
+                windowCount += window[b];
+                last[b] = total;
+            }
+            for (size_t s = 0; s < shards.size(); ++s)
+            {
+                sum += shards[s]->sums[metric.slot].load(std::memory_order_relaxed);
+                count += shards[s]->counts[metric.slot].load(std::memory_order_relaxed);
+            }
+
+            for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q)
+            {
+                double value = 0;
+                bool found = false;
+                if (windowCount > 0)
+                {
+                    unsigned long long rank = (unsigned long long)ceil(quantiles[q] * windowCount);
+                    unsigned long long seen = 0;
+                    for (int b = 0; b < SUMMARY_BUCKETS; ++b)
+                    {
+                        seen += window[b];
+                        if (seen >= rank)
+                        {
+                            value = BucketLimit(b);
+                            found = true;
+                            break;
+                        }
+                    }
+                }
+                if (!found)
+                    sprintf(line, "%s{quantile=\"%g\"} NaN\n", metric.name, quantiles[q]);
+                else
+                    sprintf(line, "%s{quantile=\"%g\"} %.9g\n", metric.name, quantiles[q], value);
+                text += line;
+            }
+            sprintf(line, "%s_sum %.9f\n%s_count %llu\n", metric.name, sum * 1e-9, metric.name, count);
+            text += line;
+        }
+    }
+
+    return text;
+}
+
+bool Metrics::writeFile()
+{
+    std::string text = format();
+    std::string temporary = m_fileName + ".tmp";
+
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+        return false;
+
+    // Readers see either the old or the new file, never a partial one
+#ifdef _WIN32
+    return MoveFileExA(temporary.c_str(), m_fileName.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(temporary.c_str(), m_fileName.c_str()) == 0;
+#endif
+}
+
+void Metrics::exportLoop(int intervalMs)
+{
+    std::unique_lock<std::mutex> lock(m_exportLock);
+    while (!m_exportStop)
+    {
+        m_exportWake.wait_for(lock, std::chrono::milliseconds(intervalMs));
+        writeFile();
+    }
+}
+
+bool Metrics::startExport(const char *fileName, int intervalMs)
+{
+    stopExport();
+
+    m_fileName = fileName;
+    if (!writeFile())
+        return false;
+
+    m_exportStop = false;
+    m_exporter = std::thread(&Metrics::exportLoop, this, intervalMs > 0 ? intervalMs : 1000);
+    return true;
+}
+
+void Metrics::stopExport()
+{
+    if (!m_exporter.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_exportLock);
+        m_exportStop = true;
+    }
+    m_exportWake.notify_all();
+    m_exporter.join();
+}
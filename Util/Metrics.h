@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counters, gauges and latency summaries exported in the Prometheus text format.
+//
+// Every thread records into a shard of its own with relaxed atomic stores, so recording never
+// takes a lock or contends with other threads, and reading the values never blocks a recorder.
+// The exporter thread rewrites a file with the current values at a fixed interval, replacing it
+// atomically, for the textfile collector of node_exporter or windows_exporter to pick up.
+class Metrics
+{
+    Metrics(const Metrics &);
+    Metrics &operator=(const Metrics &);
+
+public:
+    enum
+    {
+        MAX_METRICS = 32,
+        MAX_SUMMARIES = 4,
+        // Eight buckets per power of two of microseconds
+        SUMMARY_BUCKETS = 320
+    };
+
+    static Metrics &instance();
+
+    // Register a metric and return its id; registering a name again returns the same id.
+    // Returns -1 when out of slots. Names and help texts have to be string literals.
+    int counter(const char *name, const char *help);
+    int gauge(const char *name, const char *help);
+    int summary(const char *name, const char *help);
+
+    void add(int counter, unsigned long long value = 1);
+    void set(int gauge, double value);
+
+    // Records a duration for a summary, exported in seconds
+    void observe(int summary, int64_t nanoseconds);
+
+    // The current values in the Prometheus text format. Summary quantiles cover the samples
+    // recorded since the previous call, sums and counts everything since the start.
+    std::string format();
+
+    // Starts rewriting fileName with format() every intervalMs milliseconds
+    bool startExport(const char *fileName, int intervalMs);
+
+    // Writes the final values and stops the exporter
+    void stopExport();
+
+protected:
+    Metrics();
+    ~Metrics();
+
+    struct Shard;
+
+    enum Type
+    {
+        COUNTER,
+        GAUGE,
+        SUMMARY
+    };
+
+    struct Metric
+    {
+        const char *name;
+        const char *help;
+        Type type;
+        int slot;
+    };
+
+    int registerMetric(const char *name, const char *help, Type type);
+    Shard *threadShard();
+    bool writeFile();
+    void exportLoop(int intervalMs);
+
+    static thread_local Shard *s_threadShard;
+
+    std::mutex m_lock;
+    std::vector<Metric> m_metrics;
+    // Guards only the list of shards, so a thread recording for the first time never waits
+    // for format()
+    std::mutex m_shardLock;
+    std::vector<Shard *> m_shards;
+    int m_counters;
+    int m_summaries;
+    std::atomic<double> m_gauges[MAX_METRICS];
+    std::vector<unsigned long long> m_lastBuckets;
+
+    std::string m_fileName;
+    std::thread m_exporter;
+    std::mutex m_exportLock;
+    std::condition_variable m_exportWake;
+    bool m_exportStop;
+};
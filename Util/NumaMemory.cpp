@@ -0,0 +1,324 @@
+#include "NumaMemory.h"
+
+#include <cstdint>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+// Large pages need SeLockMemoryPrivilege, which is held by the account but disabled by default
+static bool EnableLockMemoryPrivilege()
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return false;
+
+    TOKEN_PRIVILEGES privileges;
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bool result = false;
+    if (LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid))
+    {
+        // AdjustTokenPrivileges succeeds even if the privilege was not assigned, check the last error too
+        result = AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS;
+    }
+
+    CloseHandle(token);
+    return result;
+}
+
+static bool LargePagesAvailable()
+{
+    static const bool available = GetLargePageMinimum() != 0 && EnableLockMemoryPrivilege();
+    return available;
+}
+
+// VirtualLock fails once the locked pages would exceed the minimum working set
+static bool LockPages(void *memory, size_t size)
+{
+    static std::mutex workingSetLock;
+    std::lock_guard<std::mutex> lock(workingSetLock);
+
+    SIZE_T minimum, maximum;
+    if (!GetProcessWorkingSetSize(GetCurrentProcess(), &minimum, &maximum))
+        return false;
+    if (!SetProcessWorkingSetSize(GetCurrentProcess(), minimum + size, max(maximum, minimum + size)))
+        return false;
+    return VirtualLock(memory, size) != FALSE;
+}
+
+// Logical CPUs are numbered across the processor groups, whose sizes differ with the topology
+// (a 96-core host has two groups of 48, not one of 64 and one of 32)
+static bool ProcessorOfCpu(int cpu, PROCESSOR_NUMBER *processor)
+{
+    memset(processor, 0, sizeof(*processor));
+    if (cpu < 0)
+        return false;
+
+    const WORD groups = GetActiveProcessorGroupCount();
+    for (WORD group = 0; group < groups; ++group)
+    {
+        const DWORD count = GetActiveProcessorCount(group);
+        if ((DWORD)cpu < count)
+        {
+            processor->Group = group;
+            processor->Number = (BYTE)cpu;
+            return true;
+        }
+        cpu -= (int)count;
+    }
+    return false;
+}
+
+// The node holding the page at address, which has to be resident, or -1
+static int NodeOfPage(void *address)
+{
+    PSAPI_WORKING_SET_EX_INFORMATION information;
+    memset(&information, 0, sizeof(information));
+    information.VirtualAddress = address;
+    if (!QueryWorkingSetEx(GetCurrentProcess(), &information, sizeof(information)) || !information.VirtualAttributes.Valid)
+        return -1;
+    return (int)information.VirtualAttributes.Node;
+}
+#else
+// Transparent huge pages back 2 MiB aligned ranges
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static size_t PageSize()
+{
+    static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+static size_t RoundUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+#ifndef MPOL_F_NODE
+#define MPOL_F_NODE (1 << 0)
+#define MPOL_F_ADDR (1 << 1)
+#endif
+
+// The node holding the page at address, which has to be resident, or -1
+static int NodeOfPage(void *address)
+{
+#ifdef SYS_get_mempolicy
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0UL, address, (unsigned long)(MPOL_F_NODE | MPOL_F_ADDR)) == 0)
+        return node;
+#else
+    (void)address;
+#endif
+    return -1;
+}
+#endif
+
+// The node of the first, middle and last page, or -1 if they differ or cannot be told
+static int NodeOfPages(void *memory, size_t size)
+{
+    uint8_t *pages = (uint8_t *)memory;
+    const int node = NodeOfPage(pages);
+    if (node < 0 || NodeOfPage(pages + size / 2) != node || NodeOfPage(pages + size - 1) != node)
+        return -1;
+    return node;
+}
+
+MemoryPlacement DefaultPlacement()
+{
+    MemoryPlacement placement = {-1, false, false};
+    return placement;
+}
+
+int NumaNodeOfCpu(int cpu)
+{
+    if (cpu < 0)
+        return -1;
+
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    if (!ProcessorOfCpu(cpu, &processor))
+        return -1;
+
+    USHORT node;
+    return GetNumaProcessorNodeEx(&processor, &node) && node != 0xFFFF ? node : -1;
+#else
+    // The CPU directory links to its node as nodeN
+    char path[64];
+    sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *directory = opendir(path);
+    if (!directory)
+        return -1;
+
+    int node = -1;
+    while (struct dirent *entry = readdir(directory))
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1)
+            break;
+    }
+    closedir(directory);
+    return node;
+#endif
+}
+
+bool PinCurrentThread(int cpu)
+{
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    if (!ProcessorOfCpu(cpu, &processor))
+        return false;
+
+    GROUP_AFFINITY affinity;
+    memset(&affinity, 0, sizeof(affinity));
+    affinity.Mask = (KAFFINITY)1 << processor.Number;
+    affinity.Group = processor.Group;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) != FALSE;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return cpu >= 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+bool PinThread(std::thread &thread, int cpu)
+{
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    if (!ProcessorOfCpu(cpu, &processor))
+        return false;
+
+    GROUP_AFFINITY affinity;
+    memset(&affinity, 0, sizeof(affinity));
+    affinity.Mask = (KAFFINITY)1 << processor.Number;
+    affinity.Group = processor.Group;
+    return SetThreadGroupAffinity(thread.native_handle(), &affinity, NULL) != FALSE;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return cpu >= 0 && pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#endif
+}
+
+void *AllocatePlaced(size_t size, const MemoryPlacement &placement, MemoryPlacement *actual)
+{
+    MemoryPlacement result = DefaultPlacement();
+    void *memory = NULL;
+
+#ifdef _WIN32
+    const DWORD node = placement.node >= 0 ? (DWORD)placement.node : NUMA_NO_PREFERRED_NODE;
+
+    if (placement.largePages && LargePagesAvailable() && size >= GetLargePageMinimum())
+    {
+        // Large pages are committed and locked up front
+        const SIZE_T largeSize = (size + GetLargePageMinimum() - 1) & ~(GetLargePageMinimum() - 1);
+        memory = VirtualAllocExNuma(GetCurrentProcess(), NULL, largeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                    PAGE_READWRITE, node);
+        if (memory)
+        {
+            result.largePages = true;
+            result.locked = true;
+        }
+    }
+
+    if (!memory)
+    {
+        memory = VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node);
+        if (!memory)
+            return NULL;
+    }
+#else
+    const size_t length = RoundUp(size, PageSize());
+
+    if (placement.largePages && length >= HUGE_PAGE_SIZE)
+    {
+        // Over-allocate and trim, so the buffer starts on a huge page boundary
+        uint8_t *raw = (uint8_t *)mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            return NULL;
+
+        uint8_t *aligned = (uint8_t *)RoundUp((size_t)raw, HUGE_PAGE_SIZE);
+        if (aligned != raw)
+            munmap(raw, aligned - raw);
+        munmap(aligned + length, raw + length + HUGE_PAGE_SIZE - (aligned + length));
+        memory = aligned;
+#ifdef MADV_HUGEPAGE
+        result.largePages = madvise(memory, length, MADV_HUGEPAGE) == 0;
+#endif
+    }
+    else
+    {
+        memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return NULL;
+    }
+
+#ifdef SYS_mbind
+    // Preferred rather than bound, so a full node falls back to another instead of failing
+    if (placement.node >= 0 && placement.node < 1024)
+    {
+        unsigned long mask[1024 / (8 * sizeof(unsigned long))];
+        memset(mask, 0, sizeof(mask));
+        mask[placement.node / (8 * sizeof(unsigned long))] |= 1UL << (placement.node % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, memory, length, MPOL_PREFERRED, mask, (unsigned long)(8 * sizeof(mask)), 0);
+    }
+#endif
+#endif
+
+    // Touch every page now, on the node the memory was placed on, rather than on first use
+    if (!result.largePages || !result.locked)
+    {
+        volatile uint8_t *pages = (volatile uint8_t *)memory;
+        for (size_t offset = 0; offset < size; offset += 4096)
+            pages[offset] = 0;
+    }
+
+    // A preferred node is only a hint, so ask where the touched pages actually are
+    if (size > 0)
+        result.node = NodeOfPages(memory, size);
+
+    if (placement.locked && !result.locked)
+    {
+#ifdef _WIN32
+        result.locked = LockPages(memory, size);
+#else
+        result.locked = mlock(memory, length) == 0;
+#endif
+    }
+
+    if (actual)
+        *actual = result;
+    return memory;
+}
+
+void FreePlaced(void *memory, size_t size)
+{
+    if (!memory)
+        return;
+
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, RoundUp(size, PageSize()));
+#endif
+}
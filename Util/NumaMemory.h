@@ -0,0 +1,95 @@
+#pragma once
+
+#include <new>
+#include <stddef.h>
+#include <thread>
+#include <type_traits>
+
+// Where and how a capture buffer is allocated
+struct MemoryPlacement
+{
+    int node;           // NUMA node to allocate on, -1 to leave it to the OS
+    bool largePages;    // Back with large pages: explicit on Windows, transparent on Linux
+    bool locked;        // Lock in physical memory, so touching a page never faults
+};
+
+// No particular node, regular pageable memory
+MemoryPlacement DefaultPlacement();
+
+// Logical CPUs are numbered from 0 across all processor groups on Windows, as on Linux.
+// Returns the NUMA node of a logical CPU, or -1 if it cannot be told
+int NumaNodeOfCpu(int cpu);
+
+// Restricts the calling thread, or the given thread, to one logical CPU
+bool PinCurrentThread(int cpu);
+bool PinThread(std::thread &thread, int cpu);
+
+// Allocates size bytes as placement asks, as far as the system allows, and touches every
+// page so none faults on first use. What was achieved is stored in actual, if not null; its
+// node is the one the pages were found on afterwards, -1 if they are spread over several.
+// Returns NULL if no memory could be allocated at all.
+void *AllocatePlaced(size_t size, const MemoryPlacement &placement, MemoryPlacement *actual);
+
+// Frees memory from AllocatePlaced, given the same size
+void FreePlaced(void *memory, size_t size);
+
+// Allocator for containers of large buffers, backed by AllocatePlaced, so every allocation
+// takes whole pages from the OS. Each one stores what it achieved in actual, if not null.
+template <typename T>
+class PlacedAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    PlacedAllocator()
+        : m_placement(DefaultPlacement())
+        , m_actual(NULL)
+    {}
+
+    PlacedAllocator(const MemoryPlacement &placement, MemoryPlacement *actual = NULL)
+        : m_placement(placement)
+        , m_actual(actual)
+    {}
+
+    template <typename U>
+    PlacedAllocator(const PlacedAllocator<U> &other)
+        : m_placement(other.placement())
+        , m_actual(other.actual())
+    {}
+
+    T *allocate(size_t count)
+    {
+        void *memory = AllocatePlaced(count * sizeof(T), m_placement, m_actual);
+        if (!memory)
+            throw std::bad_alloc();
+        return (T *)memory;
+    }
+
+    void deallocate(T *memory, size_t count)
+    {
+        FreePlaced(memory, count * sizeof(T));
+    }
+
+    const MemoryPlacement &placement() const { return m_placement; }
+    MemoryPlacement *actual() const { return m_actual; }
+
+protected:
+    MemoryPlacement m_placement;
+    MemoryPlacement *m_actual;
+};
+
+// Any allocator can free what another one allocated
+template <typename T, typename U>
+bool operator==(const PlacedAllocator<T> &, const PlacedAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PlacedAllocator<T> &, const PlacedAllocator<U> &)
+{
+    return false;
+}
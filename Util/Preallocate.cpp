@@ -0,0 +1,83 @@
+#include "Preallocate.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+PreallocatedFile::PreallocatedFile()
+    : m_file(INVALID_HANDLE_VALUE)
+{
+}
+
+bool PreallocatedFile::create(const char *path, unsigned long long size)
+{
+    close();
+    // Shared for writing, the output is opened on the file while this handle keeps it reserved
+    m_file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    // The allocation size, unlike the end of file, is not what readers see
+    FILE_ALLOCATION_INFO allocation;
+    allocation.AllocationSize.QuadPart = (LONGLONG)size;
+    if (size > 0)
+        SetFileInformationByHandle(m_file, FileAllocationInfo, &allocation, sizeof(allocation));
+    return true;
+}
+
+void PreallocatedFile::close()
+{
+    // The last handle closed trims the allocation to the end of file
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+PreallocatedFile::PreallocatedFile()
+    : m_fd(-1)
+{
+}
+
+bool PreallocatedFile::create(const char *path, unsigned long long size)
+{
+    close();
+    m_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (m_fd < 0)
+        return false;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    if (size > 0)
+        fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#else
+    (void)size;
+#endif
+    return true;
+}
+
+void PreallocatedFile::close()
+{
+    if (m_fd < 0)
+        return;
+    const int fd = m_fd;
+    m_fd = -1;
+
+    // Truncating to the size the file already has frees the blocks past its end
+    struct stat status;
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode))
+        (void)ftruncate(fd, status.st_size);
+    ::close(fd);
+}
+
+#endif
+
+PreallocatedFile::~PreallocatedFile()
+{
+    close();
+}
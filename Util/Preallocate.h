@@ -0,0 +1,37 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Reserves disk space for a file ahead of writing it, so the writes appending to it do not
+// have to allocate blocks on the way and a full disk shows up before the capture rather than
+// in the middle of it. The file size stays 0 meanwhile.
+//
+// The reservation lasts while the object holds the file open: NTFS gives the space beyond the
+// end of a file back when its last handle is closed. close() gives back what was not written,
+// on Windows by closing the handle and elsewhere by truncating the file to its size.
+class PreallocatedFile
+{
+    PreallocatedFile(const PreallocatedFile &);
+    PreallocatedFile &operator=(const PreallocatedFile &);
+
+public:
+    PreallocatedFile();
+    ~PreallocatedFile();
+
+    // Creates the file empty, or empties it, and reserves size bytes for it. Returns false if
+    // the file cannot be created; failing to reserve the space is not an error. Open the file
+    // for writing afterwards without truncating it, which would give the space back.
+    bool create(const char *path, unsigned long long size);
+
+    // Gives back the space reserved beyond the end of the file once it is complete and closed
+    void close();
+
+private:
+#ifdef _WIN32
+    HANDLE m_file;
+#else
+    int m_fd;
+#endif
+};
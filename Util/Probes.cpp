@@ -0,0 +1,29 @@
+#include "Probes.h"
+
+#if !defined(NVFBC_NO_PROBES) && defined(_WIN32) && defined(NTDDI_WIN10)
+
+// The GUID is the one ETW tools derive from the provider name, so "*NvFBCCapture" finds it as well
+TRACELOGGING_DEFINE_PROVIDER(g_probeProvider, "NvFBCCapture",
+    (0x3a9d1576, 0x96c7, 0x5fe7, 0xea, 0x71, 0x20, 0x42, 0xee, 0x4d, 0x3e, 0xed));
+
+void RegisterProbes()
+{
+    TraceLoggingRegister(g_probeProvider);
+}
+
+void UnregisterProbes()
+{
+    TraceLoggingUnregister(g_probeProvider);
+}
+
+#else
+
+void RegisterProbes()
+{
+}
+
+void UnregisterProbes()
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Static probe points for tracing the capture loop on production hosts, with no debug build.
+// On Linux they are USDT probes of the provider "nvfbccapture" (see scripts/*.bt for bpftrace);
+// on Windows, built with the Windows 10 SDK, they are TraceLogging events of the ETW provider
+// "NvFBCCapture" {3a9d1576-96c7-5fe7-ea71-2042ee4d3eed}. An inactive probe costs a nop on Linux
+// and a check of the provider's enabled flag on Windows. NVFBC_NO_PROBES compiles them out.
+//
+//   grab_start(frame)
+//   grab_end(frame, result)          result is the NVFBCRESULT of the grab
+//   frame_size(frame, bytes)         size of the encoded frame
+//   write_start(frame, bytes)
+//   write_end(frame, bytes)
+//   session_recreate(result)         result of setting up the re-created session
+
+// Registers the ETW provider; a no-op elsewhere
+void RegisterProbes();
+void UnregisterProbes();
+
+#if !defined(NVFBC_NO_PROBES) && defined(_WIN32) && defined(NTDDI_WIN10)
+
+#include <TraceLoggingProvider.h>
+
+TRACELOGGING_DECLARE_PROVIDER(g_probeProvider);
+
+#define PROBE_GRAB_START(frame) \
+    TraceLoggingWrite(g_probeProvider, "GrabStart", TraceLoggingUInt32(frame, "Frame"))
+#define PROBE_GRAB_END(frame, result) \
+    TraceLoggingWrite(g_probeProvider, "GrabEnd", TraceLoggingUInt32(frame, "Frame"), TraceLoggingInt32(result, "Result"))
+#define PROBE_FRAME_SIZE(frame, bytes) \
+    TraceLoggingWrite(g_probeProvider, "FrameSize", TraceLoggingUInt32(frame, "Frame"), TraceLoggingUInt32(bytes, "Bytes"))
+#define PROBE_WRITE_START(frame, bytes) \
+    TraceLoggingWrite(g_probeProvider, "WriteStart", TraceLoggingUInt32(frame, "Frame"), TraceLoggingUInt32(bytes, "Bytes"))
+#define PROBE_WRITE_END(frame, bytes) \
+    TraceLoggingWrite(g_probeProvider, "WriteEnd", TraceLoggingUInt32(frame, "Frame"), TraceLoggingUInt32(bytes, "Bytes"))
+#define PROBE_SESSION_RECREATE(result) \
+    TraceLoggingWrite(g_probeProvider, "SessionRecreate", TraceLoggingInt32(result, "Result"))
+
+#elif !defined(NVFBC_NO_PROBES) && defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define NVFBC_USDT_PROBES
+#endif
+#endif
+
+#ifdef NVFBC_USDT_PROBES
+
+#include <sys/sdt.h>
+
+#define PROBE_GRAB_START(frame) DTRACE_PROBE1(nvfbccapture, grab_start, frame)
+#define PROBE_GRAB_END(frame, result) DTRACE_PROBE2(nvfbccapture, grab_end, frame, result)
+#define PROBE_FRAME_SIZE(frame, bytes) DTRACE_PROBE2(nvfbccapture, frame_size, frame, bytes)
+#define PROBE_WRITE_START(frame, bytes) DTRACE_PROBE2(nvfbccapture, write_start, frame, bytes)
+#define PROBE_WRITE_END(frame, bytes) DTRACE_PROBE2(nvfbccapture, write_end, frame, bytes)
+#define PROBE_SESSION_RECREATE(result) DTRACE_PROBE1(nvfbccapture, session_recreate, result)
+
+#elif !defined(PROBE_GRAB_START)
+
+#define PROBE_GRAB_START(frame)
+#define PROBE_GRAB_END(frame, result)
+#define PROBE_FRAME_SIZE(frame, bytes)
+#define PROBE_WRITE_START(frame, bytes)
+#define PROBE_WRITE_END(frame, bytes)
+#define PROBE_SESSION_RECREATE(result)
+
+#endif
@@ -0,0 +1,408 @@
+#pragma warning(disable : 4996)
+
+#include "Qoi.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK_2   0xc0
+
+#define QOI_MAGIC       0x716f6966 // "qoif"
+#define QOI_HEADER_SIZE 14
+#define QOI_MAX_RUN     62
+
+// The worst case of a 3-channel image is a QOI_OP_RGB for every pixel
+#define QOI_MAX_PIXEL_SIZE 4
+
+#define QOI_HASH(px) (((px).red * 3 + (px).green * 5 + (px).blue * 7 + (px).alpha * 11) & 63)
+
+static const BYTE qoiPadding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+// Describes the structure of a QOI pixel
+union QoiPixel
+{
+    struct
+    {
+        unsigned char red;
+        unsigned char green;
+        unsigned char blue;
+        unsigned char alpha;
+    };
+    unsigned int value;
+};
+
+// Byte offsets of the color channels within a source pixel
+struct QoiLayout
+{
+    int bytesPerPixel;
+    int red;
+    int green;
+    int blue;
+};
+
+static QoiLayout GetLayout(QoiPixelFormat format)
+{
+    switch (format)
+    {
+    case QOI_FORMAT_BGR:
+        return QoiLayout{3, 2, 1, 0};
+    case QOI_FORMAT_ARGB:
+        return QoiLayout{4, 2, 1, 0};
+    case QOI_FORMAT_RGB:
+    default:
+        return QoiLayout{3, 0, 1, 2};
+    }
+}
+
+static inline QoiPixel LoadPixel(const BYTE *data, const QoiLayout &layout, size_t idx)
+{
+    const BYTE *src = data + idx * layout.bytesPerPixel;
+    QoiPixel px;
+    px.red = src[layout.red];
+    px.green = src[layout.green];
+    px.blue = src[layout.blue];
+    px.alpha = 255;
+    return px;
+}
+
+static void WriteHeader(BYTE *out, int width, int height)
+{
+    const unsigned int fields[] = {QOI_MAGIC, (unsigned int)width, (unsigned int)height};
+    for (int i = 0; i < 3; ++i)
+    {
+        out[i * 4 + 0] = (BYTE)(fields[i] >> 24);
+        out[i * 4 + 1] = (BYTE)(fields[i] >> 16);
+        out[i * 4 + 2] = (BYTE)(fields[i] >> 8);
+        out[i * 4 + 3] = (BYTE)(fields[i]);
+    }
+    out[12] = 3; // RGB
+    out[13] = 0; // sRGB with linear alpha
+}
+
+static unsigned int ReadBigEndian(const BYTE *in)
+{
+    return ((unsigned int)in[0] << 24) | ((unsigned int)in[1] << 16) | ((unsigned int)in[2] << 8) | in[3];
+}
+
+// Encodes pixels [first, last) and returns the number of bytes written to out.
+// A chunk starts with an empty color index and with the source pixel preceding it as the
+// previous pixel. Both are exactly what a decoder has at that point (every index slot the
+// chunk hits was written by the chunk itself), so encoded chunks can simply be concatenated.
+static size_t EncodeChunk(const BYTE *data, const QoiLayout &layout, size_t first, size_t last, BYTE *out)
+{
+    // Alpha is always 255 in the encoded pixels, so a zeroed slot can never produce a false hit
+    QoiPixel index[64];
+    memset(index, 0, sizeof(index));
+
+    QoiPixel prev;
+    if (first == 0)
+    {
+        prev.value = 0;
+        prev.alpha = 255;
+    }
+    else
+    {
+        prev = LoadPixel(data, layout, first - 1);
+    }
+
+    BYTE *start = out;
+    int run = 0;
+
+    for (size_t i = first; i < last; ++i)
+    {
+        QoiPixel px = LoadPixel(data, layout, i);
+
+        if (px.value == prev.value)
+        {
+            if (++run == QOI_MAX_RUN)
+            {
+                *out++ = (BYTE)(QOI_OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0)
+        {
+            *out++ = (BYTE)(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        int hash = QOI_HASH(px);
+        if (index[hash].value == px.value)
+        {
+            *out++ = (BYTE)(QOI_OP_INDEX | hash);
+        }
+        else
+        {
+            index[hash] = px;
+
+            signed char vr = (signed char)(px.red - prev.red);
+            signed char vg = (signed char)(px.green - prev.green);
+            signed char vb = (signed char)(px.blue - prev.blue);
+            signed char vgr = (signed char)(vr - vg);
+            signed char vgb = (signed char)(vb - vg);
+
+            if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+            {
+                *out++ = (BYTE)(QOI_OP_DIFF | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+            }
+            else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8)
+            {
+                *out++ = (BYTE)(QOI_OP_LUMA | (vg + 32));
+                *out++ = (BYTE)(((vgr + 8) << 4) | (vgb + 8));
+            }
+            else
+            {
+                *out++ = QOI_OP_RGB;
+                *out++ = px.red;
+                *out++ = px.green;
+                *out++ = px.blue;
+            }
+        }
+
+        prev = px;
+    }
+
+    if (run > 0)
+        *out++ = (BYTE)(QOI_OP_RUN | (run - 1));
+
+    return out - start;
+}
+
+// Encodes the image as row bands. Band i is written at scratch + (first pixel of band i) * QOI_MAX_PIXEL_SIZE,
+// so bands never overlap; its encoded size is stored in sizes[i]. Returns the number of bands.
+static int EncodeBands(const BYTE *data, int width, int height, const QoiLayout &layout, int threads,
+                       BYTE *scratch, std::vector<size_t> &offsets, std::vector<size_t> &sizes)
+{
+    if (threads < 1)
+        threads = 1;
+    if (threads > height)
+        threads = height;
+
+    offsets.resize(threads);
+    sizes.resize(threads);
+
+    std::vector<std::thread> workers;
+    for (int band = 0; band < threads; ++band)
+    {
+        size_t first = (size_t)width * (height * band / threads);
+        size_t last = (size_t)width * (height * (band + 1) / threads);
+        offsets[band] = first * QOI_MAX_PIXEL_SIZE;
+
+        if (band == threads - 1)
+        {
+            // The calling thread encodes the last band itself
+            sizes[band] = EncodeChunk(data, layout, first, last, scratch + offsets[band]);
+        }
+        else
+        {
+            workers.emplace_back([=, &layout, &sizes]()
+            {
+                sizes[band] = EncodeChunk(data, layout, first, last, scratch + first * QOI_MAX_PIXEL_SIZE);
+            });
+        }
+    }
+
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    return threads;
+}
+
+bool EncodeQOI(const BYTE *data, int width, int height, QoiPixelFormat format, std::vector<BYTE> &output, int threads)
+{
+    if (!data || width <= 0 || height <= 0)
+        return false;
+
+    QoiLayout layout = GetLayout(format);
+    size_t pixels = (size_t)width * height;
+
+    output.resize(QOI_HEADER_SIZE + pixels * QOI_MAX_PIXEL_SIZE + sizeof(qoiPadding));
+    WriteHeader(output.data(), width, height);
+
+    std::vector<size_t> offsets, sizes;
+    BYTE *body = output.data() + QOI_HEADER_SIZE;
+    int bands = EncodeBands(data, width, height, layout, threads, body, offsets, sizes);
+
+    // Close the gaps between the bands; the first band is already in place
+    size_t size = sizes[0];
+    for (int band = 1; band < bands; ++band)
+    {
+        memmove(body + size, body + offsets[band], sizes[band]);
+        size += sizes[band];
+    }
+
+    memcpy(body + size, qoiPadding, sizeof(qoiPadding));
+    output.resize(QOI_HEADER_SIZE + size + sizeof(qoiPadding));
+
+    return true;
+}
+
+bool DecodeQOI(const BYTE *data, size_t size, std::vector<BYTE> &output, int *width, int *height)
+{
+    if (!data || size < QOI_HEADER_SIZE + sizeof(qoiPadding))
+        return false;
+
+    if (ReadBigEndian(data) != QOI_MAGIC)
+        return false;
+
+    unsigned int w = ReadBigEndian(data + 4);
+    unsigned int h = ReadBigEndian(data + 8);
+    BYTE channels = data[12];
+
+    if (w == 0 || h == 0 || w > 0x7fff || h > 0x7fff || (channels != 3 && channels != 4))
+        return false;
+
+    size_t pixels = (size_t)w * h;
+    output.resize(pixels * 4);
+
+    QoiPixel index[64];
+    memset(index, 0, sizeof(index));
+
+    QoiPixel px;
+    px.value = 0;
+    px.alpha = 255;
+
+    size_t p = QOI_HEADER_SIZE;
+    size_t end = size - sizeof(qoiPadding);
+    int run = 0;
+
+    for (size_t i = 0; i < pixels; ++i)
+    {
+        if (run > 0)
+        {
+            --run;
+        }
+        else if (p < end)
+        {
+            BYTE b1 = data[p++];
+
+            if (b1 == QOI_OP_RGB)
+            {
+                if (p + 3 > end)
+                    return false;
+                px.red = data[p++];
+                px.green = data[p++];
+                px.blue = data[p++];
+            }
+            else if (b1 == QOI_OP_RGBA)
+            {
+                if (p + 4 > end)
+                    return false;
+                px.red = data[p++];
+                px.green = data[p++];
+                px.blue = data[p++];
+                px.alpha = data[p++];
+            }
+            else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX)
+            {
+                px = index[b1];
+            }
+            else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF)
+            {
+                px.red += ((b1 >> 4) & 0x03) - 2;
+                px.green += ((b1 >> 2) & 0x03) - 2;
+                px.blue += (b1 & 0x03) - 2;
+            }
+            else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA)
+            {
+                if (p >= end)
+                    return false;
+                BYTE b2 = data[p++];
+                int vg = (b1 & 0x3f) - 32;
+                px.red += vg - 8 + ((b2 >> 4) & 0x0f);
+                px.green += vg;
+                px.blue += vg - 8 + (b2 & 0x0f);
+            }
+            else
+            {
+                run = b1 & 0x3f;
+            }
+
+            index[QOI_HASH(px)] = px;
+        }
+        else
+        {
+            return false;
+        }
+
+        BYTE *dst = &output[i * 4];
+        dst[0] = px.blue;
+        dst[1] = px.green;
+        dst[2] = px.red;
+        dst[3] = px.alpha;
+    }
+
+    *width = (int)w;
+    *height = (int)h;
+
+    return true;
+}
+
+static bool SaveQOI(const char *fileName, BYTE *data, int width, int height, QoiPixelFormat format, int threads)
+{
+    if (!data || width <= 0 || height <= 0)
+        return false;
+
+    FILE *outputFile = fopen(fileName, "wb");
+    if (!outputFile)
+        return false;
+
+    // The bands are written straight from the scratch buffer, no compaction needed
+    QoiLayout layout = GetLayout(format);
+    std::vector<BYTE> scratch((size_t)width * height * QOI_MAX_PIXEL_SIZE);
+    std::vector<size_t> offsets, sizes;
+    int bands = EncodeBands(data, width, height, layout, threads, scratch.data(), offsets, sizes);
+
+    BYTE header[QOI_HEADER_SIZE];
+    WriteHeader(header, width, height);
+
+    bool result = fwrite(header, 1, sizeof(header), outputFile) == sizeof(header);
+    for (int band = 0; result && band < bands; ++band)
+        result = fwrite(scratch.data() + offsets[band], 1, sizes[band], outputFile) == sizes[band];
+    result = result && fwrite(qoiPadding, 1, sizeof(qoiPadding), outputFile) == sizeof(qoiPadding);
+
+    fclose(outputFile);
+
+    return result;
+}
+
+bool SaveRGBQOI(const char *fileName, BYTE *data, int width, int height, int threads)
+{
+    return SaveQOI(fileName, data, width, height, QOI_FORMAT_RGB, threads);
+}
+
+bool SaveBGRQOI(const char *fileName, BYTE *data, int width, int height, int threads)
+{
+    return SaveQOI(fileName, data, width, height, QOI_FORMAT_BGR, threads);
+}
+
+bool SaveARGBQOI(const char *fileName, BYTE *data, int width, int height, int threads)
+{
+    return SaveQOI(fileName, data, width, height, QOI_FORMAT_ARGB, threads);
+}
+
+bool LoadQOI(const char *fileName, std::vector<BYTE> &output, int *width, int *height)
+{
+    FILE *inputFile = fopen(fileName, "rb");
+    if (!inputFile)
+        return false;
+
+    std::vector<BYTE> encoded;
+    BYTE block[65536];
+    size_t read;
+    while ((read = fread(block, 1, sizeof(block), inputFile)) > 0)
+        encoded.insert(encoded.end(), block, block + read);
+
+    fclose(inputFile);
+
+    return DecodeQOI(encoded.data(), encoded.size(), output, width, height);
+}
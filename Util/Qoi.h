@@ -0,0 +1,33 @@
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+// Pixel layouts understood by the QOI encoder, the same ones accepted by the Save* functions
+enum QoiPixelFormat
+{
+    QOI_FORMAT_RGB,     // 3 bytes per pixel: red, green, blue
+    QOI_FORMAT_BGR,     // 3 bytes per pixel: blue, green, red
+    QOI_FORMAT_ARGB     // 4 bytes per pixel: blue, green, red, alpha (alpha is dropped)
+};
+
+// Encodes the top-down buffer as a 3-channel QOI image, replacing the contents of output.
+// With threads > 1 the image is split into row bands which are encoded concurrently;
+// the result is still a single standard QOI stream.
+bool EncodeQOI(const BYTE *data, int width, int height, QoiPixelFormat format, std::vector<BYTE> &output, int threads = 1);
+
+// Decodes a QOI image into a top-down ARGB buffer, the layout SaveARGB expects
+bool DecodeQOI(const BYTE *data, size_t size, std::vector<BYTE> &output, int *width, int *height);
+
+// Saves the RGB buffer as a QOI image
+bool SaveRGBQOI(const char *fileName, BYTE *data, int width, int height, int threads = 1);
+
+// Saves the BGR buffer as a QOI image
+bool SaveBGRQOI(const char *fileName, BYTE *data, int width, int height, int threads = 1);
+
+// Saves the ARGB buffer as a QOI image
+bool SaveARGBQOI(const char *fileName, BYTE *data, int width, int height, int threads = 1);
+
+// Loads a QOI image into a top-down ARGB buffer
+bool LoadQOI(const char *fileName, std::vector<BYTE> &output, int *width, int *height);
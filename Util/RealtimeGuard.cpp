@@ -0,0 +1,193 @@
+#include "RealtimeGuard.h"
+#include "Timer.h"
+#include "Trace.h"
+
+#include <chrono>
+
+#ifdef _WIN32
+#include <avrt.h>
+#pragma comment(lib, "avrt.lib")
+#else
+#include <sched.h>
+#endif
+
+RealtimeGuard::RealtimeGuard()
+#ifdef _WIN32
+    : m_thread(NULL)
+    , m_threadId(0)
+    , m_mmcss(NULL)
+#else
+    : m_thread()
+    , m_cpuClock()
+#endif
+    , m_raised(false)
+    , m_demoted(false)
+    , m_stopping(false)
+{
+}
+
+RealtimeGuard::~RealtimeGuard()
+{
+    stop();
+}
+
+bool RealtimeGuard::start(RealtimePolicy policy, int priority, double budget, int windowMs)
+{
+    stop();
+
+#ifdef _WIN32
+    (void)policy;
+    (void)priority;
+
+    // The pseudo handle of GetCurrentThread would mean the watchdog itself
+    if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &m_thread,
+                         THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, 0))
+        return false;
+    m_threadId = GetCurrentThreadId();
+
+    DWORD taskIndex = 0;
+    m_mmcss = AvSetMmThreadCharacteristicsW(L"Capture", &taskIndex);
+    if (m_mmcss)
+        m_raised = AvSetMmThreadPriority(m_mmcss, AVRT_PRIORITY_CRITICAL) != FALSE;
+    if (!m_raised)
+        m_raised = SetThreadPriority(m_thread, THREAD_PRIORITY_TIME_CRITICAL) != FALSE;
+
+    if (!m_raised)
+    {
+        if (m_mmcss)
+            AvRevertMmThreadCharacteristics(m_mmcss);
+        m_mmcss = NULL;
+        CloseHandle(m_thread);
+        m_thread = NULL;
+        return false;
+    }
+#else
+    m_thread = pthread_self();
+    if (pthread_getcpuclockid(m_thread, &m_cpuClock) != 0)
+        return false;
+
+    // The watchdog runs one above, so the highest priority is left to it
+    const int scheduler = policy == REALTIME_RR ? SCHED_RR : SCHED_FIFO;
+    const int highest = sched_get_priority_max(SCHED_FIFO) - 1;
+    if (priority > highest)
+        priority = highest;
+    if (priority < sched_get_priority_min(scheduler))
+        priority = sched_get_priority_min(scheduler);
+
+    sched_param param;
+    param.sched_priority = priority;
+    if (pthread_setschedparam(m_thread, scheduler, &param) != 0)
+        return false;
+    m_raised = true;
+#endif
+
+    m_demoted.store(false, std::memory_order_relaxed);
+    m_stopping = false;
+    m_watchdog = std::thread(&RealtimeGuard::watch, this, priority, budget, windowMs > 0 ? windowMs : 500);
+    return true;
+}
+
+void RealtimeGuard::stop()
+{
+    if (m_watchdog.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        m_watchdog.join();
+    }
+
+    // Even after the watchdog demoted it, the thread may still have to leave the MMCSS task
+    if (m_raised)
+        demote();
+    m_raised = false;
+
+#ifdef _WIN32
+    if (m_thread)
+        CloseHandle(m_thread);
+    m_thread = NULL;
+    m_mmcss = NULL;
+#endif
+}
+
+bool RealtimeGuard::demote()
+{
+#ifdef _WIN32
+    // Only the thread itself can leave the MMCSS task; from the watchdog, or after the thread
+    // was given up on, its priority is lowered and the task is left to MMCSS's own throttling
+    bool result = true;
+    if (m_mmcss && GetCurrentThreadId() == m_threadId)
+    {
+        result = AvRevertMmThreadCharacteristics(m_mmcss) != FALSE;
+        m_mmcss = NULL;
+    }
+    return SetThreadPriority(m_thread, THREAD_PRIORITY_NORMAL) != FALSE && result;
+#else
+    sched_param param;
+    param.sched_priority = 0;
+    return pthread_setschedparam(m_thread, SCHED_OTHER, &param) == 0;
+#endif
+}
+
+int64_t RealtimeGuard::threadCpuNanoseconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(m_thread, &creation, &exit, &kernel, &user))
+        return 0;
+
+    // FILETIME counts 100 ns units
+    ULARGE_INTEGER kernelTime, userTime;
+    kernelTime.LowPart = kernel.dwLowDateTime;
+    kernelTime.HighPart = kernel.dwHighDateTime;
+    userTime.LowPart = user.dwLowDateTime;
+    userTime.HighPart = user.dwHighDateTime;
+    return (int64_t)(kernelTime.QuadPart + userTime.QuadPart) * 100;
+#else
+    timespec now;
+    if (clock_gettime(m_cpuClock, &now) != 0)
+        return 0;
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+void RealtimeGuard::watch(int priority, double budget, int windowMs)
+{
+    Trace::setThreadName("Realtime watchdog");
+
+    // The watchdog has to preempt the thread it watches, or a spinning thread starves it too.
+    // MMCSS demotes its threads by itself once they exceed their share.
+#ifdef _WIN32
+    (void)priority;
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    sched_param param;
+    param.sched_priority = priority + 1;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+
+    int64_t lastWall = Timer::nanoseconds();
+    int64_t lastCpu = threadCpuNanoseconds();
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_stopping)
+    {
+        m_wake.wait_for(lock, std::chrono::milliseconds(windowMs));
+        if (m_stopping)
+            break;
+
+        int64_t wall = Timer::nanoseconds();
+        int64_t cpu = threadCpuNanoseconds();
+        if (wall > lastWall && (double)(cpu - lastCpu) / (wall - lastWall) > budget)
+        {
+            TRACE_INSTANT("Real-time priority revoked");
+            demote();
+            m_demoted.store(true, std::memory_order_relaxed);
+            break;
+        }
+        lastWall = wall;
+        lastCpu = cpu;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <time.h>
+#endif
+
+enum RealtimePolicy
+{
+    REALTIME_FIFO,  // Runs until it blocks or a higher priority thread is ready
+    REALTIME_RR     // Like FIFO, but shares the CPU with threads of the same priority
+};
+
+// Runs the calling thread at a real-time priority and watches it from a thread of its own.
+// A thread at real-time priority which stops blocking starves everything below it, so the
+// watchdog demotes it to normal priority for good once it used more than its budget of a
+// CPU over a window.
+//
+// On Windows the thread joins the MMCSS "Capture" task at critical priority, or, if MMCSS
+// is not available, gets THREAD_PRIORITY_TIME_CRITICAL; the policy is ignored. Elsewhere it
+// is scheduled SCHED_FIFO or SCHED_RR, which needs CAP_SYS_NICE or an RLIMIT_RTPRIO.
+//
+// Threads started by the raised thread inherit its priority on Linux, so start the other
+// threads first.
+class RealtimeGuard
+{
+    RealtimeGuard(const RealtimeGuard &);
+    RealtimeGuard &operator=(const RealtimeGuard &);
+
+public:
+    RealtimeGuard();
+    ~RealtimeGuard();
+
+    // Raises the calling thread; priority is 1-98 for SCHED_FIFO and SCHED_RR, higher ones are
+    // lowered to 98 so the watchdog can run above. budget is the share of one CPU allowed over
+    // windowMs milliseconds. Returns false if the thread could not be raised, in which case
+    // nothing is watched.
+    bool start(RealtimePolicy policy, int priority, double budget, int windowMs);
+
+    // Stops the watchdog and returns the thread to normal priority. On Windows only the raised
+    // thread itself can take it out of the MMCSS task, so call it there when it can be.
+    void stop();
+
+    // True once the watchdog demoted the thread
+    bool demoted() const { return m_demoted.load(std::memory_order_relaxed); }
+
+protected:
+    void watch(int priority, double budget, int windowMs);
+    bool demote();
+    int64_t threadCpuNanoseconds();
+
+#ifdef _WIN32
+    HANDLE m_thread;
+    DWORD m_threadId;
+    HANDLE m_mmcss;
+#else
+    pthread_t m_thread;
+    clockid_t m_cpuClock;
+#endif
+    bool m_raised;
+    std::atomic<bool> m_demoted;
+    std::thread m_watchdog;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    bool m_stopping;
+};
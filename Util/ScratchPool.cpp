@@ -0,0 +1,128 @@
+#include "ScratchPool.h"
+
+#include <string.h>
+
+// Requests are rounded up to at least 64 KiB, the allocation granularity of VirtualAlloc
+#define SCRATCH_MIN_CLASS 16
+
+ScratchPool::ScratchPool()
+    : m_placement(DefaultPlacement())
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_placement.largePages = true;
+
+    // Room for a few buffers per class, so releasing never has to grow the free lists
+    for (int i = SCRATCH_MIN_CLASS; i < 64; ++i)
+        m_free[i].reserve(8);
+}
+
+ScratchPool::~ScratchPool()
+{
+    trim();
+}
+
+ScratchPool &ScratchPool::instance()
+{
+    static ScratchPool pool;
+    return pool;
+}
+
+int ScratchPool::sizeClass(size_t size)
+{
+    int sc = SCRATCH_MIN_CLASS;
+    while (((size_t)1 << sc) < size)
+        ++sc;
+    return sc;
+}
+
+void *ScratchPool::allocate(size_t size, bool *largePages)
+{
+    MemoryPlacement placement;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        placement = m_placement;
+    }
+
+    // Placed buffers are pre-faulted, the first conversion does not pay for it
+    MemoryPlacement actual;
+    void *buffer = AllocatePlaced(size, placement, &actual);
+    *largePages = buffer && actual.largePages;
+    return buffer;
+}
+
+void ScratchPool::deallocate(void *buffer, size_t size)
+{
+    FreePlaced(buffer, size);
+}
+
+void *ScratchPool::acquire(size_t size)
+{
+    int sc = sizeClass(size);
+    size_t classSize = (size_t)1 << sc;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        ++m_stats.acquires;
+
+        if (!m_free[sc].empty())
+        {
+            void *buffer = m_free[sc].back();
+            m_free[sc].pop_back();
+            return buffer;
+        }
+    }
+
+    // Allocate and pre-fault outside of the lock, it may take a while
+    bool largePages;
+    void *buffer = allocate(classSize, &largePages);
+    if (!buffer)
+        return NULL;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    ++m_stats.systemAllocations;
+    if (largePages)
+        ++m_stats.largePageBuffers;
+    m_stats.bytesReserved += classSize;
+
+    return buffer;
+}
+
+void ScratchPool::release(void *buffer, size_t size)
+{
+    if (!buffer)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_free[sizeClass(size)].push_back(buffer);
+}
+
+void ScratchPool::trim()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (int sc = SCRATCH_MIN_CLASS; sc < 64; ++sc)
+    {
+        size_t classSize = (size_t)1 << sc;
+        for (size_t i = 0; i < m_free[sc].size(); ++i)
+        {
+            deallocate(m_free[sc][i], classSize);
+            m_stats.bytesReserved -= classSize;
+        }
+        m_free[sc].clear();
+    }
+}
+
+void ScratchPool::setPlacement(const MemoryPlacement &placement)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_placement = placement;
+    }
+    trim();
+}
+
+ScratchPoolStats ScratchPool::stats()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
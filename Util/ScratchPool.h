@@ -0,0 +1,81 @@
+#pragma once
+
+#include "NumaMemory.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Counters describing how the pool has been used so far
+struct ScratchPoolStats
+{
+    size_t acquires;            // Buffers handed out
+    size_t systemAllocations;   // Buffers which had to be allocated from the OS
+    size_t largePageBuffers;    // Of those, buffers backed by large pages
+    size_t bytesReserved;       // Bytes currently owned by the pool, in use or not
+};
+
+// Keeps large scratch buffers warm between uses. Buffers are grouped in power-of-two
+// size classes, backed by large pages when the process may use them, and pre-faulted
+// on allocation, so a steady stream of same-sized requests never reaches the OS.
+class ScratchPool
+{
+    ScratchPool(const ScratchPool &);
+    ScratchPool &operator=(const ScratchPool &);
+
+public:
+    ScratchPool();
+    ~ScratchPool();
+
+    // The pool shared by the conversion functions
+    static ScratchPool &instance();
+
+    // Returns a buffer of at least size bytes, contents are undefined
+    void *acquire(size_t size);
+
+    // Gives a buffer obtained from acquire back to the pool
+    void release(void *buffer, size_t size);
+
+    // Returns the unused buffers to the OS
+    void trim();
+
+    // Where buffers are allocated from now on; the unused buffers are returned to the OS.
+    // By default they use large pages when the process may and are not locked.
+    void setPlacement(const MemoryPlacement &placement);
+
+    ScratchPoolStats stats();
+
+protected:
+    static int sizeClass(size_t size);
+    void *allocate(size_t size, bool *largePages);
+    void deallocate(void *buffer, size_t size);
+
+    std::mutex m_lock;
+    std::vector<void *> m_free[64];
+    ScratchPoolStats m_stats;
+    MemoryPlacement m_placement;
+};
+
+// A buffer borrowed from ScratchPool::instance() for the lifetime of the object
+class ScratchBuffer
+{
+    ScratchBuffer(const ScratchBuffer &);
+    ScratchBuffer &operator=(const ScratchBuffer &);
+
+public:
+    explicit ScratchBuffer(size_t size)
+        : m_size(size)
+        , m_data(ScratchPool::instance().acquire(size))
+    {}
+
+    ~ScratchBuffer()
+    {
+        ScratchPool::instance().release(m_data, m_size);
+    }
+
+    uint8_t *data() const { return (uint8_t *)m_data; }
+
+protected:
+    size_t m_size;
+    void *m_data;
+};
@@ -0,0 +1,137 @@
+#include "ThreadStack.h"
+
+#include <mutex>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#else
+#include <atomic>
+#include <chrono>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#endif
+
+static const int MAX_FRAMES = 64;
+
+// One stack at a time, DbgHelp is not thread-safe either
+static std::mutex s_lock;
+
+#ifdef _WIN32
+bool PrintThreadStack(std::thread &thread, std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    static const bool symbols = SymInitialize(GetCurrentProcess(), NULL, TRUE) != FALSE;
+    if (!symbols)
+        return false;
+
+    HANDLE handle = thread.native_handle();
+    if (SuspendThread(handle) == (DWORD)-1)
+        return false;
+
+    CONTEXT context;
+    memset(&context, 0, sizeof(context));
+    context.ContextFlags = CONTEXT_FULL;
+    if (!GetThreadContext(handle, &context))
+    {
+        ResumeThread(handle);
+        return false;
+    }
+
+    STACKFRAME64 frame;
+    memset(&frame, 0, sizeof(frame));
+#ifdef _M_X64
+    const DWORD machine = IMAGE_FILE_MACHINE_AMD64;
+    frame.AddrPC.Offset = context.Rip;
+    frame.AddrFrame.Offset = context.Rbp;
+    frame.AddrStack.Offset = context.Rsp;
+#else
+    const DWORD machine = IMAGE_FILE_MACHINE_I386;
+    frame.AddrPC.Offset = context.Eip;
+    frame.AddrFrame.Offset = context.Ebp;
+    frame.AddrStack.Offset = context.Esp;
+#endif
+    frame.AddrPC.Mode = AddrModeFlat;
+    frame.AddrFrame.Mode = AddrModeFlat;
+    frame.AddrStack.Mode = AddrModeFlat;
+
+    // Only the addresses are taken while the thread is suspended; it may hold locks the
+    // symbol lookup needs
+    DWORD64 addresses[MAX_FRAMES];
+    int count = 0;
+    while (count < MAX_FRAMES &&
+           StackWalk64(machine, GetCurrentProcess(), handle, &frame, &context, NULL, SymFunctionTableAccess64,
+                       SymGetModuleBase64, NULL) &&
+           frame.AddrPC.Offset != 0)
+        addresses[count++] = frame.AddrPC.Offset;
+    ResumeThread(handle);
+
+    char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME];
+    SYMBOL_INFO *symbol = (SYMBOL_INFO *)buffer;
+    for (int i = 0; i < count; ++i)
+    {
+        memset(buffer, 0, sizeof(buffer));
+        symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+        symbol->MaxNameLen = MAX_SYM_NAME;
+
+        DWORD64 displacement = 0;
+        out << "  #" << i << " 0x" << std::hex << addresses[i];
+        if (SymFromAddr(GetCurrentProcess(), addresses[i], &displacement, symbol))
+            out << " " << symbol->Name << "+0x" << displacement;
+        out << std::dec << "\n";
+    }
+    return count > 0;
+}
+#else
+static void *s_frames[MAX_FRAMES];
+static std::atomic<int> s_frameCount(-1);
+
+static void RecordStack(int)
+{
+    s_frameCount.store(backtrace(s_frames, MAX_FRAMES), std::memory_order_release);
+}
+
+bool PrintThreadStack(std::thread &thread, std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    static const bool installed = [] {
+        // backtrace() loads libgcc on its first call, which is no business for a signal handler
+        void *frame;
+        backtrace(&frame, 1);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = RecordStack;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        return sigaction(SIGURG, &action, NULL) == 0;
+    }();
+    if (!installed)
+        return false;
+
+    s_frameCount.store(-1, std::memory_order_relaxed);
+    if (pthread_kill(thread.native_handle(), SIGURG) != 0)
+        return false;
+
+    // A thread blocked in the kernel takes the signal when it wakes or is interrupted
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    int count;
+    while ((count = s_frameCount.load(std::memory_order_acquire)) < 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    if (count <= 0)
+        return false;
+
+    // The first frames are the handler and the signal trampoline
+    char **names = backtrace_symbols(s_frames, count);
+    for (int i = 0; i < count; ++i)
+        out << "  #" << i << " " << (names ? names[i] : "?") << "\n";
+    free(names);
+    return true;
+}
+#endif
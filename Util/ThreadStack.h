@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ostream>
+#include <thread>
+
+// Prints the call stack of another thread of the process, one frame per line, e.g. of one
+// which stopped responding. The thread is interrupted only while its stack is walked.
+//
+// On Windows the thread is suspended and walked with DbgHelp, which resolves names from the
+// PDBs it finds. Elsewhere it is sent SIGURG and records its own stack with backtrace();
+// names need -rdynamic. Returns false if the stack could not be taken.
+bool PrintThreadStack(std::thread &thread, std::ostream &out);
@@ -51,22 +51,185 @@
 
 #include "Timer.h"
 
-LONGLONG g_llPerfFrequency; 
-bool g_timeInitialized=false;
+#include <atomic>
+#include <mutex>
 
-#define QPC(Int64)  QueryPerformanceCounter((LARGE_INTEGER*)&Int64)  
-#define QPF(Int64)  QueryPerformanceFrequency((LARGE_INTEGER*)&Int64)
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TIMER_USE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
 
-Timer::Timer()
-    : m_llStartTick(0)
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Converts TSC ticks to nanoseconds: ns = nsBase + (ticks - tscBase) * multiplier / 2^32
+struct TimerClock
+{
+    bool useTsc;
+    unsigned long long tscBase;
+    int64_t nsBase;
+    unsigned long long multiplier;
+    int64_t perfFrequency;
+};
+
+static TimerClock g_clock;
+static std::once_flag g_clockInitialized;
+static std::atomic<bool> g_clockReady(false);
+
+static int64_t OsNanoseconds(int64_t perfFrequency)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart / perfFrequency * 1000000000LL + counter.QuadPart % perfFrequency * 1000000000LL / perfFrequency;
+#else
+    (void)perfFrequency;
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+#ifdef TIMER_USE_TSC
+static bool HasInvariantTsc()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0x80000000);
+    if ((unsigned int)info[0] < 0x80000007)
+        return false;
+    __cpuid(info, 0x80000007);
+    return (info[3] & (1 << 8)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (edx & (1 << 8)) != 0;
+#endif
+}
+
+// (a * b) >> 32 without overflowing 64 bits
+static inline unsigned long long MulShift32(unsigned long long a, unsigned long long b)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long long high;
+    unsigned long long low = _umul128(a, b, &high);
+    return (high << 32) | (low >> 32);
+#elif defined(__SIZEOF_INT128__)
+    return (unsigned long long)(((unsigned __int128)a * b) >> 32);
+#else
+    unsigned long long aLow = a & 0xFFFFFFFF, aHigh = a >> 32;
+    unsigned long long bLow = b & 0xFFFFFFFF, bHigh = b >> 32;
+    unsigned long long middle = aHigh * bLow + (aLow * bLow >> 32);
+    unsigned long long middle2 = aLow * bHigh + (middle & 0xFFFFFFFF);
+    return ((aHigh * bHigh + (middle >> 32) + (middle2 >> 32)) << 32) | (middle2 & 0xFFFFFFFF);
+#endif
+}
+
+// Reads the OS clock and the TSC at the same instant, as well as the two can be paired
+static void SampleClocks(int64_t perfFrequency, int64_t *ns, unsigned long long *tsc)
+{
+    unsigned long long best = ~0ULL;
+    for (int i = 0; i < 5; ++i)
+    {
+        unsigned long long before = __rdtsc();
+        int64_t os = OsNanoseconds(perfFrequency);
+        unsigned long long after = __rdtsc();
+        if (after - before < best)
+        {
+            best = after - before;
+            *ns = os;
+            *tsc = before + (after - before) / 2;
+        }
+    }
+}
+
+// Calibrates over 20 ms, which keeps the rate within a few parts per million of the OS clock
+static void CalibrateTsc()
+{
+    int64_t ns0 = 0;
+    unsigned long long tsc0 = 0;
+    SampleClocks(g_clock.perfFrequency, &ns0, &tsc0);
+    int64_t ns1 = ns0;
+    unsigned long long tsc1 = tsc0;
+    do
+    {
+        SampleClocks(g_clock.perfFrequency, &ns1, &tsc1);
+    } while (ns1 - ns0 < 20000000);
+
+    if (tsc1 <= tsc0)
+        return;
+
+    g_clock.multiplier = ((unsigned long long)(ns1 - ns0) << 32) / (tsc1 - tsc0);
+    g_clock.tscBase = tsc1;
+    g_clock.nsBase = ns1;
+    g_clock.useTsc = true;
+}
+#endif
+
+static void InitializeClock()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    g_clock.perfFrequency = frequency.QuadPart;
+#else
+    g_clock.perfFrequency = 1000000000LL;
+#endif
+    g_clock.useTsc = false;
+
+#ifdef TIMER_USE_TSC
+    if (HasInvariantTsc())
+        CalibrateTsc();
+#endif
+
+    g_clockReady.store(true, std::memory_order_release);
+}
+
+static inline const TimerClock &Clock()
+{
+    if (!g_clockReady.load(std::memory_order_acquire))
+        std::call_once(g_clockInitialized, InitializeClock);
+    return g_clock;
+}
+
+int64_t Timer::nanoseconds()
 {
-    if(!g_timeInitialized)
+    const TimerClock &clock = Clock();
+#ifdef TIMER_USE_TSC
+    if (clock.useTsc)
     {
-        QPF(g_llPerfFrequency);
-        g_timeInitialized = true;
+        // A core whose TSC lags slightly behind the calibrating one may read less than tscBase
+        long long ticks = (long long)(__rdtsc() - clock.tscBase);
+        if (ticks >= 0)
+            return clock.nsBase + (int64_t)MulShift32((unsigned long long)ticks, clock.multiplier);
+        return clock.nsBase - (int64_t)MulShift32((unsigned long long)-ticks, clock.multiplier);
     }
+#endif
+    return OsNanoseconds(clock.perfFrequency);
+}
 
-    QPC(m_llStartTick);
+int64_t Timer::systemNanoseconds()
+{
+    return OsNanoseconds(Clock().perfFrequency);
+}
+
+bool Timer::usesTsc()
+{
+    return Clock().useTsc;
+}
+
+Timer::Timer()
+    : m_llStartNs(nanoseconds())
+{
 }
 
 Timer::~Timer()
@@ -75,12 +238,15 @@ Timer::~Timer()
 
 void Timer::reset()
 {
-    QPC(m_llStartTick);
+    m_llStartNs = nanoseconds();
 }
 
 double Timer::now()
 {
-    LONGLONG now;
-    QPC(now);
-    return (((double)(now - m_llStartTick)/(double)g_llPerfFrequency) * 1000.0);
-}
\ No newline at end of file
+    return (nanoseconds() - m_llStartNs) / 1000000.0;
+}
+
+int64_t Timer::elapsedNs() const
+{
+    return nanoseconds() - m_llStartNs;
+}
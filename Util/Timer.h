@@ -11,9 +11,14 @@
 
 #pragma once
 
-#include <windows.h>
+#include <cstdint>
 
-// Simple timer class, measures time in milliseconds
+// Simple timer class, measures time in milliseconds, or in nanoseconds for per-frame
+// instrumentation.
+//
+// On CPUs with an invariant TSC the time is read from the TSC, calibrated against the OS clock
+// on first use; elsewhere it comes from QueryPerformanceCounter on Windows and from
+// CLOCK_MONOTONIC_RAW on other systems.
 class Timer
 {
 public:
@@ -27,6 +32,18 @@ public:
     // Get the elapsed milliseconds since the starting point.
     double now();
 
+    // Get the elapsed nanoseconds since the starting point.
+    int64_t elapsedNs() const;
+
+    // Monotonic time in nanoseconds, comparable between threads.
+    static int64_t nanoseconds();
+
+    // Monotonic time in nanoseconds from the OS clock, bypassing the TSC.
+    static int64_t systemNanoseconds();
+
+    // Whether nanoseconds() reads the TSC.
+    static bool usesTsc();
+
 protected:
-    LONGLONG m_llStartTick;
-};
\ No newline at end of file
+    int64_t m_llStartNs;
+};
@@ -0,0 +1,160 @@
+#pragma warning(disable : 4996)
+
+#include "Trace.h"
+#include "Timer.h"
+
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Events kept per thread; older ones are overwritten
+static const size_t RING_SIZE = 1 << 14;
+
+struct TraceEvent
+{
+    // Index of the event plus one once written, 0 while being written
+    std::atomic<unsigned long long> sequence;
+    const char *name;
+    int64_t timestamp;
+    int64_t value;
+    char phase;
+};
+
+struct TraceRing
+{
+    std::atomic<unsigned long long> head;
+    int threadId;
+    char threadName[64];
+    TraceEvent events[RING_SIZE];
+};
+
+std::atomic<bool> Trace::s_enabled(false);
+
+static std::mutex g_ringsLock;
+static std::vector<TraceRing *> g_rings;
+static thread_local TraceRing *t_ring = NULL;
+// Kept until the thread records its first event, so threads never traced get no ring
+static thread_local char t_threadName[sizeof(TraceRing::threadName)] = "";
+
+// Rings outlive their threads so the events of finished threads still make it into a dump
+static TraceRing *ThreadRing()
+{
+    if (!t_ring)
+    {
+        TraceRing *ring = new TraceRing();
+        std::lock_guard<std::mutex> lock(g_ringsLock);
+        ring->threadId = (int)g_rings.size() + 1;
+        if (t_threadName[0])
+            strcpy(ring->threadName, t_threadName);
+        else
+            sprintf(ring->threadName, "Thread %d", ring->threadId);
+        g_rings.push_back(ring);
+        t_ring = ring;
+    }
+    return t_ring;
+}
+
+static void Record(char phase, const char *name, int64_t timestamp, int64_t value)
+{
+    TraceRing *ring = ThreadRing();
+
+    // Only this thread writes to the ring; the sequence lets dump() skip events torn by a wrap
+    unsigned long long index = ring->head.load(std::memory_order_relaxed);
+    TraceEvent &event = ring->events[index % RING_SIZE];
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name = name;
+    event.timestamp = timestamp;
+    event.value = value;
+    event.phase = phase;
+    event.sequence.store(index + 1, std::memory_order_release);
+    ring->head.store(index + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const char *name)
+{
+    strncpy(t_threadName, name, sizeof(t_threadName) - 1);
+    if (t_ring)
+    {
+        std::lock_guard<std::mutex> lock(g_ringsLock);
+        strcpy(t_ring->threadName, t_threadName);
+    }
+}
+
+int64_t Trace::timestamp()
+{
+    return Timer::nanoseconds();
+}
+
+void Trace::complete(const char *name, int64_t start, int64_t end)
+{
+    Record('X', name, start, end - start);
+}
+
+void Trace::instant(const char *name)
+{
+    Record('i', name, timestamp(), 0);
+}
+
+void Trace::counter(const char *name, int64_t value)
+{
+    Record('C', name, timestamp(), value);
+}
+
+bool Trace::dump(const char *fileName)
+{
+    FILE *file = fopen(fileName, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    std::lock_guard<std::mutex> lock(g_ringsLock);
+    bool first = true;
+    for (size_t r = 0; r < g_rings.size(); ++r)
+    {
+        TraceRing *ring = g_rings[r];
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                first ? "" : ",\n", ring->threadId);
+        for (const char *c = ring->threadName; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                fputc('\\', file);
+            fputc(*c, file);
+        }
+        fprintf(file, "\"}}");
+        first = false;
+
+        unsigned long long head = ring->head.load(std::memory_order_acquire);
+        unsigned long long begin = head > RING_SIZE ? head - RING_SIZE : 0;
+        for (unsigned long long index = begin; index < head; ++index)
+        {
+            TraceEvent &slot = ring->events[index % RING_SIZE];
+            if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+                continue;
+
+            const char *name = slot.name;
+            int64_t timestamp = slot.timestamp;
+            int64_t value = slot.value;
+            char phase = slot.phase;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != index + 1)
+                continue;
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", name, phase,
+                    timestamp / 1000.0, ring->threadId);
+            if (phase == 'X')
+                fprintf(file, ",\"dur\":%.3f}", value / 1000.0);
+            else if (phase == 'C')
+                fprintf(file, ",\"args\":{\"value\":%lld}}", (long long)value);
+            else
+                fprintf(file, ",\"s\":\"t\"}");
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
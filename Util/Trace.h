@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <stddef.h>
+
+// Timeline tracing for finding latency spikes. Every thread records its events into its own
+// ring buffer without locking; dump() writes what the rings hold as Chrome trace JSON, which
+// chrome://tracing and ui.perfetto.dev open. Recording costs one relaxed load per event while
+// disabled, and nothing at all when built with NVFBC_NO_TRACE.
+class Trace
+{
+public:
+    static void enable(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Names the calling thread in the timeline, once it records an event
+    static void setThreadName(const char *name);
+
+    // Monotonic time in nanoseconds
+    static int64_t timestamp();
+
+    // Event names are stored by pointer and have to be string literals
+    static void complete(const char *name, int64_t start, int64_t end);
+    static void instant(const char *name);
+    static void counter(const char *name, int64_t value);
+
+    // Writes the events currently held by all rings, returns false if the file cannot be written.
+    // Threads may keep recording meanwhile; events overwritten during the dump are left out.
+    static bool dump(const char *fileName);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Records the time from construction to destruction as one event
+class TraceScope
+{
+    TraceScope(const TraceScope &);
+    TraceScope &operator=(const TraceScope &);
+
+public:
+    explicit TraceScope(const char *name)
+        : m_name(Trace::enabled() ? name : NULL)
+        , m_start(m_name ? Trace::timestamp() : 0)
+    {
+    }
+
+    ~TraceScope()
+    {
+        if (m_name)
+            Trace::complete(m_name, m_start, Trace::timestamp());
+    }
+
+private:
+    const char *m_name;
+    int64_t m_start;
+};
+
+#ifdef NVFBC_NO_TRACE
+#define TRACE_SCOPE(name)
+#define TRACE_INSTANT(name)
+#define TRACE_COUNTER(name, value)
+#else
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_INSTANT(name) do { if (Trace::enabled()) Trace::instant(name); } while (0)
+#define TRACE_COUNTER(name, value) do { if (Trace::enabled()) Trace::counter(name, value); } while (0)
+#endif
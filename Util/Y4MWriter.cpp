@@ -0,0 +1,238 @@
+#pragma warning(disable : 4996)
+
+#include "Y4MWriter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+static const uint8_t frameHeader[] = {'F', 'R', 'A', 'M', 'E', '\n'};
+
+Y4MWriter::Y4MWriter()
+#ifdef _WIN32
+    : m_file(INVALID_HANDLE_VALUE)
+#else
+    : m_file(-1)
+#endif
+    , m_width(0)
+    , m_height(0)
+    , m_format(Y4M_FORMAT_I420)
+    , m_frameCount(0)
+{
+}
+
+Y4MWriter::~Y4MWriter()
+{
+    close();
+}
+
+bool Y4MWriter::open(const char *fileName, int width, int height, Y4MPixelFormat format, int fpsNum, int fpsDen)
+{
+    close();
+
+    if (width <= 0 || height <= 0)
+        return false;
+
+    // 4:2:0 chroma is half the luma size, so I420 and NV12 frames need even dimensions
+    if (format != Y4M_FORMAT_YUV444 && ((width | height) & 1))
+        return false;
+
+#ifdef _WIN32
+    m_file = CreateFileA(fileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+#else
+    m_file = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_file < 0)
+        return false;
+#endif
+
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    m_frameCount = 0;
+
+    // At most one segment per row of every plane, plus the frame header
+    m_segments.reserve(1 + height * 3);
+
+    if (format == Y4M_FORMAT_NV12)
+        m_chroma.resize((size_t)width * height / 2);
+
+    char header[128];
+    int size = sprintf(header, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 %s\n", width, height, fpsNum, fpsDen,
+                       format == Y4M_FORMAT_YUV444 ? "C444" : "C420jpeg");
+
+    m_segments.clear();
+    addSegment((const uint8_t *)header, size);
+    if (!flushSegments())
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void Y4MWriter::close()
+{
+#ifdef _WIN32
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_file >= 0)
+        ::close(m_file);
+    m_file = -1;
+#endif
+}
+
+void Y4MWriter::addSegment(const uint8_t *data, size_t size)
+{
+    // Adjacent pieces of memory, e.g. unpadded rows or consecutive planes, become one segment
+    if (!m_segments.empty())
+    {
+        Segment &last = m_segments.back();
+        if (last.data + last.size == data)
+        {
+            last.size += size;
+            return;
+        }
+    }
+
+    Segment segment = {data, size};
+    m_segments.push_back(segment);
+}
+
+void Y4MWriter::addPlane(const Y4MPlane &plane, int width, int height)
+{
+    for (int row = 0; row < height; ++row)
+        addSegment(plane.data + (size_t)row * plane.pitch, width);
+}
+
+bool Y4MWriter::flushSegments()
+{
+#ifdef _WIN32
+    for (size_t i = 0; i < m_segments.size(); ++i)
+    {
+        const uint8_t *data = m_segments[i].data;
+        size_t remaining = m_segments[i].size;
+
+        while (remaining > 0)
+        {
+            DWORD chunk = remaining > 0x40000000 ? 0x40000000 : (DWORD)remaining;
+            DWORD written = 0;
+            if (!WriteFile(m_file, data, chunk, &written, NULL) || written == 0)
+                return false;
+            data += written;
+            remaining -= written;
+        }
+    }
+#else
+    size_t first = 0;
+    while (first < m_segments.size())
+    {
+        struct iovec iov[IOV_MAX];
+        int count = 0;
+        for (size_t i = first; i < m_segments.size() && count < IOV_MAX; ++i, ++count)
+        {
+            iov[count].iov_base = (void *)m_segments[i].data;
+            iov[count].iov_len = m_segments[i].size;
+        }
+
+        ssize_t written = writev(m_file, iov, count);
+        if (written <= 0)
+            return false;
+
+        // Skip what was written, a short write leaves a partial segment in front
+        while (written > 0)
+        {
+            Segment &segment = m_segments[first];
+            if ((size_t)written >= segment.size)
+            {
+                written -= segment.size;
+                ++first;
+            }
+            else
+            {
+                segment.data += written;
+                segment.size -= written;
+                written = 0;
+            }
+        }
+    }
+#endif
+
+    m_segments.clear();
+    return true;
+}
+
+bool Y4MWriter::writeFrame(const Y4MPlane *planes)
+{
+#ifdef _WIN32
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+#else
+    if (m_file < 0)
+        return false;
+#endif
+
+    int chromaWidth = m_format == Y4M_FORMAT_YUV444 ? m_width : m_width / 2;
+    int chromaHeight = m_format == Y4M_FORMAT_YUV444 ? m_height : m_height / 2;
+
+    m_segments.clear();
+    addSegment(frameHeader, sizeof(frameHeader));
+    addPlane(planes[0], m_width, m_height);
+
+    if (m_format == Y4M_FORMAT_NV12)
+    {
+        uint8_t *u = m_chroma.data();
+        uint8_t *v = u + (size_t)chromaWidth * chromaHeight;
+        for (int row = 0; row < chromaHeight; ++row)
+        {
+            const uint8_t *uv = planes[1].data + (size_t)row * planes[1].pitch;
+            for (int col = 0; col < chromaWidth; ++col)
+            {
+                *u++ = uv[col * 2];
+                *v++ = uv[col * 2 + 1];
+            }
+        }
+        addSegment(m_chroma.data(), m_chroma.size());
+    }
+    else
+    {
+        addPlane(planes[1], chromaWidth, chromaHeight);
+        addPlane(planes[2], chromaWidth, chromaHeight);
+    }
+
+    if (!flushSegments())
+        return false;
+
+    ++m_frameCount;
+    return true;
+}
+
+bool Y4MWriter::writeFrame(const uint8_t *data)
+{
+    if (!data)
+        return false;
+
+    int chromaWidth = m_format == Y4M_FORMAT_YUV444 ? m_width : m_width / 2;
+    size_t lumaSize = (size_t)m_width * m_height;
+    size_t chromaSize = m_format == Y4M_FORMAT_YUV444 ? lumaSize : lumaSize / 4;
+
+    Y4MPlane planes[3];
+    planes[0].data = data;
+    planes[0].pitch = m_width;
+    planes[1].data = data + lumaSize;
+    planes[1].pitch = m_format == Y4M_FORMAT_NV12 ? m_width : chromaWidth;
+    planes[2].data = data + lumaSize + chromaSize;
+    planes[2].pitch = chromaWidth;
+
+    return writeFrame(planes);
+}
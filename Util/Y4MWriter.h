@@ -0,0 +1,76 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <cstdint>
+#include <stddef.h>
+#include <vector>
+
+// Frame layouts accepted by Y4MWriter
+enum Y4MPixelFormat
+{
+    Y4M_FORMAT_I420,    // Y plane, then U and V planes subsampled 2x2
+    Y4M_FORMAT_NV12,    // Y plane, then interleaved UV plane subsampled 2x2, stored as I420
+    Y4M_FORMAT_YUV444   // Y, U and V planes at full resolution
+};
+
+// Describes one plane of a frame in memory
+struct Y4MPlane
+{
+    const uint8_t *data;
+    int pitch;          // Bytes between the starts of two rows
+};
+
+// Streams YUV frames into a single Y4M (YUV4MPEG2) file.
+// The planes are handed to the OS as a gathered write straight from the caller's
+// memory; only NV12 chroma needs to be repacked, since Y4M has no interleaved format.
+class Y4MWriter
+{
+    Y4MWriter(const Y4MWriter &);
+    Y4MWriter &operator=(const Y4MWriter &);
+
+public:
+    Y4MWriter();
+    ~Y4MWriter();
+
+    // Creates the file and writes the stream header. I420 and NV12 need an even width and
+    // height; odd ones are rejected.
+    bool open(const char *fileName, int width, int height, Y4MPixelFormat format, int fpsNum = 30, int fpsDen = 1);
+
+    // Appends a frame given as separate planes: Y, U, V (or Y, UV for NV12)
+    bool writeFrame(const Y4MPlane *planes);
+
+    // Appends a frame stored contiguously without row padding, e.g. the buffer SaveYUV takes
+    bool writeFrame(const uint8_t *data);
+
+    // Closes the file
+    void close();
+
+    // Number of frames written since open
+    unsigned int frameCount() const { return m_frameCount; }
+
+protected:
+    struct Segment
+    {
+        const uint8_t *data;
+        size_t size;
+    };
+
+    void addSegment(const uint8_t *data, size_t size);
+    void addPlane(const Y4MPlane &plane, int width, int height);
+    bool flushSegments();
+
+#ifdef _WIN32
+    HANDLE m_file;
+#else
+    int m_file;
+#endif
+    int m_width;
+    int m_height;
+    Y4MPixelFormat m_format;
+    unsigned int m_frameCount;
+    std::vector<Segment> m_segments;
+    std::vector<uint8_t> m_chroma;
+};